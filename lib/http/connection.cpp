@@ -9,6 +9,8 @@
 //
 
 #include "connection.hpp"
+#include <algorithm>
+#include <cctype>
 #include <utility>
 #include <vector>
 #include "connection_manager.hpp"
@@ -50,13 +52,23 @@ connection::do_read()
         if (!ec)
         {
             request_parser::result_type result;
-            std::tie(result, std::ignore) = request_parser_.parse(
-                request_, buffer_.data(), buffer_.data() + bytes_transferred);
+            char* rest;
+            char* end = buffer_.data() + bytes_transferred;
+            std::tie(result, rest) =
+                request_parser_.parse(request_, buffer_.data(), end);
+
+            std::size_t length = 0;
+            if (result == request_parser::good &&
+                !content_length(request_, length))
+            {
+                result = request_parser::bad;
+            }
 
             if (result == request_parser::good)
             {
-                request_handler_.handle_request(request_, reply_);
-                do_write();
+                request_.content.assign(
+                    rest, rest + std::min<std::size_t>(end - rest, length));
+                do_read_content(length);
             }
             else if (result == request_parser::bad)
             {
@@ -75,6 +87,74 @@ connection::do_read()
     });
 }
 
+void
+connection::do_read_content(std::size_t length)
+{
+    if (request_.content.size() >= length)
+    {
+        do_handle_request();
+        return;
+    }
+
+    auto self(shared_from_this());
+    socket_.async_read_some(asio::buffer(buffer_),
+                            [this, self, length](asio::error_code ec,
+                                                 std::size_t bytes_transferred)
+                            {
+        if (!ec)
+        {
+            request_.content.append(
+                buffer_.data(),
+                std::min(bytes_transferred, length - request_.content.size()));
+            do_read_content(length);
+        }
+        else if (ec != asio::error::operation_aborted)
+        {
+            connection_manager_.stop(shared_from_this());
+        }
+    });
+}
+
+void
+connection::do_handle_request()
+{
+    auto self(shared_from_this());
+    // The reply may be made on another thread: write it from one of the
+    // server's.
+    request_handler_.async_handle_request(request_, reply_, [this, self]()
+                                          {
+        socket_.get_io_service().post([this, self]()
+                                      {
+                                          do_write();
+                                      });
+    });
+}
+
+bool
+connection::content_length(const request& req, std::size_t& length)
+{
+    length = 0;
+    for (auto const& h : req.headers)
+    {
+        if (h.name.size() != 14 ||
+            !std::equal(h.name.begin(), h.name.end(), "content-length",
+                        [](char a, char b)
+                        {
+                            return std::tolower(a) == b;
+                        }))
+        {
+            continue;
+        }
+        if (h.value.empty() || h.value.size() > 10 ||
+            h.value.find_first_not_of("0123456789") != std::string::npos)
+        {
+            return false;
+        }
+        length = std::stoul(h.value);
+    }
+    return length <= max_content_length;
+}
+
 void
 connection::do_write()
 {
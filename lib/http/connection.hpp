@@ -49,6 +49,19 @@ private:
   /// Perform an asynchronous read operation.
   void do_read();
 
+  /// Read the rest of the request's body, then handle the request.
+  void do_read_content(std::size_t length);
+
+  /// Hand the complete request to the server.
+  void do_handle_request();
+
+  /// Read the Content-Length of `req` into `length`, 0 without one; false
+  /// if it is malformed or larger than max_content_length.
+  static bool content_length(const request& req, std::size_t& length);
+
+  /// Largest request body accepted.
+  static const std::size_t max_content_length = 32 * 1024 * 1024;
+
   /// Perform an asynchronous write operation.
   void do_write();
 
@@ -11,6 +11,7 @@
 #ifndef HTTP_CONNECTION_MANAGER_HPP
 #define HTTP_CONNECTION_MANAGER_HPP
 
+#include <mutex>
 #include <set>
 #include "connection.hpp"
 
@@ -38,8 +39,10 @@ public:
   void stop_all();
 
 private:
-  /// The managed connections.
+  /// The managed connections, started and stopped from all the threads
+  /// running the server.
   std::set<connection_ptr> connections_;
+  std::mutex mutex_;
 };
 
 } // namespace server
@@ -26,6 +26,8 @@ struct request
   int http_version_major;
   int http_version_minor;
   std::vector<header> headers;
+  /// The body of the request, as long as its Content-Length header says.
+  std::string content;
 };
 
 } // namespace server
@@ -87,21 +87,25 @@ server::~server()
 }
 
 void
-server::handle_request(const request& req, reply& rep)
+server::setDispatcher(dispatcher d)
+{
+    dispatcher_ = d;
+}
+
+bool
+server::parse_request(const request& req, std::string& command,
+                      std::string& params)
 {
     // Decode url to path.
     std::string request_path;
     if (!url_decode(req.uri, request_path))
     {
-        rep = reply::stock_reply(reply::bad_request);
-        return;
+        return false;
     }
 
     if (request_path.size() && request_path[0] == '/')
         request_path = request_path.substr(1);
 
-    std::string command;
-    std::string params;
     auto pos = request_path.find('?');
     if (pos == std::string::npos)
         command = request_path;
@@ -110,39 +114,96 @@ server::handle_request(const request& req, reply& rep)
         command = request_path.substr(0, pos);
         params = request_path.substr(pos);
     }
+    if (!req.content.empty())
+    {
+        params = req.content;
+    }
+    return true;
+}
 
-    if (mRoutes.find(command) != mRoutes.end())
+std::map<std::string, server::routeHandler>::const_iterator
+server::find_route(const std::string& command) const
+{
+    auto route = mRoutes.find(command);
+    if (route == mRoutes.end())
     {
-        mRoutes[command](params, rep.content);
-
-        rep.status = reply::ok;
-        rep.headers.resize(3);
-        rep.headers[0].name = "Content-Length";
-        rep.headers[0].value = std::to_string(rep.content.size());
-        rep.headers[1].name = "Content-Type";
-        rep.headers[1].value = "application/json";
-        rep.headers[2].name = "Access-Control-Allow-Origin";
-        rep.headers[2].value = "*";
+        route = mRoutes.find("404");
+    }
+    return route;
+}
+
+void
+server::make_reply(const std::string& route, const std::string& content,
+                   reply& rep)
+{
+    rep.content = content;
+    rep.status = reply::ok;
+    rep.headers.resize(3);
+    rep.headers[0].name = "Content-Length";
+    rep.headers[0].value = std::to_string(rep.content.size());
+    rep.headers[1].name = "Content-Type";
+    rep.headers[1].value = route == "404" ? "text/html" : "application/json";
+    rep.headers[2].name = "Access-Control-Allow-Origin";
+    rep.headers[2].value = "*";
+}
+
+void
+server::handle_request(const request& req, reply& rep)
+{
+    std::string command;
+    std::string params;
+    if (!parse_request(req, command, params))
+    {
+        rep = reply::stock_reply(reply::bad_request);
+        return;
+    }
+
+    auto route = find_route(command);
+    if (route == mRoutes.end())
+    {
+        rep = reply::stock_reply(reply::not_found);
+        return;
+    }
+    std::string content;
+    route->second(params, content);
+    make_reply(route->first, content, rep);
+}
+
+void
+server::async_handle_request(const request& req, reply& rep,
+                             std::function<void()> done)
+{
+    std::string command;
+    std::string params;
+    if (!parse_request(req, command, params))
+    {
+        rep = reply::stock_reply(reply::bad_request);
+        done();
+        return;
+    }
+
+    auto route = find_route(command);
+    if (route == mRoutes.end())
+    {
+        rep = reply::stock_reply(reply::not_found);
+        done();
+        return;
+    }
+    std::string const& name = route->first;
+    auto respond = [name, &rep, done](const std::string& content)
+    {
+        make_reply(name, content, rep);
+        done();
+    };
+    if (dispatcher_)
+    {
+        dispatcher_(name, params, route->second, respond);
     }
     else
     {
-        if(mRoutes.find("404") != mRoutes.end())
-        {
-            mRoutes["404"](params, rep.content);
-
-            rep.status = reply::ok;
-            rep.headers.resize(3);
-            rep.headers[0].name = "Content-Length";
-            rep.headers[0].value = std::to_string(rep.content.size());
-            rep.headers[1].name = "Content-Type";
-            rep.headers[1].value = "text/html";
-            rep.headers[2].name = "Access-Control-Allow-Origin";
-            rep.headers[2].value = "*";
-        } else
-        {
-            rep = reply::stock_reply(reply::not_found);
-            return;
-        }
+        std::string content;
+        route->second(params, content);
+        respond(content);
     }
 }
 
@@ -29,7 +29,20 @@ class server
 {
     
 public:
+    /// Called with the query string of the request, starting with '?', or
+    /// with its body for requests that have one.
     typedef std::function<void(const std::string&, std::string&)> routeHandler;
+
+    /// Runs `handler` for a request that matched `route`, with its `params`,
+    /// then or later and on whatever thread, and passes what it returned to
+    /// `respond`; or calls `respond` with some other content for the route,
+    /// such as a cached one. Called on the server's own threads.
+    typedef std::function<void(const std::string& route,
+                               const std::string& params,
+                               const routeHandler& handler,
+                               std::function<void(const std::string&)> respond)>
+        dispatcher;
+
     server(const server&) = delete;
     server& operator=(const server&) = delete;
 
@@ -44,8 +57,18 @@ public:
     void addRoute(const std::string& routeName, routeHandler callback);
     void add404(routeHandler callback);
 
+    /// Handlers are only run by the dispatcher when there is one; the
+    /// routes must all be added before the server is started.
+    void setDispatcher(dispatcher d);
+
+    /// Runs the handler of the request right away.
     void handle_request(const request& req, reply& rep);
 
+    /// Runs the handler of the request through the dispatcher, if any, then
+    /// calls `done`, from whatever thread `rep` was filled on.
+    void async_handle_request(const request& req, reply& rep,
+                              std::function<void()> done);
+
     static void parseParams(const std::string& params, std::map<std::string, std::string>& retMap);
 
 private:
@@ -56,6 +79,19 @@ private:
     /// invalid.
     static bool url_decode(const std::string& in, std::string& out);
 
+    /// Splits the decoded request path into its command and parameters.
+    /// Returns false if the request is malformed.
+    static bool parse_request(const request& req, std::string& command,
+                              std::string& params);
+
+    /// The route of `command`, or the 404 route, or the end of mRoutes.
+    std::map<std::string, routeHandler>::const_iterator
+    find_route(const std::string& command) const;
+
+    /// Fills `rep` with the content returned by the handler of `route`.
+    static void make_reply(const std::string& route,
+                           const std::string& content, reply& rep);
+
     /// The io_service used to perform asynchronous operations.
     asio::io_service& io_service_;
 
@@ -72,6 +108,8 @@ private:
     asio::ip::tcp::socket socket_;
 
     std::map<std::string, routeHandler> mRoutes;
+
+    dispatcher dispatcher_;
 };
 
 } // namespace server
@@ -0,0 +1,231 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bench/Benchmark.h"
+#include "lib/json/json.h"
+#include "util/Logging.h"
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+
+namespace stellar
+{
+
+using std::chrono::nanoseconds;
+
+BenchState::BenchState(nanoseconds minTime) : mMinTime(minTime)
+{
+}
+
+bool
+BenchState::keepRunning()
+{
+    if (!mRunning)
+    {
+        if (mIterations != 0)
+        {
+            return false;
+        }
+        mRunning = true;
+        mStart = clock::now();
+        return true;
+    }
+
+    ++mIterations;
+    if (mIterations < mNextCheck)
+    {
+        return true;
+    }
+    auto elapsed = clock::now() - mStart - mPaused;
+    if (elapsed >= mMinTime)
+    {
+        mElapsed = elapsed;
+        mRunning = false;
+        return false;
+    }
+    // read the clock again after about a tenth of the time left, so that
+    // neither the clock nor overshooting distorts the measurement much
+    auto perIteration = elapsed.count() / mIterations;
+    auto left = (mMinTime - elapsed).count();
+    uint64_t step = perIteration == 0 ? mIterations : left / perIteration / 10;
+    mNextCheck = mIterations + std::max<uint64_t>(step, 1);
+    return true;
+}
+
+void
+BenchState::pause()
+{
+    mPauseStart = clock::now();
+}
+
+void
+BenchState::resume()
+{
+    mPaused += clock::now() - mPauseStart;
+}
+
+void
+BenchState::setBytesPerIteration(uint64_t bytes)
+{
+    mBytesPerIteration = bytes;
+}
+
+void
+BenchState::setItemsPerIteration(uint64_t items)
+{
+    mItemsPerIteration = items;
+}
+
+static std::map<std::string, Benchmark::Function>&
+getBenchmarks()
+{
+    static std::map<std::string, Benchmark::Function> benchmarks;
+    return benchmarks;
+}
+
+bool
+Benchmark::add(char const* name, Function f)
+{
+    if (!getBenchmarks().emplace(name, f).second)
+    {
+        throw std::runtime_error(std::string("duplicate benchmark ") + name);
+    }
+    return true;
+}
+
+std::vector<std::string>
+Benchmark::list()
+{
+    std::vector<std::string> names;
+    for (auto const& b : getBenchmarks())
+    {
+        names.push_back(b.first);
+    }
+    return names;
+}
+
+std::vector<Benchmark::Result>
+Benchmark::run(std::string const& filter, std::chrono::milliseconds minTime,
+               size_t repetitions)
+{
+    std::vector<Result> results;
+    for (auto const& b : getBenchmarks())
+    {
+        if (b.first.find(filter) == std::string::npos)
+        {
+            continue;
+        }
+        results.push_back(runOne(b.first, b.second, minTime, repetitions));
+        auto const& r = results.back();
+        LOG(INFO) << "Benchmark " << r.mName << ": " << r.mNsPerIteration
+                  << " ns/iteration (" << r.mIterations << " iterations)";
+    }
+    return results;
+}
+
+Benchmark::Result
+Benchmark::runOne(std::string const& name, Function const& f,
+                  std::chrono::milliseconds minTime, size_t repetitions)
+{
+    struct Run
+    {
+        double mNsPerIteration;
+        uint64_t mIterations;
+        uint64_t mBytes;
+        uint64_t mItems;
+    };
+    std::vector<Run> runs;
+    for (size_t i = 0; i < std::max<size_t>(repetitions, 1); ++i)
+    {
+        BenchState state(minTime);
+        f(state);
+        if (state.getIterations() == 0)
+        {
+            throw std::runtime_error("benchmark " + name +
+                                     " did not run its loop");
+        }
+        runs.push_back(
+            {static_cast<double>(state.getElapsed().count()) /
+                 state.getIterations(),
+             state.getIterations(), state.getBytesPerIteration(),
+             state.getItemsPerIteration()});
+    }
+    std::sort(runs.begin(), runs.end(), [](Run const& a, Run const& b)
+              {
+                  return a.mNsPerIteration < b.mNsPerIteration;
+              });
+
+    auto const& median = runs[runs.size() / 2];
+    Result r;
+    r.mName = name;
+    r.mIterations = median.mIterations;
+    r.mNsPerIteration = median.mNsPerIteration;
+    r.mMinNsPerIteration = runs.front().mNsPerIteration;
+    r.mMaxNsPerIteration = runs.back().mNsPerIteration;
+    r.mBytesPerSecond = median.mBytes * 1e9 / median.mNsPerIteration;
+    r.mItemsPerSecond = median.mItems * 1e9 / median.mNsPerIteration;
+    return r;
+}
+
+void
+Benchmark::report(std::vector<Result> const& results, Json::Value& root)
+{
+    auto& benchmarks = root["benchmarks"];
+    benchmarks = Json::Value(Json::objectValue);
+    for (auto const& r : results)
+    {
+        auto& b = benchmarks[r.mName];
+        b["iterations"] = static_cast<Json::UInt64>(r.mIterations);
+        b["ns_per_iteration"] = r.mNsPerIteration;
+        b["min_ns_per_iteration"] = r.mMinNsPerIteration;
+        b["max_ns_per_iteration"] = r.mMaxNsPerIteration;
+        if (r.mBytesPerSecond != 0)
+        {
+            b["mb_per_second"] = r.mBytesPerSecond / (1024 * 1024);
+        }
+        if (r.mItemsPerSecond != 0)
+        {
+            b["items_per_second"] = r.mItemsPerSecond;
+        }
+    }
+}
+
+size_t
+Benchmark::compare(std::vector<Result> const& results,
+                   Json::Value const& baseline, double tolerance,
+                   Json::Value& root)
+{
+    size_t regressions = 0;
+    auto& comparison = root["comparison"];
+    comparison = Json::Value(Json::objectValue);
+    auto const& base = baseline["benchmarks"];
+    for (auto const& r : results)
+    {
+        if (!base.isMember(r.mName))
+        {
+            continue;
+        }
+        auto baseNs = base[r.mName]["ns_per_iteration"].asDouble();
+        if (baseNs <= 0)
+        {
+            continue;
+        }
+        auto ratio = r.mNsPerIteration / baseNs;
+        auto& c = comparison[r.mName];
+        c["baseline_ns_per_iteration"] = baseNs;
+        c["ns_per_iteration"] = r.mNsPerIteration;
+        c["ratio"] = ratio;
+        c["regression"] = ratio > 1.0 + tolerance;
+        if (ratio > 1.0 + tolerance)
+        {
+            ++regressions;
+            LOG(WARNING) << "Benchmark " << r.mName << " regressed: "
+                         << r.mNsPerIteration << " ns/iteration against "
+                         << baseNs << " in the baseline";
+        }
+    }
+    root["regressions"] = static_cast<Json::UInt64>(regressions);
+    return regressions;
+}
+}
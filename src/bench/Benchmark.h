@@ -0,0 +1,159 @@
+#pragma once
+
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "lib/json/json-forwards.h"
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+/**
+ * Microbenchmarks of the hot paths of core data structures, run by the
+ * stellar-core-bench binary.
+ *
+ * A benchmark is a function registered under a name with STELLAR_BENCHMARK.
+ * It does its setup, then runs the code it measures in a loop controlled by
+ * BenchState::keepRunning, which repeats the loop until it has run for the
+ * minimum time given to the run. Every benchmark is run a few times and
+ * reported by the median of its runs, which is what makes results
+ * comparable from one run to the next.
+ *
+ * Results are reported as JSON. Given the report of an earlier run as a
+ * baseline, every benchmark is compared with its result there, and those
+ * slower by more than a tolerance are flagged as regressions.
+ */
+class BenchState : NonMovableOrCopyable
+{
+  public:
+    explicit BenchState(std::chrono::nanoseconds minTime);
+
+    // Whether to run the loop body once more. Timing starts with the first
+    // call; the clock is only read every so many iterations, once the time
+    // an iteration takes is known.
+    bool keepRunning();
+
+    // Excludes the time between pause and resume from the measurement, for
+    // setup that has to be redone within the loop now and then.
+    void pause();
+    void resume();
+
+    // Work done by one iteration, reported as throughput.
+    void setBytesPerIteration(uint64_t bytes);
+    void setItemsPerIteration(uint64_t items);
+
+    uint64_t
+    getIterations() const
+    {
+        return mIterations;
+    }
+
+    std::chrono::nanoseconds
+    getElapsed() const
+    {
+        return mElapsed;
+    }
+
+    uint64_t
+    getBytesPerIteration() const
+    {
+        return mBytesPerIteration;
+    }
+
+    uint64_t
+    getItemsPerIteration() const
+    {
+        return mItemsPerIteration;
+    }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    std::chrono::nanoseconds const mMinTime;
+    bool mRunning{false};
+    uint64_t mIterations{0};
+    uint64_t mNextCheck{1};
+    clock::time_point mStart;
+    clock::time_point mPauseStart;
+    std::chrono::nanoseconds mPaused{0};
+    std::chrono::nanoseconds mElapsed{0};
+    uint64_t mBytesPerIteration{0};
+    uint64_t mItemsPerIteration{0};
+};
+
+class Benchmark
+{
+  public:
+    using Function = std::function<void(BenchState&)>;
+
+    struct Result
+    {
+        std::string mName;
+        // of the median run
+        uint64_t mIterations;
+        double mNsPerIteration;
+        // of the fastest and slowest runs
+        double mMinNsPerIteration;
+        double mMaxNsPerIteration;
+        // 0 unless the benchmark set the work done per iteration
+        double mBytesPerSecond;
+        double mItemsPerSecond;
+    };
+
+    // Registers `f` under `name`; see STELLAR_BENCHMARK.
+    static bool add(char const* name, Function f);
+
+    // Names of the registered benchmarks, sorted.
+    static std::vector<std::string> list();
+
+    // Runs, in name order, every benchmark whose name contains `filter`,
+    // `repetitions` times each for at least `minTime`.
+    static std::vector<Result> run(std::string const& filter,
+                                   std::chrono::milliseconds minTime,
+                                   size_t repetitions);
+
+    static Result runOne(std::string const& name, Function const& f,
+                         std::chrono::milliseconds minTime,
+                         size_t repetitions);
+
+    static void report(std::vector<Result> const& results, Json::Value& root);
+
+    // Compares `results` with the benchmarks of `baseline`, an earlier
+    // report, into root["comparison"]. A benchmark is a regression if its
+    // time per iteration grew by more than `tolerance` (0.1 for 10%).
+    // Returns the number of regressions.
+    static size_t compare(std::vector<Result> const& results,
+                          Json::Value const& baseline, double tolerance,
+                          Json::Value& root);
+};
+}
+
+#define STELLAR_BENCHMARK_CAT2(a, b) a##b
+#define STELLAR_BENCHMARK_CAT(a, b) STELLAR_BENCHMARK_CAT2(a, b)
+
+// Defines and registers a benchmark; the body that follows gets its
+// BenchState as `state`:
+//
+//     STELLAR_BENCHMARK("crypto/sha256/32B")
+//     {
+//         ...setup...
+//         while (state.keepRunning())
+//         {
+//             ...measured code...
+//         }
+//     }
+#define STELLAR_BENCHMARK(name)                                                \
+    static void STELLAR_BENCHMARK_CAT(benchmark, __LINE__)(                   \
+        stellar::BenchState & state);                                          \
+    static bool STELLAR_BENCHMARK_CAT(benchmarkAdded, __LINE__) =             \
+        stellar::Benchmark::add(name,                                          \
+                                &STELLAR_BENCHMARK_CAT(benchmark, __LINE__)); \
+    static void STELLAR_BENCHMARK_CAT(benchmark, __LINE__)(                   \
+        stellar::BenchState & state)
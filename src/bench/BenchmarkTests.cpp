@@ -0,0 +1,81 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bench/Benchmark.h"
+#include "lib/catch.hpp"
+#include "lib/json/json.h"
+#include <thread>
+
+using namespace stellar;
+
+TEST_CASE("benchmark runs", "[bench]")
+{
+    auto minTime = std::chrono::milliseconds(20);
+    std::vector<size_t> iterations;
+    auto result = Benchmark::runOne(
+        "test/sleep", [&](BenchState& state)
+        {
+            state.setItemsPerIteration(2);
+            size_t n = 0;
+            while (state.keepRunning())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                ++n;
+            }
+            CHECK(!state.keepRunning());
+            CHECK(state.getIterations() == n);
+            CHECK(state.getElapsed() >= minTime);
+            iterations.push_back(n);
+        },
+        minTime, 3);
+
+    REQUIRE(iterations.size() == 3);
+    CHECK(result.mName == "test/sleep");
+    CHECK(result.mNsPerIteration >= 1e6);
+    CHECK(result.mMinNsPerIteration <= result.mNsPerIteration);
+    CHECK(result.mMaxNsPerIteration >= result.mNsPerIteration);
+    CHECK(result.mItemsPerSecond == Approx(2e9 / result.mNsPerIteration));
+    CHECK(result.mBytesPerSecond == 0);
+
+    SECTION("paused time is not measured")
+    {
+        auto paused = Benchmark::runOne(
+            "test/paused", [](BenchState& state)
+            {
+                size_t n = 0;
+                while (state.keepRunning())
+                {
+                    if (n++ < 5)
+                    {
+                        state.pause();
+                        std::this_thread::sleep_for(
+                            std::chrono::milliseconds(1));
+                        state.resume();
+                    }
+                }
+            },
+            minTime, 1);
+        CHECK(paused.mNsPerIteration < 1e6);
+    }
+
+    SECTION("comparison with a baseline")
+    {
+        Json::Value baseline;
+        Benchmark::Result faster = result;
+        faster.mName = "test/faster";
+        faster.mNsPerIteration = result.mNsPerIteration / 2;
+        Benchmark::report({result, faster}, baseline);
+
+        // as fast as the baseline, then twice as slow
+        Json::Value root;
+        CHECK(Benchmark::compare({result, faster}, baseline, 0.1, root) == 0);
+        faster.mNsPerIteration = result.mNsPerIteration;
+        CHECK(Benchmark::compare({result, faster}, baseline, 0.1, root) == 1);
+        CHECK(root["regressions"].asUInt64() == 1);
+        CHECK(root["comparison"]["test/faster"]["regression"].asBool());
+        CHECK(!root["comparison"]["test/sleep"]["regression"].asBool());
+        CHECK(root["comparison"]["test/faster"]["ratio"].asDouble() ==
+              Approx(2));
+    }
+}
@@ -0,0 +1,356 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Microbenchmarks of the hot paths of core data structures; see
+// Benchmark.h. Names are <module>/<structure>/<operation>[/<size>], keep
+// them stable: they are the keys baselines are compared on.
+
+#include "bench/Benchmark.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketManager.h"
+#include "bucket/LedgerCmp.h"
+#include "crypto/Random.h"
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "ledger/EntryFrame.h"
+#include "ledger/LedgerDelta.h"
+#include "ledger/LedgerManager.h"
+#include "ledger/LedgerTestUtils.h"
+#include "main/Application.h"
+#include "main/test.h"
+#include "overlay/Floodgate.h"
+#include "scp/LocalNode.h"
+#include "transactions/TxTests.h"
+#include "util/Timer.h"
+#include "xdrpp/marshal.h"
+#include <algorithm>
+
+namespace stellar
+{
+
+namespace
+{
+
+// A fresh application on a test configuration, for the benchmarks that
+// need one.
+struct BenchApp
+{
+    VirtualClock mClock;
+    Application::pointer mApp;
+
+    BenchApp() : mApp(Application::create(mClock, getTestConfig()))
+    {
+        mApp->start();
+    }
+};
+
+TransactionEnvelope
+benchEnvelope()
+{
+    auto from = txtest::getAccount("bench-from");
+    auto to = txtest::getAccount("bench-to");
+    return txtest::createPaymentTx(sha256("bench"), from, to, 1, 1000)
+        ->getEnvelope();
+}
+
+std::vector<BucketEntry>
+benchBucketEntries(size_t n)
+{
+    std::vector<BucketEntry> entries(n);
+    for (auto& e : entries)
+    {
+        e.type(LIVEENTRY);
+        e.liveEntry() = LedgerTestUtils::generateValidLedgerEntry(3);
+    }
+    return entries;
+}
+
+template <typename T>
+void
+benchEncode(BenchState& state, T const& value)
+{
+    state.setBytesPerIteration(xdr::xdr_argpack_size(value));
+    while (state.keepRunning())
+    {
+        xdr::xdr_to_opaque(value);
+    }
+}
+
+template <typename T>
+void
+benchDecode(BenchState& state, T const& value)
+{
+    auto bytes = xdr::xdr_to_opaque(value);
+    state.setBytesPerIteration(bytes.size());
+    T decoded;
+    while (state.keepRunning())
+    {
+        xdr::xdr_from_opaque(bytes, decoded);
+    }
+}
+}
+
+STELLAR_BENCHMARK("xdr/TransactionEnvelope/encode")
+{
+    benchEncode(state, benchEnvelope());
+}
+
+STELLAR_BENCHMARK("xdr/TransactionEnvelope/decode")
+{
+    benchDecode(state, benchEnvelope());
+}
+
+STELLAR_BENCHMARK("xdr/BucketEntry/encode")
+{
+    benchEncode(state, benchBucketEntries(1).front());
+}
+
+STELLAR_BENCHMARK("xdr/BucketEntry/decode")
+{
+    benchDecode(state, benchBucketEntries(1).front());
+}
+
+STELLAR_BENCHMARK("bucket/LedgerEntryIdCmp/sort/10000")
+{
+    auto const entries = benchBucketEntries(10000);
+    std::vector<BucketEntry> sorted;
+    state.setItemsPerIteration(entries.size());
+    while (state.keepRunning())
+    {
+        state.pause();
+        sorted = entries;
+        state.resume();
+        std::sort(sorted.begin(), sorted.end(), BucketEntryIdCmp());
+    }
+}
+
+STELLAR_BENCHMARK("bucket/Bucket/merge/10000")
+{
+    BenchApp b;
+    auto& bm = b.mApp->getBucketManager();
+
+    // the new bucket updates half of the entries of the old one; count the
+    // bytes read from both bucket files, entries and their record marks
+    std::vector<LedgerEntry> oldLive, newLive;
+    std::vector<LedgerKey> noDead;
+    uint64_t bytes = 0;
+    for (auto const& e : benchBucketEntries(10000))
+    {
+        oldLive.push_back(e.liveEntry());
+        bytes += xdr::xdr_argpack_size(e) + 4;
+        if (oldLive.size() % 2 == 0)
+        {
+            newLive.push_back(e.liveEntry());
+            newLive.back().lastModifiedLedgerSeq++;
+            bytes += xdr::xdr_argpack_size(e) + 4;
+        }
+    }
+    auto oldBucket = Bucket::fresh(bm, oldLive, noDead);
+    auto newBucket = Bucket::fresh(bm, newLive, noDead);
+    state.setBytesPerIteration(bytes);
+    while (state.keepRunning())
+    {
+        auto merged = Bucket::merge(bm, oldBucket, newBucket);
+        state.pause();
+        merged.reset();
+        bm.forgetUnreferencedBuckets();
+        state.resume();
+    }
+}
+
+STELLAR_BENCHMARK("ledger/LedgerDelta/nest-commit/100")
+{
+    BenchApp b;
+    auto& app = *b.mApp;
+    std::vector<EntryFrame::pointer> entries;
+    for (size_t i = 0; i < 100; ++i)
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(3);
+        entries.push_back(EntryFrame::FromXDR(le));
+    }
+    // what a transaction does: a delta per transaction, one per operation
+    // within it, the operations modifying entries the transaction created
+    state.setItemsPerIteration(entries.size());
+    while (state.keepRunning())
+    {
+        LedgerDelta ledgerDelta(app.getLedgerManager().getCurrentLedgerHeader(),
+                                app.getDatabase(), false);
+        {
+            LedgerDelta txDelta(ledgerDelta);
+            for (auto const& e : entries)
+            {
+                txDelta.addEntry(*e);
+            }
+            {
+                LedgerDelta opDelta(txDelta);
+                for (size_t i = 0; i < entries.size(); i += 10)
+                {
+                    opDelta.modEntry(*entries[i]);
+                }
+                opDelta.commit();
+            }
+            txDelta.commit();
+        }
+    }
+}
+
+STELLAR_BENCHMARK("crypto/verifySig/hit")
+{
+    auto key = SecretKey::random();
+    auto message = randomBytes(256);
+    auto signature = key.sign(message);
+    auto pub = key.getPublicKey();
+    PubKeyUtils::verifySig(pub, signature, message);
+    while (state.keepRunning())
+    {
+        PubKeyUtils::verifySig(pub, signature, message);
+    }
+}
+
+STELLAR_BENCHMARK("crypto/verifySig/miss")
+{
+    // more signatures than fit in the verification cache would do, but
+    // generating them takes long: clear the cache every round instead
+    size_t const n = 1024;
+    auto key = SecretKey::random();
+    auto pub = key.getPublicKey();
+    std::vector<std::vector<uint8_t>> messages;
+    std::vector<Signature> signatures;
+    for (size_t i = 0; i < n; ++i)
+    {
+        messages.push_back(randomBytes(256));
+        signatures.push_back(key.sign(messages.back()));
+    }
+    PubKeyUtils::clearVerifySigCache();
+    size_t i = 0;
+    while (state.keepRunning())
+    {
+        PubKeyUtils::verifySig(pub, signatures[i], messages[i]);
+        if (++i == n)
+        {
+            i = 0;
+            state.pause();
+            PubKeyUtils::clearVerifySigCache();
+            state.resume();
+        }
+    }
+}
+
+STELLAR_BENCHMARK("crypto/sha256/32B")
+{
+    auto bytes = randomBytes(32);
+    state.setBytesPerIteration(bytes.size());
+    while (state.keepRunning())
+    {
+        sha256(bytes);
+    }
+}
+
+STELLAR_BENCHMARK("crypto/sha256/64KB")
+{
+    auto bytes = randomBytes(65536);
+    state.setBytesPerIteration(bytes.size());
+    while (state.keepRunning())
+    {
+        sha256(bytes);
+    }
+}
+
+STELLAR_BENCHMARK("crypto/hmacSha256/1KB")
+{
+    HmacSha256Key key;
+    auto keyBytes = randomBytes(key.key.size());
+    std::copy(keyBytes.begin(), keyBytes.end(), key.key.begin());
+    auto bytes = randomBytes(1024);
+    state.setBytesPerIteration(bytes.size());
+    while (state.keepRunning())
+    {
+        hmacSha256(key, bytes);
+    }
+}
+
+namespace
+{
+std::vector<StellarMessage>
+benchFloodMessages(size_t n)
+{
+    std::vector<StellarMessage> messages(n);
+    for (auto& m : messages)
+    {
+        m.type(GET_TX_SET);
+        auto bytes = randomBytes(m.txSetHash().size());
+        std::copy(bytes.begin(), bytes.end(), m.txSetHash().begin());
+    }
+    return messages;
+}
+}
+
+STELLAR_BENCHMARK("overlay/Floodgate/insert")
+{
+    BenchApp b;
+    Floodgate floodgate(*b.mApp);
+    auto messages = benchFloodMessages(10000);
+    size_t i = 0;
+    while (state.keepRunning())
+    {
+        floodgate.addRecord(messages[i], nullptr);
+        if (++i == messages.size())
+        {
+            i = 0;
+            state.pause();
+            floodgate.clearBelow(UINT32_MAX);
+            state.resume();
+        }
+    }
+}
+
+STELLAR_BENCHMARK("overlay/Floodgate/lookup")
+{
+    BenchApp b;
+    Floodgate floodgate(*b.mApp);
+    auto messages = benchFloodMessages(10000);
+    for (auto const& m : messages)
+    {
+        floodgate.addRecord(m, nullptr);
+    }
+    size_t i = 0;
+    while (state.keepRunning())
+    {
+        floodgate.addRecord(messages[i], nullptr);
+        i = (i + 1) % messages.size();
+    }
+}
+
+STELLAR_BENCHMARK("scp/LocalNode/isQuorum/21")
+{
+    // 7 organizations of 3 validators: 2 of each of 5 of them
+    SCPQuorumSet qSet;
+    qSet.threshold = 5;
+    std::map<NodeID, SCPEnvelope> envelopes;
+    for (size_t i = 0; i < 7; ++i)
+    {
+        SCPQuorumSet org;
+        org.threshold = 2;
+        for (size_t j = 0; j < 3; ++j)
+        {
+            auto node = SecretKey::random().getPublicKey();
+            org.validators.push_back(node);
+            envelopes[node].statement.nodeID = node;
+        }
+        qSet.innerSets.push_back(org);
+    }
+    auto qSetPtr = std::make_shared<SCPQuorumSet>(qSet);
+    auto qfun = [&](SCPStatement const&)
+    {
+        return qSetPtr;
+    };
+    state.setItemsPerIteration(envelopes.size());
+    while (state.keepRunning())
+    {
+        LocalNode::isQuorum(qSet, envelopes, qfun);
+    }
+}
+}
@@ -0,0 +1,180 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+// Entry point of stellar-core-bench, which runs the microbenchmarks of
+// bench/CoreBenchmarks.cpp; see bench/Benchmark.h.
+
+#include "bench/Benchmark.h"
+#include "StellarCoreVersion.h"
+#include "lib/json/json.h"
+#include "lib/util/getopt.h"
+#include "util/Logging.h"
+#include <sodium.h>
+#include <fstream>
+#include <iostream>
+
+_INITIALIZE_EASYLOGGINGPP
+
+namespace stellar
+{
+
+enum opttag
+{
+    OPT_BASELINE,
+    OPT_FILTER,
+    OPT_HELP,
+    OPT_LIST,
+    OPT_LOGLEVEL,
+    OPT_MINTIME,
+    OPT_OUTPUT,
+    OPT_REPETITIONS,
+    OPT_TOLERANCE
+};
+
+static const struct option bench_options[] = {
+    {"baseline", required_argument, nullptr, OPT_BASELINE},
+    {"filter", required_argument, nullptr, OPT_FILTER},
+    {"help", no_argument, nullptr, OPT_HELP},
+    {"list", no_argument, nullptr, OPT_LIST},
+    {"ll", required_argument, nullptr, OPT_LOGLEVEL},
+    {"min-time", required_argument, nullptr, OPT_MINTIME},
+    {"output", required_argument, nullptr, OPT_OUTPUT},
+    {"repetitions", required_argument, nullptr, OPT_REPETITIONS},
+    {"tolerance", required_argument, nullptr, OPT_TOLERANCE},
+    {nullptr, 0, nullptr, 0}};
+
+static void
+usage(int err = 1)
+{
+    std::ostream& os = err ? std::cerr : std::cout;
+    os << "usage: stellar-core-bench [OPTIONS]\n"
+          "where OPTIONS can be any of:\n"
+          "      --baseline FILE  Compare with the report of an earlier run "
+          "and exit with 1\n"
+          "                       if any benchmark regressed\n"
+          "      --filter STR     Only run the benchmarks whose name "
+          "contains STR\n"
+          "      --help           To display this string\n"
+          "      --list           List the benchmarks and exit\n"
+          "      --ll LEVEL       Set the log level (default: warning)\n"
+          "      --min-time MS    Minimum duration of each run (default: "
+          "500)\n"
+          "      --output FILE    Write the JSON report to FILE rather than "
+          "stdout\n"
+          "      --repetitions N  Runs of each benchmark, reported by their "
+          "median (default: 5)\n"
+          "      --tolerance PCT  Slowdown against the baseline tolerated "
+          "before a\n"
+          "                       benchmark counts as a regression "
+          "(default: 10)\n";
+    exit(err);
+}
+
+static int
+runBenchmarks(int argc, char* const* argv)
+{
+    std::string baselineFile;
+    std::string filter;
+    std::string outputFile;
+    std::chrono::milliseconds minTime(500);
+    size_t repetitions = 5;
+    double tolerance = 10;
+
+    Logging::setLogLevel(el::Level::Warning, nullptr);
+
+    int opt;
+    while ((opt = getopt_long_only(argc, argv, "", bench_options,
+                                   nullptr)) != -1)
+    {
+        switch (opt)
+        {
+        case OPT_BASELINE:
+            baselineFile = optarg;
+            break;
+        case OPT_FILTER:
+            filter = optarg;
+            break;
+        case OPT_HELP:
+            usage(0);
+        case OPT_LIST:
+            for (auto const& name : Benchmark::list())
+            {
+                std::cout << name << std::endl;
+            }
+            return 0;
+        case OPT_LOGLEVEL:
+            Logging::setLogLevel(Logging::getLLfromString(optarg), nullptr);
+            break;
+        case OPT_MINTIME:
+            minTime = std::chrono::milliseconds(std::stoul(optarg));
+            break;
+        case OPT_OUTPUT:
+            outputFile = optarg;
+            break;
+        case OPT_REPETITIONS:
+            repetitions = std::stoul(optarg);
+            break;
+        case OPT_TOLERANCE:
+            tolerance = std::stod(optarg);
+            break;
+        default:
+            usage(1);
+        }
+    }
+
+    Json::Value baseline;
+    if (!baselineFile.empty())
+    {
+        std::ifstream in(baselineFile);
+        Json::Reader reader;
+        if (!in || !reader.parse(in, baseline))
+        {
+            std::cerr << "Could not read baseline " << baselineFile
+                      << std::endl;
+            return 1;
+        }
+    }
+
+    auto results = Benchmark::run(filter, minTime, repetitions);
+
+    Json::Value root;
+    root["version"] = STELLAR_CORE_VERSION;
+    root["min_time_ms"] = static_cast<Json::UInt64>(minTime.count());
+    root["repetitions"] = static_cast<Json::UInt64>(repetitions);
+    Benchmark::report(results, root);
+    size_t regressions = 0;
+    if (!baselineFile.empty())
+    {
+        regressions =
+            Benchmark::compare(results, baseline, tolerance / 100, root);
+    }
+
+    if (outputFile.empty())
+    {
+        std::cout << root.toStyledString();
+    }
+    else
+    {
+        std::ofstream out(outputFile);
+        out << root.toStyledString();
+    }
+    return regressions == 0 ? 0 : 1;
+}
+}
+
+int
+main(int argc, char* const* argv)
+{
+    sodium_init();
+    stellar::Logging::init();
+    try
+    {
+        return stellar::runBenchmarks(argc, argv);
+    }
+    catch (std::exception& e)
+    {
+        LOG(ERROR) << e.what();
+        return 1;
+    }
+}
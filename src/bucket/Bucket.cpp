@@ -64,6 +64,9 @@ Bucket::~Bucket()
     {
         CLOG(TRACE, "Bucket") << "Bucket::~Bucket removing file: " << mFilename;
         std::remove(mFilename.c_str());
+        // also drop any compressed copy, even one left over by an earlier
+        // run, which isCompressed() would not know about
+        std::remove((mFilename + ".gz").c_str());
     }
 }
 
@@ -89,6 +92,18 @@ Bucket::setRetain(bool r)
     mRetain = r;
 }
 
+bool
+Bucket::isCompressed() const
+{
+    return mCompressed;
+}
+
+void
+Bucket::setCompressed()
+{
+    mCompressed = true;
+}
+
 /**
  * Helper class that reads from the file underlying a bucket, keeping the bucket
  * alive for the duration of its existence.
@@ -298,7 +313,6 @@ Bucket::apply(Database& db) const
         LedgerDelta delta(lh, db, false);
         if ((i++ & 0xfff) == 0xfff)
         {
-            db.clearPreparedStatementCache();
             db.getSession().commit();
             CLOG(INFO, "Bucket") << "Bucket-apply: committed " << i
                                  << " entries";
@@ -324,44 +338,60 @@ Bucket::fresh(BucketManager& bucketManager,
               std::vector<LedgerEntry> const& liveEntries,
               std::vector<LedgerKey> const& deadEntries)
 {
-    std::vector<BucketEntry> live, dead, combined;
+    // Sort pointers to the entries rather than copies of them, then merge
+    // the two sorted runs straight into the output, which is what merging a
+    // bucket of the live entries with one of the dead entries would write.
+    LedgerEntryIdCmp cmp;
+    std::vector<LedgerEntry const*> live;
+    std::vector<LedgerKey const*> dead;
     live.reserve(liveEntries.size());
     dead.reserve(deadEntries.size());
-
     for (auto const& e : liveEntries)
     {
-        BucketEntry ce;
-        ce.type(LIVEENTRY);
-        ce.liveEntry() = e;
-        live.push_back(ce);
+        live.push_back(&e);
     }
-
     for (auto const& e : deadEntries)
     {
-        BucketEntry ce;
-        ce.type(DEADENTRY);
-        ce.deadEntry() = e;
-        dead.push_back(ce);
-    }
-
-    std::sort(live.begin(), live.end(), BucketEntryIdCmp());
-
-    std::sort(dead.begin(), dead.end(), BucketEntryIdCmp());
-
-    OutputIterator liveOut(bucketManager.getTmpDir(), true);
-    OutputIterator deadOut(bucketManager.getTmpDir(), true);
-    for (auto const& e : live)
-    {
-        liveOut.put(e);
+        dead.push_back(&e);
     }
-    for (auto const& e : dead)
+    std::sort(live.begin(), live.end(),
+              [&cmp](LedgerEntry const* a, LedgerEntry const* b)
+              {
+                  return cmp(*a, *b);
+              });
+    std::sort(dead.begin(), dead.end(),
+              [&cmp](LedgerKey const* a, LedgerKey const* b)
+              {
+                  return cmp(*a, *b);
+              });
+
+    BucketEntry liveEntry, deadEntry;
+    liveEntry.type(LIVEENTRY);
+    deadEntry.type(DEADENTRY);
+    OutputIterator out(bucketManager.getTmpDir(), true);
+    auto li = live.begin();
+    auto di = dead.begin();
+    while (li != live.end() || di != dead.end())
     {
-        deadOut.put(e);
+        if (di == dead.end() || (li != live.end() && cmp(**li, **di)))
+        {
+            liveEntry.liveEntry() = **li;
+            out.put(liveEntry);
+            ++li;
+        }
+        else if (li == live.end() || cmp(**di, **li))
+        {
+            deadEntry.deadEntry() = **di;
+            out.put(deadEntry);
+            ++di;
+        }
+        else
+        {
+            // Same key live and dead: the dead entry wins.
+            ++li;
+        }
     }
-
-    auto liveBucket = liveOut.getBucket(bucketManager);
-    auto deadBucket = deadOut.getBucket(bucketManager);
-    return Bucket::merge(bucketManager, liveBucket, deadBucket);
+    return out.getBucket(bucketManager);
 }
 
 inline void
@@ -467,21 +497,9 @@ compareSizes(std::string const& objType, uint64_t inDatabase,
     }
 }
 
-// FIXME issue NNN: this should be refactored to run in a read-transaction on a
-// background thread and take a soci::session& rather than Database&. For now we
-// code it to run on main thread because there's a bunch of code to move around
-// in the ledger frames and db layer to make that work.
-
-void
-checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
-                      BucketManager& bucketManager, Database& db,
-                      BucketList& bl)
+std::vector<std::shared_ptr<Bucket>>
+collectBucketsForCheckDB(BucketList& bl)
 {
-    CLOG(INFO, "Bucket") << "CheckDB starting";
-    auto execTimer =
-        metrics.NewTimer({"bucket", "checkdb", "execute"}).TimeScope();
-
-    // Step 1: Collect all buckets to merge.
     std::vector<std::shared_ptr<Bucket>> buckets;
     for (size_t i = 0; i < BucketList::kNumLevels; ++i)
     {
@@ -497,14 +515,43 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
         buckets.push_back(level.getCurr());
         buckets.push_back(level.getSnap());
     }
+    return buckets;
+}
+
+bool
+checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
+                      BucketManager& bucketManager, Database& db,
+                      soci::session& sess, uint32_t ledgerSeq,
+                      std::vector<std::shared_ptr<Bucket>> const& buckets)
+{
+    CLOG(INFO, "Bucket") << "CheckDB starting at ledger " << ledgerSeq;
+    auto execTimer =
+        metrics.NewTimer({"bucket", "checkdb", "execute"}).TimeScope();
+
+    // The first read in `sess`'s transaction fixes the snapshot every later
+    // read sees, so make it the last closed ledger: if a ledger closed after
+    // the buckets were collected, the two no longer describe the same state.
+    uint32_t dbLedgerSeq = 0;
+    soci::indicator dbLedgerSeqIndicator;
+    sess << "SELECT MAX(ledgerseq) FROM ledgerheaders;",
+        soci::into(dbLedgerSeq, dbLedgerSeqIndicator);
+    if (dbLedgerSeqIndicator != soci::indicator::i_ok ||
+        dbLedgerSeq != ledgerSeq)
+    {
+        CLOG(WARNING, "Bucket")
+            << "CheckDB skipped: buckets are at ledger " << ledgerSeq
+            << " but the database is at ledger " << dbLedgerSeq;
+        metrics.NewMeter({"bucket", "checkdb", "skipped"}, "run").Mark();
+        return false;
+    }
 
     if (buckets.empty())
     {
         CLOG(INFO, "Bucket") << "CheckDB found no buckets, returning";
-        return;
+        return true;
     }
 
-    // Step 2: merge all buckets into a single super-bucket.
+    // Step 1: merge all buckets into a single super-bucket.
     auto i = buckets.begin();
     assert(i != buckets.end());
     std::shared_ptr<Bucket> superBucket = *i;
@@ -520,7 +567,7 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
 
     CLOG(INFO, "Bucket") << "CheckDB starting object comparison";
 
-    // Step 3: scan the superbucket, checking each object against the DB and
+    // Step 2: scan the superbucket, checking each object against the DB and
     // counting objects along the way.
     uint64_t nAccounts = 0, nTrustLines = 0, nOffers = 0;
     {
@@ -546,7 +593,7 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
                     ++nOffers;
                     break;
                 }
-                EntryFrame::checkAgainstDatabase(e.liveEntry(), db);
+                EntryFrame::checkAgainstDatabase(e.liveEntry(), db, sess);
                 if (meter.count() % 100 == 0)
                 {
                     CLOG(INFO, "Bucket") << "CheckDB compared " << meter.count()
@@ -556,10 +603,10 @@ checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
         }
     }
 
-    // Step 4: confirm size of datasets matches size of datasets in DB.
-    soci::session& sess = db.getSession();
+    // Step 3: confirm size of datasets matches size of datasets in DB.
     compareSizes("account", AccountFrame::countObjects(sess), nAccounts);
     compareSizes("trustline", TrustFrame::countObjects(sess), nTrustLines);
     compareSizes("offer", OfferFrame::countObjects(sess), nOffers);
+    return true;
 }
 }
@@ -13,6 +13,11 @@ namespace medida
 class MetricsRegistry;
 }
 
+namespace soci
+{
+class session;
+}
+
 namespace stellar
 {
 
@@ -38,6 +43,7 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     std::string const mFilename;
     uint256 const mHash;
     bool mRetain{false};
+    bool mCompressed{false};
 
   public:
     // Helper class that reads through the entries in a bucket, used internally
@@ -52,8 +58,8 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // filename is the empty string.
     Bucket();
 
-    // Destroy a bucket, deleting its underlying file if the bucket is not
-    // 'retained'. See `setRetain`.
+    // Destroy a bucket, deleting its underlying file, and its compressed
+    // copy if any, if the bucket is not 'retained'. See `setRetain`.
     ~Bucket();
 
     // Construct a bucket with a given filename and hash. Asserts that the file
@@ -72,6 +78,12 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
     // be retained.
     void setRetain(bool r);
 
+    // Whether the gzipped copy of the bucket that is published to history
+    // archives exists, at getFilename() + ".gz". Only ever touched from the
+    // main thread, see BucketManager::compressBucket.
+    bool isCompressed() const;
+    void setCompressed();
+
     // Returns true if a BucketEntry that is key-wise identical to the given
     // BucketEntry exists in the bucket. For testing.
     bool containsBucketIdentity(BucketEntry const& id) const;
@@ -107,7 +119,17 @@ class Bucket : public std::enable_shared_from_this<Bucket>,
           bool keepDeadEntries = true);
 };
 
-void checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
+// Collect (on the main thread) every bucket in `bl`, resolving any live
+// merges, for use with checkDBAgainstBuckets below.
+std::vector<std::shared_ptr<Bucket>> collectBucketsForCheckDB(BucketList& bl);
+
+// Merge `buckets`, collected at ledger `ledgerSeq`, and compare every live
+// entry against the database, reading through `sess`. Returns false without
+// comparing if the database snapshot `sess` sees is not at `ledgerSeq`. Only
+// touches thread-safe state, so it may run on a worker thread against a
+// connection-pool session. Throws on any mismatch.
+bool checkDBAgainstBuckets(medida::MetricsRegistry& metrics,
                            BucketManager& bucketManager, Database& db,
-                           BucketList& bl);
+                           soci::session& sess, uint32_t ledgerSeq,
+                           std::vector<std::shared_ptr<Bucket>> const& buckets);
 }
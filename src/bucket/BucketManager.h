@@ -4,13 +4,20 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <functional>
 #include <memory>
+#include <system_error>
 #include "overlay/StellarXDR.h"
 #include "bucket/Bucket.h"
 #include "util/NonCopyable.h"
 
 #include "medida/timer_context.h"
 
+namespace asio
+{
+typedef std::error_code error_code;
+};
+
 namespace stellar
 {
 
@@ -74,6 +81,16 @@ class BucketManager : NonMovableOrCopyable
     // Return a bucket by hash if we have it, else return nullptr.
     virtual std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) = 0;
 
+    // Call `handler` once the gzipped copy of `bucket` exists, at
+    // `bucket->getFilename() + ".gz"`. The first call for a bucket compresses
+    // it, concurrent calls wait for that compression and later ones find it
+    // done: the compressed copy then lives as long as the bucket and every
+    // publish of it, to every history archive, only uploads it. Main thread
+    // only; the handler is never called before compressBucket returns.
+    virtual void
+    compressBucket(std::shared_ptr<Bucket> bucket,
+                   std::function<void(asio::error_code const&)> handler) = 0;
+
     // Forget any buckets not referenced by the current BucketList. This will
     // not immediately cause the buckets to delete themselves, if someone else
     // is using them via a shared_ptr<>, but the BucketManager will no longer
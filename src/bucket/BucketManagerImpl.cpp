@@ -12,6 +12,7 @@
 #include "util/make_unique.h"
 #include "util/TmpDir.h"
 #include "util/Logging.h"
+#include "util/Timer.h"
 #include "util/types.h"
 #include "crypto/Hex.h"
 #include <fstream>
@@ -64,6 +65,8 @@ BucketManagerImpl::BucketManagerImpl(Application& app)
     , mBucketSnapMerge(app.getMetrics().NewTimer({"bucket", "snap", "merge"}))
     , mSharedBucketsSize(
           app.getMetrics().NewCounter({"bucket", "memory", "shared"}))
+    , mBucketCompressReuse(
+          app.getMetrics().NewMeter({"bucket", "compress", "reuse"}, "bucket"))
 
 {
 }
@@ -231,6 +234,53 @@ BucketManagerImpl::getBucketByHash(uint256 const& hash)
     return std::shared_ptr<Bucket>();
 }
 
+void
+BucketManagerImpl::compressBucket(
+    std::shared_ptr<Bucket> bucket,
+    std::function<void(asio::error_code const&)> handler)
+{
+    assert(bucket && !bucket->getFilename().empty());
+    if (bucket->isCompressed())
+    {
+        mBucketCompressReuse.Mark();
+        mApp.getClock().post(CrankStats::ORIGIN_HISTORY, [handler]()
+                             {
+                                 handler(asio::error_code());
+                             });
+        return;
+    }
+
+    auto const& filename = bucket->getFilename();
+    auto i = mCompressing.find(filename);
+    if (i != mCompressing.end())
+    {
+        i->second.push_back(handler);
+        return;
+    }
+    mCompressing[filename].push_back(handler);
+
+    CLOG(DEBUG, "Bucket") << "Compressing bucket " << filename;
+    // The bucket is held until the compression finishes, so that its file
+    // outlives gzip.
+    mApp.getHistoryManager().compress(
+        filename, [this, bucket](asio::error_code const& ec)
+        {
+            if (!ec)
+            {
+                bucket->setCompressed();
+            }
+            auto j = mCompressing.find(bucket->getFilename());
+            assert(j != mCompressing.end());
+            auto handlers = std::move(j->second);
+            mCompressing.erase(j);
+            for (auto const& h : handlers)
+            {
+                h(ec);
+            }
+        },
+        true);
+}
+
 void
 BucketManagerImpl::forgetUnreferencedBuckets()
 {
@@ -8,6 +8,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 // Copyright 2015 Stellar Development Foundation and contributors. Licensed
 // under the Apache License, Version 2.0. See the COPYING file at the root
@@ -44,6 +45,12 @@ class BucketManagerImpl : public BucketManager
     medida::Timer& mBucketAddBatch;
     medida::Timer& mBucketSnapMerge;
     medida::Counter& mSharedBucketsSize;
+    medida::Meter& mBucketCompressReuse;
+
+    // Handlers waiting on compressions in progress, by bucket filename.
+    std::map<std::string,
+             std::vector<std::function<void(asio::error_code const&)>>>
+        mCompressing;
 
   protected:
     void calculateSkipValues(LedgerHeader& currentHeader);
@@ -61,6 +68,10 @@ class BucketManagerImpl : public BucketManager
                                               size_t nBytes) override;
     std::shared_ptr<Bucket> getBucketByHash(uint256 const& hash) override;
 
+    void compressBucket(
+        std::shared_ptr<Bucket> bucket,
+        std::function<void(asio::error_code const&)> handler) override;
+
     void forgetUnreferencedBuckets() override;
     void addBatch(Application& app, uint32_t currLedger,
                   std::vector<LedgerEntry> const& liveEntries,
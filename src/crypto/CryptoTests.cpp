@@ -4,6 +4,7 @@
 
 #include "main/test.h"
 #include "util/Logging.h"
+#include "main/Config.h"
 #include "lib/catch.hpp"
 #include "crypto/Base58.h"
 #include "crypto/Hex.h"
@@ -14,8 +15,12 @@
 #include "util/basen.h"
 #include <autocheck/autocheck.hpp>
 #include <sodium.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <map>
 #include <regex>
+#include <thread>
 
 using namespace stellar;
 
@@ -298,6 +303,39 @@ TEST_CASE("sign tests", "[crypto]")
     CHECK(!PubKeyUtils::verifySig(pk, sig, msg));
 }
 
+TEST_CASE("verify signature cache resize", "[crypto]")
+{
+    auto sk = SecretKey::random();
+    auto pk = sk.getPublicKey();
+    std::string msg = "hello";
+    auto sig = sk.sign(msg);
+    uint64_t hits, misses, ignores;
+
+    PubKeyUtils::setVerifySigCacheSize(1024);
+    CHECK(PubKeyUtils::verifySig(pk, sig, msg));
+    PubKeyUtils::flushVerifySigCacheCounts(hits, misses, ignores);
+
+    SECTION("same size keeps cached results")
+    {
+        PubKeyUtils::setVerifySigCacheSize(1024);
+        CHECK(PubKeyUtils::verifySig(pk, sig, msg));
+        PubKeyUtils::flushVerifySigCacheCounts(hits, misses, ignores);
+        CHECK(hits == 1);
+        CHECK(misses == 0);
+    }
+
+    SECTION("new size clears cached results")
+    {
+        PubKeyUtils::setVerifySigCacheSize(2048);
+        CHECK(PubKeyUtils::verifySig(pk, sig, msg));
+        PubKeyUtils::flushVerifySigCacheCounts(hits, misses, ignores);
+        CHECK(hits == 0);
+        CHECK(misses == 1);
+    }
+
+    PubKeyUtils::setVerifySigCacheSize(Config().VERIFY_SIG_CACHE_SIZE);
+}
+
 struct SignVerifyTestcase
 {
     SecretKey key;
@@ -352,6 +390,181 @@ TEST_CASE("sign and verify benchmarking", "[crypto-bench][bench][hide]")
     }
 }
 
+static size_t
+verifyConcurrently(std::vector<SignVerifyTestcase> const& cases,
+                   size_t nThreads, size_t passes)
+{
+    std::atomic<size_t> failures(0);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < nThreads; ++t)
+    {
+        threads.emplace_back([&cases, &failures, t, nThreads, passes]()
+                             {
+                                 for (size_t p = 0; p < passes; ++p)
+                                 {
+                                     for (size_t i = t; i < cases.size();
+                                          i += nThreads)
+                                     {
+                                         auto const& c = cases[i];
+                                         if (!PubKeyUtils::verifySig(
+                                                 c.pub, c.sig, c.msg))
+                                         {
+                                             ++failures;
+                                         }
+                                     }
+                                 }
+                             });
+    }
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    return failures;
+}
+
+TEST_CASE("verify signatures from many threads", "[crypto]")
+{
+    std::vector<SignVerifyTestcase> cases;
+    for (size_t i = 0; i < 256; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+
+    PubKeyUtils::clearVerifySigCache();
+    REQUIRE(verifyConcurrently(cases, 8, 4) == 0);
+
+    // Tampered messages must miss the cached results of the originals.
+    for (auto& c : cases)
+    {
+        c.msg[0] ^= 1;
+    }
+    REQUIRE(verifyConcurrently(cases, 8, 2) == cases.size() * 2);
+}
+
+TEST_CASE("concurrent verify benchmarking",
+          "[crypto-bench][bench][hide]")
+{
+    size_t n = 20000;
+    std::vector<SignVerifyTestcase> cases;
+    for (size_t i = 0; i < n; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+
+    size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (size_t nThreads = 1; nThreads <= maxThreads; nThreads *= 2)
+    {
+        PubKeyUtils::clearVerifySigCache();
+        PubKeyUtils::setVerifySigCacheSize(n * 2);
+
+        auto start = std::chrono::steady_clock::now();
+        REQUIRE(verifyConcurrently(cases, nThreads, 1) == 0);
+        auto mid = std::chrono::steady_clock::now();
+        REQUIRE(verifyConcurrently(cases, nThreads, 4) == 0);
+        auto end = std::chrono::steady_clock::now();
+
+        auto coldSecs = std::chrono::duration<double>(mid - start).count();
+        auto warmSecs = std::chrono::duration<double>(end - mid).count();
+        LOG(INFO) << nThreads << " threads: "
+                  << static_cast<uint64_t>(n / coldSecs)
+                  << " verifies/s uncached, "
+                  << static_cast<uint64_t>(n * 4 / warmSecs)
+                  << " verifies/s cached";
+    }
+    PubKeyUtils::setVerifySigCacheSize(Config().VERIFY_SIG_CACHE_SIZE);
+}
+
+TEST_CASE("verify signature batch", "[crypto]")
+{
+    std::vector<SignVerifyTestcase> cases;
+    for (size_t i = 0; i < 16; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+    // corrupt every third signature
+    for (size_t i = 0; i < cases.size(); i += 3)
+    {
+        cases[i].sig[4] ^= 1;
+    }
+
+    std::vector<PubKeyUtils::SigVerifyItem> items;
+    for (auto const& c : cases)
+    {
+        items.emplace_back(c.pub, c.sig, c.msg);
+    }
+    // duplicates are answered consistently
+    items.emplace_back(cases[0].pub, cases[0].sig, cases[0].msg);
+    items.emplace_back(cases[1].pub, cases[1].sig, cases[1].msg);
+
+    PubKeyUtils::clearVerifySigCache();
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        auto res = PubKeyUtils::verifySigBatch(items);
+        REQUIRE(res.size() == items.size());
+        for (size_t i = 0; i < cases.size(); ++i)
+        {
+            CHECK(res[i] == (i % 3 != 0));
+            CHECK(res[i] ==
+                  PubKeyUtils::verifySig(cases[i].pub, cases[i].sig,
+                                         cases[i].msg));
+        }
+        CHECK(!res[cases.size()]);
+        CHECK(res[cases.size() + 1]);
+    }
+
+    CHECK(PubKeyUtils::verifySigBatch(nullptr, 0).empty());
+}
+
+TEST_CASE("batch verify benchmarking", "[crypto-bench][bench][hide]")
+{
+    size_t n = 20000;
+    std::vector<SignVerifyTestcase> cases;
+    std::vector<PubKeyUtils::SigVerifyItem> items;
+    for (size_t i = 0; i < n; ++i)
+    {
+        cases.push_back(SignVerifyTestcase::create());
+        cases.back().sign();
+    }
+    for (auto const& c : cases)
+    {
+        items.emplace_back(c.pub, c.sig, c.msg);
+    }
+
+    PubKeyUtils::setVerifySigCacheSize(n * 2);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        auto cached = pass == 0 ? "uncached" : "cached";
+        PubKeyUtils::clearVerifySigCache();
+        if (pass == 1)
+        {
+            PubKeyUtils::verifySigBatch(items);
+        }
+        LOG(INFO) << "Benchmarking " << n << " " << cached << " verifications";
+        {
+            TIMED_SCOPE(timerBlkObj, "per-signature");
+            for (auto& c : cases)
+            {
+                c.verify();
+            }
+        }
+        PubKeyUtils::clearVerifySigCache();
+        if (pass == 1)
+        {
+            PubKeyUtils::verifySigBatch(items);
+        }
+        {
+            TIMED_SCOPE(timerBlkObj, "batch");
+            auto res = PubKeyUtils::verifySigBatch(items);
+            CHECK(static_cast<size_t>(
+                      std::count(res.begin(), res.end(), true)) == n);
+        }
+    }
+    PubKeyUtils::setVerifySigCacheSize(Config().VERIFY_SIG_CACHE_SIZE);
+}
+
 TEST_CASE("StrKey tests", "[crypto]")
 {
     std::regex b32("^([A-Z2-7])+$");
@@ -11,11 +11,45 @@
 #include <type_traits>
 #include <memory>
 #include "util/make_unique.h"
-#include "util/HashOfHash.h"
 #include <mutex>
 #include "main/Config.h"
 #include "util/lrucache.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <unordered_map>
+
+namespace stellar
+{
+// Key of an entry in the signature-verification cache: a 128-bit keyed
+// SipHash digest of (public key, signature, message).
+struct VerifySigCacheKey
+{
+    uint64_t mLow;
+    uint64_t mHigh;
+
+    bool
+    operator==(VerifySigCacheKey const& other) const
+    {
+        return mLow == other.mLow && mHigh == other.mHigh;
+    }
+};
+}
+
+namespace std
+{
+template <> struct hash<stellar::VerifySigCacheKey>
+{
+    size_t
+    operator()(stellar::VerifySigCacheKey const& k) const noexcept
+    {
+        return static_cast<size_t>(k.mLow);
+    }
+};
+}
+
 namespace stellar
 {
 
@@ -25,13 +59,77 @@ namespace stellar
 // to the state of the process; caching its results centrally
 // makes all signature-verification in the program faster and
 // has no effect on correctness.
+//
+// The cache is split into independently-locked shards, selected by the
+// high half of the cache key, so that threads verifying different
+// signatures rarely contend. Keys are computed with SipHash under two
+// process-random keys, which needs no shared hasher state.
+
+static size_t const kVerifySigCacheShards = 16;
+static size_t const kDefaultVerifySigCacheSize = 0xffff;
+
+struct VerifySigCacheShard
+{
+    std::mutex mMutex;
+    std::unique_ptr<cache::lru_cache<VerifySigCacheKey, bool>> mCache;
+};
+
+// Per-shard capacity the shards were last built with; guarded by
+// gVerifySigCacheSizeMutex.
+static std::mutex gVerifySigCacheSizeMutex;
+static size_t gVerifySigCacheShardSize =
+    kDefaultVerifySigCacheSize / kVerifySigCacheShards;
+
+static std::array<VerifySigCacheShard, kVerifySigCacheShards>&
+getVerifySigCacheShards()
+{
+    static std::array<VerifySigCacheShard, kVerifySigCacheShards> shards;
+    static std::once_flag initialized;
+    std::call_once(initialized, []()
+                   {
+                       for (auto& shard : shards)
+                       {
+                           shard.mCache = make_unique<
+                               cache::lru_cache<VerifySigCacheKey, bool>>(
+                               kDefaultVerifySigCacheSize /
+                               kVerifySigCacheShards);
+                       }
+                   });
+    return shards;
+}
+
+static std::atomic<uint64_t> gVerifyCacheHit(0);
+static std::atomic<uint64_t> gVerifyCacheMiss(0);
+static std::atomic<uint64_t> gVerifyCacheIgnore(0);
+
+typedef std::array<unsigned char, crypto_shorthash_KEYBYTES> ShortHashKey;
+
+static std::array<ShortHashKey, 2> const&
+getVerifySigCacheHashKeys()
+{
+    static std::array<ShortHashKey, 2> const keys = []()
+    {
+        std::array<ShortHashKey, 2> k;
+        for (auto& i : k)
+        {
+            randombytes_buf(i.data(), i.size());
+        }
+        return k;
+    }();
+    return keys;
+}
 
-static std::mutex gVerifySigCacheMutex;
-static cache::lru_cache<Hash, bool> gVerifySigCache(0xffff);
-static std::unique_ptr<SHA256> gHasher = SHA256::create();
-static uint64_t gVerifyCacheHit = 0;
-static uint64_t gVerifyCacheMiss = 0;
-static uint64_t gVerifyCacheIgnore = 0;
+static uint64_t
+shortHash(unsigned char const* in, size_t len, ShortHashKey const& key)
+{
+    static_assert(crypto_shorthash_BYTES == sizeof(uint64_t),
+                  "Unexpected short hash length");
+    unsigned char out[crypto_shorthash_BYTES];
+    crypto_shorthash(out, in, len, key.data());
+    uint64_t res;
+    std::memcpy(&res, out, sizeof(res));
+    return res;
+}
 
 static bool
 shouldCacheVerifySig(PublicKey const& key, Signature const& signature,
@@ -40,15 +138,41 @@ shouldCacheVerifySig(PublicKey const& key, Signature const& signature,
     return true;
 }
 
-static Hash
+static VerifySigCacheKey
 verifySigCacheKey(PublicKey const& key, Signature const& signature,
                   ByteSlice const& bin)
 {
-    gHasher->reset();
-    gHasher->add(key.ed25519());
-    gHasher->add(signature);
-    gHasher->add(bin);
-    return gHasher->finish();
+    auto const& keys = getVerifySigCacheHashKeys();
+
+    // The message has arbitrary length, so it is first reduced to a pair
+    // of independently-keyed digests; those are hashed together with the
+    // (fixed-size) key and signature from a stack buffer.
+    uint64_t msgDigest[2] = {shortHash(bin.data(), bin.size(), keys[0]),
+                             shortHash(bin.data(), bin.size(), keys[1])};
+
+    unsigned char buf[crypto_sign_PUBLICKEYBYTES + crypto_sign_BYTES +
+                      sizeof(msgDigest) + 1];
+    size_t sigLen = std::min<size_t>(signature.size(), crypto_sign_BYTES);
+    unsigned char* p = buf;
+    std::memset(buf, 0, sizeof(buf));
+    std::memcpy(p, key.ed25519().data(), crypto_sign_PUBLICKEYBYTES);
+    p += crypto_sign_PUBLICKEYBYTES;
+    std::memcpy(p, signature.data(), sigLen);
+    p += crypto_sign_BYTES;
+    std::memcpy(p, msgDigest, sizeof(msgDigest));
+    p += sizeof(msgDigest);
+    *p = static_cast<unsigned char>(sigLen);
+
+    VerifySigCacheKey k;
+    k.mLow = shortHash(buf, sizeof(buf), keys[0]);
+    k.mHigh = shortHash(buf, sizeof(buf), keys[1]);
+    return k;
+}
+
+static VerifySigCacheShard&
+getVerifySigCacheShard(VerifySigCacheKey const& k)
+{
+    return getVerifySigCacheShards()[k.mHigh % kVerifySigCacheShards];
 }
 
 SecretKey::SecretKey() : mKeyType(KEY_TYPE_ED25519)
@@ -234,21 +358,49 @@ SecretKey::fromBase58Seed(std::string const& base58Seed)
 void
 PubKeyUtils::clearVerifySigCache()
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    gVerifySigCache.clear();
+    for (auto& shard : getVerifySigCacheShards())
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache->clear();
+    }
+}
+
+void
+PubKeyUtils::setVerifySigCacheSize(size_t entries)
+{
+    size_t perShard = std::max<size_t>(1, entries / kVerifySigCacheShards);
+    std::lock_guard<std::mutex> sizeGuard(gVerifySigCacheSizeMutex);
+    if (perShard == gVerifySigCacheShardSize)
+    {
+        // Every Application sets the size from its config; keep the
+        // process-wide cache warm when it does not actually change.
+        return;
+    }
+    gVerifySigCacheShardSize = perShard;
+    for (auto& shard : getVerifySigCacheShards())
+    {
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache =
+            make_unique<cache::lru_cache<VerifySigCacheKey, bool>>(perShard);
+    }
 }
 
 void
 PubKeyUtils::flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses,
                                        uint64_t& ignores)
 {
-    std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-    hits = gVerifyCacheHit;
-    misses = gVerifyCacheMiss;
-    ignores = gVerifyCacheIgnore;
-    gVerifyCacheHit = 0;
-    gVerifyCacheMiss = 0;
-    gVerifyCacheIgnore = 0;
+    hits = gVerifyCacheHit.exchange(0);
+    misses = gVerifyCacheMiss.exchange(0);
+    ignores = gVerifyCacheIgnore.exchange(0);
+}
+
+static bool
+verifySigUncached(PublicKey const& key, Signature const& signature,
+                  ByteSlice const& bin)
+{
+    return (crypto_sign_verify_detached(signature.data(), bin.data(),
+                                        bin.size(),
+                                        key.ed25519().data()) == 0);
 }
 
 bool
@@ -256,16 +408,17 @@ PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
                        ByteSlice const& bin)
 {
     bool shouldCache = shouldCacheVerifySig(key, signature, bin);
-    Hash cacheKey;
+    VerifySigCacheKey cacheKey;
 
     if (shouldCache)
     {
         cacheKey = verifySigCacheKey(key, signature, bin);
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        if (gVerifySigCache.exists(cacheKey))
+        auto& shard = getVerifySigCacheShard(cacheKey);
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        if (shard.mCache->exists(cacheKey))
         {
             ++gVerifyCacheHit;
-            return gVerifySigCache.get(cacheKey);
+            return shard.mCache->get(cacheKey);
         }
         ++gVerifyCacheMiss;
     }
@@ -274,17 +427,108 @@ PubKeyUtils::verifySig(PublicKey const& key, Signature const& signature,
         ++gVerifyCacheIgnore;
     }
 
-    bool ok =
-        (crypto_sign_verify_detached(signature.data(), bin.data(), bin.size(),
-                                     key.ed25519().data()) == 0);
+    bool ok = verifySigUncached(key, signature, bin);
     if (shouldCache)
     {
-        std::lock_guard<std::mutex> guard(gVerifySigCacheMutex);
-        gVerifySigCache.put(cacheKey, ok);
+        auto& shard = getVerifySigCacheShard(cacheKey);
+        std::lock_guard<std::mutex> guard(shard.mMutex);
+        shard.mCache->put(cacheKey, ok);
     }
     return ok;
 }
 
+std::vector<bool>
+PubKeyUtils::verifySigBatch(SigVerifyItem const* items, size_t count)
+{
+    // libsodium has no multi-signature Ed25519 verification, so the batch
+    // gain comes from amortizing the cache: items are bucketed by shard,
+    // each shard is locked once to look up and once to store, and
+    // identical tuples in the batch are only verified once.
+    std::vector<bool> results(count, false);
+    std::vector<VerifySigCacheKey> keys(count);
+    std::vector<bool> cacheable(count, false);
+    std::array<std::vector<size_t>, kVerifySigCacheShards> byShard;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        auto const& item = items[i];
+        if (shouldCacheVerifySig(*item.mKey, *item.mSignature, item.mMessage))
+        {
+            cacheable[i] = true;
+            keys[i] = verifySigCacheKey(*item.mKey, *item.mSignature,
+                                        item.mMessage);
+            byShard[keys[i].mHigh % kVerifySigCacheShards].push_back(i);
+        }
+        else
+        {
+            ++gVerifyCacheIgnore;
+            results[i] = verifySigUncached(*item.mKey, *item.mSignature,
+                                           item.mMessage);
+        }
+    }
+
+    auto& shards = getVerifySigCacheShards();
+    std::vector<size_t> misses;
+    uint64_t hits = 0;
+    for (size_t s = 0; s < kVerifySigCacheShards; ++s)
+    {
+        if (byShard[s].empty())
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(shards[s].mMutex);
+        for (auto i : byShard[s])
+        {
+            if (shards[s].mCache->exists(keys[i]))
+            {
+                ++hits;
+                results[i] = shards[s].mCache->get(keys[i]);
+            }
+            else
+            {
+                misses.push_back(i);
+            }
+        }
+    }
+    gVerifyCacheHit += hits;
+    gVerifyCacheMiss += misses.size();
+
+    // Each miss is checked on its own, so a bad signature only ever
+    // fails its own item.
+    std::unordered_map<VerifySigCacheKey, bool> verified;
+    for (auto i : misses)
+    {
+        auto it = verified.find(keys[i]);
+        if (it == verified.end())
+        {
+            auto const& item = items[i];
+            bool ok = verifySigUncached(*item.mKey, *item.mSignature,
+                                        item.mMessage);
+            it = verified.emplace(keys[i], ok).first;
+        }
+        results[i] = it->second;
+    }
+
+    std::array<std::vector<size_t>, kVerifySigCacheShards> missesByShard;
+    for (auto i : misses)
+    {
+        missesByShard[keys[i].mHigh % kVerifySigCacheShards].push_back(i);
+    }
+    for (size_t s = 0; s < kVerifySigCacheShards; ++s)
+    {
+        if (missesByShard[s].empty())
+        {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(shards[s].mMutex);
+        for (auto i : missesByShard[s])
+        {
+            shards[s].mCache->put(keys[i], results[i]);
+        }
+    }
+    return results;
+}
+
 std::string
 PubKeyUtils::toShortString(PublicKey const& pk)
 {
@@ -5,17 +5,17 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "xdr/Stellar-types.h"
+#include "crypto/ByteSlice.h"
 #include <ostream>
 #include <functional>
 #include <array>
+#include <vector>
 
 namespace stellar
 {
 
 using xdr::operator==;
 
-class ByteSlice;
-
 class SecretKey
 {
     using uint512 = xdr::opaque_array<64>;
@@ -80,7 +80,37 @@ namespace PubKeyUtils
 bool verifySig(PublicKey const& key, Signature const& signature,
                ByteSlice const& bin);
 
+// One (key, signature, message) tuple of a batch verification. The
+// referenced key, signature and message bytes must outlive the call.
+struct SigVerifyItem
+{
+    PublicKey const* mKey;
+    Signature const* mSignature;
+    ByteSlice mMessage;
+
+    SigVerifyItem(PublicKey const& key, Signature const& signature,
+                  ByteSlice const& message)
+        : mKey(&key), mSignature(&signature), mMessage(message)
+    {
+    }
+};
+
+// Verify `count` signatures starting at `items`; result i is what
+// verifySig would return for items[i]. The verification cache is probed
+// and updated once per shard for the whole batch and duplicate tuples
+// are verified only once.
+std::vector<bool> verifySigBatch(SigVerifyItem const* items, size_t count);
+
+inline std::vector<bool>
+verifySigBatch(std::vector<SigVerifyItem> const& items)
+{
+    return verifySigBatch(items.data(), items.size());
+}
+
 void clearVerifySigCache();
+// Resize (and clear) the process-wide signature-verification cache; does
+// nothing if it already has that size.
+void setVerifySigCacheSize(size_t entries);
 void flushVerifySigCacheCounts(uint64_t& hits, uint64_t& misses,
                                uint64_t& ignores);
 
@@ -22,8 +22,13 @@
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "medida/counter.h"
+#include "medida/meter.h"
 
+#include <soci-sqlite3.h>
+
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
 #include <vector>
 #include <sstream>
 #include <thread>
@@ -45,7 +50,53 @@ using namespace std;
 
 bool Database::gDriversRegistered = false;
 
-static unsigned long const SCHEMA_VERSION = 1;
+static unsigned long const SCHEMA_VERSION = 3;
+
+size_t const Database::kEntryCacheSize = 4096;
+
+// Process-wide table of registered statement texts. IDs are handed out in
+// registration order and never reused, so they are valid indexes into the
+// per-Database statement vector of every Database in the process.
+struct StatementRegistry
+{
+    std::mutex mLock;
+    std::vector<std::string> mQueries;
+    std::unordered_map<std::string, StatementID> mIDs;
+};
+
+static StatementRegistry&
+getStatementRegistry()
+{
+    static StatementRegistry registry;
+    return registry;
+}
+
+static std::string
+getRegisteredStatement(StatementID id)
+{
+    auto& reg = getStatementRegistry();
+    std::lock_guard<std::mutex> lock(reg.mLock);
+    assert(id < reg.mQueries.size());
+    return reg.mQueries[id];
+}
+
+StatementContext::~StatementContext()
+{
+    if (mStmt)
+    {
+        // An sqlite statement that was stepped but not run to completion
+        // keeps its cursor (and read lock) open until reset; reset it here
+        // rather than on next use so idle cached statements never conflict
+        // with a COMMIT.
+        auto be = dynamic_cast<soci::sqlite3_statement_backend*>(
+            mStmt->get_backend());
+        if (be && be->stmt_)
+        {
+            sqlite_api::sqlite3_reset(be->stmt_);
+        }
+        mStmt->clean_up(false);
+    }
+}
 
 static void
 setSerializable(soci::session& sess)
@@ -54,6 +105,15 @@ setSerializable(soci::session& sess)
             "SERIALIZABLE";
 }
 
+static void
+setTransactionReadOnly(soci::session& sess, bool sqlite)
+{
+    if (!sqlite)
+    {
+        sess << "SET TRANSACTION READ ONLY";
+    }
+}
+
 void
 Database::registerDrivers()
 {
@@ -73,7 +133,12 @@ Database::Database(Application& app)
           app.getMetrics().NewMeter({"database", "query", "exec"}, "query"))
     , mStatementsSize(
           app.getMetrics().NewCounter({"database", "memory", "statements"}))
-    , mEntryCache(4096)
+    , mStatementPrepares(app.getMetrics().NewMeter(
+          {"database", "statement", "prepare"}, "statement"))
+    , mPrepareCount(0)
+    , mEntryCache(kEntryCacheSize)
+    , mEntryCacheHits(0)
+    , mEntryCacheMisses(0)
     , mExcludedQueryTime(0)
     , mExcludedTotalTime(0)
     , mLastIdleQueryTime(0)
@@ -97,7 +162,14 @@ applySchemaUpgrade(Database& db, unsigned long vers)
 {
     switch (vers)
     {
-    case SCHEMA_VERSION:
+    case 2:
+        // inflation votes are tallied as accounts are stored
+        AccountFrame::initializeInflationVotes(db);
+        break;
+
+    case 3:
+        // accounts load their signers from a packed column
+        AccountFrame::initializeInlineSigners(db);
         break;
 
     default:
@@ -164,7 +236,10 @@ Database::getAppSchemaVersion()
 medida::TimerContext
 Database::getInsertTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "insert", entityName})
@@ -174,7 +249,10 @@ Database::getInsertTimer(std::string const& entityName)
 medida::TimerContext
 Database::getSelectTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "select", entityName})
@@ -184,7 +262,10 @@ Database::getSelectTimer(std::string const& entityName)
 medida::TimerContext
 Database::getDeleteTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "delete", entityName})
@@ -194,7 +275,10 @@ Database::getDeleteTimer(std::string const& entityName)
 medida::TimerContext
 Database::getUpdateTimer(std::string const& entityName)
 {
-    mEntityTypes.insert(entityName);
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        mEntityTypes.insert(entityName);
+    }
     mQueryMeter.Mark();
     return mApp.getMetrics()
         .NewTimer({"database", "update", entityName})
@@ -225,17 +309,96 @@ Database::canUsePool() const
     return !(mApp.getConfig().DATABASE == ("sqlite3://:memory:"));
 }
 
+bool
+Database::isMainSession(soci::session const& sess) const
+{
+    return &sess == &mSession;
+}
+
+void
+Database::postReadQuery(std::string const& name,
+                        std::function<void(soci::session&)> query,
+                        std::function<void(std::exception_ptr)> handler)
+{
+    auto& queueTimer =
+        mApp.getMetrics().NewTimer({"database", "read-query", "queue"});
+    auto& execTimer =
+        mApp.getMetrics().NewTimer({"database", "read-query", name});
+    bool sqlite = isSqlite();
+
+    if (!canUsePool())
+    {
+        mApp.getClock().post(
+            CrankStats::ORIGIN_DATABASE,
+            [this, query, handler, &execTimer]()
+            {
+                std::exception_ptr ep;
+                try
+                {
+                    auto timer = execTimer.TimeScope();
+                    soci::transaction tx(mSession);
+                    query(mSession);
+                    tx.commit();
+                }
+                catch (...)
+                {
+                    ep = std::current_exception();
+                }
+                handler(ep);
+            });
+        return;
+    }
+
+    // Pool construction is not thread safe, so make sure it happens here.
+    soci::connection_pool& pool = getPool();
+    Application& app = mApp;
+    auto posted = std::chrono::steady_clock::now();
+    mApp.getWorkerIOService().post(
+        [&app, &pool, &queueTimer, &execTimer, sqlite, posted, query,
+         handler]()
+        {
+            queueTimer.Update(std::chrono::steady_clock::now() - posted);
+            std::exception_ptr ep;
+            try
+            {
+                auto timer = execTimer.TimeScope();
+                soci::session sess(pool);
+                soci::transaction tx(sess);
+                setTransactionReadOnly(sess, sqlite);
+                query(sess);
+                tx.commit();
+            }
+            catch (...)
+            {
+                ep = std::current_exception();
+            }
+            app.getClock().post(CrankStats::ORIGIN_DATABASE, [handler, ep]()
+                                {
+                                    handler(ep);
+                                });
+        });
+}
+
 void
 Database::clearPreparedStatementCache()
 {
     // Flush all prepared statements; in sqlite they represent open cursors
     // and will conflict with any DROP TABLE commands issued below
-    for (auto st : mStatements)
+    for (auto& st : mStatements)
     {
-        st.second->clean_up(true);
+        if (st)
+        {
+            st->clean_up(true);
+        }
     }
     mStatements.clear();
-    mStatementsSize.set_count(mStatements.size());
+    mStatementsSize.set_count(0);
+}
+
+uint64_t
+Database::getStatementPrepareCount() const
+{
+    return mPrepareCount;
 }
 
 void
@@ -299,6 +462,24 @@ Database::getEntryCache()
     return mEntryCache;
 }
 
+void
+Database::recordEntryCacheLookup(bool hit)
+{
+    ++(hit ? mEntryCacheHits : mEntryCacheMisses);
+}
+
+uint64_t
+Database::getEntryCacheHits() const
+{
+    return mEntryCacheHits;
+}
+
+uint64_t
+Database::getEntryCacheMisses() const
+{
+    return mEntryCacheMisses;
+}
+
 class SQLLogContext : NonCopyable
 {
     std::string mName;
@@ -335,27 +516,64 @@ class SQLLogContext : NonCopyable
     }
 };
 
+StatementID
+Database::registerStatement(std::string const& query)
+{
+    auto& reg = getStatementRegistry();
+    std::lock_guard<std::mutex> lock(reg.mLock);
+    auto i = reg.mIDs.find(query);
+    if (i != reg.mIDs.end())
+    {
+        return i->second;
+    }
+    StatementID id = reg.mQueries.size();
+    reg.mQueries.push_back(query);
+    reg.mIDs.insert(std::make_pair(query, id));
+    return id;
+}
+
 StatementContext
-Database::getPreparedStatement(std::string const& query)
+Database::getPreparedStatement(StatementID id)
 {
-    auto i = mStatements.find(query);
-    std::shared_ptr<soci::statement> p;
-    if (i == mStatements.end())
+    if (id >= mStatements.size())
+    {
+        mStatements.resize(id + 1);
+    }
+    auto p = mStatements[id];
+    if (!p)
     {
         p = std::make_shared<soci::statement>(mSession);
         p->alloc();
-        p->prepare(query);
-        mStatements.insert(std::make_pair(query, p));
-        mStatementsSize.set_count(mStatements.size());
+        p->prepare(getRegisteredStatement(id));
+        mStatements[id] = p;
+        ++mPrepareCount;
+        mStatementPrepares.Mark();
+        mStatementsSize.inc();
     }
-    else
+    StatementContext sc(p);
+    return sc;
+}
+
+StatementContext
+Database::getPreparedStatement(StatementID id, soci::session& sess)
+{
+    if (isMainSession(sess))
     {
-        p = i->second;
+        return getPreparedStatement(id);
     }
+    auto p = std::make_shared<soci::statement>(sess);
+    p->alloc();
+    p->prepare(getRegisteredStatement(id));
     StatementContext sc(p);
     return sc;
 }
 
+StatementContext
+Database::getPreparedStatement(std::string const& query)
+{
+    return getPreparedStatement(registerStatement(query));
+}
+
 std::shared_ptr<SQLLogContext>
 Database::captureAndLogSQL(std::string contextName)
 {
@@ -373,9 +591,14 @@ Database::totalQueryTime() const
 {
     std::vector<std::string> qtypes = {"insert", "delete", "select", "update"};
     std::chrono::nanoseconds nsq(0);
+    std::set<std::string> entityTypes;
+    {
+        std::lock_guard<std::mutex> lock(mEntityTypesMutex);
+        entityTypes = mEntityTypes;
+    }
     for (auto const& q : qtypes)
     {
-        for (auto const& e : mEntityTypes)
+        for (auto const& e : entityTypes)
         {
             auto& timer = mApp.getMetrics().NewTimer({"database", q, e});
             uint64_t sumns = static_cast<uint64_t>(
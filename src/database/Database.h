@@ -4,8 +4,12 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
 #include <set>
+#include <vector>
 #include <soci.h>
 #include "overlay/StellarXDR.h"
 #include "ledger/AccountFrame.h"
@@ -28,6 +32,13 @@ namespace stellar
 class Application;
 class SQLLogContext;
 
+/**
+ * Stable, process-wide handle for an SQL statement registered through
+ * Database::registerStatement. It is used as a direct index into each
+ * Database's table of prepared statements.
+ */
+typedef size_t StatementID;
+
 /**
  * Helper class for borrowing a SOCI prepared statement handle into a local
  * scope and cleaning it up once done with it. Returned by
@@ -47,13 +58,9 @@ class StatementContext : NonCopyable
         mStmt = other.mStmt;
         other.mStmt.reset();
     }
-    ~StatementContext()
-    {
-        if (mStmt)
-        {
-            mStmt->clean_up(false);
-        }
-    }
+    // Unbinds the statement and resets any open cursor on it, so that the
+    // (cached) statement holds no locks while it sits idle in the cache.
+    ~StatementContext();
     soci::statement&
     statement()
     {
@@ -92,14 +99,22 @@ class Database : NonMovableOrCopyable
     soci::session mSession;
     std::unique_ptr<soci::connection_pool> mPool;
 
-    std::map<std::string, std::shared_ptr<soci::statement>> mStatements;
+    // Prepared statements, indexed by StatementID. Entries are prepared
+    // lazily on first use and then kept for the lifetime of the session.
+    std::vector<std::shared_ptr<soci::statement>> mStatements;
     medida::Counter& mStatementsSize;
+    medida::Meter& mStatementPrepares;
+    uint64_t mPrepareCount;
 
     cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
         mEntryCache;
+    uint64_t mEntryCacheHits;
+    uint64_t mEntryCacheMisses;
 
     // Helpers for maintaining the total query time and calculating
-    // idle percentage.
+    // idle percentage. mEntityTypes is also touched by queries running on
+    // worker threads, hence the lock.
+    mutable std::mutex mEntityTypesMutex;
     std::set<std::string> mEntityTypes;
     std::chrono::nanoseconds mExcludedQueryTime;
     std::chrono::nanoseconds mExcludedTotalTime;
@@ -138,16 +153,37 @@ class Database : NonMovableOrCopyable
     // to the process' log for diagnostics. For testing and perf tuning.
     std::shared_ptr<SQLLogContext> captureAndLogSQL(std::string contextName);
 
+    // Register `query` in the process-wide statement table and return its
+    // stable StatementID. Registering the same text twice returns the same
+    // ID. Hot-path callers register their statements once (typically in a
+    // function-local static) and then borrow them by ID.
+    static StatementID registerStatement(std::string const& query);
+
     // Return a helper object that borrows, from the Database, a prepared
-    // statement handle for the provided query. The prepared statement handle
-    // is ceated if necessary before borrowing, and reset (unbound from data)
-    // when the statement context is destroyed.
+    // statement handle for the provided statement. The prepared statement
+    // handle is created if necessary before borrowing, and reset (unbound
+    // from data) when the statement context is destroyed. Handles stay
+    // prepared across SQL transactions and ledger closes.
+    StatementContext getPreparedStatement(StatementID id);
+
+    // As above, but for an arbitrary session. Statements for the main
+    // session come from the cache; statements for any other session (eg. a
+    // connection-pool session on a worker thread) are prepared afresh and
+    // released with the returned context.
+    StatementContext getPreparedStatement(StatementID id,
+                                          soci::session& sess);
+
+    // As above, but resolves the query text through registerStatement on
+    // each call. Prefer the StatementID overload on hot paths.
     StatementContext getPreparedStatement(std::string const& query);
 
     // Purge all cached prepared statements, closing their handles with the
-    // database.
+    // database. This is only needed before schema changes (DROP TABLE).
     void clearPreparedStatementCache();
 
+    // Number of statements prepared on the main session since startup.
+    uint64_t getStatementPrepareCount() const;
+
     // Return metric-gathering timers for various families of SQL operation.
     // These timers automatically count the time they are alive for,
     // so only acquire them immediately before executing an SQL statement.
@@ -168,6 +204,23 @@ class Database : NonMovableOrCopyable
     // to read from the database through, otherwise false.
     bool canUsePool() const;
 
+    // Return true if `sess` is the main session (as opposed to a session
+    // borrowed from the connection pool). Safe to call from any thread.
+    bool isMainSession(soci::session const& sess) const;
+
+    // Run `query` against a connection-pool session, inside a read-only
+    // snapshot transaction, on a worker thread; then post `handler` back to
+    // the main thread, passing any exception `query` raised (or nullptr).
+    // `query` must not touch main-thread state; results should be passed
+    // back through its captures. When !canUsePool() both run on the main
+    // thread against the main session, from a posted handler.
+    //
+    // Execution time is recorded in the timer database.read-query.<name>,
+    // and the time spent waiting for a worker in database.read-query.queue.
+    void postReadQuery(std::string const& name,
+                       std::function<void(soci::session&)> query,
+                       std::function<void(std::exception_ptr)> handler);
+
     // Drop and recreate all tables in the database target. This is called
     // by the --newdb command-line flag on stellar-core.
     void initialize();
@@ -197,6 +250,13 @@ class Database : NonMovableOrCopyable
     typedef cache::lru_cache<std::string, std::shared_ptr<LedgerEntry const>>
         EntryCache;
     EntryCache& getEntryCache();
+    static size_t const kEntryCacheSize;
+
+    // Running counts of entry cache lookups (EntryFrame::cachedEntryExists)
+    // that found, or did not find, the entry. Main thread only.
+    void recordEntryCacheLookup(bool hit);
+    uint64_t getEntryCacheHits() const;
+    uint64_t getEntryCacheMisses() const;
 };
 
 class DBTimeExcluder : NonCopyable
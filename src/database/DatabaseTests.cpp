@@ -8,6 +8,7 @@
 #include "main/Config.h"
 #include "main/test.h"
 #include "crypto/Hex.h"
+#include "util/GlobalChecks.h"
 #include "util/Logging.h"
 #include "util/Timer.h"
 #include "util/TmpDir.h"
@@ -338,3 +339,108 @@ TEST_CASE("schema test", "[db]")
     auto av = db.getAppSchemaVersion();
     REQUIRE(dbv == av);
 }
+
+TEST_CASE("prepared statements persist across transactions", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    session << "DROP TABLE IF EXISTS test";
+    session << "CREATE TABLE test (x INTEGER)";
+    session << "INSERT INTO test (x) VALUES (1)";
+    session << "INSERT INTO test (x) VALUES (2)";
+
+    static StatementID const selectStmt =
+        Database::registerStatement("SELECT x FROM test ORDER BY x");
+    REQUIRE(Database::registerStatement("SELECT x FROM test ORDER BY x") ==
+            selectStmt);
+
+    auto before = db.getStatementPrepareCount();
+    for (int i = 0; i < 10; ++i)
+    {
+        soci::transaction tx(session);
+        int x = 0;
+        {
+            // Only step the first row, leaving the cursor open until the
+            // statement context resets it.
+            auto prep = db.getPreparedStatement(selectStmt);
+            auto& st = prep.statement();
+            st.exchange(soci::into(x));
+            st.define_and_bind();
+            st.execute(true);
+            REQUIRE(st.got_data());
+        }
+        CHECK(x == 1);
+        session << "UPDATE test SET x = x + 0";
+        tx.commit();
+    }
+    CHECK(db.getStatementPrepareCount() == before + 1);
+
+    db.clearPreparedStatementCache();
+    {
+        auto prep = db.getPreparedStatement(selectStmt);
+    }
+    CHECK(db.getStatementPrepareCount() == before + 2);
+}
+
+TEST_CASE("read queries run on pool sessions", "[db]")
+{
+    Config const& cfg = getTestConfig(0, Config::TESTDB_ON_DISK_SQLITE);
+
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    auto& db = app->getDatabase();
+    auto& session = db.getSession();
+
+    session << "DROP TABLE IF EXISTS test";
+    session << "CREATE TABLE test (x INTEGER)";
+    session << "INSERT INTO test (x) VALUES (7)";
+
+    SECTION("results are delivered on the main thread")
+    {
+        auto x = std::make_shared<int>(0);
+        auto onPool = std::make_shared<bool>(false);
+        bool done = false;
+        db.postReadQuery("test",
+                         [x, onPool, &db](soci::session& sess)
+                         {
+                             *onPool = !db.isMainSession(sess);
+                             sess << "SELECT x FROM test", soci::into(*x);
+                         },
+                         [&done](std::exception_ptr ep)
+                         {
+                             assertThreadIsMain();
+                             CHECK(!ep);
+                             done = true;
+                         });
+        while (!done)
+        {
+            clock.crank(false);
+        }
+        CHECK(*onPool);
+        CHECK(*x == 7);
+    }
+
+    SECTION("errors are delivered on the main thread")
+    {
+        bool done = false;
+        db.postReadQuery("test",
+                         [](soci::session& sess)
+                         {
+                             sess << "SELECT x FROM no_such_table";
+                         },
+                         [&done](std::exception_ptr ep)
+                         {
+                             CHECK(ep);
+                             done = true;
+                         });
+        while (!done)
+        {
+            clock.crank(false);
+        }
+    }
+}
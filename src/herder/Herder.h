@@ -82,6 +82,12 @@ class Herder
     virtual void recvTxSet(Hash hash, TxSetFrame const& txset) = 0;
     // We are learning about a new transaction.
     virtual TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) = 0;
+    // We are learning about many transactions at once: same as calling
+    // recvTransaction on each of them in order, but within one database
+    // transaction, with their source accounts loaded and their signatures
+    // verified in batches. Returns the status of each.
+    virtual std::vector<TransactionSubmitStatus>
+    recvTransactions(std::vector<TransactionFramePtr> const& txs) = 0;
     virtual void peerDoesntHave(stellar::MessageType type,
                                 uint256 const& itemID, PeerPtr peer) = 0;
     virtual TxSetFramePtr getTxSet(Hash hash) = 0;
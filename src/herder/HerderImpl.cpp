@@ -7,6 +7,7 @@
 #include "crypto/SHA.h"
 #include "herder/TxSetFrame.h"
 #include "herder/LedgerCloseData.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerManager.h"
 #include "main/Application.h"
 #include "main/Config.h"
@@ -48,6 +49,8 @@ HerderImpl::SCPMetrics::SCPMetrics(Application& app)
           app.getMetrics().NewMeter({"scp", "value", "nominating"}, "value"))
     , mValueExternalize(
           app.getMetrics().NewMeter({"scp", "value", "externalize"}, "value"))
+    , mExternalizeLatency(
+          app.getMetrics().NewTimer({"scp", "timing", "externalized"}))
     , mUpdatedCandidate(
           app.getMetrics().NewMeter({"scp", "value", "candidate"}, "value"))
     , mStartBallotProtocol(
@@ -524,6 +527,11 @@ HerderImpl::valueExternalized(uint64 slotIndex, Value const& value)
 {
     updateSCPCounters();
     mSCPMetrics.mValueExternalize.Mark();
+    if (slotIndex == mLastTriggerSlot)
+    {
+        mSCPMetrics.mExternalizeLatency.Update(mApp.getClock().now() -
+                                               mLastTrigger);
+    }
     mSCPTimers.erase(slotIndex); // cancels all timers for this slot
     StellarValue b;
     try
@@ -761,8 +769,8 @@ HerderImpl::combineCandidates(uint64 slotIndex,
                                 << " invalid transactions";
 
         // post to avoid triggering SCP handling code recursively
-        mApp.getClock().getIOService().post(
-            [this, bestTxSet]()
+        mApp.getClock().post(
+            CrankStats::ORIGIN_HERDER, [this, bestTxSet]()
             {
                 mPendingEnvelopes.recvTxSet(bestTxSet->getContentsHash(),
                                             bestTxSet);
@@ -868,23 +876,6 @@ HerderImpl::emitEnvelope(SCPEnvelope const& envelope)
     startRebroadcastTimer();
 }
 
-bool
-HerderImpl::recvTransactions(TxSetFramePtr txSet)
-{
-    soci::transaction sqltx(mApp.getDatabase().getSession());
-    //mApp.getDatabase().setCurrentTransactionReadOnly();
-
-    bool allGood = true;
-    for (auto tx : txSet->sortForApply())
-    {
-        if (recvTransaction(tx) != TX_STATUS_PENDING)
-        {
-            allGood = false;
-        }
-    }
-    return allGood;
-}
-
 void
 HerderImpl::TxMap::addTx(TransactionFramePtr tx)
 {
@@ -913,9 +904,59 @@ HerderImpl::TxMap::recalculate()
 Herder::TransactionSubmitStatus
 HerderImpl::recvTransaction(TransactionFramePtr tx)
 {
+    CrankTag crankTag(mApp.getClock().getCrankStats(),
+                      CrankStats::ORIGIN_HERDER);
     soci::transaction sqltx(mApp.getDatabase().getSession());
     //mApp.getDatabase().setCurrentTransactionReadOnly();
 
+    return addTransaction(tx);
+}
+
+std::vector<Herder::TransactionSubmitStatus>
+HerderImpl::recvTransactions(std::vector<TransactionFramePtr> const& txs)
+{
+    CrankTag crankTag(mApp.getClock().getCrankStats(),
+                      CrankStats::ORIGIN_HERDER);
+    auto& db = mApp.getDatabase();
+    soci::transaction sqltx(db.getSession());
+
+    // load the source accounts with a few queries and verify every
+    // signature that may count in one batch, so that checkValid below
+    // is served by the entry and verification caches
+    std::vector<AccountID> ids;
+    ids.reserve(txs.size());
+    for (auto const& tx : txs)
+    {
+        ids.emplace_back(tx->getSourceID());
+    }
+    AccountFrame::prefetch(ids, db);
+
+    // items point into the accounts, which must stay alive for the batch
+    std::vector<AccountFrame::pointer> accounts;
+    std::vector<PubKeyUtils::SigVerifyItem> items;
+    for (auto const& tx : txs)
+    {
+        auto account = tx->loadAccount(db, tx->getSourceID());
+        if (account)
+        {
+            tx->collectSignatures(*account, items);
+            accounts.emplace_back(account);
+        }
+    }
+    PubKeyUtils::verifySigBatch(items);
+
+    std::vector<TransactionSubmitStatus> statuses;
+    statuses.reserve(txs.size());
+    for (auto const& tx : txs)
+    {
+        statuses.emplace_back(addTransaction(tx));
+    }
+    return statuses;
+}
+
+Herder::TransactionSubmitStatus
+HerderImpl::addTransaction(TransactionFramePtr tx)
+{
     auto const& acc = tx->getSourceID();
     auto const& txID = tx->getFullHash();
 
@@ -963,6 +1004,8 @@ HerderImpl::recvTransaction(TransactionFramePtr tx)
 void
 HerderImpl::recvSCPEnvelope(SCPEnvelope const& envelope)
 {
+    CrankTag crankTag(mApp.getClock().getCrankStats(),
+                      CrankStats::ORIGIN_HERDER);
     if (mApp.getConfig().MANUAL_CLOSE)
     {
         return;
@@ -1072,6 +1115,12 @@ HerderImpl::processSCPQueue()
     }
 }
 
+bool
+HerderImpl::isSlotBehind(uint64 slotIndex) const
+{
+    return mTrackingSCP && slotIndex < nextConsensusLedgerIndex();
+}
+
 void
 HerderImpl::processSCPQueueAtIndex(uint64 slotIndex)
 {
@@ -1328,6 +1377,7 @@ HerderImpl::triggerNextLedger(uint32_t ledgerSeqToTrigger)
 
     // We store at which time we triggered consensus
     mLastTrigger = mApp.getClock().now();
+    mLastTriggerSlot = slotIndex;
 
     // We pick as next close time the current time unless it's before the last
     // close time. We don't know how much time it will take to reach consensus
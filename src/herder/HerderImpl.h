@@ -59,6 +59,8 @@ class HerderImpl : public Herder, public SCPDriver
     // SCP methods
 
     void signEnvelope(SCPEnvelope& envelope) override;
+    // answered from the signature-verification cache for the envelopes
+    // PendingEnvelopes checked as they came in
     bool verifyEnvelope(SCPEnvelope const& envelope) override;
 
     bool validateValue(uint64 slotIndex, Value const& value) override;
@@ -83,7 +85,6 @@ class HerderImpl : public Herder, public SCPDriver
                     std::function<void()> cb) override;
 
     void emitEnvelope(SCPEnvelope const& envelope) override;
-    bool recvTransactions(TxSetFramePtr txSet);
     // Extra SCP methods overridden solely to increment metrics.
     void updatedCandidateValue(uint64 slotIndex, Value const& value) override;
     void startedBallotProtocol(uint64 slotIndex,
@@ -95,6 +96,8 @@ class HerderImpl : public Herder, public SCPDriver
     void acceptedCommit(uint64 slotIndex, SCPBallot const& ballot) override;
 
     TransactionSubmitStatus recvTransaction(TransactionFramePtr tx) override;
+    std::vector<TransactionSubmitStatus>
+    recvTransactions(std::vector<TransactionFramePtr> const& txs) override;
 
     void recvSCPEnvelope(SCPEnvelope const& envelope) override;
 
@@ -109,6 +112,9 @@ class HerderImpl : public Herder, public SCPDriver
 
     void processSCPQueue();
 
+    // returns true if we are tracking consensus and have moved past slotIndex
+    bool isSlotBehind(uint64 slotIndex) const;
+
     uint32_t getCurrentLedgerSeq() const override;
 
     SequenceNumber getMaxSeqInPendingTxs(AccountID const&) override;
@@ -134,6 +140,9 @@ class HerderImpl : public Herder, public SCPDriver
     void ledgerClosed();
     void removeReceivedTxs(std::vector<TransactionFramePtr> const& txs);
 
+    // recvTransaction, within the caller's database transaction
+    TransactionSubmitStatus addTransaction(TransactionFramePtr tx);
+
     // returns true if upgrade is a valid upgrade step
     // in which case it also sets upgradeType
     bool validateUpgradeStep(uint64 slotIndex, UpgradeType const& upgrade,
@@ -212,6 +221,7 @@ class HerderImpl : public Herder, public SCPDriver
     void trackingHeartBeat();
 
     VirtualClock::time_point mLastTrigger;
+    uint64 mLastTriggerSlot{0};
     VirtualTimer mTriggerTimer;
 
     VirtualTimer mRebroadcastTimer;
@@ -230,6 +240,8 @@ class HerderImpl : public Herder, public SCPDriver
         medida::Meter& mValueInvalid;
         medida::Meter& mNominatingValue;
         medida::Meter& mValueExternalize;
+        // time from triggering a ledger to externalizing it
+        medida::Timer& mExternalizeLatency;
 
         medida::Meter& mUpdatedCandidate;
         medida::Meter& mStartBallotProtocol;
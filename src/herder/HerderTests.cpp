@@ -159,6 +159,44 @@ TEST_CASE("recvTx", "[herder]")
 {
 }
 
+TEST_CASE("recvTransactions", "[herder]")
+{
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, getTestConfig());
+    app->start();
+
+    Hash const& networkID = app->getNetworkID();
+    SecretKey root = getRoot(networkID);
+    SecretKey a1 = getAccount("A");
+    SecretKey b1 = getAccount("B");
+    const int64_t paymentAmount = app->getLedgerManager().getMinBalance(0);
+    SequenceNumber rootSeq = getAccountSeqNum(root, *app) + 1;
+
+    auto createA1 =
+        createCreateAccountTx(networkID, root, a1, rootSeq, paymentAmount);
+    auto createB1 =
+        createCreateAccountTx(networkID, root, b1, rootSeq + 1, paymentAmount);
+    auto badSeq =
+        createCreateAccountTx(networkID, root, b1, rootSeq + 5, paymentAmount);
+    auto noAccount = createPaymentTx(networkID, a1, root, 1, paymentAmount);
+    auto duplicate = TransactionFrame::makeTransactionFromWire(
+        networkID, createA1->getEnvelope());
+
+    // in order, as if received one at a time
+    auto statuses = app->getHerder().recvTransactions(
+        {createA1, createB1, duplicate, badSeq, noAccount});
+    REQUIRE(statuses.size() == 5);
+    REQUIRE(statuses[0] == Herder::TX_STATUS_PENDING);
+    REQUIRE(statuses[1] == Herder::TX_STATUS_PENDING);
+    REQUIRE(statuses[2] == Herder::TX_STATUS_DUPLICATE);
+    REQUIRE(statuses[3] == Herder::TX_STATUS_ERROR);
+    REQUIRE(badSeq->getResultCode() == txBAD_SEQ);
+    REQUIRE(statuses[4] == Herder::TX_STATUS_ERROR);
+    REQUIRE(noAccount->getResultCode() == txNO_ACCOUNT);
+
+    REQUIRE(app->getHerder().recvTransactions({}).empty());
+}
+
 TEST_CASE("txset", "[herder]")
 {
     Config cfg(getTestConfig());
@@ -560,6 +598,204 @@ TEST_CASE("SCP Driver", "[herder]")
     }
 }
 
+TEST_CASE("pending envelopes", "[herder]")
+{
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, getTestConfig());
+    app->start();
+
+    Hash const& networkID = app->getNetworkID();
+    auto& herder = *static_cast<HerderImpl*>(&app->getHerder());
+    auto const& lcl = app->getLedgerManager().getLastClosedLedgerHeader();
+
+    auto& metrics = app->getMetrics();
+    auto& fetching =
+        metrics.NewCounter({"scp", "memory", "fetching-envelopes"});
+    auto& duplicate =
+        metrics.NewMeter({"scp", "envelope", "duplicate"}, "envelope");
+    auto& dropped =
+        metrics.NewMeter({"scp", "envelope", "dropped"}, "envelope");
+    auto& invalidSig =
+        metrics.NewMeter({"scp", "envelope", "invalidsig"}, "envelope");
+    auto& verifying =
+        metrics.NewCounter({"scp", "memory", "verifying-envelopes"});
+
+    // a node outside of our quorum set, nominating a tx set we don't have
+    SecretKey node = SecretKey::random();
+    SCPQuorumSet qset;
+    qset.threshold = 1;
+    qset.validators.emplace_back(node.getPublicKey());
+    Hash qSetHash = sha256(xdr::xdr_to_opaque(qset));
+    herder.recvSCPQuorumSet(qSetHash, qset);
+
+    SecretKey root = getRoot(networkID);
+    SecretKey a1 = getAccount("A");
+    TxSetFramePtr txSet = std::make_shared<TxSetFrame>(lcl.hash);
+    txSet->add(createCreateAccountTx(networkID, root, a1,
+                                     getAccountSeqNum(root, *app) + 1,
+                                     10000000));
+    Hash txSetHash = txSet->getContentsHash();
+
+    auto nominate = [&](uint64_t closeTime)
+    {
+        StellarValue sv(txSetHash, closeTime, emptyUpgradeSteps, 0);
+        SCPEnvelope envelope;
+        auto& st = envelope.statement;
+        st.slotIndex = lcl.header.ledgerSeq + 1;
+        st.pledges.type(SCP_ST_NOMINATE);
+        auto& nom = st.pledges.nominate();
+        nom.votes.emplace_back(xdr::xdr_to_opaque(sv));
+        nom.quorumSetHash = qSetHash;
+        st.nodeID = node.getPublicKey();
+        envelope.signature = node.sign(
+            xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_SCP, st));
+        return envelope;
+    };
+
+    // signatures are checked on the worker threads
+    auto crankUntilVerified = [&]()
+    {
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (verifying.count() != 0 &&
+               std::chrono::steady_clock::now() < deadline)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(verifying.count() == 0);
+    };
+    auto receive = [&](SCPEnvelope const& envelope)
+    {
+        herder.recvSCPEnvelope(envelope);
+        crankUntilVerified();
+    };
+
+    SECTION("copies are dropped")
+    {
+        auto envelope = nominate(1);
+        herder.recvSCPEnvelope(envelope);
+        herder.recvSCPEnvelope(envelope);
+        REQUIRE(verifying.count() == 1);
+        REQUIRE(duplicate.count() == 1);
+        crankUntilVerified();
+        receive(envelope);
+        REQUIRE(fetching.count() == 1);
+        REQUIRE(duplicate.count() == 2);
+    }
+
+    SECTION("envelopes are verified off the main thread")
+    {
+        herder.recvSCPEnvelope(nominate(1));
+        herder.recvSCPEnvelope(nominate(2));
+        REQUIRE(verifying.count() == 2);
+        REQUIRE(fetching.count() == 0);
+        crankUntilVerified();
+        REQUIRE(fetching.count() == 2);
+    }
+
+    SECTION("envelopes with a bad signature are dropped")
+    {
+        auto envelope = nominate(1);
+        envelope.signature[0] ^= 1;
+        receive(envelope);
+        REQUIRE(fetching.count() == 0);
+        REQUIRE(invalidSig.count() == 1);
+        receive(envelope);
+        REQUIRE(invalidSig.count() == 2);
+        REQUIRE(duplicate.count() == 0);
+    }
+
+    SECTION("envelopes are bounded per node")
+    {
+        for (uint64_t closeTime = 1; closeTime <= 100; closeTime++)
+        {
+            receive(nominate(closeTime));
+        }
+        REQUIRE(fetching.count() == 50);
+        REQUIRE(dropped.count() == 50);
+    }
+
+    SECTION("envelopes being verified count against the bounds")
+    {
+        for (uint64_t closeTime = 1; closeTime <= 100; closeTime++)
+        {
+            herder.recvSCPEnvelope(nominate(closeTime));
+        }
+        REQUIRE(verifying.count() == 50);
+        REQUIRE(dropped.count() == 50);
+        crankUntilVerified();
+        REQUIRE(fetching.count() == 50);
+        REQUIRE(dropped.count() == 50);
+    }
+
+    SECTION("the tx set completes the envelopes waiting for it")
+    {
+        receive(nominate(1));
+        receive(nominate(2));
+        REQUIRE(fetching.count() == 2);
+        herder.recvTxSet(txSetHash, *txSet);
+        REQUIRE(fetching.count() == 0);
+    }
+}
+
+TEST_CASE("pending envelopes while out of sync", "[herder]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.FORCE_SCP = false;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& herder = app->getHerder();
+    REQUIRE(herder.getState() == Herder::HERDER_SYNCING_STATE);
+
+    auto& metrics = app->getMetrics();
+    auto& fetching =
+        metrics.NewCounter({"scp", "memory", "fetching-envelopes"});
+    auto& dropped =
+        metrics.NewMeter({"scp", "envelope", "dropped"}, "envelope");
+    auto& verifying =
+        metrics.NewCounter({"scp", "memory", "verifying-envelopes"});
+
+    // nominations waiting for a quorum set nobody has
+    SecretKey node = SecretKey::random();
+    auto receive = [&](uint64 slotIndex)
+    {
+        SCPEnvelope envelope;
+        auto& st = envelope.statement;
+        st.slotIndex = slotIndex;
+        st.pledges.type(SCP_ST_NOMINATE);
+        st.pledges.nominate().quorumSetHash = sha256("unknown quorum set");
+        st.nodeID = node.getPublicKey();
+        envelope.signature = node.sign(
+            xdr::xdr_to_opaque(app->getNetworkID(), ENVELOPE_TYPE_SCP, st));
+        herder.recvSCPEnvelope(envelope);
+
+        // signatures are checked on the worker threads
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (verifying.count() != 0 &&
+               std::chrono::steady_clock::now() < deadline)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(verifying.count() == 0);
+    };
+
+    // more stale slots than are held at once
+    for (uint64 slotIndex = 2; slotIndex < 42; slotIndex++)
+    {
+        receive(slotIndex);
+    }
+    REQUIRE(fetching.count() == 32);
+    REQUIRE(dropped.count() == 0);
+
+    // the slot the network is on still gets in
+    receive(1000);
+    REQUIRE(fetching.count() == 32);
+    REQUIRE(dropped.count() == 0);
+}
+
 TEST_CASE("SCP State", "[herder]")
 {
     SecretKey nodeKeys[3];
@@ -718,3 +954,232 @@ TEST_CASE("SCP State", "[herder]")
         }
     }
 }
+
+TEST_CASE("txset partition for apply", "[herder][cluster]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    Hash const& networkID = app->getNetworkID();
+
+    std::vector<SecretKey> k;
+    for (int i = 0; i < 10; i++)
+    {
+        k.emplace_back(getAccount(("P" + std::to_string(i)).c_str()));
+    }
+    Asset usd = makeAsset(k[9], "USD");
+
+    std::vector<TransactionFramePtr> txs;
+    txs.emplace_back(createPaymentTx(networkID, k[0], k[1], 1, 100));
+    txs.emplace_back(createPaymentTx(networkID, k[2], k[3], 1, 100));
+    txs.emplace_back(createPaymentTx(networkID, k[1], k[4], 1, 100));
+    // both only read the issuer account
+    txs.emplace_back(createCreditPaymentTx(networkID, k[5], k[6], usd, 1, 10));
+    txs.emplace_back(createCreditPaymentTx(networkID, k[7], k[8], usd, 1, 10));
+
+    auto clusters = TxSetFrame::partitionForApply(txs);
+    REQUIRE(clusters.size() == 4);
+    CHECK(clusters[0] == std::vector<size_t>({0, 2}));
+    CHECK(clusters[1] == std::vector<size_t>({1}));
+    CHECK(clusters[2] == std::vector<size_t>({3}));
+    CHECK(clusters[3] == std::vector<size_t>({4}));
+
+    SECTION("writing a shared read joins clusters")
+    {
+        txs.emplace_back(createPaymentTx(networkID, k[9], k[0], 1, 100));
+        clusters = TxSetFrame::partitionForApply(txs);
+        REQUIRE(clusters.size() == 2);
+        CHECK(clusters[0] == std::vector<size_t>({0, 2, 3, 4, 5}));
+        CHECK(clusters[1] == std::vector<size_t>({1}));
+    }
+
+    SECTION("offers conflict with everything")
+    {
+        Asset xlm;
+        xlm.type(ASSET_TYPE_NATIVE);
+        txs.emplace_back(manageOfferOp(networkID, 0, k[3], usd, xlm,
+                                       Price(1, 1), 10, 1));
+        clusters = TxSetFrame::partitionForApply(txs);
+        REQUIRE(clusters.size() == 1);
+        CHECK(clusters[0].size() == txs.size());
+    }
+}
+
+TEST_CASE("clustered apply matches apply order", "[herder][cluster]")
+{
+    VirtualClock clock1;
+    VirtualClock clock2;
+    Config cfg1(getTestConfig(0));
+    Config cfg2(getTestConfig(1));
+    cfg2.ARTIFICIALLY_CLUSTER_TX_APPLY_FOR_TESTING = true;
+    Application::pointer app1 = Application::create(clock1, cfg1);
+    Application::pointer app2 = Application::create(clock2, cfg2);
+    app1->start();
+    app2->start();
+
+    Hash const& networkID = app1->getNetworkID();
+    SecretKey root = getRoot(networkID);
+    std::vector<SecretKey> k;
+    for (int i = 0; i < 8; i++)
+    {
+        k.emplace_back(getAccount(("C" + std::to_string(i)).c_str()));
+    }
+    SecretKey& issuer = k[7];
+    Asset usd = makeAsset(issuer, "USD");
+    int64_t amount = app1->getLedgerManager().getMinBalance(5);
+
+    typedef std::function<std::vector<TransactionFramePtr>(Application&)>
+        TxsBuilder;
+    auto seq = [](SecretKey const& key, Application& app)
+    {
+        return getAccountSeqNum(key, app) + 1;
+    };
+
+    // closes the same ledger on both applications, one applying in apply
+    // order and one cluster by cluster, compares their results, meta and
+    // resulting ledger, and returns the results
+    REQUIRE(!cfg1.ARTIFICIALLY_CLUSTER_TX_APPLY_FOR_TESTING);
+    int day = 1;
+    auto closeBoth = [&](TxsBuilder const& build)
+    {
+        std::vector<TxSetResultMeta> results;
+        std::vector<std::vector<std::string>> metas;
+        for (auto app : {app1, app2})
+        {
+            auto& lm = app->getLedgerManager();
+            auto txSet = std::make_shared<TxSetFrame>(
+                lm.getLastClosedLedgerHeader().hash);
+            for (auto tx : build(*app))
+            {
+                txSet->add(tx);
+            }
+            txSet->sortForHash();
+            uint32 ledgerSeq = lm.getLedgerNum();
+            results.emplace_back(
+                closeLedgerOn(*app, ledgerSeq, day, 7, 2014, txSet));
+
+            std::vector<std::string> meta(txSet->size());
+            for (int i = 0; i < static_cast<int>(meta.size()); i++)
+            {
+                app->getDatabase().getSession()
+                    << "SELECT txmeta FROM txhistory WHERE ledgerseq = "
+                    << ledgerSeq << " AND txindex = " << (i + 1),
+                    soci::into(meta[i]);
+            }
+            metas.emplace_back(meta);
+        }
+        day++;
+
+        REQUIRE(results[0].size() == results[1].size());
+        for (size_t i = 0; i < results[0].size(); i++)
+        {
+            CHECK(xdr::xdr_to_opaque(results[0][i].first) ==
+                  xdr::xdr_to_opaque(results[1][i].first));
+            CHECK(xdr::xdr_to_opaque(results[0][i].second) ==
+                  xdr::xdr_to_opaque(results[1][i].second));
+        }
+        CHECK(metas[0] == metas[1]);
+        CHECK(app1->getLedgerManager().getLastClosedLedgerHeader().hash ==
+              app2->getLedgerManager().getLastClosedLedgerHeader().hash);
+        return results[1];
+    };
+
+    closeBoth([&](Application& app)
+              {
+                  std::vector<TransactionFramePtr> txs;
+                  auto rootSeq = seq(root, app);
+                  for (auto& key : k)
+                  {
+                      txs.emplace_back(createCreateAccountTx(
+                          networkID, root, key, rootSeq++, amount * 4));
+                  }
+                  return txs;
+              });
+    closeBoth([&](Application& app)
+              {
+                  std::vector<TransactionFramePtr> txs;
+                  for (int i = 0; i < 4; i++)
+                  {
+                      txs.emplace_back(createChangeTrust(
+                          networkID, k[i], issuer, seq(k[i], app), "USD",
+                          INT64_MAX));
+                  }
+                  return txs;
+              });
+
+    std::vector<TransactionFramePtr> txs;
+    std::vector<TransactionFramePtr> sorted;
+    TxsBuilder const lastLedger = [&](Application& app)
+    {
+        // the issuer and k[4] both have a transaction in each of the first
+        // two apply batches, and share no entry
+        auto issuerSeq = seq(issuer, app);
+        auto k4Seq = seq(k[4], app);
+        txs.clear();
+        txs.emplace_back(createCreditPaymentTx(
+            networkID, issuer, k[0], usd, issuerSeq++, 1000));
+        txs.emplace_back(createCreditPaymentTx(
+            networkID, issuer, k[1], usd, issuerSeq++, 1000));
+        txs.emplace_back(
+            createPaymentTx(networkID, k[2], k[3], seq(k[2], app), amount));
+        txs.emplace_back(
+            createPaymentTx(networkID, k[4], k[5], k4Seq++, amount));
+        txs.emplace_back(
+            createPaymentTx(networkID, k[5], k[6], seq(k[5], app), amount));
+        txs.emplace_back(
+            createPaymentTx(networkID, k[4], k[6], k4Seq++, amount));
+        // fails: underfunded
+        txs.emplace_back(createCreditPaymentTx(
+            networkID, k[3], k[1], usd, seq(k[3], app), 1000));
+
+        auto& lm = app.getLedgerManager();
+        TxSetFrame txSet(lm.getLastClosedLedgerHeader().hash);
+        for (auto tx : txs)
+        {
+            txSet.add(tx);
+        }
+        txSet.sortForHash();
+        sorted = txSet.sortForApply();
+        return txs;
+    };
+    auto results = closeBoth(lastLedger);
+
+    // the clustered application really applied the last ledger out of
+    // apply order...
+    auto clusters = TxSetFrame::partitionForApply(sorted);
+    std::vector<size_t> clusteredOrder;
+    for (auto const& c : clusters)
+    {
+        clusteredOrder.insert(clusteredOrder.end(), c.begin(), c.end());
+    }
+    std::vector<size_t> applyOrder(sorted.size());
+    for (size_t i = 0; i < applyOrder.size(); i++)
+    {
+        applyOrder[i] = i;
+    }
+    REQUIRE(clusteredOrder.size() == applyOrder.size());
+    REQUIRE(clusteredOrder != applyOrder);
+
+    // ...and got the expected outcome for every transaction
+    REQUIRE(results.size() == txs.size());
+    auto resultCode = [&](TransactionFramePtr const& tx)
+    {
+        for (auto const& r : results)
+        {
+            if (r.first.transactionHash == tx->getContentsHash())
+            {
+                return r.first.result.result;
+            }
+        }
+        FAIL("no result for transaction");
+        return TransactionResult().result;
+    };
+    for (size_t i = 0; i < 6; i++)
+    {
+        CHECK(resultCode(txs[i]).code() == txSUCCESS);
+    }
+    auto underfunded = resultCode(txs[6]);
+    REQUIRE(underfunded.code() == txFAILED);
+    CHECK(underfunded.results()[0].tr().paymentResult().code() ==
+          PAYMENT_UNDERFUNDED);
+}
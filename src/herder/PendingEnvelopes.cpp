@@ -7,12 +7,27 @@
 #include "util/Logging.h"
 #include <scp/Slot.h>
 #include "herder/TxSetFrame.h"
-#include "main/Application.h"
+#include "crypto/SHA.h"
+#include "crypto/SecretKey.h"
+#include "scp/LocalNode.h"
+#include "medida/timer.h"
+#include <algorithm>
 
 using namespace std;
 
 #define QSET_CACHE_SIZE 10000
 #define TXSET_CACHE_SIZE 10000
+// envelopes a node can have fetching or waiting for SCP in a slot
+#define MAX_ENVELOPES_PER_NODE 50
+// envelopes the nodes outside of our quorum set can have fetching or
+// waiting for SCP in a slot, all together
+#define MAX_OUTSIDE_QUORUM_ENVELOPES 1000
+// slots held at once
+#define MAX_SLOTS 32
+// envelopes whose signature is being checked
+#define MAX_VERIFYING_ENVELOPES 10000
+// closed slots whose envelope hashes are kept to drop late copies
+#define CLOSED_SLOTS_KEPT 10
 
 namespace stellar
 {
@@ -20,13 +35,40 @@ namespace stellar
 PendingEnvelopes::PendingEnvelopes(Application& app, HerderImpl& herder)
     : mApp(app)
     , mHerder(herder)
+    , mNextArrival(0)
+    , mOutsideQuorumVerifying(0)
+    , mLastClosedSlot(0)
     , mQsetCache(QSET_CACHE_SIZE)
     , mTxSetFetcher(app)
     , mQuorumSetFetcher(app)
     , mTxSetCache(TXSET_CACHE_SIZE)
+    , mReadyCount(0)
+    , mFetchingCount(0)
+    , mSeenCount(0)
     , mPendingEnvelopesSize(
           app.getMetrics().NewCounter({"scp", "memory", "pending-envelopes"}))
+    , mFetchingEnvelopesSize(
+          app.getMetrics().NewCounter({"scp", "memory", "fetching-envelopes"}))
+    , mSeenEnvelopesSize(
+          app.getMetrics().NewCounter({"scp", "memory", "seen-envelopes"}))
+    , mVerifyingEnvelopesSize(
+          app.getMetrics().NewCounter({"scp", "memory", "verifying-envelopes"}))
+    , mEnvelopeUnique(
+          app.getMetrics().NewMeter({"scp", "envelope", "unique"}, "envelope"))
+    , mEnvelopeDuplicate(app.getMetrics().NewMeter(
+          {"scp", "envelope", "duplicate"}, "envelope"))
+    , mEnvelopeInvalidSig(app.getMetrics().NewMeter(
+          {"scp", "envelope", "invalidsig"}, "envelope"))
+    , mEnvelopeDropped(
+          app.getMetrics().NewMeter({"scp", "envelope", "dropped"}, "envelope"))
+    , mVerifyQueueTimer(
+          app.getMetrics().NewTimer({"scp", "envelope", "verify-queue"}))
 {
+    LocalNode::forAllNodes(app.getConfig().QUORUM_SET,
+                           [&](NodeID const& n)
+                           {
+                               mQuorumNodes.insert(n);
+                           });
 }
 
 PendingEnvelopes::~PendingEnvelopes()
@@ -58,6 +100,7 @@ PendingEnvelopes::recvSCPQuorumSet(Hash hash, const SCPQuorumSet& q)
     SCPQuorumSetPtr qset(new SCPQuorumSet(q));
     mQsetCache.put(hash, qset);
     mQuorumSetFetcher.recv(hash);
+    itemReceived(hash);
 }
 
 void
@@ -66,56 +109,318 @@ PendingEnvelopes::recvTxSet(Hash hash, TxSetFramePtr txset)
     CLOG(TRACE, "Herder") << "Got TxSet " << hexAbbrev(hash);
     mTxSetCache.put(hash, txset);
     mTxSetFetcher.recv(hash);
+    itemReceived(hash);
 }
 
-// called from Peer and when an Item tracker completes
 void
-PendingEnvelopes::recvSCPEnvelope(SCPEnvelope const& envelope)
+PendingEnvelopes::itemReceived(Hash const& itemID)
 {
-    // do we already have this envelope?
-    // do we have the qset
-    // do we have the txset
-
-    try
+    auto it = mWaiting.find(itemID);
+    if (it == mWaiting.end())
     {
-        auto& set = mFetchingEnvelopes[envelope.statement.slotIndex];
-        auto& processedList = mProcessedEnvelopes[envelope.statement.slotIndex];
+        return;
+    }
+    auto waiting = std::move(it->second);
+    mWaiting.erase(it);
 
-        auto fetching = find(set.begin(), set.end(), envelope);
+    // envelopeReady runs SCP, which can change any of this: look everything
+    // up again for each envelope
+    for (auto const& w : waiting)
+    {
+        auto slot = mSlots.find(w.first);
+        if (slot == mSlots.end())
+        {
+            continue;
+        }
+        auto& fetching = slot->second.mFetching;
+        auto env = fetching.find(w.second);
+        if (env == fetching.end() || !isFullyFetched(env->second))
+        {
+            continue;
+        }
+        SCPEnvelope envelope = std::move(env->second);
+        fetching.erase(env);
+        --mFetchingCount;
+        envelopeReady(envelope);
+    }
+    updateSizeMetrics();
+}
 
-        if (fetching == set.end())
-        { // we aren't fetching this envelope
-            if (find(processedList.begin(), processedList.end(), envelope) ==
-                processedList.end())
-            { // we haven't seen this envelope before
-                // insert it into the fetching set
-                fetching = set.insert(envelope).first;
-                startFetch(envelope);
+PendingEnvelopes::SlotEnvelopes*
+PendingEnvelopes::admitSlot(uint64 slotIndex)
+{
+    auto it = mSlots.find(slotIndex);
+    if (it != mSlots.end())
+    {
+        return &it->second;
+    }
+    if (mSlots.size() >= MAX_SLOTS)
+    {
+        auto victim = mSlots.end();
+        if (mHerder.getState() == Herder::HERDER_TRACKING_STATE)
+        {
+            // the slots we need are the lowest ones, far away slots are the
+            // cheapest to make up: the highest one goes
+            victim = std::prev(mSlots.end());
+            if (victim->first < slotIndex)
+            {
+                return nullptr;
             }
-            else
+        }
+        else
+        {
+            // we don't know where the network is, only that it is not behind
+            // stale slots: an idle slot goes, or else the lowest one
+            victim = std::find_if(mSlots.begin(), mSlots.end(),
+                                  [](std::pair<uint64 const,
+                                               SlotEnvelopes> const& s)
+                                  {
+                                      return s.second.mFetching.empty() &&
+                                             s.second.mReady.empty();
+                                  });
+            if (victim == mSlots.end())
             {
-                // we already have this one
-                fetching = set.end();
+                victim = mSlots.begin();
+                if (victim->first > slotIndex)
+                {
+                    return nullptr;
+                }
             }
         }
+        clearSlot(victim->first, victim->second);
+        mSeenCount -= victim->second.mSeen.size();
+        mSlots.erase(victim);
+    }
+    return &mSlots[slotIndex];
+}
 
-        if (fetching != set.end())
-        { // we are fetching this envelope
-            // check if we are done fetching it
-            if (isFullyFetched(envelope))
-            {
-                // move the item from fetching to processed
-                processedList.emplace_back(*fetching);
-                set.erase(fetching);
-                envelopeReady(envelope);
-            } // else just keep waiting for it to come in
+bool
+PendingEnvelopes::isInQuorum(NodeID const& node) const
+{
+    return mQuorumNodes.find(node) != mQuorumNodes.end();
+}
+
+bool
+PendingEnvelopes::hasRoom(uint64 slotIndex, NodeID const& node) const
+{
+    auto it = mCounts.find(slotIndex);
+    if (it == mCounts.end())
+    {
+        return true;
+    }
+    auto const& counts = it->second;
+    auto perNode = counts.mPerNode.find(node);
+    if (perNode != counts.mPerNode.end() &&
+        perNode->second >= MAX_ENVELOPES_PER_NODE)
+    {
+        return false;
+    }
+    return isInQuorum(node) ||
+           counts.mOutsideQuorum < MAX_OUTSIDE_QUORUM_ENVELOPES;
+}
+
+void
+PendingEnvelopes::count(SCPEnvelope const& envelope)
+{
+    auto& counts = mCounts[envelope.statement.slotIndex];
+    ++counts.mPerNode[envelope.statement.nodeID];
+    if (!isInQuorum(envelope.statement.nodeID))
+    {
+        ++counts.mOutsideQuorum;
+    }
+}
+
+void
+PendingEnvelopes::release(SCPEnvelope const& envelope)
+{
+    auto it = mCounts.find(envelope.statement.slotIndex);
+    if (it == mCounts.end())
+    {
+        return;
+    }
+    auto& counts = it->second;
+    auto const& node = envelope.statement.nodeID;
+    auto perNode = counts.mPerNode.find(node);
+    if (perNode != counts.mPerNode.end() && --perNode->second == 0)
+    {
+        counts.mPerNode.erase(perNode);
+    }
+    if (!isInQuorum(node))
+    {
+        --counts.mOutsideQuorum;
+    }
+    if (counts.mPerNode.empty())
+    {
+        mCounts.erase(it);
+    }
+}
+
+// called from Herder for every envelope received
+void
+PendingEnvelopes::recvSCPEnvelope(SCPEnvelope const& envelope)
+{
+    // do we already have this envelope?
+    // is there room for it
+    // is it signed by its node, checked on a worker thread
+
+    // the slot itself is only taken in with an envelope that checks out
+
+    Hash h = sha256(xdr::xdr_to_opaque(envelope));
+    auto slot = mSlots.find(envelope.statement.slotIndex);
+    if ((slot != mSlots.end() &&
+         slot->second.mSeen.find(h) != slot->second.mSeen.end()) ||
+        mVerifyingHashes.find(h) != mVerifyingHashes.end())
+    {
+        mEnvelopeDuplicate.Mark();
+        return;
+    }
+    // envelopes being verified count against the caps, and only the nodes
+    // outside of our quorum set can fill the verification queue
+    auto const& node = envelope.statement.nodeID;
+    if (!hasRoom(envelope.statement.slotIndex, node) ||
+        (!isInQuorum(node) &&
+         mOutsideQuorumVerifying >= MAX_VERIFYING_ENVELOPES))
+    {
+        CLOG(DEBUG, "Herder") << "Dropping envelope from "
+                              << mApp.getConfig().toShortString(node)
+                              << " i:" << envelope.statement.slotIndex;
+        mEnvelopeDropped.Mark();
+        return;
+    }
+
+    mVerifyingHashes.insert(h);
+    count(envelope);
+    if (!isInQuorum(node))
+    {
+        ++mOutsideQuorumVerifying;
+    }
+    mEnvelopeUnique.Mark();
+
+    uint64 arrival = mNextArrival++;
+    auto& verifying = mVerifying[arrival];
+    verifying.mEnvelope = std::make_shared<SCPEnvelope const>(envelope);
+    verifying.mHash = h;
+    verifying.mReceived = std::chrono::steady_clock::now();
+    updateSizeMetrics();
+
+    Application& app = mApp;
+    auto env = verifying.mEnvelope;
+    Hash networkID = mApp.getNetworkID();
+    mApp.getWorkerIOService().post(
+        [this, &app, env, networkID, arrival]()
+        {
+            bool valid = PubKeyUtils::verifySig(
+                env->statement.nodeID, env->signature,
+                xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_SCP,
+                                   env->statement));
+            app.getClock().post(CrankStats::ORIGIN_HERDER,
+                                [this, arrival, valid]()
+                                {
+                                    envelopeVerified(arrival, valid);
+                                });
+        });
+}
+
+void
+PendingEnvelopes::envelopeVerified(uint64 arrival, bool valid)
+{
+    auto it = mVerifying.find(arrival);
+    if (it == mVerifying.end())
+    {
+        return;
+    }
+    it->second.mVerified = true;
+    it->second.mValid = valid;
+
+    // hand the envelopes over in the order they arrived in; addEnvelope
+    // runs SCP, so each is taken out of mVerifying first
+    while (!mVerifying.empty() && mVerifying.begin()->second.mVerified)
+    {
+        auto verifying = std::move(mVerifying.begin()->second);
+        mVerifying.erase(mVerifying.begin());
+        mVerifyingHashes.erase(verifying.mHash);
+        mVerifyQueueTimer.Update(std::chrono::steady_clock::now() -
+                                 verifying.mReceived);
+        auto const& envelope = *verifying.mEnvelope;
+        if (!isInQuorum(envelope.statement.nodeID))
+        {
+            --mOutsideQuorumVerifying;
+        }
+        if (verifying.mValid)
+        {
+            addEnvelope(envelope, verifying.mHash);
+        }
+        else
+        {
+            CLOG(DEBUG, "Herder") << "Dropping envelope with a bad signature "
+                                  << "from "
+                                  << mApp.getConfig().toShortString(
+                                         envelope.statement.nodeID)
+                                  << " i:" << envelope.statement.slotIndex;
+            mEnvelopeInvalidSig.Mark();
+            release(envelope);
         }
     }
+    updateSizeMetrics();
+}
+
+void
+PendingEnvelopes::addEnvelope(SCPEnvelope const& envelope,
+                              Hash const& envelopeHash)
+{
+    // is its slot still open
+    // is there a slot for it
+    // do we have the qset
+    // do we have the txset
+
+    auto slotIndex = envelope.statement.slotIndex;
+    if (mHerder.isSlotBehind(slotIndex) || slotIndex <= mLastClosedSlot)
+    {
+        // the slot closed while the signature was being checked: fetching
+        // for it would restart what slotClosed stopped
+        CLOG(TRACE, "Herder") << "Dropping envelope for past slot "
+                              << slotIndex;
+        release(envelope);
+        return;
+    }
+
+    auto slot = admitSlot(slotIndex);
+    if (!slot)
+    {
+        CLOG(DEBUG, "Herder") << "Dropping envelope from "
+                              << mApp.getConfig().toShortString(
+                                     envelope.statement.nodeID)
+                              << " i:" << slotIndex;
+        mEnvelopeDropped.Mark();
+        release(envelope);
+        return;
+    }
+
+    slot->mSeen.insert(envelopeHash);
+    ++mSeenCount;
+
+    bool fetched;
+    try
+    {
+        fetched = startFetch(envelope, envelopeHash);
+    }
     catch (xdr::xdr_runtime_error& e)
     {
         CLOG(TRACE, "Herder")
-            << "PendingEnvelopes::recvSCPEnvelope got corrupt message: "
+            << "PendingEnvelopes::addEnvelope got corrupt message: "
             << e.what();
+        release(envelope);
+        return;
+    }
+
+    if (fetched)
+    {
+        envelopeReady(envelope);
+    }
+    else
+    {
+        slot->mFetching.emplace(envelopeHash, envelope);
+        ++mFetchingCount;
     }
 }
 
@@ -127,7 +432,8 @@ PendingEnvelopes::envelopeReady(SCPEnvelope const& envelope)
     msg.envelope() = envelope;
     mApp.getOverlayManager().broadcastMessage(msg);
 
-    mPendingEnvelopes[envelope.statement.slotIndex].push_back(envelope);
+    mSlots[envelope.statement.slotIndex].mReady.push_back(envelope);
+    ++mReadyCount;
 
     CLOG(TRACE, "Herder") << "Envelope ready i:" << envelope.statement.slotIndex
                           << " t:" << envelope.statement.pledges.type();
@@ -157,15 +463,18 @@ PendingEnvelopes::isFullyFetched(SCPEnvelope const& envelope)
 
 // returns true if already fetched
 bool
-PendingEnvelopes::startFetch(SCPEnvelope const& envelope)
+PendingEnvelopes::startFetch(SCPEnvelope const& envelope,
+                             Hash const& envelopeHash)
 {
     bool ret = true;
+    auto slotIndex = envelope.statement.slotIndex;
 
     Hash h = Slot::getCompanionQuorumSetHashFromStatement(envelope.statement);
 
     if (!mQsetCache.exists(h))
     {
         mQuorumSetFetcher.fetch(h, envelope);
+        mWaiting[h].emplace_back(slotIndex, envelopeHash);
         ret = false;
     }
 
@@ -178,6 +487,7 @@ PendingEnvelopes::startFetch(SCPEnvelope const& envelope)
         if (!mTxSetCache.exists(wb.txSetHash))
         {
             mTxSetFetcher.fetch(wb.txSetHash, envelope);
+            mWaiting[wb.txSetHash].emplace_back(slotIndex, envelopeHash);
             ret = false;
         }
     }
@@ -190,72 +500,136 @@ PendingEnvelopes::startFetch(SCPEnvelope const& envelope)
 bool
 PendingEnvelopes::pop(uint64 slotIndex, SCPEnvelope& ret)
 {
-    if (mPendingEnvelopes.find(slotIndex) == mPendingEnvelopes.end())
+    auto it = mSlots.find(slotIndex);
+    if (it == mSlots.end() || it->second.mReady.empty())
     {
         return false;
     }
-    else
-    {
-        if (!mPendingEnvelopes[slotIndex].size())
-            return false;
-        ret = mPendingEnvelopes[slotIndex].back();
-        mPendingEnvelopes[slotIndex].pop_back();
 
-        return true;
-    }
+    auto& ready = it->second.mReady;
+    ret = std::move(ready.back());
+    ready.pop_back();
+    --mReadyCount;
+    release(ret);
+    updateSizeMetrics();
+    return true;
 }
 
 vector<uint64>
 PendingEnvelopes::readySlots()
 {
     vector<uint64> result;
-    for (auto const& entry : mPendingEnvelopes)
+    for (auto const& entry : mSlots)
     {
-        if (!entry.second.empty())
+        if (!entry.second.mReady.empty())
             result.push_back(entry.first);
     }
     return result;
 }
 
 void
-PendingEnvelopes::eraseBelow(uint64 slotIndex)
+PendingEnvelopes::clearSlot(uint64 slotIndex, SlotEnvelopes& slot)
 {
-    for (auto iter = mPendingEnvelopes.begin();
-         iter != mPendingEnvelopes.end();)
+    for (auto const& f : slot.mFetching)
     {
-        if (iter->first < slotIndex)
+        release(f.second);
+
+        // forget the items this envelope was waiting for
+        auto forget = [&](Hash const& itemID)
+        {
+            auto it = mWaiting.find(itemID);
+            if (it == mWaiting.end())
+            {
+                return;
+            }
+            auto& w = it->second;
+            w.erase(std::remove_if(w.begin(), w.end(),
+                                   [&](std::pair<uint64, Hash> const& p)
+                                   {
+                                       return p.first == slotIndex;
+                                   }),
+                    w.end());
+            if (w.empty())
+            {
+                mWaiting.erase(it);
+            }
+        };
+        auto const& st = f.second.statement;
+        forget(Slot::getCompanionQuorumSetHashFromStatement(st));
+        for (auto const& v : Slot::getStatementValues(st))
         {
-            iter = mPendingEnvelopes.erase(iter);
+            StellarValue wb;
+            xdr::xdr_from_opaque(v, wb);
+            forget(wb.txSetHash);
         }
-        else
-            break;
     }
 
-    for (auto iter = mFetchingEnvelopes.begin();
-         iter != mFetchingEnvelopes.end();)
+    for (auto const& r : slot.mReady)
+    {
+        release(r);
+    }
+
+    mFetchingCount -= slot.mFetching.size();
+    mReadyCount -= slot.mReady.size();
+    slot.mFetching.clear();
+    slot.mReady.clear();
+}
+
+void
+PendingEnvelopes::eraseBelow(uint64 slotIndex)
+{
+    // the envelope hashes are kept until slotClosed drops them
+    for (auto& entry : mSlots)
     {
-        if (iter->first < slotIndex)
+        if (entry.first >= slotIndex)
         {
-            iter = mFetchingEnvelopes.erase(iter);
-        }
-        else
             break;
+        }
+        clearSlot(entry.first, entry.second);
+    }
+    for (auto it = mSlots.begin();
+         it != mSlots.end() && it->first < slotIndex;)
+    {
+        it = it->second.mSeen.empty() ? mSlots.erase(it) : std::next(it);
     }
+    updateSizeMetrics();
 }
 
 void
 PendingEnvelopes::slotClosed(uint64 slotIndex)
 {
-    mPendingEnvelopes.erase(slotIndex);
+    mLastClosedSlot = std::max(mLastClosedSlot, slotIndex);
 
-    // keep the last few ledgers worth of messages around to give to people
-    mProcessedEnvelopes.erase(slotIndex - 10);
-    mFetchingEnvelopes.erase(slotIndex);
+    auto it = mSlots.find(slotIndex);
+    if (it != mSlots.end())
+    {
+        clearSlot(slotIndex, it->second);
+    }
+
+    // keep the hashes of the last few ledgers worth of messages around to
+    // drop the copies still being flooded
+    for (it = mSlots.begin();
+         it != mSlots.end() && it->first + CLOSED_SLOTS_KEPT <= slotIndex;)
+    {
+        clearSlot(it->first, it->second);
+        mSeenCount -= it->second.mSeen.size();
+        it = mSlots.erase(it);
+    }
+    updateSizeMetrics();
 
     mTxSetFetcher.stopFetchingBelow(slotIndex + 1);
     mQuorumSetFetcher.stopFetchingBelow(slotIndex + 1);
 }
 
+void
+PendingEnvelopes::updateSizeMetrics()
+{
+    mPendingEnvelopesSize.set_count(mReadyCount);
+    mFetchingEnvelopesSize.set_count(mFetchingCount);
+    mSeenEnvelopesSize.set_count(mSeenCount);
+    mVerifyingEnvelopesSize.set_count(mVerifying.size());
+}
+
 TxSetFramePtr
 PendingEnvelopes::getTxSet(Hash hash)
 {
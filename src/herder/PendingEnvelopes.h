@@ -5,14 +5,30 @@
 #include <medida/medida.h>
 #include <util/optional.h>
 #include <set>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
 #include <xdr/Stellar-SCP.h>
 #include "overlay/ItemFetcher.h"
 #include "lib/json/json.h"
 #include "lib/util/lrucache.hpp"
+#include "util/HashOfHash.h"
 
 /*
 SCP messages that you have received but are waiting to get the info of
 before feeding into SCP
+
+Envelopes are hashed when they come in, and copies of the ones already
+taken in are dropped. The signatures of the others are checked on the worker
+threads, and those that check out are handed over to be fetched in the order
+they came in.
+
+Memory is bounded per slot: each node can have a limited number of envelopes
+being fetched or waiting for SCP, and so can all the nodes outside of our
+quorum set together. Only a limited number of slots are held at once: while
+tracking consensus the highest ones make room for lower ones, otherwise idle
+or low ones make room for the others.
 */
 
 namespace stellar
@@ -22,17 +38,65 @@ class HerderImpl;
 
 class PendingEnvelopes
 {
+    // what we hold for a slot
+    struct SlotEnvelopes
+    {
+        // hashes of the envelopes we took in, so that copies are dropped
+        // before anything else is done with them
+        std::unordered_set<Hash> mSeen;
+
+        // envelopes waiting for their quorum set or tx sets, by hash
+        std::unordered_map<Hash, SCPEnvelope> mFetching;
+
+        // envelopes that haven't been sent to SCP yet
+        std::vector<SCPEnvelope> mReady;
+    };
+
+    // number of envelopes of a slot being verified, fetched or waiting for
+    // SCP, per node and for the nodes outside of our quorum set
+    struct EnvelopeCounts
+    {
+        std::map<NodeID, size_t> mPerNode;
+        size_t mOutsideQuorum = 0;
+    };
+
+    // an envelope whose signature is being checked on a worker thread
+    struct VerifyingEnvelope
+    {
+        std::shared_ptr<SCPEnvelope const> mEnvelope;
+        Hash mHash;
+        std::chrono::steady_clock::time_point mReceived;
+        bool mVerified = false;
+        bool mValid = false;
+    };
+
     Application& mApp;
     HerderImpl& mHerder;
 
-    // ledger# and list of envelopes we have processed already
-    std::map<uint64, std::vector<SCPEnvelope>> mProcessedEnvelopes;
+    std::map<uint64, SlotEnvelopes> mSlots;
+
+    // envelopes being verified, by arrival number: they are handed over in
+    // that order once verified
+    std::map<uint64, VerifyingEnvelope> mVerifying;
+    std::unordered_set<Hash> mVerifyingHashes;
+    uint64 mNextArrival;
+    // how many of them are from nodes outside of our quorum set
+    size_t mOutsideQuorumVerifying;
 
-    // ledger# and list of envelopes we are fetching right now
-    std::map<uint64, std::set<SCPEnvelope>> mFetchingEnvelopes;
+    // by slot, from the moment an envelope is taken in for verification
+    // until it is dropped or popped
+    std::map<uint64, EnvelopeCounts> mCounts;
 
-    // ledger# and list of envelopes that haven't been sent to SCP yet
-    std::map<uint64, std::vector<SCPEnvelope>> mPendingEnvelopes;
+    // envelopes of this slot and below are not taken in anymore
+    uint64 mLastClosedSlot;
+
+    // quorum set or tx set hash -> the envelopes fetching it, by slot and
+    // envelope hash, so that only those are looked at when it comes in
+    std::unordered_map<Hash, std::vector<std::pair<uint64, Hash>>> mWaiting;
+
+    // the nodes of our quorum set, whose envelopes are let in past the per
+    // slot and verification queue limits
+    std::set<NodeID> mQuorumNodes;
 
     // all the quorum sets we have learned about
     cache::lru_cache<uint256, SCPQuorumSetPtr> mQsetCache;
@@ -43,7 +107,53 @@ class PendingEnvelopes
     // all the txsets we have learned about per ledger#
     cache::lru_cache<uint256, TxSetFramePtr> mTxSetCache;
 
+    size_t mReadyCount;
+    size_t mFetchingCount;
+    size_t mSeenCount;
     medida::Counter& mPendingEnvelopesSize;
+    medida::Counter& mFetchingEnvelopesSize;
+    medida::Counter& mSeenEnvelopesSize;
+    medida::Counter& mVerifyingEnvelopesSize;
+    medida::Meter& mEnvelopeUnique;
+    medida::Meter& mEnvelopeDuplicate;
+    medida::Meter& mEnvelopeInvalidSig;
+    medida::Meter& mEnvelopeDropped;
+    medida::Timer& mVerifyQueueTimer;
+
+    // returns the slot of `slotIndex`, making room for it if needed, or
+    // nullptr if there is none; only called for envelopes that checked out
+    SlotEnvelopes* admitSlot(uint64 slotIndex);
+
+    bool isInQuorum(NodeID const& node) const;
+
+    // whether the slot can take one more envelope from node
+    bool hasRoom(uint64 slotIndex, NodeID const& node) const;
+
+    // called on the main thread once the signature of the arrival-th
+    // envelope has been checked
+    void envelopeVerified(uint64 arrival, bool valid);
+
+    // takes in an envelope signed by its node
+    void addEnvelope(SCPEnvelope const& envelope, Hash const& envelopeHash);
+
+    bool isFullyFetched(SCPEnvelope const& envelope);
+    // returns true if already fetched
+    bool startFetch(SCPEnvelope const& envelope, Hash const& envelopeHash);
+
+    void envelopeReady(SCPEnvelope const& envelope);
+
+    // hands the envelopes waiting for itemID that are now fully fetched
+    // over to SCP
+    void itemReceived(Hash const& itemID);
+
+    // adds the envelope to, or removes it from, the counts of its slot
+    void count(SCPEnvelope const& envelope);
+    void release(SCPEnvelope const& envelope);
+
+    // drops the envelopes the slot is fetching or holding for SCP
+    void clearSlot(uint64 slotIndex, SlotEnvelopes& slot);
+
+    void updateSizeMetrics();
 
   public:
     PendingEnvelopes(Application& app, HerderImpl& herder);
@@ -56,12 +166,6 @@ class PendingEnvelopes
     void peerDoesntHave(MessageType type, uint256 const& itemID,
                         Peer::pointer peer);
 
-    bool isFullyFetched(SCPEnvelope const& envelope);
-    // returns true if already fetched
-    bool startFetch(SCPEnvelope const& envelope);
-
-    void envelopeReady(SCPEnvelope const& envelope);
-
     bool pop(uint64 slotIndex, SCPEnvelope& ret);
 
     void eraseBelow(uint64 slotIndex);
@@ -11,7 +11,9 @@
 #include "main/Application.h"
 #include "main/Config.h"
 #include "database/Database.h"
+#include "ledger/LedgerHashUtils.h"
 #include <algorithm>
+#include <unordered_map>
 
 #include "xdrpp/printer.h"
 
@@ -132,6 +134,98 @@ TxSetFrame::sortForApply()
     return retList;
 }
 
+std::vector<std::vector<size_t>>
+TxSetFrame::partitionForApply(std::vector<TransactionFramePtr> const& txs)
+{
+    // union-find over positions in txs; the root of a set is always its
+    // smallest position
+    vector<size_t> parent(txs.size());
+    for (size_t i = 0; i < parent.size(); i++)
+    {
+        parent[i] = i;
+    }
+    auto find = [&parent](size_t i)
+    {
+        while (parent[i] != i)
+        {
+            parent[i] = parent[parent[i]];
+            i = parent[i];
+        }
+        return i;
+    };
+    auto unite = [&parent, &find](size_t a, size_t b)
+    {
+        a = find(a);
+        b = find(b);
+        if (a != b)
+        {
+            parent[std::max(a, b)] = std::min(a, b);
+        }
+    };
+
+    // for each key, the last writer so far and the readers since then:
+    // reads only conflict with writes
+    struct KeyUse
+    {
+        bool mHasWriter{false};
+        size_t mWriter{0};
+        vector<size_t> mReaders;
+    };
+    unordered_map<LedgerKey, KeyUse, LedgerKeyHash, LedgerKeyEqual> uses;
+
+    for (size_t i = 0; i < txs.size(); i++)
+    {
+        auto fp = txs[i]->getFootprint();
+        if (fp.mGlobal)
+        {
+            // conflicts with every other transaction
+            vector<vector<size_t>> all(1);
+            for (size_t j = 0; j < txs.size(); j++)
+            {
+                all[0].push_back(j);
+            }
+            return all;
+        }
+        for (auto const& k : fp.mWrites)
+        {
+            auto& u = uses[k];
+            if (u.mHasWriter)
+            {
+                unite(i, u.mWriter);
+            }
+            for (auto r : u.mReaders)
+            {
+                unite(i, r);
+            }
+            u.mReaders.clear();
+            u.mHasWriter = true;
+            u.mWriter = i;
+        }
+        for (auto const& k : fp.mReads)
+        {
+            auto& u = uses[k];
+            if (u.mHasWriter)
+            {
+                unite(i, u.mWriter);
+            }
+            u.mReaders.push_back(i);
+        }
+    }
+
+    vector<vector<size_t>> clusters;
+    unordered_map<size_t, size_t> clusterOfRoot;
+    for (size_t i = 0; i < txs.size(); i++)
+    {
+        auto res = clusterOfRoot.emplace(find(i), clusters.size());
+        if (res.second)
+        {
+            clusters.emplace_back();
+        }
+        clusters[res.first->second].push_back(i);
+    }
+    return clusters;
+}
+
 struct SurgeSorter
 {
     map<AccountID, double>& mAccountFeeMap;
@@ -185,6 +279,24 @@ TxSetFrame::surgePricingFilter(LedgerManager const& lm)
     }
 }
 
+void
+TxSetFrame::verifySignatures(Application& app) const
+{
+    // items point into the accounts, which must stay alive for the batch
+    std::vector<AccountFrame::pointer> accounts;
+    std::vector<PubKeyUtils::SigVerifyItem> items;
+    for (auto const& tx : mTransactions)
+    {
+        auto account = tx->loadAccount(app.getDatabase(), tx->getSourceID());
+        if (account)
+        {
+            tx->collectSignatures(*account, items);
+            accounts.emplace_back(account);
+        }
+    }
+    PubKeyUtils::verifySigBatch(items);
+}
+
 // TODO.3 this and checkValid share a lot of code
 void
 TxSetFrame::trimInvalid(Application& app,
@@ -194,6 +306,7 @@ TxSetFrame::trimInvalid(Application& app,
     app.getDatabase().setCurrentTransactionReadOnly();
 
     sortForHash();
+    verifySignatures(app);
 
     map<AccountID, vector<TransactionFramePtr>> accountTxMap;
 
@@ -288,6 +401,8 @@ TxSetFrame::checkValid(Application& app) const
         lastHash = tx->getFullHash();
     }
 
+    verifySignatures(app);
+
     for (auto& item : accountTxMap)
     {
         // order by sequence number
@@ -21,6 +21,10 @@ class TxSetFrame
 
     Hash mPreviousLedgerHash;
 
+    // verify the source-account signatures of every transaction in one
+    // batch, leaving the results in the signature-verification cache
+    void verifySignatures(Application& app) const;
+
   public:
     std::vector<TransactionFramePtr> mTransactions;
 
@@ -38,6 +42,15 @@ class TxSetFrame
 
     std::vector<TransactionFramePtr> sortForApply();
 
+    // splits transactions (in apply order) into clusters such that no two
+    // clusters touch the same ledger entry, judging by
+    // TransactionFrame::getFootprint. Each cluster lists positions in txs in
+    // increasing order, and clusters are ordered by their first position:
+    // applying the clusters one after another gives the same results as
+    // applying txs in order.
+    static std::vector<std::vector<size_t>>
+    partitionForApply(std::vector<TransactionFramePtr> const& txs);
+
     bool checkValid(Application& app) const;
     void trimInvalid(Application& app,
                      std::vector<TransactionFramePtr>& trimmed);
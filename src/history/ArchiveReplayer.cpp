@@ -0,0 +1,354 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "history/ArchiveReplayer.h"
+#include "bucket/Bucket.h"
+#include "bucket/BucketList.h"
+#include "bucket/BucketManager.h"
+#include "crypto/Hex.h"
+#include "database/Database.h"
+#include "herder/LedgerCloseData.h"
+#include "herder/TxSetFrame.h"
+#include "history/FileTransferInfo.h"
+#include "history/HistoryArchive.h"
+#include "history/HistoryManager.h"
+#include "ledger/LedgerHeaderFrame.h"
+#include "ledger/LedgerManager.h"
+#include "lib/json/json.h"
+#include "main/Application.h"
+#include "main/PersistentState.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "util/XDRStream.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include <fstream>
+
+namespace stellar
+{
+
+static std::chrono::nanoseconds
+timerTotal(medida::Timer& timer)
+{
+    return std::chrono::nanoseconds(static_cast<uint64_t>(
+        timer.sum() * static_cast<double>(timer.duration_unit().count())));
+}
+
+static void
+crankUntil(Application& app, bool const& done)
+{
+    while (!done && !app.getClock().getIOService().stopped())
+    {
+        app.getClock().crank(true);
+    }
+}
+
+double
+ArchiveReplayer::LedgerStats::txPerSecond() const
+{
+    if (mApplyTime.count() == 0)
+    {
+        return 0.0;
+    }
+    return static_cast<double>(mTxCount) /
+           std::chrono::duration<double>(mApplyTime).count();
+}
+
+ArchiveReplayer::ArchiveReplayer(Application& app,
+                                 std::string const& archiveDir)
+    : mApp(app)
+    , mArchiveDir(archiveDir)
+    , mWorkDir(app.getTmpDirManager().tmpDir("replay"))
+{
+}
+
+std::string
+ArchiveReplayer::fetchFile(std::string const& type,
+                           std::string const& hexDigits)
+{
+    std::string src =
+        mArchiveDir + "/" + fs::remoteName(type, hexDigits, "xdr.gz");
+    std::string dst =
+        mWorkDir.getName() + "/" + fs::baseName(type, hexDigits, "xdr");
+    {
+        std::ifstream in(src, std::ifstream::binary);
+        if (!in)
+        {
+            throw std::runtime_error("missing archive file: " + src);
+        }
+        std::ofstream out(dst + ".gz", std::ofstream::binary);
+        out << in.rdbuf();
+        if (!out)
+        {
+            throw std::runtime_error("failed to copy archive file: " + src);
+        }
+    }
+
+    bool done = false;
+    asio::error_code error;
+    mApp.getHistoryManager().decompress(
+        dst + ".gz", [&done, &error](asio::error_code const& ec)
+        {
+            error = ec;
+            done = true;
+        });
+    crankUntil(mApp, done);
+    if (!done || error)
+    {
+        throw std::runtime_error("failed to decompress archive file: " + src);
+    }
+    return dst;
+}
+
+void
+ArchiveReplayer::bootstrap(uint32_t checkpoint)
+{
+    HistoryArchiveState has;
+    has.load(mArchiveDir + "/" + HistoryArchiveState::remoteName(checkpoint));
+    if (has.currentLedger != checkpoint)
+    {
+        throw std::runtime_error("archive state does not match checkpoint");
+    }
+
+    // The last header of the checkpoint is the state the buckets describe.
+    LedgerHeaderHistoryEntry lastClosed;
+    {
+        XDRInputFileStream hdrIn;
+        hdrIn.open(fetchFile(HISTORY_FILE_TYPE_LEDGER, fs::hexStr(checkpoint)));
+        bool readOne = false;
+        LedgerHeaderHistoryEntry h;
+        while (hdrIn && hdrIn.readOne(h))
+        {
+            lastClosed = h;
+            readOne = true;
+        }
+        if (!readOne || lastClosed.header.ledgerSeq != checkpoint)
+        {
+            throw std::runtime_error("checkpoint ledger file is incomplete");
+        }
+    }
+    if (lastClosed.header.bucketListHash != has.getBucketListHash())
+    {
+        throw std::runtime_error(
+            "archive BucketList hash differs from checkpoint ledger");
+    }
+
+    CLOG(INFO, "History") << "Replay bootstrapping from checkpoint "
+                          << LedgerManager::ledgerAbbrev(lastClosed);
+
+    auto& bm = mApp.getBucketManager();
+    auto& db = mApp.getDatabase();
+    auto adopt = [this, &bm](std::string const& hash)
+    {
+        std::shared_ptr<Bucket> b;
+        if (hash.find_first_not_of('0') == std::string::npos)
+        {
+            return b;
+        }
+        b = bm.getBucketByHash(hexToBin256(hash));
+        if (!b)
+        {
+            b = bm.adoptFileAsBucket(
+                fetchFile(HISTORY_FILE_TYPE_BUCKET, hash), hexToBin256(hash));
+        }
+        return b;
+    };
+
+    // Apply buckets oldest to newest, as catchup does.
+    for (size_t i = BucketList::kNumLevels; i != 0; --i)
+    {
+        auto const& level = has.currentBuckets.at(i - 1);
+        for (auto const& hash : {level.snap, level.curr})
+        {
+            auto b = adopt(hash);
+            if (b)
+            {
+                CLOG(INFO, "History") << "Replay applying bucket "
+                                      << b->getFilename();
+                b->apply(db);
+            }
+        }
+        if (level.next.hasOutputHash())
+        {
+            adopt(level.next.getOutputHash());
+        }
+    }
+
+    // Record the checkpoint as the last closed ledger and let the
+    // LedgerManager pick it up as on a restart.
+    LedgerHeaderFrame(lastClosed).storeInsert(mApp.getLedgerManager());
+    mApp.getPersistentState().setState(PersistentState::kLastClosedLedger,
+                                       binToHex(lastClosed.hash));
+    mApp.getPersistentState().setState(PersistentState::kHistoryArchiveState,
+                                       has.toString());
+
+    bool done = false;
+    asio::error_code error;
+    mApp.getLedgerManager().loadLastKnownLedger(
+        [&done, &error](asio::error_code const& ec)
+        {
+            error = ec;
+            done = true;
+        });
+    crankUntil(mApp, done);
+    if (!done || error)
+    {
+        throw std::runtime_error("failed to load bootstrapped ledger");
+    }
+}
+
+void
+ArchiveReplayer::replayCheckpoint(uint32_t checkpoint, uint32_t first,
+                                  uint32_t last,
+                                  std::vector<LedgerStats>& stats)
+{
+    XDRInputFileStream hdrIn;
+    XDRInputFileStream txIn;
+    hdrIn.open(fetchFile(HISTORY_FILE_TYPE_LEDGER, fs::hexStr(checkpoint)));
+    txIn.open(
+        fetchFile(HISTORY_FILE_TYPE_TRANSACTIONS, fs::hexStr(checkpoint)));
+
+    auto& lm = mApp.getLedgerManager();
+    auto& db = mApp.getDatabase();
+    auto& addBatch = mApp.getMetrics().NewTimer({"bucket", "batch", "add"});
+
+    LedgerHeaderHistoryEntry hHeader;
+    LedgerHeader const& header = hHeader.header;
+    TransactionHistoryEntry txHistoryEntry;
+    bool readTxSet = txIn.readOne(txHistoryEntry);
+
+    while (hdrIn && hdrIn.readOne(hHeader))
+    {
+        if (header.ledgerSeq <= lm.getLastClosedLedgerNum())
+        {
+            continue;
+        }
+        if (header.ledgerSeq > last)
+        {
+            break;
+        }
+        if (header.previousLedgerHash != lm.getLastClosedLedgerHeader().hash)
+        {
+            throw std::runtime_error("replay disagreed on LCL hash at ledger " +
+                                     std::to_string(header.ledgerSeq));
+        }
+
+        while (readTxSet && txHistoryEntry.ledgerSeq < header.ledgerSeq)
+        {
+            readTxSet = txIn.readOne(txHistoryEntry);
+        }
+        TxSetFramePtr txset =
+            std::make_shared<TxSetFrame>(lm.getLastClosedLedgerHeader().hash);
+        if (readTxSet && txHistoryEntry.ledgerSeq == header.ledgerSeq)
+        {
+            txset = std::make_shared<TxSetFrame>(mApp.getNetworkID(),
+                                                 txHistoryEntry.txSet);
+            readTxSet = txIn.readOne(txHistoryEntry);
+        }
+
+        LedgerStats s;
+        s.mLedgerSeq = header.ledgerSeq;
+        s.mTxCount = txset->size();
+        auto sqlBefore = db.totalQueryTime();
+        auto addBatchBefore = timerTotal(addBatch);
+        auto start = std::chrono::steady_clock::now();
+
+        LedgerCloseData closeData(header.ledgerSeq, txset, header.scpValue);
+        lm.closeLedger(closeData);
+
+        s.mApplyTime = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start);
+        s.mSqlTime = db.totalQueryTime() - sqlBefore;
+        s.mAddBatchTime = timerTotal(addBatch) - addBatchBefore;
+
+        if (lm.getLastClosedLedgerHeader().hash != hHeader.hash)
+        {
+            throw std::runtime_error(
+                "replay produced mismatched ledger hash at ledger " +
+                std::to_string(header.ledgerSeq));
+        }
+        if (header.ledgerSeq >= first)
+        {
+            stats.push_back(s);
+        }
+
+        // Run whatever closing the ledger posted, without waiting on timers.
+        while (mApp.getClock().crank(false) > 0)
+        {
+        }
+    }
+}
+
+std::vector<ArchiveReplayer::LedgerStats>
+ArchiveReplayer::replay(uint32_t first, uint32_t last)
+{
+    auto& hm = mApp.getHistoryManager();
+    uint32_t freq = hm.getCheckpointFrequency();
+    if (first > last || first < freq)
+    {
+        throw std::runtime_error("replay range must be ordered and start at "
+                                 "or after ledger " +
+                                 std::to_string(freq));
+    }
+
+    // Checkpoint N covers the ledgers up to and including N, and is named
+    // by the ledger preceding a multiple of the checkpoint frequency.
+    uint32_t bootstrapCheckpoint = hm.prevCheckpointLedger(first) - 1;
+    bootstrap(bootstrapCheckpoint);
+
+    std::vector<LedgerStats> stats;
+    for (uint32_t checkpoint = bootstrapCheckpoint + freq;
+         checkpoint < last + freq; checkpoint += freq)
+    {
+        replayCheckpoint(checkpoint, first, last, stats);
+    }
+    if (mApp.getLedgerManager().getLastClosedLedgerNum() != last)
+    {
+        throw std::runtime_error("archive ends before ledger " +
+                                 std::to_string(last));
+    }
+    return stats;
+}
+
+void
+ArchiveReplayer::writeCSV(std::vector<LedgerStats> const& stats,
+                          std::ostream& out)
+{
+    out << "ledger,txs,apply_ms,sql_ms,addbatch_ms,txs_per_sec\n";
+    for (auto const& s : stats)
+    {
+        out << s.mLedgerSeq << "," << s.mTxCount << ","
+            << std::chrono::duration<double, std::milli>(s.mApplyTime).count()
+            << ","
+            << std::chrono::duration<double, std::milli>(s.mSqlTime).count()
+            << ","
+            << std::chrono::duration<double, std::milli>(s.mAddBatchTime)
+                   .count()
+            << "," << s.txPerSecond() << "\n";
+    }
+}
+
+void
+ArchiveReplayer::writeJSON(std::vector<LedgerStats> const& stats,
+                           std::ostream& out)
+{
+    Json::Value root(Json::arrayValue);
+    for (auto const& s : stats)
+    {
+        Json::Value l;
+        l["ledger"] = s.mLedgerSeq;
+        l["txs"] = static_cast<Json::UInt>(s.mTxCount);
+        l["apply_ms"] =
+            std::chrono::duration<double, std::milli>(s.mApplyTime).count();
+        l["sql_ms"] =
+            std::chrono::duration<double, std::milli>(s.mSqlTime).count();
+        l["addbatch_ms"] =
+            std::chrono::duration<double, std::milli>(s.mAddBatchTime).count();
+        l["txs_per_sec"] = s.txPerSecond();
+        root.append(l);
+    }
+    out << root.toStyledString();
+}
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/TmpDir.h"
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Offline replay of a history archive that lives in a local directory.
+ *
+ * The replayer rebuilds ledger state from the buckets of the last checkpoint
+ * before the requested range, then feeds the recorded ledger headers and
+ * transaction sets of the range through LedgerManager::closeLedger as fast as
+ * it can, checking each resulting ledger hash against the archive. Timings
+ * are recorded per ledger, which makes this a benchmark of the apply path on
+ * real traffic, with no network and no downloads involved.
+ *
+ * The application should have a freshly-initialized database and no history
+ * archives configured (so that replay does not publish).
+ */
+class ArchiveReplayer
+{
+  public:
+    struct LedgerStats
+    {
+        uint32_t mLedgerSeq{0};
+        size_t mTxCount{0};
+        std::chrono::nanoseconds mApplyTime{0};
+        std::chrono::nanoseconds mSqlTime{0};
+        std::chrono::nanoseconds mAddBatchTime{0};
+
+        double txPerSecond() const;
+    };
+
+    ArchiveReplayer(Application& app, std::string const& archiveDir);
+
+    // Replay ledgers [first, last]; first must be past the first checkpoint.
+    // Ledgers between the bootstrap checkpoint and `first` are replayed but
+    // not reported.
+    std::vector<LedgerStats> replay(uint32_t first, uint32_t last);
+
+    static void writeCSV(std::vector<LedgerStats> const& stats,
+                         std::ostream& out);
+    static void writeJSON(std::vector<LedgerStats> const& stats,
+                          std::ostream& out);
+
+  private:
+    Application& mApp;
+    std::string mArchiveDir;
+    TmpDir mWorkDir;
+
+    // Copy a gzipped file out of the archive and decompress it; returns the
+    // path of the decompressed copy.
+    std::string fetchFile(std::string const& type,
+                          std::string const& hexDigits);
+    void bootstrap(uint32_t checkpoint);
+    void replayCheckpoint(uint32_t checkpoint, uint32_t first, uint32_t last,
+                          std::vector<LedgerStats>& stats);
+};
+}
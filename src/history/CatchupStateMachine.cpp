@@ -757,8 +757,8 @@ CatchupStateMachine::advanceVerifyingState(
     {
         uint32_t nextCheckpoint = i->first;
         std::weak_ptr<CatchupStateMachine> weak(shared_from_this());
-        mApp.getClock().getIOService().post(
-            [weak, prev, nextCheckpoint]()
+        mApp.getClock().post(
+            CrankStats::ORIGIN_HISTORY, [weak, prev, nextCheckpoint]()
             {
                 auto self = weak.lock();
                 if (!self)
@@ -959,15 +959,15 @@ CatchupStateMachine::advanceApplyingState()
     if (keepGoing)
     {
         std::weak_ptr<CatchupStateMachine> weak(shared_from_this());
-        mApp.getClock().getIOService().post([weak]()
-                                            {
-                                                auto self = weak.lock();
-                                                if (!self)
-                                                {
-                                                    return;
-                                                }
-                                                self->advanceApplyingState();
-                                            });
+        mApp.getClock().post(CrankStats::ORIGIN_HISTORY, [weak]()
+                             {
+                                 auto self = weak.lock();
+                                 if (!self)
+                                 {
+                                     return;
+                                 }
+                                 self->advanceApplyingState();
+                             });
     }
     else
     {
@@ -210,6 +210,8 @@ HistoryManagerImpl::HistoryManagerImpl(Application& app)
           app.getMetrics().NewMeter({"history", "catchup", "success"}, "event"))
     , mCatchupFailure(
           app.getMetrics().NewMeter({"history", "catchup", "failure"}, "event"))
+    , mCompressBytes(
+          app.getMetrics().NewMeter({"history", "compress", "byte"}, "byte"))
 {
 }
 
@@ -374,10 +376,10 @@ HistoryManagerImpl::verifyHash(
                     ec = std::make_error_code(std::errc::io_error);
                 }
             }
-            app.getClock().getIOService().post([ec, handler]()
-                                               {
-                                                   handler(ec);
-                                               });
+            app.getClock().post(CrankStats::ORIGIN_HISTORY, [ec, handler]()
+                                {
+                                    handler(ec);
+                                });
         });
 }
 
@@ -433,20 +435,38 @@ HistoryManagerImpl::compress(
         outputFile = filename;
     }
     commandLine += filename_nogz;
-    auto exit = app.getProcessManager().runProcess(commandLine, outputFile);
-    exit.async_wait(
-        [&app, filename_nogz, filename, handler](asio::error_code const& ec)
+    uint64_t bytes = 0;
+    {
+        std::ifstream in(filename_nogz, std::ifstream::ate |
+                                            std::ifstream::binary);
+        if (in)
         {
-            if (ec)
-            {
-                LOG(WARNING) << "'gzip " << filename_nogz << "' failed,"
-                             << " removing " << filename_nogz << " and "
-                             << filename;
-                std::remove(filename_nogz.c_str());
-                std::remove(filename.c_str());
-            }
-            handler(ec);
-        });
+            bytes = static_cast<uint64_t>(in.tellg());
+        }
+    }
+    auto& compressBytes = mCompressBytes;
+    auto exit = app.getProcessManager().runProcess(commandLine, outputFile);
+    exit.async_wait([&compressBytes, filename_nogz, filename, bytes,
+                     keepExisting, handler](asio::error_code const& ec)
+                    {
+                        if (ec)
+                        {
+                            LOG(WARNING) << "'gzip " << filename_nogz
+                                         << "' failed, removing its output";
+                            // An input we were asked to keep may be shared,
+                            // like a bucket, so it stays.
+                            if (!keepExisting)
+                            {
+                                std::remove(filename_nogz.c_str());
+                            }
+                            std::remove(filename.c_str());
+                        }
+                        else
+                        {
+                            compressBytes.Mark(bytes);
+                        }
+                        handler(ec);
+                    });
 }
 
 void
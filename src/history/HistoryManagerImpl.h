@@ -38,6 +38,8 @@ class HistoryManagerImpl : public HistoryManager
     medida::Meter& mCatchupSuccess;
     medida::Meter& mCatchupFailure;
 
+    medida::Meter& mCompressBytes;
+
   public:
     HistoryManagerImpl(Application& app);
     ~HistoryManagerImpl() override;
@@ -5,6 +5,7 @@
 #include "main/Application.h"
 #include "history/HistoryManager.h"
 #include "history/HistoryArchive.h"
+#include "history/ArchiveReplayer.h"
 #include "main/test.h"
 #include "main/ExternalQueue.h"
 #include "main/Config.h"
@@ -22,10 +23,12 @@
 #include "process/ProcessManager.h"
 #include "util/NonCopyable.h"
 #include "herder/LedgerCloseData.h"
+#include <algorithm>
 #include <cstdio>
 #include <xdrpp/autocheck.h>
 #include <fstream>
 #include <random>
+#include <sstream>
 
 using namespace stellar;
 
@@ -50,6 +53,12 @@ class TmpDirConfigurator : public Configurator
     {
     }
 
+    std::string const&
+    getArchiveDirName() const
+    {
+        return mDir.getName();
+    }
+
     Config&
     configure(Config& cfg, bool writable) const override
     {
@@ -665,6 +674,41 @@ TEST_CASE_METHOD(HistoryTests, "Full history catchup",
     }
 }
 
+TEST_CASE_METHOD(HistoryTests, "Replay archive from local directory",
+                 "[history][replay]")
+{
+    generateAndPublishInitialHistory(3);
+    auto const& lcl = app.getLedgerManager().getLastClosedLedgerHeader();
+
+    auto dir = std::dynamic_pointer_cast<TmpDirConfigurator>(mConfigurator);
+    REQUIRE(dir);
+
+    mCfgs.emplace_back(getTestConfig(1));
+    Application::pointer app2 = Application::create(clock, mCfgs.back());
+    ArchiveReplayer replayer(*app2, dir->getArchiveDirName());
+
+    uint32_t first = 70;
+    auto stats = replayer.replay(first, lcl.header.ledgerSeq);
+
+    REQUIRE(stats.size() == lcl.header.ledgerSeq - first + 1);
+    for (size_t i = 0; i < stats.size(); ++i)
+    {
+        CHECK(stats[i].mLedgerSeq == first + i);
+        CHECK(stats[i].mApplyTime.count() > 0);
+    }
+    CHECK(app2->getLedgerManager().getLastClosedLedgerHeader().hash ==
+          lcl.hash);
+
+    std::ostringstream csv;
+    ArchiveReplayer::writeCSV(stats, csv);
+    auto text = csv.str();
+    CHECK(static_cast<size_t>(std::count(text.begin(), text.end(), '\n')) ==
+          stats.size() + 1);
+
+    // there is no checkpoint to bootstrap from before the first one
+    CHECK_THROWS(replayer.replay(10, 20));
+}
+
 TEST_CASE_METHOD(HistoryTests, "History publish queueing",
                  "[history][historydelay][historycatchup]")
 {
@@ -13,7 +13,6 @@
 #include "main/Application.h"
 #include "main/Config.h"
 #include "database/Database.h"
-#include "ledger/LedgerHeaderFrame.h"
 #include "transactions/TransactionFrame.h"
 #include "util/Logging.h"
 #include "util/make_unique.h"
@@ -21,6 +20,8 @@
 
 #include "medida/metrics_registry.h"
 #include "medida/counter.h"
+#include "medida/histogram.h"
+#include "medida/meter.h"
 
 #include <soci.h>
 
@@ -44,9 +45,12 @@ struct StateSnapshot : public std::enable_shared_from_this<StateSnapshot>
     VirtualTimer mRetryTimer;
     size_t mRetryCount{0};
 
+    // history.compress.byte when publishing started
+    uint64_t mCompressedBytesAtStart{0};
+
     StateSnapshot(Application& app, HistoryArchiveState const& state);
     void makeLiveAndRetainBuckets();
-    bool writeHistoryBlocks() const;
+    bool writeHistoryBlocks(soci::session& sess) const;
     void writeHistoryBlocksWithRetry();
     void retryHistoryBlockWriteOrFail(asio::error_code const& ec);
 };
@@ -222,21 +226,34 @@ ArchivePublisher::enterSendingState()
             break;
 
         case FILE_PUBLISH_NEEDED:
+        {
             fi->setState(FILE_PUBLISH_COMPRESSING);
-            CLOG(DEBUG, "History") << "Compressing " << name;
-            hm.compress(fi->localPath_nogz(),
-                        [weak, name](asio::error_code const& ec)
-                        {
-                            auto self = weak.lock();
-                            if (!self)
-                            {
-                                return;
-                            }
-                            self->fileStateChange(ec, name,
-                                                  FILE_PUBLISH_COMPRESSED);
-                        },
-                        true);
+            auto compressed = [weak, name](asio::error_code const& ec)
+            {
+                auto self = weak.lock();
+                if (!self)
+                {
+                    return;
+                }
+                self->fileStateChange(ec, name, FILE_PUBLISH_COMPRESSED);
+            };
+            std::string hash;
+            if (fi->getBucketHashName(hash))
+            {
+                // Buckets are compressed once, whatever the number of
+                // archives and retries, and keep their compressed copy.
+                auto& bm = mApp.getBucketManager();
+                auto b = bm.getBucketByHash(hexToBin256(hash));
+                assert(b);
+                bm.compressBucket(b, compressed);
+            }
+            else
+            {
+                CLOG(DEBUG, "History") << "Compressing " << name;
+                hm.compress(fi->localPath_nogz(), compressed, true);
+            }
             break;
+        }
 
         case FILE_PUBLISH_COMPRESSING:
             break;
@@ -280,9 +297,15 @@ ArchivePublisher::enterSendingState()
             break;
 
         case FILE_PUBLISH_UPLOADED:
-            std::remove(fi->localPath_gz().c_str());
+        {
+            std::string hash;
+            if (!fi->getBucketHashName(hash))
+            {
+                std::remove(fi->localPath_gz().c_str());
+            }
             break;
         }
+        }
 
         minimumState = std::min(fi->getState(), minimumState);
     }
@@ -354,6 +377,10 @@ PublishStateMachine::PublishStateMachine(Application& app)
           app.getMetrics().NewCounter({"history", "memory", "publishers"}))
     , mPendingSnapsSize(
           app.getMetrics().NewCounter({"history", "memory", "pending-snaps"}))
+    , mCompressBytes(
+          app.getMetrics().NewMeter({"history", "compress", "byte"}, "byte"))
+    , mPublishCompressedBytes(app.getMetrics().NewHistogram(
+          {"history", "publish", "compressed-bytes"}))
     , mRecheckRunningMergeTimer(app)
 {
 }
@@ -449,15 +476,8 @@ StateSnapshot::makeLiveAndRetainBuckets()
 }
 
 bool
-StateSnapshot::writeHistoryBlocks() const
+StateSnapshot::writeHistoryBlocks(soci::session& sess) const
 {
-    std::unique_ptr<soci::session> snapSess(
-        mApp.getDatabase().canUsePool()
-            ? make_unique<soci::session>(mApp.getDatabase().getPool())
-            : nullptr);
-    soci::session& sess(snapSess ? *snapSess : mApp.getDatabase().getSession());
-    soci::transaction tx(sess);
-
     // The current "history block" is stored in _three_ files, one just ledger
     // headers, one TransactionHistoryEntry (which contain txSets) and
     // one TransactionHistoryResultEntry containing transaction set results.
@@ -478,11 +498,10 @@ StateSnapshot::writeHistoryBlocks() const
     CLOG(DEBUG, "History") << "Streaming " << count
                            << " ledgers worth of history, from " << begin;
 
-    size_t nHeaders = LedgerHeaderFrame::copyLedgerHeadersToStream(
-        mApp.getDatabase(), sess, begin, count, ledgerOut);
-    size_t nTxs = TransactionFrame::copyTransactionsToStream(
-        mApp.getNetworkID(), mApp.getDatabase(), sess, begin, count, txOut,
-        txResultOut);
+    size_t nHeaders;
+    size_t nTxs = TransactionFrame::copyHistoryToStreams(
+        mApp.getNetworkID(), mApp.getDatabase(), sess, begin, count, ledgerOut,
+        txOut, txResultOut, nHeaders);
     CLOG(DEBUG, "History") << "Wrote " << nHeaders << " ledger headers to "
                            << mLedgerSnapFile->localPath_nogz();
     CLOG(DEBUG, "History") << "Wrote " << nTxs << " transactions to "
@@ -507,6 +526,10 @@ StateSnapshot::writeHistoryBlocks() const
         return false;
     }
 
+    // Throws if the tail of any file could not be written out.
+    ledgerOut.close();
+    txOut.close();
+    txResultOut.close();
     return true;
 }
 
@@ -541,44 +564,45 @@ void
 StateSnapshot::writeHistoryBlocksWithRetry()
 {
     std::weak_ptr<StateSnapshot> weak(shared_from_this());
+    auto written = std::make_shared<bool>(false);
 
-    if (mApp.getDatabase().canUsePool())
-    {
-        mApp.getWorkerIOService().post(
-            [weak]()
+    mApp.getDatabase().postReadQuery(
+        "history-blocks",
+        [weak, written](soci::session& sess)
+        {
+            auto snap = weak.lock();
+            if (snap)
             {
-                auto snap = weak.lock();
-                if (!snap)
+                *written = snap->writeHistoryBlocks(sess);
+            }
+        },
+        [weak, written](std::exception_ptr ep)
+        {
+            auto snap = weak.lock();
+            if (!snap)
+            {
+                return;
+            }
+            asio::error_code ec;
+            if (ep)
+            {
+                try
                 {
-                    return;
+                    std::rethrow_exception(ep);
                 }
-
-                asio::error_code ec;
-                if (!snap->writeHistoryBlocks())
+                catch (std::exception& e)
                 {
-                    ec = std::make_error_code(std::errc::io_error);
+                    CLOG(WARNING, "History")
+                        << "Failed writing history blocks: " << e.what();
                 }
-                snap->mApp.getClock().getIOService().post(
-                    [weak, ec]()
-                    {
-                        auto snap = weak.lock();
-                        if (!snap)
-                        {
-                            return;
-                        }
-                        snap->retryHistoryBlockWriteOrFail(ec);
-                    });
-            });
-    }
-    else
-    {
-        asio::error_code ec;
-        if (!writeHistoryBlocks())
-        {
-            ec = std::make_error_code(std::errc::io_error);
-        }
-        retryHistoryBlockWriteOrFail(ec);
-    }
+                ec = std::make_error_code(std::errc::io_error);
+            }
+            else if (!*written)
+            {
+                ec = std::make_error_code(std::errc::io_error);
+            }
+            snap->retryHistoryBlockWriteOrFail(ec);
+        });
 }
 
 std::shared_ptr<StateSnapshot>
@@ -597,10 +621,11 @@ PublishStateMachine::writeNextSnapshot()
 {
     // Once we've taken a (synchronous) snapshot of the buckets and db, we then
     // run writeHistoryBlocks() to get the tx and ledger history files written
-    // out from the db. This may run synchronously (if we're not using a
-    // thread-pool-friendly db backend) or asynchronously on the worker pool if
-    // we're on, say, postgres). In either case, when complete it will call back
-    // to snapshotWritten(), at which point we can begin the actual publishing
+    // out from the db, through Database::postReadQuery. This runs on the main
+    // thread (if we're not using a thread-pool-friendly db backend) or on the
+    // worker pool in a read-only snapshot transaction (if we're on, say,
+    // postgres). In either case, when complete it will call back to
+    // snapshotWritten(), at which point we can begin the actual publishing
     // work.
 
     if (mPendingSnaps.empty())
@@ -657,6 +682,7 @@ PublishStateMachine::snapshotWritten(asio::error_code const& ec)
     }
     CLOG(DEBUG, "History") << "Publishing snapshot of ledger "
                            << snap->mLocalState.currentLedger;
+    snap->mCompressedBytesAtStart = mCompressBytes.count();
 
     // Iterate over writable archives instantiating an ArchivePublisher for them
     // with a callback that returns to the PublishStateMachine and possibly
@@ -696,6 +722,9 @@ PublishStateMachine::snapshotPublished(asio::error_code const& ec)
                            << mPublishers.size() << " remain";
     if (mPublishers.empty())
     {
+        auto snap = mPendingSnaps.front().first;
+        mPublishCompressedBytes.Update(mCompressBytes.count() -
+                                       snap->mCompressedBytesAtStart);
         finishOne(ecSaved);
     }
 }
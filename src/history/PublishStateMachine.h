@@ -21,6 +21,8 @@ class session;
 namespace medida
 {
 class Counter;
+class Histogram;
+class Meter;
 }
 
 namespace stellar
@@ -103,6 +105,8 @@ class PublishStateMachine
     std::deque<std::pair<SnapshotPtr, PublishCallback>> mPendingSnaps;
     medida::Counter& mPublishersSize;
     medida::Counter& mPendingSnapsSize;
+    medida::Meter& mCompressBytes;
+    medida::Histogram& mPublishCompressedBytes;
     VirtualTimer mRecheckRunningMergeTimer;
 
     void writeNextSnapshot();
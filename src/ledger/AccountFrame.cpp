@@ -13,6 +13,7 @@
 #include "util/types.h"
 #include "lib/util/format.h"
 #include <algorithm>
+#include <set>
 
 using namespace soci;
 using namespace std;
@@ -20,6 +21,7 @@ using namespace std;
 namespace stellar
 {
 using xdr::operator<;
+using xdr::operator==;
 
 const char* AccountFrame::kSQLCreateStatement1 =
     "CREATE TABLE accounts"
@@ -32,7 +34,8 @@ const char* AccountFrame::kSQLCreateStatement1 =
     "homedomain      VARCHAR(32)  NOT NULL,"
     "thresholds      TEXT         NOT NULL,"
     "flags           INT          NOT NULL,"
-    "lastmodified    INT          NOT NULL"
+    "lastmodified    INT          NOT NULL,"
+    "signers         TEXT"
     ");";
 
 const char* AccountFrame::kSQLCreateStatement2 =
@@ -51,6 +54,19 @@ const char* AccountFrame::kSQLCreateStatement4 = "CREATE INDEX accountbalances "
                                                  "ON accounts (balance) WHERE "
                                                  "balance >= 1000000000";
 
+const char* AccountFrame::kSQLCreateStatement5 =
+    "CREATE TABLE inflationvotes"
+    "("
+    "inflationdest   VARCHAR(56)  PRIMARY KEY,"
+    "votes           BIGINT       NOT NULL CHECK (votes > 0)"
+    ");";
+
+const char* AccountFrame::kSQLCreateStatement6 =
+    "CREATE INDEX inflationvotesbyvotes ON inflationvotes "
+    "(votes, inflationdest)";
+
+const int64 AccountFrame::kMinInflationVoteBalance = 1000000000;
+
 AccountFrame::AccountFrame()
     : EntryFrame(ACCOUNT), mAccountEntry(mEntry.data.account())
 {
@@ -211,33 +227,63 @@ AccountFrame::getLowThreshold() const
 
 AccountFrame::pointer
 AccountFrame::loadAccount(AccountID const& accountID, Database& db)
+{
+    return loadAccount(accountID, db, db.getSession());
+}
+
+// accounts.signers holds the account's signers, XDR encoded in base64
+static std::string
+packSigners(decltype(AccountEntry::signers) const& signers)
+{
+    return bn::encode_b64(xdr::xdr_to_opaque(signers));
+}
+
+static void
+unpackSigners(std::string const& packed,
+              decltype(AccountEntry::signers)& signers)
+{
+    std::vector<uint8_t> bin;
+    bn::decode_b64(packed, bin);
+    xdr::xdr_from_opaque(bin, signers);
+}
+
+AccountFrame::pointer
+AccountFrame::newAccount(AccountID const& accountID)
+{
+    AccountFrame::pointer res = make_shared<AccountFrame>(accountID);
+    res->setIsNew();
+    res->normalize();
+    res->mUpdateSigners = false;
+    return res;
+}
+
+AccountFrame::pointer
+AccountFrame::loadAccount(AccountID const& accountID, Database& db,
+                          soci::session& sess)
 {
     LedgerKey key;
-    uint32_t sqlIsNew;
     key.type(ACCOUNT);
     key.account().accountID = accountID;
-    if (cachedEntryExists(key, db))
+    bool useCache = db.isMainSession(sess);
+    if (useCache && cachedEntryExists(key, db))
     {
+        // absent accounts are cached as nullptr
         auto p = getCachedEntry(key, db);
-        return p ? std::make_shared<AccountFrame>(*p) : nullptr;
+        return p ? std::make_shared<AccountFrame>(*p) : newAccount(accountID);
     }
 
     std::string actIDStrKey = PubKeyUtils::toStrKey(accountID);
 
-    std::string publicKey, inflationDest, creditAuthKey;
-    std::string homeDomain, thresholds;
-    soci::indicator inflationDestInd;
+    std::string inflationDest, homeDomain, thresholds, signers;
+    soci::indicator inflationDestInd, signersInd;
 
     AccountFrame::pointer res = make_shared<AccountFrame>(accountID);
     AccountEntry& account = res->getAccount();
-    CLOG(INFO, "Database") << "BEFORE getisnew is: " << res->getIsNew();
-    auto prep =
-        db.getPreparedStatement("SELECT "
-"balance, seqnum, numsubentries, inflationdest, homedomain, thresholds, flags,lastmodified, 0 as isnew "
-"FROM accounts WHERE accountid=:v1 "
-"UNION SELECT "
-"0 as balance, 0 as seqnum, 0 as numsubentries, null as inflationdest, '' as homedomain,'AQAAAA==' as thresholds,0 as flags,0 as lastmodified, 1 as isnew  "
-"WHERE NOT EXISTS (SELECT * FROM accounts WHERE accountid=:v1)");
+    static StatementID const loadStmt = Database::registerStatement(
+        "SELECT balance, seqnum, numsubentries, inflationdest, homedomain, "
+        "thresholds, flags, lastmodified, signers FROM accounts "
+        "WHERE accountid=:v1");
+    auto prep = db.getPreparedStatement(loadStmt, sess);
     auto& st = prep.statement();
     st.exchange(into(account.balance));
     st.exchange(into(account.seqNum));
@@ -247,7 +293,7 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     st.exchange(into(thresholds));
     st.exchange(into(account.flags));
     st.exchange(into(res->getLastModified()));
-    st.exchange(into(sqlIsNew));
+    st.exchange(into(signers, signersInd));
     st.exchange(use(actIDStrKey, "v1"));
     st.define_and_bind();
     {
@@ -257,15 +303,12 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
 
     if (!st.got_data())
     {
-        putCachedEntry(key, nullptr, db);
-        return nullptr;
-    }
-    if (sqlIsNew == 1) {
-        res->setIsNew();
+        if (useCache)
+        {
+            putCachedEntry(key, nullptr, db);
+        }
+        return newAccount(accountID);
     }
-    CLOG(INFO, "Database") << actIDStrKey <<" sqlisnew is: " << sqlIsNew;
-    CLOG(INFO, "Database") << actIDStrKey <<" isnew is: " << res->isnew;
-
 
     account.homeDomain = homeDomain;
 
@@ -279,31 +322,132 @@ AccountFrame::loadAccount(AccountID const& accountID, Database& db)
     }
 
     account.signers.clear();
-
-    if (account.numSubEntries != 0)
+    if (signersInd == soci::i_ok)
     {
-        auto signers = loadSigners(db, actIDStrKey);
-        account.signers.insert(account.signers.begin(), signers.begin(),
-                               signers.end());
+        unpackSigners(signers, account.signers);
     }
 
     res->normalize();
     res->mUpdateSigners = false;
     assert(res->isValid());
     res->mKeyCalculated = false;
-    res->putCachedEntry(db);
+    if (useCache)
+    {
+        res->putCachedEntry(db);
+    }
     return res;
 }
 
+size_t
+AccountFrame::prefetch(std::vector<AccountID> const& ids, Database& db)
+{
+    std::vector<std::string> todo;
+    todo.reserve(ids.size());
+    for (auto const& id : ids)
+    {
+        todo.emplace_back(PubKeyUtils::toStrKey(id));
+    }
+    std::sort(todo.begin(), todo.end());
+    todo.erase(std::unique(todo.begin(), todo.end()), todo.end());
+
+    static StatementID const loadStmt = Database::registerStatement(
+        "SELECT accountid, balance, seqnum, numsubentries, inflationdest, "
+        "homedomain, thresholds, flags, lastmodified, signers FROM accounts "
+        "WHERE accountid IN (" +
+        batchPlaceholders("id") + ")");
+
+    size_t loaded = 0;
+    for (size_t b = 0; b < todo.size(); b += kPrefetchBatchSize)
+    {
+        auto batchEnd =
+            todo.begin() + std::min(b + kPrefetchBatchSize, todo.size());
+        std::vector<std::string> batch(todo.begin() + b, batchEnd);
+        batch.resize(kPrefetchBatchSize, batch[0]);
+
+        std::set<std::string> found;
+        {
+            std::string actIDStrKey, inflationDest, homeDomain, thresholds;
+            std::string signers;
+            soci::indicator inflationDestInd, signersInd;
+            LedgerEntry le;
+            le.data.type(ACCOUNT);
+            AccountEntry& account = le.data.account();
+
+            auto prep = db.getPreparedStatement(loadStmt);
+            auto& st = prep.statement();
+            st.exchange(into(actIDStrKey));
+            st.exchange(into(account.balance));
+            st.exchange(into(account.seqNum));
+            st.exchange(into(account.numSubEntries));
+            st.exchange(into(inflationDest, inflationDestInd));
+            st.exchange(into(homeDomain));
+            st.exchange(into(thresholds));
+            st.exchange(into(account.flags));
+            st.exchange(into(le.lastModifiedLedgerSeq));
+            st.exchange(into(signers, signersInd));
+            for (auto& id : batch)
+            {
+                st.exchange(use(id));
+            }
+            st.define_and_bind();
+            {
+                auto timer = db.getSelectTimer("account");
+                st.execute(true);
+            }
+            while (st.got_data())
+            {
+                account.accountID = PubKeyUtils::fromStrKey(actIDStrKey);
+                account.homeDomain = homeDomain;
+                bn::decode_b64(thresholds.begin(), thresholds.end(),
+                               account.thresholds.begin());
+                account.inflationDest.reset();
+                if (inflationDestInd == soci::i_ok)
+                {
+                    account.inflationDest.activate() =
+                        PubKeyUtils::fromStrKey(inflationDest);
+                }
+                account.signers.clear();
+                if (signersInd == soci::i_ok)
+                {
+                    unpackSigners(signers, account.signers);
+                }
+
+                AccountFrame res(le);
+                res.normalize();
+                assert(res.isValid());
+                res.putCachedEntry(db);
+                found.insert(actIDStrKey);
+                ++loaded;
+                st.fetch();
+            }
+        }
+
+        // remember the accounts that do not exist as well
+        for (auto it = todo.begin() + b; it != batchEnd; ++it)
+        {
+            if (found.find(*it) == found.end())
+            {
+                LedgerKey key;
+                key.type(ACCOUNT);
+                key.account().accountID = PubKeyUtils::fromStrKey(*it);
+                putCachedEntry(key, nullptr, db);
+            }
+        }
+    }
+    return loaded;
+}
+
 std::vector<Signer>
-AccountFrame::loadSigners(Database& db, std::string const& actIDStrKey)
+AccountFrame::loadSigners(Database& db, soci::session& sess,
+                          std::string const& actIDStrKey)
 {
     std::vector<Signer> res;
     string pubKey;
     Signer signer;
 
-    auto prep2 = db.getPreparedStatement("SELECT publickey, weight FROM "
-                                         "signers WHERE accountid =:id");
+    static StatementID const loadSignersStmt = Database::registerStatement(
+        "SELECT publickey, weight FROM signers WHERE accountid =:id");
+    auto prep2 = db.getPreparedStatement(loadSignersStmt, sess);
     auto& st2 = prep2.statement();
     st2.exchange(use(actIDStrKey));
     st2.exchange(into(pubKey));
@@ -328,18 +472,18 @@ AccountFrame::loadSigners(Database& db, std::string const& actIDStrKey)
 bool
 AccountFrame::exists(Database& db, LedgerKey const& key)
 {
-    if (cachedEntryExists(key, db) && getCachedEntry(key, db) != nullptr)
+    if (cachedEntryExists(key, db))
     {
-        return true;
+        return getCachedEntry(key, db) != nullptr;
     }
 
     std::string actIDStrKey = PubKeyUtils::toStrKey(key.account().accountID);
     int exists = 0;
     {
         auto timer = db.getSelectTimer("account-exists");
-        auto prep =
-            db.getPreparedStatement("SELECT EXISTS (SELECT NULL FROM accounts "
-                                    "WHERE accountid=:v1)");
+        static StatementID const existsStmt = Database::registerStatement(
+            "SELECT EXISTS (SELECT NULL FROM accounts WHERE accountid=:v1)");
+        auto prep = db.getPreparedStatement(existsStmt);
         auto& st = prep.statement();
         st.exchange(use(actIDStrKey));
         st.exchange(into(exists));
@@ -367,13 +511,16 @@ void
 AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
                           LedgerKey const& key)
 {
+    std::string actIDStrKey = PubKeyUtils::toStrKey(key.account().accountID);
+    updateInflationVotes(db, key, actIDStrKey, nullptr, false);
+
     flushCachedEntry(key, db);
 
-    std::string actIDStrKey = PubKeyUtils::toStrKey(key.account().accountID);
     {
         auto timer = db.getDeleteTimer("account");
-        auto prep = db.getPreparedStatement(
+        static StatementID const deleteStmt = Database::registerStatement(
             "DELETE from accounts where accountid= :v1");
+        auto prep = db.getPreparedStatement(deleteStmt);
         auto& st = prep.statement();
         st.exchange(soci::use(actIDStrKey));
         st.define_and_bind();
@@ -381,8 +528,10 @@ AccountFrame::storeDelete(LedgerDelta& delta, Database& db,
     }
     {
         auto timer = db.getDeleteTimer("signer");
-        auto prep =
-            db.getPreparedStatement("DELETE from signers where accountid= :v1");
+        static StatementID const deleteSignersStmt =
+            Database::registerStatement(
+                "DELETE from signers where accountid= :v1");
+        auto prep = db.getPreparedStatement(deleteSignersStmt);
         auto& st = prep.statement();
         st.exchange(soci::use(actIDStrKey));
         st.define_and_bind();
@@ -398,24 +547,22 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
 
     touch(delta);
 
+    std::string actIDStrKey = PubKeyUtils::toStrKey(mAccountEntry.accountID);
+    updateInflationVotes(db, getKey(), actIDStrKey, &mAccountEntry, insert);
+
     flushCachedEntry(db);
 
-    std::string actIDStrKey = PubKeyUtils::toStrKey(mAccountEntry.accountID);
-    std::string sql;
-
-   
-        sql = std::string(
-            "INSERT INTO accounts ( accountid, balance, seqnum, "
-            "numsubentries, inflationdest, homedomain, thresholds, flags, "
-            "lastmodified ) "
-            "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8 ) "
-            "ON CONFLICT (accountid) DO UPDATE SET balance = :v1, seqnum = :v2, "
-            "numsubentries = :v3, "
-            "inflationdest = :v4, homedomain = :v5, thresholds = :v6, "
-            "flags = :v7, lastmodified = :v8");
-   
-
-    auto prep = db.getPreparedStatement(sql);
+    static StatementID const upsertStmt = Database::registerStatement(
+        "INSERT INTO accounts ( accountid, balance, seqnum, "
+        "numsubentries, inflationdest, homedomain, thresholds, flags, "
+        "lastmodified, signers ) "
+        "VALUES ( :id, :v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8, :v9 ) "
+        "ON CONFLICT (accountid) DO UPDATE SET balance = :v1, seqnum = :v2, "
+        "numsubentries = :v3, "
+        "inflationdest = :v4, homedomain = :v5, thresholds = :v6, "
+        "flags = :v7, lastmodified = :v8, signers = :v9");
+
+    auto prep = db.getPreparedStatement(upsertStmt);
 
     soci::indicator inflation_ind = soci::i_null;
     string inflationDestStrKey;
@@ -429,6 +576,14 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
 
     string thresholds(bn::encode_b64(mAccountEntry.thresholds));
 
+    soci::indicator signers_ind = soci::i_null;
+    string signers;
+    if (!mAccountEntry.signers.empty())
+    {
+        signers = packSigners(mAccountEntry.signers);
+        signers_ind = soci::i_ok;
+    }
+
     {
         soci::statement& st = prep.statement();
         st.exchange(use(actIDStrKey, "id"));
@@ -441,6 +596,7 @@ AccountFrame::storeUpdate(LedgerDelta& delta, Database& db, bool insert)
         st.exchange(use(thresholds, "v6"));
         st.exchange(use(mAccountEntry.flags, "v7"));
         st.exchange(use(getLastModified(), "v8"));
+        st.exchange(use(signers, signers_ind, "v9"));
         st.define_and_bind();
         {
             auto timer = insert ? db.getInsertTimer("account")
@@ -479,7 +635,7 @@ AccountFrame::applySigners(Database& db, bool insert)
     std::vector<Signer> signers;
     if (!insert)
     {
-        signers = loadSigners(db, actIDStrKey);
+        signers = loadSigners(db, db.getSession(), actIDStrKey);
     }
 
     auto it_new = mAccountEntry.signers.begin();
@@ -514,9 +670,11 @@ AccountFrame::applySigners(Database& db, bool insert)
                 std::string signerStrKey =
                     PubKeyUtils::toStrKey(it_new->pubKey);
                 auto timer = db.getUpdateTimer("signer");
-                auto prep2 = db.getPreparedStatement(
-                    "UPDATE signers set weight=:v1 WHERE "
-                    "accountid=:v2 AND publickey=:v3");
+                static StatementID const updateSignerStmt =
+                    Database::registerStatement(
+                        "UPDATE signers set weight=:v1 WHERE "
+                        "accountid=:v2 AND publickey=:v3");
+                auto prep2 = db.getPreparedStatement(updateSignerStmt);
                 auto& st = prep2.statement();
                 st.exchange(use(it_new->weight));
                 st.exchange(use(actIDStrKey));
@@ -537,9 +695,11 @@ AccountFrame::applySigners(Database& db, bool insert)
             // signer was added
             std::string signerStrKey = PubKeyUtils::toStrKey(it_new->pubKey);
 
-            auto prep2 = db.getPreparedStatement("INSERT INTO signers "
-                                                 "(accountid,publickey,weight) "
-                                                 "VALUES (:v1,:v2,:v3)");
+            static StatementID const insertSignerStmt =
+                Database::registerStatement("INSERT INTO signers "
+                                            "(accountid,publickey,weight) "
+                                            "VALUES (:v1,:v2,:v3)");
+            auto prep2 = db.getPreparedStatement(insertSignerStmt);
             auto& st = prep2.statement();
             st.exchange(use(actIDStrKey));
             st.exchange(use(signerStrKey));
@@ -559,9 +719,11 @@ AccountFrame::applySigners(Database& db, bool insert)
             // signer was deleted
             std::string signerStrKey = PubKeyUtils::toStrKey(it_old->pubKey);
 
-            auto prep2 = db.getPreparedStatement("DELETE from signers WHERE "
-                                                 "accountid=:v2 AND "
-                                                 "publickey=:v3");
+            static StatementID const deleteSignerStmt =
+                Database::registerStatement("DELETE from signers WHERE "
+                                            "accountid=:v2 AND "
+                                            "publickey=:v3");
+            auto prep2 = db.getPreparedStatement(deleteSignerStmt);
             auto& st = prep2.statement();
             st.exchange(use(actIDStrKey));
             st.exchange(use(signerStrKey));
@@ -600,26 +762,175 @@ AccountFrame::storeAdd(LedgerDelta& delta, Database& db)
     storeUpdate(delta, db, true);
 }
 
+// adds `votes`, which may be negative, to the tally of `inflationDest`
+static void
+adjustInflationVotes(Database& db, std::string const& inflationDest,
+                     int64 votes)
+{
+    if (votes > 0)
+    {
+        static StatementID const upsertStmt = Database::registerStatement(
+            "INSERT INTO inflationvotes (inflationdest, votes) "
+            "VALUES (:d, :v) ON CONFLICT (inflationdest) DO UPDATE SET "
+            "votes = inflationvotes.votes + :v");
+        auto prep = db.getPreparedStatement(upsertStmt);
+        auto& st = prep.statement();
+        st.exchange(use(inflationDest, "d"));
+        st.exchange(use(votes, "v"));
+        st.define_and_bind();
+        {
+            auto timer = db.getUpdateTimer("inflationvotes");
+            st.execute(true);
+        }
+        if (st.get_affected_rows() != 1)
+        {
+            throw std::runtime_error(
+                "Could not update data in SQL (inflation votes)");
+        }
+        return;
+    }
+
+    // the destination loses its last voter: drop it from the tally
+    int64 remaining = -votes;
+    {
+        static StatementID const deleteStmt = Database::registerStatement(
+            "DELETE FROM inflationvotes WHERE inflationdest = :d "
+            "AND votes = :v");
+        auto prep = db.getPreparedStatement(deleteStmt);
+        auto& st = prep.statement();
+        st.exchange(use(inflationDest, "d"));
+        st.exchange(use(remaining, "v"));
+        st.define_and_bind();
+        {
+            auto timer = db.getDeleteTimer("inflationvotes");
+            st.execute(true);
+        }
+        if (st.get_affected_rows() == 1)
+        {
+            return;
+        }
+    }
+
+    static StatementID const updateStmt = Database::registerStatement(
+        "UPDATE inflationvotes SET votes = votes + :v "
+        "WHERE inflationdest = :d");
+    auto prep = db.getPreparedStatement(updateStmt);
+    auto& st = prep.statement();
+    st.exchange(use(votes, "v"));
+    st.exchange(use(inflationDest, "d"));
+    st.define_and_bind();
+    {
+        auto timer = db.getUpdateTimer("inflationvotes");
+        st.execute(true);
+    }
+    if (st.get_affected_rows() != 1)
+    {
+        throw std::runtime_error(
+            "Could not update data in SQL (inflation votes)");
+    }
+}
+
+// returns the votes `account` gives to its inflation destination, and sets
+// `inflationDest` if there are any
+static int64
+inflationVotesOf(AccountEntry const& account, std::string& inflationDest)
+{
+    if (!account.inflationDest ||
+        account.balance < AccountFrame::kMinInflationVoteBalance)
+    {
+        return 0;
+    }
+    inflationDest = PubKeyUtils::toStrKey(*account.inflationDest);
+    return account.balance;
+}
+
+void
+AccountFrame::updateInflationVotes(Database& db, LedgerKey const& key,
+                                   std::string const& actIDStrKey,
+                                   AccountEntry const* newEntry, bool insert)
+{
+    std::string oldDest;
+    int64 oldVotes = 0;
+    if (!insert)
+    {
+        // the entry cache, when it has the account, holds what is stored
+        if (cachedEntryExists(key, db))
+        {
+            auto p = getCachedEntry(key, db);
+            if (p)
+            {
+                oldVotes = inflationVotesOf(p->data.account(), oldDest);
+            }
+        }
+        else
+        {
+            static StatementID const loadStmt = Database::registerStatement(
+                "SELECT balance, inflationdest FROM accounts "
+                "WHERE accountid = :id");
+            int64 balance = 0;
+            std::string inflationDest;
+            soci::indicator inflationDestInd = soci::i_null;
+            auto prep = db.getPreparedStatement(loadStmt);
+            auto& st = prep.statement();
+            st.exchange(into(balance));
+            st.exchange(into(inflationDest, inflationDestInd));
+            st.exchange(use(actIDStrKey));
+            st.define_and_bind();
+            {
+                auto timer = db.getSelectTimer("account");
+                st.execute(true);
+            }
+            if (st.got_data() && inflationDestInd == soci::i_ok &&
+                balance >= kMinInflationVoteBalance)
+            {
+                oldDest = inflationDest;
+                oldVotes = balance;
+            }
+        }
+    }
+
+    std::string newDest;
+    int64 newVotes = newEntry ? inflationVotesOf(*newEntry, newDest) : 0;
+
+    if (oldVotes != 0 && newVotes != 0 && oldDest == newDest)
+    {
+        if (oldVotes != newVotes)
+        {
+            adjustInflationVotes(db, newDest, newVotes - oldVotes);
+        }
+        return;
+    }
+    if (oldVotes != 0)
+    {
+        adjustInflationVotes(db, oldDest, -oldVotes);
+    }
+    if (newVotes != 0)
+    {
+        adjustInflationVotes(db, newDest, newVotes);
+    }
+}
+
 void
 AccountFrame::processForInflation(
     std::function<bool(AccountFrame::InflationVotes const&)> inflationProcessor,
     int maxWinners, Database& db)
 {
-    soci::session& session = db.getSession();
-
     InflationVotes v;
     std::string inflationDest;
 
-    soci::statement st =
-        (session.prepare
-             << "SELECT"
-                " sum(balance) AS votes, inflationdest FROM accounts WHERE"
-                " inflationdest IS NOT NULL"
-                " AND balance >= 1000000000 GROUP BY inflationdest"
-                " ORDER BY votes DESC, inflationdest DESC LIMIT :lim",
-         into(v.mVotes), into(inflationDest), use(maxWinners));
-
-    st.execute(true);
+    static StatementID const winnersStmt = Database::registerStatement(
+        "SELECT votes, inflationdest FROM inflationvotes "
+        "ORDER BY votes DESC, inflationdest DESC LIMIT :lim");
+    auto prep = db.getPreparedStatement(winnersStmt);
+    auto& st = prep.statement();
+    st.exchange(into(v.mVotes));
+    st.exchange(into(inflationDest));
+    st.exchange(use(maxWinners));
+    st.define_and_bind();
+    {
+        auto timer = db.getSelectTimer("inflation");
+        st.execute(true);
+    }
 
     while (st.got_data())
     {
@@ -632,6 +943,40 @@ AccountFrame::processForInflation(
     }
 }
 
+std::unordered_map<AccountID, int64>
+AccountFrame::loadInflationVotes(Database& db)
+{
+    std::unordered_map<AccountID, int64> res;
+    int64 votes;
+    std::string inflationDest;
+    soci::statement st =
+        (db.getSession().prepare
+             << "SELECT votes, inflationdest FROM inflationvotes",
+         into(votes), into(inflationDest));
+    st.execute(true);
+    while (st.got_data())
+    {
+        res[PubKeyUtils::fromStrKey(inflationDest)] = votes;
+        st.fetch();
+    }
+    return res;
+}
+
+void
+AccountFrame::initializeInflationVotes(Database& db)
+{
+    db.getSession() << "DROP TABLE IF EXISTS inflationvotes;";
+    db.getSession() << kSQLCreateStatement5;
+    db.getSession() << kSQLCreateStatement6;
+
+    int64 minBalance = kMinInflationVoteBalance;
+    db.getSession() << "INSERT INTO inflationvotes (inflationdest, votes) "
+                       "SELECT inflationdest, sum(balance) FROM accounts "
+                       "WHERE inflationdest IS NOT NULL AND balance >= :min "
+                       "GROUP BY inflationdest",
+        use(minBalance);
+}
+
 std::unordered_map<AccountID, AccountFrame::pointer>
 AccountFrame::checkDB(Database& db)
 {
@@ -680,9 +1025,62 @@ AccountFrame::checkDB(Database& db)
             st.fetch();
         }
     }
+    // the signers table must hold the same signers as accounts.signers
+    for (auto const& s : state)
+    {
+        auto const& signers = s.second->mAccountEntry.signers;
+        if (signers.empty())
+        {
+            continue;
+        }
+        auto id = PubKeyUtils::toStrKey(s.first);
+        auto stored = loadSigners(db, db.getSession(), id);
+        if (stored.size() != signers.size() ||
+            !std::equal(stored.begin(), stored.end(), signers.begin(),
+                        [](Signer const& a, Signer const& b)
+                        {
+                            return a.pubKey == b.pubKey &&
+                                   a.weight == b.weight;
+                        }))
+        {
+            throw std::runtime_error(
+                fmt::format("Mismatch signers for account {}", id));
+        }
+    }
     return state;
 }
 
+void
+AccountFrame::initializeInlineSigners(Database& db)
+{
+    db.getSession() << "ALTER TABLE accounts ADD signers TEXT";
+
+    std::vector<std::string> ids;
+    {
+        std::string id;
+        soci::statement st =
+            (db.getSession().prepare
+                 << "SELECT DISTINCT accountid FROM signers",
+             soci::into(id));
+        st.execute(true);
+        while (st.got_data())
+        {
+            ids.emplace_back(id);
+            st.fetch();
+        }
+    }
+    for (auto& id : ids)
+    {
+        auto signers = loadSigners(db, db.getSession(), id);
+        decltype(AccountEntry::signers) packed;
+        packed.assign(signers.begin(), signers.end());
+        std::string s = packSigners(packed);
+        db.getSession() << "UPDATE accounts SET signers = :s "
+                           "WHERE accountid = :id",
+            use(s), use(id);
+    }
+}
+
 void
 AccountFrame::dropAll(Database& db)
 {
@@ -693,5 +1091,7 @@ AccountFrame::dropAll(Database& db)
     db.getSession() << kSQLCreateStatement2;
     db.getSession() << kSQLCreateStatement3;
     db.getSession() << kSQLCreateStatement4;
+
+    initializeInflationVotes(db);
 }
 }
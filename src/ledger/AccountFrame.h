@@ -35,10 +35,22 @@ class AccountFrame : public EntryFrame
 
     bool isValid();
 
-    static std::vector<Signer> loadSigners(Database& db,
+    // the account loadAccount returns for accounts that do not exist
+    static AccountFrame::pointer newAccount(AccountID const& accountID);
+
+    // Signers are stored both inline, packed in accounts.signers, which is
+    // what loads read, and in the signers table for external consumers.
+    static std::vector<Signer> loadSigners(Database& db, soci::session& sess,
                                            std::string const& actIDStrKey);
     void applySigners(Database& db, bool insert);
 
+    // moves the votes of the account stored under `key` (as found in the
+    // entry cache or database) to what `newEntry` votes for
+    static void updateInflationVotes(Database& db, LedgerKey const& key,
+                                     std::string const& actIDStrKey,
+                                     AccountEntry const* newEntry,
+                                     bool insert);
+
   public:
     typedef std::shared_ptr<AccountFrame> pointer;
     
@@ -124,8 +136,22 @@ class AccountFrame : public EntryFrame
     static uint64_t countObjects(soci::session& sess);
 
     // database utilities
+    // Loads the account, signers included, with one point query. Accounts
+    // that do not exist load as a new, empty account; the entry cache
+    // remembers them as absent so that they are not looked up again.
     static AccountFrame::pointer loadAccount(AccountID const& accountID,
                                              Database& db);
+    // Loads through `sess`, which may be a connection-pool session on a
+    // worker thread; the entry cache is only consulted for the main session.
+    static AccountFrame::pointer loadAccount(AccountID const& accountID,
+                                             Database& db,
+                                             soci::session& sess);
+
+    // Loads `ids` with batched queries on the main session and puts the
+    // accounts, or their absence, into the entry cache, so that the
+    // loadAccount calls that follow are served from memory. Returns the
+    // number of accounts loaded.
+    static size_t prefetch(std::vector<AccountID> const& ids, Database& db);
 
     // compare signers, ignores weight
     static bool signerCompare(Signer const& s1, Signer const& s2);
@@ -138,19 +164,39 @@ class AccountFrame : public EntryFrame
         AccountID mInflationDest;
     };
 
+    // Only accounts holding at least this balance count towards the votes
+    // of their inflation destination.
+    static const int64 kMinInflationVoteBalance;
+
+    // Calls inflationProcessor with the destinations that received the most
+    // votes, best first, at most maxWinners of them. The tally is kept up to
+    // date in the inflationvotes table as accounts are stored, so this reads
+    // an index rather than aggregating the accounts table.
     // inflationProcessor returns true to continue processing, false otherwise
     static void processForInflation(
         std::function<bool(InflationVotes const&)> inflationProcessor,
         int maxWinners, Database& db);
 
+    // Votes per destination as stored in the inflationvotes table.
+    static std::unordered_map<AccountID, int64>
+    loadInflationVotes(Database& db);
+
+    // Creates the inflationvotes table and fills it from the accounts table.
+    static void initializeInflationVotes(Database& db);
+
     // loads all accounts from database and checks for consistency (slow!)
     static std::unordered_map<AccountID, AccountFrame::pointer>
     checkDB(Database& db);
 
+    // Adds the accounts.signers column and fills it from the signers table.
+    static void initializeInlineSigners(Database& db);
+
     static void dropAll(Database& db);
     static const char* kSQLCreateStatement1;
     static const char* kSQLCreateStatement2;
     static const char* kSQLCreateStatement3;
     static const char* kSQLCreateStatement4;
+    static const char* kSQLCreateStatement5;
+    static const char* kSQLCreateStatement6;
 };
 }
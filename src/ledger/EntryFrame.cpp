@@ -39,6 +39,12 @@ EntryFrame::FromXDR(LedgerEntry const& from)
 
 EntryFrame::pointer
 EntryFrame::storeLoad(LedgerKey const& key, Database& db)
+{
+    return storeLoad(key, db, db.getSession());
+}
+
+EntryFrame::pointer
+EntryFrame::storeLoad(LedgerKey const& key, Database& db, soci::session& sess)
 {
     EntryFrame::pointer res;
 
@@ -46,20 +52,20 @@ EntryFrame::storeLoad(LedgerKey const& key, Database& db)
     {
     case ACCOUNT:
         res = std::static_pointer_cast<EntryFrame>(
-            AccountFrame::loadAccount(key.account().accountID, db));
+            AccountFrame::loadAccount(key.account().accountID, db, sess));
         break;
     case TRUSTLINE:
     {
         auto const& tl = key.trustLine();
         res = std::static_pointer_cast<EntryFrame>(
-            TrustFrame::loadTrustLine(tl.accountID, tl.asset, db));
+            TrustFrame::loadTrustLine(tl.accountID, tl.asset, db, sess));
     }
     break;
     case OFFER:
     {
         auto const& off = key.offer();
         res = std::static_pointer_cast<EntryFrame>(
-            OfferFrame::loadOffer(off.sellerID, off.offerID, db));
+            OfferFrame::loadOffer(off.sellerID, off.offerID, db, sess));
     }
     break;
     }
@@ -106,7 +112,27 @@ bool
 EntryFrame::cachedEntryExists(LedgerKey const& key, Database& db)
 {
     auto s = binToHex(xdr::xdr_to_opaque(key));
-    return db.getEntryCache().exists(s);
+    bool found = db.getEntryCache().exists(s);
+    db.recordEntryCacheLookup(found);
+    return found;
+}
+
+size_t const EntryFrame::kPrefetchBatchSize = 64;
+size_t const EntryFrame::kPrefetchMaxEntries = Database::kEntryCacheSize / 2;
+
+std::string
+EntryFrame::batchPlaceholders(std::string const& prefix)
+{
+    std::string res;
+    for (size_t i = 0; i < kPrefetchBatchSize; i++)
+    {
+        if (i != 0)
+        {
+            res += ", ";
+        }
+        res += ":" + prefix + std::to_string(i);
+    }
+    return res;
 }
 
 std::shared_ptr<LedgerEntry const>
@@ -138,10 +164,20 @@ EntryFrame::putCachedEntry(Database& db) const
 
 void
 EntryFrame::checkAgainstDatabase(LedgerEntry const& entry, Database& db)
+{
+    checkAgainstDatabase(entry, db, db.getSession());
+}
+
+void
+EntryFrame::checkAgainstDatabase(LedgerEntry const& entry, Database& db,
+                                 soci::session& sess)
 {
     auto key = LedgerEntryKey(entry);
-    flushCachedEntry(key, db);
-    auto const& fromDb = EntryFrame::storeLoad(key, db);
+    if (db.isMainSession(sess))
+    {
+        flushCachedEntry(key, db);
+    }
+    auto const& fromDb = EntryFrame::storeLoad(key, db, sess);
     if (!(fromDb->mEntry == entry))
     {
         std::string s;
@@ -15,6 +15,11 @@ Parent of AccountFrame, TrustFrame, OfferFrame
 These just hold the xdr LedgerEntry objects and have some associated functions
 */
 
+namespace soci
+{
+class session;
+}
+
 namespace stellar
 {
 class Database;
@@ -41,6 +46,10 @@ class EntryFrame : public NonMovableOrCopyable
 
     static pointer FromXDR(LedgerEntry const& from);
     static pointer storeLoad(LedgerKey const& key, Database& db);
+    // Load through `sess`, which may be a connection-pool session owned by a
+    // worker thread; see Database::postReadQuery.
+    static pointer storeLoad(LedgerKey const& key, Database& db,
+                             soci::session& sess);
 
     // Static helpers for working with the DB LedgerEntry cache.
     static void flushCachedEntry(LedgerKey const& key, Database& db);
@@ -51,6 +60,19 @@ class EntryFrame : public NonMovableOrCopyable
                                std::shared_ptr<LedgerEntry const> p,
                                Database& db);
 
+    // Number of keys bound by the batched "IN (...)" lookups used to
+    // prefetch entries into the cache, and the matching placeholder list
+    // ":<prefix>0, :<prefix>1, ...". Short batches are padded by repeating
+    // a key, so that each statement text is prepared only once.
+    static size_t const kPrefetchBatchSize;
+    static std::string batchPlaceholders(std::string const& prefix);
+
+    // Most entries prefetched before applying a ledger. Half the entry
+    // cache: the entries that apply loads or creates without prefetching
+    // (offers, new accounts and trust lines) go through the same LRU, and
+    // must not push prefetched entries out before they are used.
+    static size_t const kPrefetchMaxEntries;
+
     // helpers to get/set the last modified field
     uint32 getLastModified() const;
     uint32& getLastModified();
@@ -65,6 +87,8 @@ class EntryFrame : public NonMovableOrCopyable
     void putCachedEntry(Database& db) const;
 
     static void checkAgainstDatabase(LedgerEntry const& entry, Database& db);
+    static void checkAgainstDatabase(LedgerEntry const& entry, Database& db,
+                                     soci::session& sess);
 
     virtual EntryFrame::pointer copy() const = 0;
 
@@ -0,0 +1,203 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerChangeFeed.h"
+#include "history/HistoryManager.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "util/Fs.h"
+#include "util/Logging.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include <cstdio>
+#include <regex>
+
+namespace stellar
+{
+
+LedgerChangeFeed::LedgerChangeFeed(Application& app)
+    : mApp(app)
+    , mDir(app.getConfig().LEDGER_CHANGE_FEED_DIR_PATH)
+    , mOutOpen(false)
+    , mOutFirst(0)
+    , mOutGoodSize(0)
+    , mLedgersWritten(
+          app.getMetrics().NewMeter({"ledger", "feed", "write"}, "ledger"))
+    , mBytesWritten(
+          app.getMetrics().NewMeter({"ledger", "feed", "byte"}, "byte"))
+    , mFilesDeleted(
+          app.getMetrics().NewMeter({"ledger", "feed", "delete"}, "file"))
+    , mWriteErrors(
+          app.getMetrics().NewMeter({"ledger", "feed", "error"}, "error"))
+    , mLedgersDropped(
+          app.getMetrics().NewMeter({"ledger", "feed", "drop"}, "ledger"))
+{
+    if (isEnabled() && !fs::exists(mDir) && !fs::mkdir(mDir))
+    {
+        throw std::runtime_error("Unable to create ledger change feed "
+                                 "directory " +
+                                 mDir);
+    }
+}
+
+uint32_t
+LedgerChangeFeed::ledgersPerFile() const
+{
+    return mApp.getHistoryManager().getCheckpointFrequency();
+}
+
+std::string
+LedgerChangeFeed::fileName(uint32_t ledgerSeq) const
+{
+    auto first = ledgerSeq - ledgerSeq % ledgersPerFile();
+    return fs::baseName("ledger-changes", fs::hexStr(first), "xdr");
+}
+
+std::string
+LedgerChangeFeed::filePath(uint32_t ledgerSeq) const
+{
+    return mDir + "/" + fileName(ledgerSeq);
+}
+
+bool
+LedgerChangeFeed::closeOut()
+{
+    mOutOpen = false;
+    try
+    {
+        mOut.close();
+        return true;
+    }
+    catch (std::exception const& e)
+    {
+        CLOG(ERROR, "Ledger") << "Ledger change feed: " << e.what();
+        return false;
+    }
+}
+
+bool
+LedgerChangeFeed::writeRecord(LedgerCloseMeta const& meta)
+{
+    auto seq = meta.v0().ledgerHeader.header.ledgerSeq;
+    auto first = seq - seq % ledgersPerFile();
+    auto path = filePath(seq);
+    bool onPath = mOutOpen && first == mOutFirst;
+    try
+    {
+        if (!mOutOpen || first != mOutFirst)
+        {
+            if (mOutOpen && !closeOut())
+            {
+                throw std::runtime_error("could not close " +
+                                         filePath(mOutFirst));
+            }
+            if (!fs::exists(mDir) && !fs::mkdir(mDir))
+            {
+                throw std::runtime_error("could not create " + mDir);
+            }
+            mOutGoodSize = 0;
+            fs::fileSize(path, mOutGoodSize);
+            onPath = true;
+            mOut.open(path, true);
+            mOutOpen = true;
+            mOutFirst = first;
+        }
+
+        size_t bytes = 0;
+        if (!mOut.writeOne(meta, nullptr, &bytes))
+        {
+            throw std::runtime_error("could not write to " + path);
+        }
+        mOut.flush();
+        if (!mOut)
+        {
+            throw std::runtime_error("could not flush " + path);
+        }
+        mOutGoodSize += bytes;
+        mLedgersWritten.Mark();
+        mBytesWritten.Mark(bytes);
+        return true;
+    }
+    catch (std::exception const& e)
+    {
+        CLOG(ERROR, "Ledger") << "Could not write ledger " << seq
+                              << " to the ledger change feed, will retry at "
+                                 "the next ledger close: "
+                              << e.what();
+        mWriteErrors.Mark();
+        if (mOutOpen)
+        {
+            closeOut();
+        }
+        // drop whatever part of the record made it to the file
+        uint64_t size;
+        if (onPath && fs::fileSize(path, size) && size > mOutGoodSize &&
+            !fs::truncate(path, mOutGoodSize))
+        {
+            CLOG(ERROR, "Ledger") << "Could not truncate " << path << " to "
+                                  << mOutGoodSize << " bytes";
+        }
+        return false;
+    }
+}
+
+void
+LedgerChangeFeed::write(LedgerCloseMeta const& meta)
+{
+    mPending.push_back(meta);
+    while (mPending.size() > ledgersPerFile())
+    {
+        CLOG(ERROR, "Ledger")
+            << "Dropping ledger "
+            << mPending.front().v0().ledgerHeader.header.ledgerSeq
+            << " from the ledger change feed";
+        mLedgersDropped.Mark();
+        mPending.pop_front();
+    }
+    while (!mPending.empty() && writeRecord(mPending.front()))
+    {
+        mPending.pop_front();
+    }
+}
+
+size_t
+LedgerChangeFeed::trim(uint32_t ledgerSeq)
+{
+    if (!isEnabled())
+    {
+        return 0;
+    }
+
+    std::regex rx("ledger-changes-([[:xdigit:]]{8})\\.xdr");
+    auto names = fs::findfiles(mDir, [&](std::string const& name)
+                               {
+                                   return std::regex_match(name, rx);
+                               });
+
+    size_t deleted = 0;
+    for (auto const& name : names)
+    {
+        std::smatch sm;
+        std::regex_match(name, sm, rx);
+        auto first = static_cast<uint32_t>(std::stoul(sm[1], nullptr, 16));
+        if (first + ledgersPerFile() - 1 > ledgerSeq)
+        {
+            continue;
+        }
+        if (mOutOpen && first == mOutFirst)
+        {
+            closeOut();
+        }
+        auto path = mDir + "/" + name;
+        if (std::remove(path.c_str()) != 0)
+        {
+            CLOG(WARNING, "Ledger") << "Could not delete " << path;
+            continue;
+        }
+        mFilesDeleted.Mark();
+        ++deleted;
+    }
+    return deleted;
+}
+}
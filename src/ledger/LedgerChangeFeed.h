@@ -0,0 +1,97 @@
+#pragma once
+
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "util/XDRStream.h"
+#include "xdr/Stellar-ledger.h"
+#include <deque>
+#include <string>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+class Application;
+
+/**
+ * Push-based feed of the changes each ledger close makes, for services that
+ * would otherwise poll the txhistory and txfeehistory tables.
+ *
+ * For every ledger it closes, LedgerManagerImpl::closeLedger writes a
+ * LedgerCloseMeta (header, transaction set, and the result, fee changes and
+ * TransactionMeta of each transaction in apply order) to the feed. Records
+ * are appended, with XDR record marks like in history files, to files
+ * covering a checkpoint's worth of ledgers each, named
+ * ledger-changes-<first ledger in hex>.xdr, and each is flushed before the
+ * close commits. A ledger whose close did not commit is closed again after
+ * a restart, so readers must expect to see it twice.
+ *
+ * A failure to write to the feed (a full disk, a removed directory) does not
+ * stop ledger close: it is logged and counted in ledger.feed.error, the file
+ * is cut back to its last complete record, and the records not written are
+ * tried again, in order, at the next close. At most a file's worth of them
+ * is kept; older ones are dropped (ledger.feed.drop), leaving a gap readers
+ * can see in the ledger sequence.
+ *
+ * Readers acknowledge what they have processed with the same cursors that
+ * guard the SQL history (see ExternalQueue): ExternalQueue::process deletes
+ * the files all of whose ledgers are at or below every cursor. Without
+ * cursors, files are kept.
+ */
+class LedgerChangeFeed : NonMovableOrCopyable
+{
+    Application& mApp;
+    std::string const mDir;
+    XDROutputFileStream mOut;
+    bool mOutOpen;
+    uint32_t mOutFirst; // first ledger of the file mOut is open on
+    // size of that file up to its last complete record
+    uint64_t mOutGoodSize;
+    // records not written yet because of write failures, in ledger order
+    std::deque<LedgerCloseMeta> mPending;
+    medida::Meter& mLedgersWritten;
+    medida::Meter& mBytesWritten;
+    medida::Meter& mFilesDeleted;
+    medida::Meter& mWriteErrors;
+    medida::Meter& mLedgersDropped;
+
+    uint32_t ledgersPerFile() const;
+    std::string filePath(uint32_t ledgerSeq) const;
+
+    // Writes and flushes one record; on failure, logs it, cuts the file back
+    // to its last full record and returns false.
+    bool writeRecord(LedgerCloseMeta const& meta);
+
+    // Closes mOut; false if the tail of the file could not be written.
+    bool closeOut();
+
+  public:
+    // Writes to LEDGER_CHANGE_FEED_DIR_PATH, creating it if needed.
+    LedgerChangeFeed(Application& app);
+
+    bool
+    isEnabled() const
+    {
+        return !mDir.empty();
+    }
+
+    // Appends `meta`, after any records still pending from failed writes,
+    // to the file of its ledger and flushes it. Never throws.
+    void write(LedgerCloseMeta const& meta);
+
+    // Deletes the files all of whose ledgers are at or below `ledgerSeq`,
+    // returns how many.
+    size_t trim(uint32_t ledgerSeq);
+
+    // The name of the file holding ledger `ledgerSeq`, within the feed's
+    // directory.
+    std::string fileName(uint32_t ledgerSeq) const;
+};
+}
@@ -0,0 +1,211 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "ledger/LedgerCloseTimeline.h"
+#include "lib/json/json.h"
+#include "medida/meter.h"
+#include <cassert>
+#include <string>
+
+namespace stellar
+{
+
+using std::chrono::nanoseconds;
+using std::chrono::steady_clock;
+
+static Json::UInt64
+toUs(nanoseconds d)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+}
+
+LedgerCloseTimeline::Recording::Recording(LedgerCloseTimeline& timeline,
+                                          uint32_t ledgerSeq, size_t txCount)
+    : mTimeline(timeline)
+{
+    mTimeline.begin(ledgerSeq, txCount);
+}
+
+LedgerCloseTimeline::Recording::~Recording()
+{
+    mTimeline.end();
+}
+
+LedgerCloseTimeline::LedgerCloseTimeline(size_t capacity,
+                                         medida::Meter& statements,
+                                         medida::Meter& bucketBytes)
+    : mCapacity(capacity), mStatements(statements), mBucketBytes(bucketBytes)
+{
+}
+
+void
+LedgerCloseTimeline::begin(uint32_t ledgerSeq, size_t txCount)
+{
+    assert(!mRecording);
+    if (mCapacity == 0)
+    {
+        return;
+    }
+    mRecording = true;
+    mInPhase = false;
+    mCurrent.mLedgerSeq = ledgerSeq;
+    mCurrent.mTxCount = txCount;
+    mCurrent.mCloseStart = std::chrono::system_clock::now();
+    mCurrent.mPhases.clear();
+    mCloseStart = steady_clock::now();
+}
+
+void
+LedgerCloseTimeline::endPhase(steady_clock::time_point now)
+{
+    if (mInPhase)
+    {
+        auto& p = mCurrent.mPhases.back();
+        p.mDuration = now - mPhaseStart;
+        p.mStatements = mStatements.count() - mPhaseStatements;
+        p.mBucketBytes = mBucketBytes.count() - mPhaseBucketBytes;
+        mInPhase = false;
+    }
+}
+
+void
+LedgerCloseTimeline::phase(char const* name)
+{
+    if (!mRecording)
+    {
+        return;
+    }
+    auto now = steady_clock::now();
+    endPhase(now);
+    Phase p;
+    p.mName = name;
+    p.mStart = now - mCloseStart;
+    p.mDuration = nanoseconds(0);
+    p.mStatements = 0;
+    p.mBucketBytes = 0;
+    mCurrent.mPhases.push_back(p);
+    mInPhase = true;
+    mPhaseStart = now;
+    mPhaseStatements = mStatements.count();
+    mPhaseBucketBytes = mBucketBytes.count();
+}
+
+void
+LedgerCloseTimeline::end()
+{
+    if (!mRecording)
+    {
+        return;
+    }
+    auto now = steady_clock::now();
+    endPhase(now);
+    mCurrent.mDuration = now - mCloseStart;
+    mRecording = false;
+
+    if (mLedgers.size() == mCapacity)
+    {
+        // recycle the oldest entry, and its phase vector, for the next close
+        auto oldest = std::move(mLedgers.front());
+        mLedgers.pop_front();
+        mLedgers.push_back(std::move(mCurrent));
+        mCurrent = std::move(oldest);
+    }
+    else
+    {
+        mLedgers.push_back(std::move(mCurrent));
+    }
+}
+
+std::deque<LedgerCloseTimeline::Ledger> const&
+LedgerCloseTimeline::getLedgers() const
+{
+    return mLedgers;
+}
+
+void
+LedgerCloseTimeline::report(Json::Value& root, size_t limit) const
+{
+    size_t first = 0;
+    if (limit != 0 && limit < mLedgers.size())
+    {
+        first = mLedgers.size() - limit;
+    }
+
+    auto& ledgers = root["ledgers"];
+    ledgers = Json::Value(Json::arrayValue);
+    for (size_t i = first; i < mLedgers.size(); i++)
+    {
+        auto const& l = mLedgers[i];
+        Json::Value ledger;
+        ledger["ledger"] = l.mLedgerSeq;
+        ledger["txs"] = static_cast<Json::UInt64>(l.mTxCount);
+        ledger["start_us"] = toUs(l.mCloseStart.time_since_epoch());
+        ledger["duration_ns"] = static_cast<Json::UInt64>(l.mDuration.count());
+        auto& phases = ledger["phases"];
+        phases = Json::Value(Json::arrayValue);
+        for (auto const& p : l.mPhases)
+        {
+            Json::Value phase;
+            phase["name"] = p.mName;
+            phase["start_ns"] = static_cast<Json::UInt64>(p.mStart.count());
+            phase["duration_ns"] =
+                static_cast<Json::UInt64>(p.mDuration.count());
+            phase["sql_statements"] =
+                static_cast<Json::UInt64>(p.mStatements);
+            phase["bucket_bytes"] = static_cast<Json::UInt64>(p.mBucketBytes);
+            phases.append(phase);
+        }
+        ledgers.append(ledger);
+    }
+}
+
+void
+LedgerCloseTimeline::reportTrace(Json::Value& root, size_t limit) const
+{
+    size_t first = 0;
+    if (limit != 0 && limit < mLedgers.size())
+    {
+        first = mLedgers.size() - limit;
+    }
+
+    root["displayTimeUnit"] = "ns";
+    auto& events = root["traceEvents"];
+    events = Json::Value(Json::arrayValue);
+    for (size_t i = first; i < mLedgers.size(); i++)
+    {
+        auto const& l = mLedgers[i];
+        auto start = toUs(l.mCloseStart.time_since_epoch());
+
+        Json::Value close;
+        close["name"] = "ledger " + std::to_string(l.mLedgerSeq);
+        close["cat"] = "ledger";
+        close["ph"] = "X";
+        close["pid"] = 1;
+        close["tid"] = 1;
+        close["ts"] = start;
+        close["dur"] = toUs(l.mDuration);
+        close["args"]["ledger"] = l.mLedgerSeq;
+        close["args"]["txs"] = static_cast<Json::UInt64>(l.mTxCount);
+        events.append(close);
+
+        for (auto const& p : l.mPhases)
+        {
+            Json::Value phase;
+            phase["name"] = p.mName;
+            phase["cat"] = "ledger";
+            phase["ph"] = "X";
+            phase["pid"] = 1;
+            phase["tid"] = 1;
+            phase["ts"] = start + toUs(p.mStart);
+            phase["dur"] = toUs(p.mDuration);
+            phase["args"]["ledger"] = l.mLedgerSeq;
+            phase["args"]["sql_statements"] =
+                static_cast<Json::UInt64>(p.mStatements);
+            phase["args"]["bucket_bytes"] =
+                static_cast<Json::UInt64>(p.mBucketBytes);
+            events.append(phase);
+        }
+    }
+}
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "lib/json/json-forwards.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace medida
+{
+class Meter;
+}
+
+namespace stellar
+{
+
+/**
+ * Breakdown of the last few ledger closes into their phases.
+ *
+ * LedgerManagerImpl::closeLedger marks the start of each of its phases (fee
+ * processing, transaction apply, adding to the bucket list, committing, ...)
+ * while a Recording is active. For every phase the timeline keeps its
+ * duration in nanoseconds, the number of SQL statements issued and the
+ * number of bytes of buckets written, read off the database query meter and
+ * the bucket.byte.insert meter. Merges running on worker threads also mark
+ * the latter, so bucket bytes are those adopted while the phase ran.
+ *
+ * Only the last `capacity` ledgers are kept. They can be reported as plain
+ * JSON or as a Chrome trace (chrome://tracing, about:tracing, Perfetto),
+ * see /ledgertimeline.
+ */
+class LedgerCloseTimeline : NonMovableOrCopyable
+{
+  public:
+    struct Phase
+    {
+        char const* mName;
+        std::chrono::nanoseconds mStart; // from the start of the close
+        std::chrono::nanoseconds mDuration;
+        uint64_t mStatements;
+        uint64_t mBucketBytes;
+    };
+
+    struct Ledger
+    {
+        uint32_t mLedgerSeq;
+        size_t mTxCount;
+        std::chrono::system_clock::time_point mCloseStart;
+        std::chrono::nanoseconds mDuration;
+        std::vector<Phase> mPhases;
+    };
+
+    // Brackets the close of one ledger; the ledger is added to the timeline
+    // when the Recording is destroyed.
+    class Recording : NonMovableOrCopyable
+    {
+      public:
+        Recording(LedgerCloseTimeline& timeline, uint32_t ledgerSeq,
+                  size_t txCount);
+        ~Recording();
+
+      private:
+        LedgerCloseTimeline& mTimeline;
+    };
+
+    LedgerCloseTimeline(size_t capacity, medida::Meter& statements,
+                        medida::Meter& bucketBytes);
+
+    // Ends the current phase, if any, and starts `name`, which must be a
+    // string literal. Does nothing unless a Recording is active, so that
+    // code shared with other paths than ledger close can mark its phases
+    // unconditionally.
+    void phase(char const* name);
+
+    bool
+    isRecording() const
+    {
+        return mRecording;
+    }
+
+    std::deque<Ledger> const& getLedgers() const;
+
+    // The last `limit` ledgers (all of them if 0), oldest first.
+    void report(Json::Value& root, size_t limit) const;
+
+    // The same ledgers as complete ("X") events of the Chrome trace event
+    // format: one for the whole close and one per phase, timestamps in
+    // microseconds since the epoch.
+    void reportTrace(Json::Value& root, size_t limit) const;
+
+  private:
+    void begin(uint32_t ledgerSeq, size_t txCount);
+    void endPhase(std::chrono::steady_clock::time_point now);
+    void end();
+
+    size_t mCapacity;
+    medida::Meter& mStatements;
+    medida::Meter& mBucketBytes;
+    std::deque<Ledger> mLedgers;
+
+    bool mRecording{false};
+    bool mInPhase{false};
+    Ledger mCurrent;
+    std::chrono::steady_clock::time_point mCloseStart;
+    std::chrono::steady_clock::time_point mPhaseStart;
+    uint64_t mPhaseStatements{0};
+    uint64_t mPhaseBucketBytes{0};
+};
+}
@@ -3,25 +3,96 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerHashUtils.h"
 #include "xdr/Stellar-ledger.h"
 #include "main/Application.h"
 #include "main/Config.h"
-#include "medida/metrics_registry.h"
-#include "medida/meter.h"
+#include "util/make_unique.h"
+#include "util/MetricsFacade.h"
 #include "xdrpp/printer.h"
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace stellar
 {
 using xdr::operator==;
 
+struct LedgerDelta::Store
+{
+    struct Slot
+    {
+        LedgerKey mKey;
+        EntryFrame::pointer mEntry; // latest value, null once deleted
+        EntryState mState;          // relative to the top-level delta
+    };
+
+    // previous contents of a slot, restored when rolling back
+    struct UndoRecord
+    {
+        uint32_t mSlot;
+        EntryState mState;
+        EntryFrame::pointer mEntry;
+    };
+
+    std::unordered_map<LedgerKey, uint32_t, LedgerKeyHash, LedgerKeyEqual>
+        mIndex;
+    std::vector<Slot> mSlots;
+    std::vector<UndoRecord> mLog;
+    size_t mOpenDepth{0}; // depth of the innermost open delta
+
+    // returns the slot for k, recording its current contents in the undo
+    // log when a nested delta may need to restore them
+    Slot&
+    change(LedgerKey const& k)
+    {
+        auto res =
+            mIndex.emplace(k, static_cast<uint32_t>(mSlots.size()));
+        if (res.second)
+        {
+            mSlots.push_back(Slot{k, nullptr, ENTRY_NONE});
+        }
+        uint32_t i = res.first->second;
+        auto& slot = mSlots[i];
+        if (mOpenDepth != 0)
+        {
+            mLog.push_back(UndoRecord{i, slot.mState, slot.mEntry});
+        }
+        return slot;
+    }
+
+    // state of an entry relative to a nested delta, given its state
+    // relative to the top-level delta when the nested delta touched it first
+    // and now. This is what merging the nested delta into its outer delta
+    // entry by entry used to produce.
+    static EntryState
+    scopeState(EntryState before, EntryState after)
+    {
+        switch (before)
+        {
+        case ENTRY_NEW:
+            return after == ENTRY_NONE ? ENTRY_DELETE : ENTRY_MOD;
+        case ENTRY_DELETE:
+            return after == ENTRY_MOD ? ENTRY_NEW : ENTRY_NONE;
+        default:
+            return after;
+        }
+    }
+};
+
 LedgerDelta::LedgerDelta(LedgerDelta& outerDelta)
     : mOuterDelta(&outerDelta)
     , mHeader(&outerDelta.getHeader())
     , mCurrentHeader(outerDelta.getHeader())
     , mPreviousHeaderValue(outerDelta.getHeader())
+    , mStore(&outerDelta.getStore())
+    , mDepth(outerDelta.mDepth + 1)
+    , mSavepoint(mStore->mLog.size())
     , mDb(outerDelta.mDb)
     , mUpdateLastModified(outerDelta.mUpdateLastModified)
 {
+    outerDelta.checkInnermost();
+    mStore->mOpenDepth = mDepth;
 }
 
 LedgerDelta::LedgerDelta(LedgerHeader& header, Database& db,
@@ -30,6 +101,9 @@ LedgerDelta::LedgerDelta(LedgerHeader& header, Database& db,
     , mHeader(&header)
     , mCurrentHeader(header)
     , mPreviousHeaderValue(header)
+    , mStore(nullptr)
+    , mDepth(0)
+    , mSavepoint(0)
     , mDb(db)
     , mUpdateLastModified(updateLastModified)
 {
@@ -89,24 +163,48 @@ LedgerDelta::modEntry(EntryFrame const& entry)
     modEntry(entry.copy());
 }
 
+LedgerDelta::Store&
+LedgerDelta::getStore()
+{
+    if (!mStore)
+    {
+        mOwnedStore = make_unique<Store>();
+        mStore = mOwnedStore.get();
+    }
+    return *mStore;
+}
+
+void
+LedgerDelta::checkInnermost()
+{
+    if (mStore && mStore->mOpenDepth != mDepth)
+    {
+        throw std::runtime_error(
+            "Invalid operation: delta has an open nested delta");
+    }
+}
+
 void
 LedgerDelta::addEntry(EntryFrame::pointer entry)
 {
     checkState();
-    auto k = entry->getKey();
-    auto del_it = mDelete.find(k);
-    if (del_it != mDelete.end())
+    checkInnermost();
+    auto& slot = getStore().change(entry->getKey());
+    switch (slot.mState)
     {
+    case ENTRY_DELETE:
         // delete + new is an update
-        mDelete.erase(del_it);
-        mMod[k] = entry;
-    }
-    else
-    {
-        assert(mNew.find(k) == mNew.end()); // double new
-        assert(mMod.find(k) == mMod.end()); // mod + new is invalid
-        mNew[k] = entry;
+        slot.mState = ENTRY_MOD;
+        break;
+    case ENTRY_NONE:
+        slot.mState = ENTRY_NEW;
+        break;
+    default:
+        assert(slot.mState != ENTRY_NEW); // double new
+        assert(slot.mState != ENTRY_MOD); // mod + new is invalid
+        break;
     }
+    slot.mEntry = entry;
 }
 
 void
@@ -120,70 +218,47 @@ void
 LedgerDelta::deleteEntry(LedgerKey const& k)
 {
     checkState();
-    auto new_it = mNew.find(k);
-    if (new_it != mNew.end())
+    checkInnermost();
+    auto& slot = getStore().change(k);
+    if (slot.mState == ENTRY_NEW)
     {
         // new + delete -> don't add it in the first place
-        mNew.erase(new_it);
+        slot.mState = ENTRY_NONE;
     }
     else
     {
-        assert(mDelete.find(k) == mDelete.end()); // double delete is invalid
+        assert(slot.mState != ENTRY_DELETE); // double delete is invalid
         // only keep the delete
-        mMod.erase(k);
-        mDelete.insert(k);
+        slot.mState = ENTRY_DELETE;
     }
+    slot.mEntry.reset();
 }
 
 void
 LedgerDelta::modEntry(EntryFrame::pointer entry)
 {
     checkState();
-    auto k = entry->getKey();
-    auto mod_it = mMod.find(k);
-    if (mod_it != mMod.end())
+    checkInnermost();
+    auto& slot = getStore().change(entry->getKey());
+    switch (slot.mState)
     {
+    case ENTRY_NEW:
+        // new + mod = new (with latest value)
+        break;
+    default:
+        assert(slot.mState != ENTRY_DELETE); // delete + mod is illegal
         // collapse mod
-        mod_it->second = entry;
-    }
-    else
-    {
-        auto new_it = mNew.find(k);
-        if (new_it != mNew.end())
-        {
-            // new + mod = new (with latest value)
-            new_it->second = entry;
-        }
-        else
-        {
-            assert(mDelete.find(k) == mDelete.end()); // delete + mod is illegal
-            mMod[k] = entry;
-        }
-    }
-}
-
-void
-LedgerDelta::mergeEntries(LedgerDelta& other)
-{
-    checkState();
-    for (auto& d : other.mDelete)
-    {
-        deleteEntry(d);
-    }
-    for (auto& n : other.mNew)
-    {
-        addEntry(n.second);
-    }
-    for (auto& m : other.mMod)
-    {
-        modEntry(m.second);
+        slot.mState = ENTRY_MOD;
+        break;
     }
+    slot.mEntry = entry;
 }
 
 void
 LedgerDelta::commit()
 {
     checkState();
+    checkInnermost();
     // checks if we about to override changes that were made
     // outside of this LedgerDelta
     if (!(mPreviousHeaderValue == *mHeader))
@@ -193,7 +268,13 @@ LedgerDelta::commit()
 
     if (mOuterDelta)
     {
-        mOuterDelta->mergeEntries(*this);
+        // the entries already live in the shared store: dropping the
+        // savepoint is all it takes to hand them to the outer delta
+        mStore->mOpenDepth = mDepth - 1;
+        if (mStore->mOpenDepth == 0)
+        {
+            mStore->mLog.clear();
+        }
         mOuterDelta = nullptr;
     }
     *mHeader = mCurrentHeader.mHeader;
@@ -206,41 +287,123 @@ LedgerDelta::rollback()
     checkState();
     mHeader = nullptr;
 
-    for (auto& d : mDelete)
+    if (!mStore)
     {
-        EntryFrame::flushCachedEntry(d, mDb);
+        return;
     }
-    for (auto& n : mNew)
+    auto& store = *mStore;
+
+    if (mDepth == 0)
     {
-        EntryFrame::flushCachedEntry(n.first, mDb);
+        for (auto const& slot : store.mSlots)
+        {
+            EntryFrame::flushCachedEntry(slot.mKey, mDb);
+        }
+        return;
     }
-    for (auto& m : mMod)
+
+    while (store.mLog.size() > mSavepoint)
     {
-        EntryFrame::flushCachedEntry(m.first, mDb);
+        auto& u = store.mLog.back();
+        auto& slot = store.mSlots[u.mSlot];
+        slot.mState = u.mState;
+        slot.mEntry = std::move(u.mEntry);
+        EntryFrame::flushCachedEntry(slot.mKey, mDb);
+        store.mLog.pop_back();
     }
+    store.mOpenDepth = mDepth - 1;
+    mOuterDelta = nullptr;
 }
 
-LedgerEntryChanges
-LedgerDelta::getChanges() const
+template <typename F>
+void
+LedgerDelta::forEachChange(F f) const
 {
-    LedgerEntryChanges changes;
+    if (!mStore)
+    {
+        return;
+    }
+    auto const& store = *mStore;
 
-    for (auto const& k : mNew)
+    // (state relative to this delta, slot)
+    std::vector<std::pair<EntryState, uint32_t>> changes;
+    if (mDepth == 0)
     {
-        changes.emplace_back(LEDGER_ENTRY_CREATED);
-        changes.back().created() = k.second->mEntry;
+        changes.reserve(store.mSlots.size());
+        for (uint32_t i = 0; i < store.mSlots.size(); i++)
+        {
+            changes.emplace_back(store.mSlots[i].mState, i);
+        }
     }
-    for (auto const& k : mMod)
+    else
     {
-        changes.emplace_back(LEDGER_ENTRY_UPDATED);
-        changes.back().updated() = k.second->mEntry;
+        // the first undo record of each slot in this delta's part of the
+        // log holds its state from before this delta touched it
+        std::unordered_set<uint32_t> seen;
+        for (size_t i = mSavepoint; i < store.mLog.size(); i++)
+        {
+            auto const& u = store.mLog[i];
+            if (seen.insert(u.mSlot).second)
+            {
+                changes.emplace_back(
+                    Store::scopeState(u.mState, store.mSlots[u.mSlot].mState),
+                    u.mSlot);
+            }
+        }
     }
 
-    for (auto const& k : mDelete)
+    changes.erase(std::remove_if(changes.begin(), changes.end(),
+                                 [](std::pair<EntryState, uint32_t> const& c)
+                                 {
+                                     return c.first == ENTRY_NONE;
+                                 }),
+                  changes.end());
+
+    // new, then modified, then deleted entries, each in key order
+    LedgerEntryIdCmp cmp;
+    std::sort(changes.begin(), changes.end(),
+              [&store, &cmp](std::pair<EntryState, uint32_t> const& a,
+                             std::pair<EntryState, uint32_t> const& b)
+              {
+                  if (a.first != b.first)
+                  {
+                      return a.first < b.first;
+                  }
+                  return cmp(store.mSlots[a.second].mKey,
+                             store.mSlots[b.second].mKey);
+              });
+
+    for (auto const& c : changes)
     {
-        changes.emplace_back(LEDGER_ENTRY_REMOVED);
-        changes.back().removed() = k;
+        auto const& slot = store.mSlots[c.second];
+        f(c.first, slot.mKey, slot.mEntry);
     }
+}
+
+LedgerEntryChanges
+LedgerDelta::getChanges() const
+{
+    LedgerEntryChanges changes;
+
+    forEachChange([&changes](EntryState state, LedgerKey const& key,
+                             EntryFrame::pointer const& entry)
+                  {
+                      switch (state)
+                      {
+                      case ENTRY_NEW:
+                          changes.emplace_back(LEDGER_ENTRY_CREATED);
+                          changes.back().created() = entry->mEntry;
+                          break;
+                      case ENTRY_MOD:
+                          changes.emplace_back(LEDGER_ENTRY_UPDATED);
+                          changes.back().updated() = entry->mEntry;
+                          break;
+                      default:
+                          changes.emplace_back(LEDGER_ENTRY_REMOVED);
+                          changes.back().removed() = key;
+                          break;
+                      }
+                  });
 
     return changes;
 }
@@ -250,16 +413,14 @@ LedgerDelta::getLiveEntries() const
 {
     std::vector<LedgerEntry> live;
 
-    live.reserve(mNew.size() + mMod.size());
-
-    for (auto const& k : mNew)
-    {
-        live.push_back(k.second->mEntry);
-    }
-    for (auto const& k : mMod)
-    {
-        live.push_back(k.second->mEntry);
-    }
+    forEachChange([&live](EntryState state, LedgerKey const&,
+                          EntryFrame::pointer const& entry)
+                  {
+                      if (state != ENTRY_DELETE)
+                      {
+                          live.push_back(entry->mEntry);
+                      }
+                  });
 
     return live;
 }
@@ -269,12 +430,15 @@ LedgerDelta::getDeadEntries() const
 {
     std::vector<LedgerKey> dead;
 
-    dead.reserve(mDelete.size());
+    forEachChange([&dead](EntryState state, LedgerKey const& key,
+                          EntryFrame::pointer const&)
+                  {
+                      if (state == ENTRY_DELETE)
+                      {
+                          dead.push_back(key);
+                      }
+                  });
 
-    for (auto const& k : mDelete)
-    {
-        dead.push_back(k);
-    }
     return dead;
 }
 
@@ -284,74 +448,41 @@ LedgerDelta::updateLastModified() const
     return mUpdateLastModified;
 }
 
-void
-LedgerDelta::markMeters(Application& app) const
+namespace
 {
-    for (auto const& ke : mNew)
-    {
-        switch (ke.first.type())
-        {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "add"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "add"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "add"}, "entry")
-                .Mark();
-            break;
-        }
-    }
+// one meter per entry type and kind of change, indexed by LedgerEntryType
+// and by add/modify/delete
+struct LedgerDeltaMetrics
+{
+    MeterHandle* mChanges[3][3];
 
-    for (auto const& ke : mMod)
+    explicit LedgerDeltaMetrics(MetricsFacade& m)
     {
-        switch (ke.first.type())
+        char const* types[] = {"account", "trust", "offer"};
+        char const* changes[] = {"add", "modify", "delete"};
+        for (size_t t = 0; t < 3; t++)
         {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "modify"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "modify"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "modify"}, "entry")
-                .Mark();
-            break;
+            for (size_t c = 0; c < 3; c++)
+            {
+                mChanges[t][c] =
+                    &m.newMeter({"ledger", types[t], changes[c]}, "entry");
+            }
         }
     }
+};
+}
 
-    for (auto const& ke : mDelete)
-    {
-        switch (ke.type())
-        {
-        case ACCOUNT:
-            app.getMetrics()
-                .NewMeter({"ledger", "account", "delete"}, "entry")
-                .Mark();
-            break;
-        case TRUSTLINE:
-            app.getMetrics()
-                .NewMeter({"ledger", "trust", "delete"}, "entry")
-                .Mark();
-            break;
-        case OFFER:
-            app.getMetrics()
-                .NewMeter({"ledger", "offer", "delete"}, "entry")
-                .Mark();
-            break;
-        }
-    }
+void
+LedgerDelta::markMeters(Application& app) const
+{
+    auto& metrics = app.getMetricsFacade().handles<LedgerDeltaMetrics>();
+    forEachChange([&metrics](EntryState state, LedgerKey const& key,
+                             EntryFrame::pointer const&)
+                  {
+                      size_t change =
+                          state == ENTRY_NEW ? 0 : (state == ENTRY_MOD ? 1 : 2);
+                      metrics.mChanges[key.type()][change]->mark();
+                  });
 }
 
 void
@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include <map>
+#include <memory>
 #include <set>
 #include "ledger/EntryFrame.h"
 #include "ledger/LedgerHeaderFrame.h"
@@ -16,10 +17,29 @@ namespace stellar
 class Application;
 class Database;
 
+/**
+ * A LedgerDelta records the ledger entries created, modified and deleted
+ * within a scope, and can be nested: a nested delta commits into its outer
+ * delta, or rolls back leaving the outer delta as it was.
+ *
+ * All deltas nested under the same top-level delta share one Store: a flat
+ * hash table from LedgerKey to a slot holding the latest entry and its state
+ * relative to the top-level delta, plus an undo log. Opening a nested delta
+ * just remembers the position in the undo log (a savepoint); committing it
+ * forgets that position, and rolling it back replays the log back to it.
+ * Changes only ever go to the innermost open delta.
+ */
 class LedgerDelta
 {
-    typedef std::map<LedgerKey, EntryFrame::pointer, LedgerEntryIdCmp>
-        KeyEntryMap;
+    // state of an entry relative to some delta
+    enum EntryState : uint8_t
+    {
+        ENTRY_NONE,
+        ENTRY_NEW,
+        ENTRY_MOD,
+        ENTRY_DELETE
+    };
+    struct Store;
 
     LedgerDelta*
         mOuterDelta;       // set when this delta is nested inside another delta
@@ -29,22 +49,30 @@ class LedgerDelta
     // ledger header itself
     LedgerHeaderFrame mCurrentHeader;
     LedgerHeader mPreviousHeaderValue;
-    // ledger entries
-    KeyEntryMap mNew;
-    KeyEntryMap mMod;
-    std::set<LedgerKey, LedgerEntryIdCmp> mDelete;
+
+    // ledger entries: owned by the top-level delta, allocated on first use
+    std::unique_ptr<Store> mOwnedStore;
+    Store* mStore;
+    // nesting depth (0 for a top-level delta) and undo log position at the
+    // time this delta was opened
+    size_t mDepth;
+    size_t mSavepoint;
 
     Database& mDb; // Used strictly for rollback of db entry cache.
 
     bool mUpdateLastModified;
 
     void checkState();
+    void checkInnermost();
+    Store& getStore();
     void addEntry(EntryFrame::pointer entry);
     void deleteEntry(EntryFrame::pointer entry);
     void modEntry(EntryFrame::pointer entry);
 
-    // merge "other" into current ledgerDelta
-    void mergeEntries(LedgerDelta& other);
+    // calls f(state, key, entry) for every entry changed within this delta's
+    // scope: new entries first, then modified ones, then deleted ones, each
+    // group in key order
+    template <typename F> void forEachChange(F f) const;
 
   public:
     // keeps an internal reference to the outerDelta,
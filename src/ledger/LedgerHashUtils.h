@@ -0,0 +1,82 @@
+#pragma once
+
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "bucket/LedgerCmp.h"
+#include "crypto/SecretKey.h"
+#include "overlay/StellarXDR.h"
+#include <functional>
+
+namespace stellar
+{
+
+// Hash and equality for using LedgerKey in unordered containers. The hash
+// only looks at the identifying fields of the key, so it stays cheap: no
+// XDR serialization is involved.
+struct LedgerKeyHash
+{
+    static size_t
+    mix(size_t seed, size_t v)
+    {
+        return seed ^ (v + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+
+    template <uint32_t N>
+    static size_t
+    mixCode(size_t seed, xdr::opaque_array<N> const& code)
+    {
+        for (auto c : code)
+        {
+            seed = mix(seed, c);
+        }
+        return seed;
+    }
+
+    size_t
+    operator()(LedgerKey const& k) const
+    {
+        std::hash<PublicKey> hashKey;
+        switch (k.type())
+        {
+        case ACCOUNT:
+            return hashKey(k.account().accountID);
+        case TRUSTLINE:
+        {
+            auto const& tl = k.trustLine();
+            size_t res = hashKey(tl.accountID);
+            switch (tl.asset.type())
+            {
+            case ASSET_TYPE_CREDIT_ALPHANUM4:
+                res = mix(res, hashKey(tl.asset.alphaNum4().issuer));
+                res = mixCode(res, tl.asset.alphaNum4().assetCode);
+                break;
+            case ASSET_TYPE_CREDIT_ALPHANUM12:
+                res = mix(res, hashKey(tl.asset.alphaNum12().issuer));
+                res = mixCode(res, tl.asset.alphaNum12().assetCode);
+                break;
+            default:
+                break;
+            }
+            return mix(res, tl.asset.type());
+        }
+        case OFFER:
+            return mix(hashKey(k.offer().sellerID),
+                       std::hash<uint64_t>()(k.offer().offerID));
+        default:
+            return 0;
+        }
+    }
+};
+
+struct LedgerKeyEqual
+{
+    bool
+    operator()(LedgerKey const& a, LedgerKey const& b) const
+    {
+        LedgerEntryIdCmp cmp;
+        return !cmp(a, b) && !cmp(b, a);
+    }
+};
+}
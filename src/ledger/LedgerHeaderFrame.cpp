@@ -5,7 +5,6 @@
 #include "util/asio.h"
 #include "LedgerHeaderFrame.h"
 #include "LedgerManager.h"
-#include "util/XDRStream.h"
 #include "util/Logging.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
@@ -84,11 +83,12 @@ LedgerHeaderFrame::storeInsert(LedgerManager& ledgerManager) const
     auto& db = ledgerManager.getDatabase();
 
     // note: columns other than "data" are there to faciliate lookup/processing
-    auto prep = db.getPreparedStatement(
+    static StatementID const insertStmt = Database::registerStatement(
         "INSERT INTO ledgerheaders "
         "(ledgerhash, prevhash, bucketlisthash, ledgerseq, closetime, data) "
         "VALUES "
         "(:h,        :ph,      :blh,            :seq,     :ct,       :data)");
+    auto prep = db.getPreparedStatement(insertStmt);
     auto& st = prep.statement();
     st.exchange(use(hash));
     st.exchange(use(prevHash));
@@ -182,42 +182,6 @@ LedgerHeaderFrame::loadBySequence(uint32_t seq, Database& db,
     return lhf;
 }
 
-size_t
-LedgerHeaderFrame::copyLedgerHeadersToStream(Database& db, soci::session& sess,
-                                             uint32_t ledgerSeq,
-                                             uint32_t ledgerCount,
-                                             XDROutputFileStream& headersOut)
-{
-    auto timer = db.getSelectTimer("ledger-header-history");
-    uint32_t begin = ledgerSeq, end = ledgerSeq + ledgerCount;
-    size_t n = 0;
-
-    string headerEncoded;
-
-    assert(begin <= end);
-
-    soci::statement st =
-        (sess.prepare << "SELECT data FROM ledgerheaders "
-                         "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
-                         "BY ledgerseq ASC",
-         into(headerEncoded), use(begin), use(end));
-
-    st.execute(true);
-    while (st.got_data())
-    {
-        LedgerHeaderHistoryEntry lhe;
-        LedgerHeaderFrame::pointer lhf = decodeFromData(headerEncoded);
-        lhe.hash = lhf->getHash();
-        lhe.header = lhf->mHeader;
-        CLOG(DEBUG, "Ledger") << "Streaming ledger-header "
-                              << lhe.header.ledgerSeq;
-        headersOut.writeOne(lhe);
-        ++n;
-        st.fetch();
-    }
-    return n;
-}
-
 void
 LedgerHeaderFrame::deleteOldEntries(Database& db, uint32_t ledgerSeq)
 {
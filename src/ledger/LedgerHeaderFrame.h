@@ -15,7 +15,6 @@ namespace stellar
 {
 class LedgerManager;
 class Database;
-class XDROutputFileStream;
 
 class LedgerHeaderFrame
 {
@@ -49,11 +48,6 @@ class LedgerHeaderFrame
     static LedgerHeaderFrame::pointer loadBySequence(uint32_t seq, Database& db,
                                                      soci::session& sess);
 
-    static size_t copyLedgerHeadersToStream(Database& db, soci::session& sess,
-                                            uint32_t ledgerSeq,
-                                            uint32_t ledgerCount,
-                                            XDROutputFileStream& headersOut);
-
     static void deleteOldEntries(Database& db, uint32_t ledgerSeq);
 
     static void dropAll(Database& db);
@@ -5,6 +5,7 @@
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
 #include "history/HistoryManager.h"
+#include "util/Timer.h"
 #include <memory>
 
 namespace stellar
@@ -12,6 +13,8 @@ namespace stellar
 
 class LedgerHeaderFrame;
 class LedgerCloseData;
+class LedgerCloseTimeline;
+class LedgerChangeFeed;
 class Database;
 
 /**
@@ -102,6 +105,10 @@ class LedgerManager
     // epoch.
     virtual uint64_t getCloseTime() const = 0;
 
+    // Return the time, on the application's clock, at which this node made
+    // the LCL its last closed ledger.
+    virtual VirtualClock::time_point getLastClosedLedgerTime() const = 0;
+
     // Return the fee required to apply a transaction to the current ledger. The
     // current ledger's baseFee is a 32bit value in stroops, but it is returned
     // as a 64bit value here to minimize the chance of overflow in a subsequent
@@ -170,6 +177,13 @@ class LedgerManager
     // checks the database for inconsistencies between objects
     virtual void checkDbState() = 0;
 
+    // Phase-by-phase breakdown of the most recent ledger closes.
+    virtual LedgerCloseTimeline const& getCloseTimeline() const = 0;
+
+    // Where the changes of each ledger close are written for downstream
+    // consumers, if LEDGER_CHANGE_FEED_DIR_PATH is set.
+    virtual LedgerChangeFeed& getChangeFeed() = 0;
+
     virtual ~LedgerManager()
     {
     }
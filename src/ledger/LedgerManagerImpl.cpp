@@ -11,13 +11,17 @@
 #include "herder/TxSetFrame.h"
 #include "herder/LedgerCloseData.h"
 #include "history/HistoryManager.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerDelta.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "ledger/LedgerManagerImpl.h"
+#include "ledger/TrustFrame.h"
 #include "main/Application.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
+#include "util/CrankStats.h"
 #include "util/Logging.h"
+#include "util/Timer.h"
 #include "util/make_unique.h"
 #include "util/format.h"
 
@@ -25,9 +29,11 @@
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "medida/counter.h"
+#include "medida/histogram.h"
 #include "xdrpp/printer.h"
 #include "xdrpp/types.h"
 
+#include <algorithm>
 #include <chrono>
 #include <sstream>
 
@@ -98,7 +104,18 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     : mApp(app)
     , mTransactionApply(
           app.getMetrics().NewTimer({"ledger", "transaction", "apply"}))
+    , mPrefetchLoad(app.getMetrics().NewTimer({"ledger", "prefetch", "load"}))
+    , mPrefetchEntries(app.getMetrics().NewMeter(
+          {"ledger", "prefetch", "entries"}, "entry"))
+    , mPrefetchHitRate(
+          app.getMetrics().NewHistogram({"ledger", "prefetch", "hit-rate"}))
+    , mTransactionClusters(
+          app.getMetrics().NewHistogram({"ledger", "transaction", "clusters"}))
+    , mTransactionClusterSize(app.getMetrics().NewHistogram(
+          {"ledger", "transaction", "largest-cluster"}))
     , mLedgerClose(app.getMetrics().NewTimer({"ledger", "ledger", "close"}))
+    , mLedgerPrepares(
+          app.getMetrics().NewHistogram({"ledger", "ledger", "prepares"}))
     , mLedgerAgeClosed(app.getMetrics().NewTimer({"ledger", "age", "closed"}))
     , mLedgerAge(
           app.getMetrics().NewCounter({"ledger", "age", "current-seconds"}))
@@ -107,9 +124,15 @@ LedgerManagerImpl::LedgerManagerImpl(Application& app)
     , mLedgerStateChanges(
           app.getMetrics().NewTimer({"ledger", "state", "changes"}))
     , mLastClose(mApp.getClock().now())
+    , mLastClosedLedgerTime(mLastClose)
     , mLastStateChange(mApp.getClock().now())
     , mSyncingLedgersSize(
           app.getMetrics().NewCounter({"ledger", "memory", "syncing-ledgers"}))
+    , mCloseTimeline(
+          app.getConfig().LEDGER_CLOSE_TIMELINE_SIZE,
+          app.getDatabase().getQueryMeter(),
+          app.getMetrics().NewMeter({"bucket", "byte", "insert"}, "byte"))
+    , mChangeFeed(app)
     , mState(LM_BOOTING_STATE)
 
 {
@@ -289,6 +312,12 @@ LedgerManagerImpl::getCloseTime() const
     return mCurrentLedger->mHeader.scpValue.closeTime;
 }
 
+VirtualClock::time_point
+LedgerManagerImpl::getLastClosedLedgerTime() const
+{
+    return mLastClosedLedgerTime;
+}
+
 LedgerHeader const&
 LedgerManagerImpl::getCurrentLedgerHeader() const
 {
@@ -608,6 +637,8 @@ during replays.
 void
 LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
 {
+    CrankTag crankTag(mApp.getClock().getCrankStats(),
+                      CrankStats::ORIGIN_LEDGER);
     DBTimeExcluder qtExclude(mApp);
     CLOG(DEBUG, "Ledger") << "starting closeLedger() on ledgerSeq="
                           << mCurrentLedger->mHeader.ledgerSeq;
@@ -637,7 +668,13 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         throw std::runtime_error("corrupt transaction set");
     }
 
+    LedgerCloseTimeline::Recording timeline(
+        mCloseTimeline, mCurrentLedger->mHeader.ledgerSeq,
+        ledgerData.mTxSet->size());
+    mCloseTimeline.phase("begin");
+
     soci::transaction txscope(getDatabase().getSession());
+    auto preparesBefore = getDatabase().getStatementPrepareCount();
 
     auto ledgerTime = mLedgerClose.TimeScope();
 
@@ -649,22 +686,49 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     // the transaction set that was agreed upon by consensus
     // was sorted by hash; we reorder it so that transactions are
     // sorted such that sequence numbers are respected
+    mCloseTimeline.phase("sort");
     vector<TransactionFramePtr> txs = ledgerData.mTxSet->sortForApply();
 
+    // load what the transactions are known to touch in a few batched
+    // queries, then see how much of fees and apply the cache served
+    mCloseTimeline.phase("prefetch");
+    prefetchTransactionEntries(txs);
+    auto& db = getDatabase();
+    auto hitsBefore = db.getEntryCacheHits();
+    auto missesBefore = db.getEntryCacheMisses();
+
+    LedgerCloseMeta meta;
+    auto& txProcessing = meta.v0().txProcessing;
+    if (mChangeFeed.isEnabled())
+    {
+        txProcessing.resize(txs.size());
+    }
+
     // first, charge fees
-    processFeesSeqNums(txs, ledgerDelta);
+    mCloseTimeline.phase("fees");
+    processFeesSeqNums(txs, ledgerDelta, txProcessing);
 
     TransactionResultSet txResultSet;
     txResultSet.results.reserve(txs.size());
 
-    applyTransactions(txs, ledgerDelta, txResultSet);
+    mCloseTimeline.phase("apply");
+    applyTransactions(txs, ledgerDelta, txResultSet, txProcessing);
+
+    auto hits = db.getEntryCacheHits() - hitsBefore;
+    auto lookups = hits + db.getEntryCacheMisses() - missesBefore;
+    if (lookups != 0)
+    {
+        mPrefetchHitRate.Update(hits * 100 / lookups);
+    }
 
+    mCloseTimeline.phase("result-hash");
     ledgerDelta.getHeader().txSetResultHash =
         sha256(xdr::xdr_to_opaque(txResultSet));
 
     // apply any upgrades that were decided during consensus
     // this must be done after applying transactions as the txset
     // was validated before upgrades
+    mCloseTimeline.phase("upgrades");
     for (size_t i = 0; i < sv.upgrades.size(); i++)
     {
         LedgerUpgrade lupgrade;
@@ -698,11 +762,21 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
         }
     }
 
+    mCloseTimeline.phase("check-database");
     ledgerDelta.checkAgainstDatabase(mApp);
 
+    mCloseTimeline.phase("commit-delta");
     ledgerDelta.commit();
     closeLedgerHelper(ledgerDelta);
 
+    if (mChangeFeed.isEnabled())
+    {
+        mCloseTimeline.phase("change-feed");
+        meta.v0().ledgerHeader = getLastClosedLedgerHeader();
+        ledgerData.mTxSet->toXDR(meta.v0().txSet);
+        mChangeFeed.write(meta);
+    }
+
     // The next 4 steps happen in a relatively non-obvious, subtle order.
     // This is unfortunate and it would be nice if we could make it not
     // be so subtle, but for the time being this is where we are.
@@ -721,23 +795,40 @@ LedgerManagerImpl::closeLedger(LedgerCloseData const& ledgerData)
     // 4. GC unreferenced buckets. Only do this once publishes are in progress.
 
     // step 1
+    mCloseTimeline.phase("queue-checkpoint");
     auto& hm = mApp.getHistoryManager();
     hm.maybeQueueHistoryCheckpoint();
 
     // step 2
-    mApp.getDatabase().clearPreparedStatementCache();
+    mCloseTimeline.phase("commit");
     txscope.commit();
+    mLedgerPrepares.Update(getDatabase().getStatementPrepareCount() -
+                           preparesBefore);
 
     // step 3
+    mCloseTimeline.phase("publish");
     hm.publishQueuedHistory([](asio::error_code const&)
                             {
                             });
     hm.logAndUpdateStatus(true);
 
     // step 4
+    mCloseTimeline.phase("forget-buckets");
     mApp.getBucketManager().forgetUnreferencedBuckets();
 }
 
+LedgerCloseTimeline const&
+LedgerManagerImpl::getCloseTimeline() const
+{
+    return mCloseTimeline;
+}
+
+LedgerChangeFeed&
+LedgerManagerImpl::getChangeFeed()
+{
+    return mChangeFeed;
+}
+
 void
 LedgerManagerImpl::deleteOldEntries(Database& db, uint32_t ledgerSeq)
 {
@@ -798,6 +889,40 @@ LedgerManagerImpl::checkDbState()
                             PubKeyUtils::toStrKey(of.first)));
         }
     }
+
+    // recomputes the inflation vote tally and checks the maintained one
+    std::unordered_map<AccountID, int64> votes;
+    for (auto& i : aData)
+    {
+        auto const& a = i.second->getAccount();
+        if (a.inflationDest &&
+            a.balance >= AccountFrame::kMinInflationVoteBalance)
+        {
+            votes[*a.inflationDest] += a.balance;
+        }
+    }
+    auto tally = AccountFrame::loadInflationVotes(getDatabase());
+    for (auto const& v : votes)
+    {
+        auto it = tally.find(v.first);
+        int64 stored = it == tally.end() ? 0 : it->second;
+        if (stored != v.second)
+        {
+            throw std::runtime_error(fmt::format(
+                "Mismatch in inflation votes for {}: tally says {} but "
+                "accounts add up to {}",
+                PubKeyUtils::toStrKey(v.first), stored, v.second));
+        }
+    }
+    for (auto const& t : tally)
+    {
+        if (votes.find(t.first) == votes.end())
+        {
+            throw std::runtime_error(
+                fmt::format("Unexpected inflation votes ({}) for {}",
+                            t.second, PubKeyUtils::toStrKey(t.first)));
+        }
+    }
 }
 
 void
@@ -810,13 +935,56 @@ LedgerManagerImpl::advanceLedgerPointers()
     mLastClosedLedger.hash = mCurrentLedger->getHash();
     mLastClosedLedger.header = mCurrentLedger->mHeader;
     mCurrentLedger = make_shared<LedgerHeaderFrame>(mLastClosedLedger);
+    mLastClosedLedgerTime = mApp.getClock().now();
     CLOG(DEBUG, "Ledger") << "New current ledger: seq="
                           << mCurrentLedger->mHeader.ledgerSeq;
 }
 
 void
-LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
-                                      LedgerDelta& delta)
+LedgerManagerImpl::prefetchTransactionEntries(
+    std::vector<TransactionFramePtr> const& txs)
+{
+    auto timer = mPrefetchLoad.TimeScope();
+
+    std::vector<AccountID> accounts;
+    std::vector<LedgerKey> trustLines;
+    for (auto const& tx : txs)
+    {
+        auto fp = tx->getFootprint();
+        for (auto const* keys : {&fp.mReads, &fp.mWrites})
+        {
+            for (auto const& k : *keys)
+            {
+                if (k.type() == ACCOUNT)
+                {
+                    accounts.emplace_back(k.account().accountID);
+                }
+                else if (k.type() == TRUSTLINE)
+                {
+                    trustLines.emplace_back(k);
+                }
+            }
+        }
+    }
+
+    // don't evict what we just loaded
+    size_t const maxEntries = EntryFrame::kPrefetchMaxEntries;
+    if (accounts.size() > maxEntries)
+    {
+        accounts.resize(maxEntries);
+    }
+    trustLines.resize(
+        std::min(trustLines.size(), maxEntries - accounts.size()));
+
+    auto& db = getDatabase();
+    mPrefetchEntries.Mark(AccountFrame::prefetch(accounts, db) +
+                          TrustFrame::prefetch(trustLines, db));
+}
+
+void
+LedgerManagerImpl::processFeesSeqNums(
+    std::vector<TransactionFramePtr>& txs, LedgerDelta& delta,
+    xdr::xvector<TransactionResultMeta>& txProcessing)
 {
     CLOG(DEBUG, "Ledger") << "processing fees and sequence numbers";
     int index = 0;
@@ -827,7 +995,12 @@ LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
         {
             LedgerDelta thisTxDelta(delta);
             tx->processFeeSeqNum(thisTxDelta, *this);
-            tx->storeTransactionFee(*this, thisTxDelta.getChanges(), ++index);
+            auto changes = thisTxDelta.getChanges();
+            tx->storeTransactionFee(*this, changes, ++index);
+            if (!txProcessing.empty())
+            {
+                txProcessing[index - 1].feeProcessing = std::move(changes);
+            }
             thisTxDelta.commit();
         }
         sqlTx.commit();
@@ -841,47 +1014,90 @@ LedgerManagerImpl::processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
 }
 
 void
-LedgerManagerImpl::applyTransactions(std::vector<TransactionFramePtr>& txs,
-                                     LedgerDelta& ledgerDelta,
-                                     TransactionResultSet& txResultSet)
+LedgerManagerImpl::applyTransactions(
+    std::vector<TransactionFramePtr>& txs, LedgerDelta& ledgerDelta,
+    TransactionResultSet& txResultSet,
+    xdr::xvector<TransactionResultMeta>& txProcessing)
 {
     CLOG(DEBUG, "Tx") << "applyTransactions: ledger = "
                       << mCurrentLedger->mHeader.ledgerSeq;
-    int index = 0;
-    for (auto tx : txs)
+
+    // how much of this ledger could be applied independently
+    auto clusters = TxSetFrame::partitionForApply(txs);
+    size_t largest = 0;
+    for (auto const& c : clusters)
     {
-        auto txTime = mTransactionApply.TimeScope();
-        LedgerDelta delta(ledgerDelta);
-        TransactionMeta tm;
-        try
-        {
-            CLOG(DEBUG, "Tx")
-                << " tx#" << index << " = " << hexAbbrev(tx->getFullHash())
-                << " txseq=" << tx->getSeqNum() << " (@ "
-                << mApp.getConfig().toShortString(tx->getSourceID()) << ")";
+        largest = std::max(largest, c.size());
+    }
+    mTransactionClusters.Update(clusters.size());
+    mTransactionClusterSize.Update(largest);
 
-            if (tx->apply(delta, tm, mApp))
-            {
-                delta.commit();
-            }
-            else
+    std::vector<TransactionMeta> metas(txs.size());
+    if (mApp.getConfig().ARTIFICIALLY_CLUSTER_TX_APPLY_FOR_TESTING)
+    {
+        for (auto const& c : clusters)
+        {
+            for (auto i : c)
             {
-                // failure means there should be no side effects
-                assert(delta.getChanges().size() == 0);
-                assert(delta.getHeader() == ledgerDelta.getHeader());
+                applyTransaction(txs[i], ledgerDelta, metas[i]);
             }
         }
-        catch (std::runtime_error& e)
+    }
+    else
+    {
+        for (size_t i = 0; i < txs.size(); i++)
+        {
+            applyTransaction(txs[i], ledgerDelta, metas[i]);
+        }
+    }
+
+    // results and meta are recorded in apply order either way
+    for (size_t i = 0; i < txs.size(); i++)
+    {
+        txs[i]->storeTransaction(*this, metas[i], static_cast<int>(i + 1),
+                                 txResultSet);
+        if (!txProcessing.empty())
+        {
+            txProcessing[i].result = txResultSet.results.back();
+            txProcessing[i].txApplyProcessing = std::move(metas[i]);
+        }
+    }
+}
+
+void
+LedgerManagerImpl::applyTransaction(TransactionFramePtr tx,
+                                    LedgerDelta& ledgerDelta,
+                                    TransactionMeta& tm)
+{
+    auto txTime = mTransactionApply.TimeScope();
+    LedgerDelta delta(ledgerDelta);
+    try
+    {
+        CLOG(DEBUG, "Tx") << " tx = " << hexAbbrev(tx->getFullHash())
+                          << " txseq=" << tx->getSeqNum() << " (@ "
+                          << mApp.getConfig().toShortString(tx->getSourceID())
+                          << ")";
+
+        if (tx->apply(delta, tm, mApp))
         {
-            CLOG(ERROR, "Ledger") << "Exception during tx->apply: " << e.what();
-            tx->getResult().result.code(txINTERNAL_ERROR);
+            delta.commit();
         }
-        catch (...)
+        else
         {
-            CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
-            tx->getResult().result.code(txINTERNAL_ERROR);
+            // failure means there should be no side effects
+            assert(delta.getChanges().size() == 0);
+            assert(delta.getHeader() == ledgerDelta.getHeader());
         }
-        tx->storeTransaction(*this, tm, ++index, txResultSet);
+    }
+    catch (std::runtime_error& e)
+    {
+        CLOG(ERROR, "Ledger") << "Exception during tx->apply: " << e.what();
+        tx->getResult().result.code(txINTERNAL_ERROR);
+    }
+    catch (...)
+    {
+        CLOG(ERROR, "Ledger") << "Unknown exception during tx->apply";
+        tx->getResult().result.code(txINTERNAL_ERROR);
     }
 }
 
@@ -889,17 +1105,22 @@ void
 LedgerManagerImpl::closeLedgerHelper(LedgerDelta const& delta)
 {
     delta.markMeters(mApp);
+
+    mCloseTimeline.phase("add-batch");
     mApp.getBucketManager().addBatch(mApp, mCurrentLedger->mHeader.ledgerSeq,
                                      delta.getLiveEntries(),
                                      delta.getDeadEntries());
 
+    mCloseTimeline.phase("snapshot");
     mApp.getBucketManager().snapshotLedger(mCurrentLedger->mHeader);
 
+    mCloseTimeline.phase("store-header");
     mCurrentLedger->storeInsert(*this);
 
     mApp.getPersistentState().setState(PersistentState::kLastClosedLedger,
                                        binToHex(mCurrentLedger->getHash()));
 
+    mCloseTimeline.phase("history-archive-state");
     // Store the current HAS in the database; this is really just to checkpoint
     // the bucketlist so we can survive a restart and re-attach to the buckets.
     HistoryArchiveState has(mCurrentLedger->mHeader.ledgerSeq,
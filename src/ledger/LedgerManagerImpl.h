@@ -6,6 +6,8 @@
 #include "util/asio.h"
 
 #include <string>
+#include "ledger/LedgerChangeFeed.h"
+#include "ledger/LedgerCloseTimeline.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerHeaderFrame.h"
 #include "main/PersistentState.h"
@@ -21,7 +23,9 @@ Hands the old ledger off to the history
 namespace medida
 {
 class Timer;
+class Meter;
 class Counter;
+class Histogram;
 }
 
 namespace stellar
@@ -37,27 +41,44 @@ class LedgerManagerImpl : public LedgerManager
 
     Application& mApp;
     medida::Timer& mTransactionApply;
+    medida::Timer& mPrefetchLoad;
+    medida::Meter& mPrefetchEntries;
+    medida::Histogram& mPrefetchHitRate;
+    medida::Histogram& mTransactionClusters;
+    medida::Histogram& mTransactionClusterSize;
     medida::Timer& mLedgerClose;
+    medida::Histogram& mLedgerPrepares;
     medida::Timer& mLedgerAgeClosed;
     medida::Counter& mLedgerAge;
     medida::Counter& mLedgerStateCurrent;
     medida::Timer& mLedgerStateChanges;
     VirtualClock::time_point mLastClose;
+    VirtualClock::time_point mLastClosedLedgerTime;
     VirtualClock::time_point mLastStateChange;
 
     medida::Counter& mSyncingLedgersSize;
 
     std::vector<LedgerCloseData> mSyncingLedgers;
 
+    LedgerCloseTimeline mCloseTimeline;
+    LedgerChangeFeed mChangeFeed;
+
     void historyCaughtup(asio::error_code const& ec,
                          HistoryManager::CatchupMode mode,
                          LedgerHeaderHistoryEntry const& lastClosed);
 
+    void
+    prefetchTransactionEntries(std::vector<TransactionFramePtr> const& txs);
+    // fill in `txProcessing` for the change feed unless it is empty
     void processFeesSeqNums(std::vector<TransactionFramePtr>& txs,
-                            LedgerDelta& delta);
+                            LedgerDelta& delta,
+                            xdr::xvector<TransactionResultMeta>& txProcessing);
     void applyTransactions(std::vector<TransactionFramePtr>& txs,
                            LedgerDelta& ledgerDelta,
-                           TransactionResultSet& txResultSet);
+                           TransactionResultSet& txResultSet,
+                           xdr::xvector<TransactionResultMeta>& txProcessing);
+    void applyTransaction(TransactionFramePtr tx, LedgerDelta& ledgerDelta,
+                          TransactionMeta& tm);
 
     void closeLedgerHelper(LedgerDelta const& delta);
     void advanceLedgerPointers();
@@ -79,6 +100,7 @@ class LedgerManagerImpl : public LedgerManager
     int64_t getTxFee() const override;
     uint32_t getMaxTxSetSize() const override;
     uint64_t getCloseTime() const override;
+    VirtualClock::time_point getLastClosedLedgerTime() const override;
     uint64_t secondsSinceLastLedgerClose() const override;
     void syncMetrics() override;
 
@@ -99,5 +121,8 @@ class LedgerManagerImpl : public LedgerManager
     void closeLedger(LedgerCloseData const& ledgerData) override;
     void deleteOldEntries(Database& db, uint32_t ledgerSeq) override;
     void checkDbState() override;
+
+    LedgerCloseTimeline const& getCloseTimeline() const override;
+    LedgerChangeFeed& getChangeFeed() override;
 };
 }
@@ -5,18 +5,35 @@
 #include "util/Timer.h"
 #include "main/Application.h"
 #include "main/test.h"
+#include "main/CommandHandler.h"
 #include "main/Config.h"
 #include "lib/catch.hpp"
 #include "database/Database.h"
+#include "ledger/LedgerChangeFeed.h"
+#include "ledger/LedgerCloseTimeline.h"
 #include "ledger/LedgerDelta.h"
+#include "ledger/LedgerHashUtils.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/EntryFrame.h"
+#include "ledger/AccountFrame.h"
+#include "ledger/TrustFrame.h"
+#include "transactions/TxTests.h"
+#include "util/Fs.h"
 #include "util/Logging.h"
+#include "util/TmpDir.h"
+#include "util/XDRStream.h"
 #include "util/types.h"
 #include <xdrpp/autocheck.h>
 #include "LedgerTestUtils.h"
+#include "lib/json/json.h"
+#include "medida/meter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
 
 using namespace stellar;
+using xdr::operator==;
 
 TEST_CASE("Ledger entry db lifecycle", "[ledger]")
 {
@@ -137,3 +154,522 @@ TEST_CASE("DB cache interaction with transactions", "[ledger][dbcache]")
 
     CHECK(balance0 == acc->getAccount().balance);
 }
+
+TEST_CASE("LedgerDelta nesting", "[ledger][delta]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto makeAccount = []()
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(3);
+        return EntryFrame::FromXDR(le);
+    };
+    auto a = makeAccount();
+    auto b = makeAccount();
+    auto c = makeAccount();
+    auto b2 = EntryFrame::FromXDR(b->mEntry);
+    b2->mEntry.data.account().balance += 1;
+
+    LedgerDelta delta(app->getLedgerManager().getCurrentLedgerHeader(),
+                      app->getDatabase());
+    {
+        LedgerDelta inner(delta);
+        inner.addEntry(*a);
+        inner.modEntry(*b);
+        inner.deleteEntry(c->getKey());
+
+        auto changes = inner.getChanges();
+        REQUIRE(changes.size() == 3);
+        CHECK(changes[0].type() == LEDGER_ENTRY_CREATED);
+        CHECK(changes[1].type() == LEDGER_ENTRY_UPDATED);
+        CHECK(changes[2].type() == LEDGER_ENTRY_REMOVED);
+
+        // changes only go to the innermost delta
+        CHECK_THROWS(delta.modEntry(*b2));
+        inner.commit();
+    }
+    CHECK(delta.getLiveEntries().size() == 2);
+    CHECK(delta.getDeadEntries().size() == 1);
+
+    SECTION("rollback restores the outer delta")
+    {
+        {
+            LedgerDelta inner(delta);
+            inner.deleteEntry(a->getKey());
+            inner.addEntry(*c);
+            inner.modEntry(*b2);
+
+            // relative to the inner delta, c is new and a is gone
+            auto changes = inner.getChanges();
+            REQUIRE(changes.size() == 3);
+            CHECK(changes[0].type() == LEDGER_ENTRY_CREATED);
+            CHECK(changes[1].type() == LEDGER_ENTRY_UPDATED);
+            CHECK(changes[2].type() == LEDGER_ENTRY_REMOVED);
+            // scope-end rolls back
+        }
+        auto live = delta.getLiveEntries();
+        REQUIRE(live.size() == 2);
+        CHECK(delta.getDeadEntries().size() == 1);
+        CHECK(delta.getChanges()[0].created() == a->mEntry);
+        CHECK(delta.getChanges()[1].updated() == b->mEntry);
+    }
+
+    SECTION("nested commits fold into the outer delta")
+    {
+        {
+            LedgerDelta inner(delta);
+            {
+                LedgerDelta innermost(inner);
+                innermost.modEntry(*b2);
+                innermost.deleteEntry(a->getKey());
+                innermost.commit();
+            }
+            // relative to inner, a existed and got deleted
+            auto changes = inner.getChanges();
+            REQUIRE(changes.size() == 2);
+            CHECK(changes[0].type() == LEDGER_ENTRY_UPDATED);
+            CHECK(changes[1].type() == LEDGER_ENTRY_REMOVED);
+            inner.commit();
+        }
+        auto changes = delta.getChanges();
+        REQUIRE(changes.size() == 2);
+        CHECK(changes[0].type() == LEDGER_ENTRY_UPDATED);
+        CHECK(changes[0].updated() == b2->mEntry);
+        CHECK(changes[1].type() == LEDGER_ENTRY_REMOVED);
+        CHECK(changes[1].removed() == c->getKey());
+    }
+}
+
+TEST_CASE("ledger key hash covers the trust line asset", "[ledger][hash]")
+{
+    using namespace txtest;
+
+    SecretKey holder = getAccount("holder");
+    SecretKey issuer = getAccount("issuer");
+    auto makeKey = [&](Asset const& asset)
+    {
+        LedgerKey key;
+        key.type(TRUSTLINE);
+        key.trustLine().accountID = holder.getPublicKey();
+        key.trustLine().asset = asset;
+        return key;
+    };
+
+    LedgerKeyHash hash;
+    auto usd = makeKey(makeAsset(issuer, "USD"));
+    CHECK(hash(usd) == hash(makeKey(makeAsset(issuer, "USD"))));
+    CHECK(hash(usd) != hash(makeKey(makeAsset(issuer, "EUR"))));
+    CHECK(hash(makeKey(makeAsset(issuer, "LONGASSET1"))) !=
+          hash(makeKey(makeAsset(issuer, "LONGASSET2"))));
+}
+
+TEST_CASE("prefetch loads entries into the entry cache", "[ledger][prefetch]")
+{
+    using namespace txtest;
+
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& db = app->getDatabase();
+    SecretKey root = getRoot(app->getNetworkID());
+    SequenceNumber rootSeq = getAccountSeqNum(root, *app) + 1;
+    int64_t const minBalance = app->getLedgerManager().getMinBalance(5);
+
+    // more than one batch worth of accounts
+    std::vector<SecretKey> keys;
+    std::vector<AccountID> ids;
+    for (size_t i = 0; i < EntryFrame::kPrefetchBatchSize + 10; i++)
+    {
+        keys.emplace_back(getAccount(("prefetch" + std::to_string(i)).c_str()));
+        applyCreateAccountTx(*app, root, keys.back(), rootSeq++, minBalance);
+        ids.emplace_back(keys.back().getPublicKey());
+    }
+    SecretKey missing = getAccount("missing");
+    ids.emplace_back(missing.getPublicKey());
+    ids.emplace_back(ids.front());
+
+    SecretKey& gateway = keys[0];
+    SecretKey& holder = keys[1];
+    applyChangeTrust(*app, holder, gateway, getAccountSeqNum(holder, *app) + 1,
+                     "USD", 1000);
+
+    SECTION("accounts")
+    {
+        db.getEntryCache().clear();
+        REQUIRE(AccountFrame::prefetch(ids, db) == keys.size());
+
+        // the missing account is cached as absent
+        LedgerKey missingKey;
+        missingKey.type(ACCOUNT);
+        missingKey.account().accountID = missing.getPublicKey();
+        CHECK(EntryFrame::cachedEntryExists(missingKey, db));
+        CHECK(!EntryFrame::getCachedEntry(missingKey, db));
+
+        auto hits = db.getEntryCacheHits();
+        std::vector<AccountFrame::pointer> cached;
+        for (auto const& k : keys)
+        {
+            cached.emplace_back(AccountFrame::loadAccount(k.getPublicKey(), db));
+        }
+        CHECK(db.getEntryCacheHits() - hits == keys.size());
+
+        db.getEntryCache().clear();
+        for (size_t i = 0; i < keys.size(); i++)
+        {
+            auto fresh = AccountFrame::loadAccount(keys[i].getPublicKey(), db);
+            REQUIRE(fresh);
+            REQUIRE(cached[i]);
+            CHECK(cached[i]->mEntry == fresh->mEntry);
+        }
+    }
+
+    SECTION("trust lines")
+    {
+        Asset usd = makeAsset(gateway, "USD");
+        auto makeKey = [&usd](SecretKey const& k)
+        {
+            LedgerKey key;
+            key.type(TRUSTLINE);
+            key.trustLine().accountID = k.getPublicKey();
+            key.trustLine().asset = usd;
+            return key;
+        };
+
+        db.getEntryCache().clear();
+        std::vector<LedgerKey> lines{makeKey(holder), makeKey(keys[2]),
+                                     makeKey(gateway)};
+        REQUIRE(TrustFrame::prefetch(lines, db) == 1);
+
+        // both the line and the absence of one are cached
+        CHECK(EntryFrame::cachedEntryExists(lines[0], db));
+        CHECK(EntryFrame::cachedEntryExists(lines[1], db));
+        CHECK(!EntryFrame::getCachedEntry(lines[1], db));
+
+        auto cached = loadTrustLine(holder, usd, *app);
+        db.getEntryCache().clear();
+        auto fresh = loadTrustLine(holder, usd, *app);
+        CHECK(cached->mEntry == fresh->mEntry);
+        CHECK(!loadTrustLine(keys[2], usd, *app, false));
+    }
+}
+
+static std::vector<AccountFrame::pointer>
+storeRandomAccounts(Application& app, size_t n)
+{
+    auto& db = app.getDatabase();
+    LedgerDelta delta(app.getLedgerManager().getCurrentLedgerHeader(), db);
+    std::vector<AccountFrame::pointer> res;
+    for (size_t i = 0; i < n; i++)
+    {
+        LedgerEntry le;
+        le.data.type(ACCOUNT);
+        le.data.account() = LedgerTestUtils::generateValidAccountEntry(5);
+        auto a = std::make_shared<AccountFrame>(le);
+        a->setUpdateSigners();
+        a->storeAdd(delta, db);
+        res.emplace_back(a);
+    }
+    delta.commit();
+    return res;
+}
+
+TEST_CASE("account loads", "[ledger][accountload]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+    auto& db = app->getDatabase();
+
+    SECTION("signers are loaded inline")
+    {
+        auto accounts = storeRandomAccounts(*app, 20);
+        db.getEntryCache().clear();
+        auto queries = db.getQueryMeter().count();
+        for (auto const& a : accounts)
+        {
+            auto id = a->getAccount().accountID;
+            auto loaded = AccountFrame::loadAccount(id, db);
+            REQUIRE(loaded);
+            auto expected = a->getAccount().signers;
+            std::sort(expected.begin(), expected.end(),
+                      &AccountFrame::signerCompare);
+            REQUIRE(loaded->getAccount().signers.size() == expected.size());
+            for (size_t i = 0; i < expected.size(); i++)
+            {
+                CHECK(loaded->getAccount().signers[i].pubKey ==
+                      expected[i].pubKey);
+                CHECK(loaded->getAccount().signers[i].weight ==
+                      expected[i].weight);
+            }
+            CHECK(loaded->getBalance() == a->getBalance());
+        }
+        // one query per account, signers included
+        CHECK(db.getQueryMeter().count() - queries == accounts.size());
+
+        // and they agree with the signers table
+        AccountFrame::checkDB(db);
+    }
+
+    SECTION("absent accounts are looked up once")
+    {
+        SecretKey nobody = SecretKey::random();
+        auto queries = db.getQueryMeter().count();
+        auto a = AccountFrame::loadAccount(nobody.getPublicKey(), db);
+        REQUIRE(a);
+        CHECK(a->getIsNew());
+        CHECK(a->getBalance() == 0);
+        CHECK(db.getQueryMeter().count() - queries == 1);
+
+        auto again = AccountFrame::loadAccount(nobody.getPublicKey(), db);
+        REQUIRE(again);
+        CHECK(again->getIsNew());
+        CHECK(again->getAccount().thresholds[0] == 1);
+        CHECK(!AccountFrame::exists(db, again->getKey()));
+        CHECK(db.getQueryMeter().count() - queries == 1);
+    }
+}
+
+TEST_CASE("account load benchmark", "[ledger][bench][hide]")
+{
+    Config cfg(getTestConfig());
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+    auto& db = app->getDatabase();
+
+    // present and absent accounts all fit in the entry cache
+    size_t const n = 2000;
+    std::vector<AccountID> present, absent;
+    for (auto const& a : storeRandomAccounts(*app, n))
+    {
+        present.emplace_back(a->getAccount().accountID);
+        absent.emplace_back(SecretKey::random().getPublicKey());
+    }
+
+    auto bench = [&](char const* name, std::vector<AccountID> const& ids)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (auto const& id : ids)
+        {
+            REQUIRE(AccountFrame::loadAccount(id, db));
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        LOG(INFO) << name << ": " << ids.size() << " account loads in "
+                  << elapsed.count() << "us ("
+                  << (ids.size() * 1000000.0) / (elapsed.count() + 1)
+                  << " loads/s)";
+    };
+
+    db.getEntryCache().clear();
+    bench("cold", present);
+    bench("hot", present);
+    bench("absent, first lookup", absent);
+    bench("absent, known", absent);
+}
+
+TEST_CASE("ledger close timeline", "[ledger][timeline]")
+{
+    using namespace txtest;
+
+    Config cfg(getTestConfig());
+    cfg.LEDGER_CLOSE_TIMELINE_SIZE = 3;
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto const& timeline = lm.getCloseTimeline();
+    SecretKey root = getRoot(app->getNetworkID());
+    SecretKey a1 = getAccount("A");
+
+    uint32_t first = lm.getLedgerNum();
+    auto tx = createCreateAccountTx(app->getNetworkID(), root, a1,
+                                    getAccountSeqNum(root, *app) + 1,
+                                    lm.getMinBalance(0));
+    closeLedgerOn(*app, first, 1, 7, 2014, tx);
+
+    REQUIRE(timeline.getLedgers().size() == 1);
+    auto const& closed = timeline.getLedgers().back();
+    CHECK(closed.mLedgerSeq == first);
+    CHECK(closed.mTxCount == 1);
+
+    std::map<std::string, LedgerCloseTimeline::Phase> phases;
+    std::chrono::nanoseconds sum(0);
+    for (auto const& p : closed.mPhases)
+    {
+        phases[p.mName] = p;
+        sum += p.mDuration;
+    }
+    for (auto name : {"fees", "apply", "add-batch", "commit", "forget-buckets"})
+    {
+        CHECK(phases.find(name) != phases.end());
+    }
+    CHECK(phases["apply"].mStatements != 0);
+    CHECK(phases["add-batch"].mBucketBytes != 0);
+    CHECK(sum <= closed.mDuration);
+
+    for (uint32_t i = 1; i <= 4; i++)
+    {
+        closeLedgerOn(*app, first + i, 1 + i, 7, 2014);
+    }
+    REQUIRE(timeline.getLedgers().size() == 3);
+    CHECK(timeline.getLedgers().front().mLedgerSeq == first + 2);
+    CHECK(timeline.getLedgers().back().mLedgerSeq == first + 4);
+    CHECK(timeline.getLedgers().back().mTxCount == 0);
+
+    Json::Value report;
+    timeline.report(report, 2);
+    REQUIRE(report["ledgers"].size() == 2);
+    CHECK(report["ledgers"][1]["ledger"].asUInt() == first + 4);
+    CHECK(report["ledgers"][1]["phases"].size() ==
+          timeline.getLedgers().back().mPhases.size());
+
+    Json::Value trace;
+    timeline.reportTrace(trace, 1);
+    auto const& events = trace["traceEvents"];
+    REQUIRE(events.size() == 1 + timeline.getLedgers().back().mPhases.size());
+    for (auto const& e : events)
+    {
+        CHECK(e["ph"].asString() == "X");
+        CHECK(e["ts"].asUInt64() >= events[0]["ts"].asUInt64());
+    }
+}
+
+TEST_CASE("ledger change feed", "[ledger][changefeed]")
+{
+    using namespace txtest;
+
+    TmpDir dir("changefeed");
+    Config cfg(getTestConfig());
+    cfg.LEDGER_CHANGE_FEED_DIR_PATH = dir.getName();
+    cfg.ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = true;
+    VirtualClock clock;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto& lm = app->getLedgerManager();
+    auto& feed = lm.getChangeFeed();
+    REQUIRE(feed.isEnabled());
+    SecretKey root = getRoot(app->getNetworkID());
+    SecretKey a1 = getAccount("A");
+
+    // files hold 8 ledgers: 2 to 7, 8 to 15 and 16 to 17
+    uint32_t first = lm.getLedgerNum();
+    REQUIRE(first == 2);
+    auto tx = createCreateAccountTx(app->getNetworkID(), root, a1,
+                                    getAccountSeqNum(root, *app) + 1,
+                                    lm.getMinBalance(0));
+    closeLedgerOn(*app, first, 1, 7, 2014, tx);
+    auto firstHash = lm.getLastClosedLedgerHeader().hash;
+    for (uint32_t seq = first + 1; seq <= 17; seq++)
+    {
+        closeLedgerOn(*app, seq, 1 + seq, 7, 2014);
+    }
+
+    auto path = [&](uint32_t seq)
+    {
+        return dir.getName() + "/" + feed.fileName(seq);
+    };
+    REQUIRE(feed.fileName(2) == "ledger-changes-00000000.xdr");
+    REQUIRE(feed.fileName(15) == "ledger-changes-00000008.xdr");
+
+    XDRInputFileStream in;
+    in.open(path(first));
+    LedgerCloseMeta meta;
+    std::vector<uint32_t> seqs;
+    while (in.readOne(meta))
+    {
+        auto const& v0 = meta.v0();
+        seqs.push_back(v0.ledgerHeader.header.ledgerSeq);
+        if (seqs.back() != first)
+        {
+            CHECK(v0.txSet.txs.empty());
+            CHECK(v0.txProcessing.empty());
+            continue;
+        }
+        CHECK(v0.ledgerHeader.hash == firstHash);
+        REQUIRE(v0.txSet.txs.size() == 1);
+        REQUIRE(v0.txProcessing.size() == 1);
+        auto const& txp = v0.txProcessing[0];
+        CHECK(txp.result.transactionHash == tx->getContentsHash());
+        CHECK(txp.result.result.result.code() == txSUCCESS);
+        CHECK(!txp.feeProcessing.empty());
+        CHECK(txp.txApplyProcessing.operations().size() == 1);
+    }
+    REQUIRE(seqs == std::vector<uint32_t>({2, 3, 4, 5, 6, 7}));
+    REQUIRE(fs::exists(path(8)));
+    REQUIRE(fs::exists(path(16)));
+
+    SECTION("kept without cursors")
+    {
+        app->getCommandHandler().manualCmd("maintenance?queue=true");
+        REQUIRE(fs::exists(path(2)));
+    }
+
+    SECTION("trimmed by the cursors")
+    {
+        app->getCommandHandler().manualCmd("setcursor?id=A1&cursor=9");
+        app->getCommandHandler().manualCmd("setcursor?id=A2&cursor=15");
+        app->getCommandHandler().manualCmd("maintenance?queue=true");
+        REQUIRE(!fs::exists(path(2)));
+        REQUIRE(fs::exists(path(8)));
+
+        app->getCommandHandler().manualCmd("setcursor?id=A1&cursor=17");
+        app->getCommandHandler().manualCmd("maintenance?queue=true");
+        REQUIRE(!fs::exists(path(8)));
+        REQUIRE(fs::exists(path(16)));
+
+        // and the ledgers to come still go to the last file
+        closeLedgerOn(*app, 18, 1, 8, 2014);
+        XDRInputFileStream last;
+        last.open(path(18));
+        seqs.clear();
+        while (last.readOne(meta))
+        {
+            seqs.push_back(meta.v0().ledgerHeader.header.ledgerSeq);
+        }
+        REQUIRE(seqs == std::vector<uint32_t>({16, 17, 18}));
+    }
+
+    SECTION("write failures do not stop ledger close")
+    {
+        auto& errors = app->getMetrics().NewMeter({"ledger", "feed", "error"},
+                                                  "error");
+
+        // ledgers up to 23 still go to the open file of ledger 16; opening
+        // the next one fails while a file stands where the directory was
+        fs::deltree(dir.getName());
+        {
+            std::ofstream blocker(dir.getName());
+            blocker << "not a directory";
+        }
+        for (uint32_t seq = 18; seq <= 25; seq++)
+        {
+            closeLedgerOn(*app, seq, seq - 17, 8, 2014);
+        }
+        REQUIRE(lm.getLastClosedLedgerNum() == 25);
+        REQUIRE(errors.count() == 2);
+
+        // the ledgers that could not be written come first at the next close
+        REQUIRE(std::remove(dir.getName().c_str()) == 0);
+        closeLedgerOn(*app, 26, 9, 8, 2014);
+        REQUIRE(errors.count() == 2);
+        XDRInputFileStream last;
+        last.open(path(24));
+        seqs.clear();
+        while (last.readOne(meta))
+        {
+            seqs.push_back(meta.v0().ledgerHeader.header.ledgerSeq);
+        }
+        REQUIRE(seqs == std::vector<uint32_t>({24, 25, 26}));
+    }
+}
@@ -129,14 +129,22 @@ OfferFrame::isValid() const
 
 OfferFrame::pointer
 OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db)
+{
+    return loadOffer(sellerID, offerID, db, db.getSession());
+}
+
+OfferFrame::pointer
+OfferFrame::loadOffer(AccountID const& sellerID, uint64_t offerID, Database& db,
+                      soci::session& sess)
 {
     OfferFrame::pointer retOffer;
 
     std::string actIDStrKey = PubKeyUtils::toStrKey(sellerID);
 
-    std::string sql = offerColumnSelector;
-    sql += " WHERE sellerid = :id AND offerid = :offerid";
-    auto prep = db.getPreparedStatement(sql);
+    static StatementID const loadStmt = Database::registerStatement(
+        std::string(offerColumnSelector) +
+        " WHERE sellerid = :id AND offerid = :offerid");
+    auto prep = db.getPreparedStatement(loadStmt, sess);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(offerID));
@@ -389,9 +397,10 @@ OfferFrame::exists(Database& db, LedgerKey const& key)
     std::string actIDStrKey = PubKeyUtils::toStrKey(key.offer().sellerID);
     int exists = 0;
     auto timer = db.getSelectTimer("offer-exists");
-    auto prep =
-        db.getPreparedStatement("SELECT EXISTS (SELECT NULL FROM offers "
-                                "WHERE sellerid=:id AND offerid=:s)");
+    static StatementID const existsStmt =
+        Database::registerStatement("SELECT EXISTS (SELECT NULL FROM offers "
+                                    "WHERE sellerid=:id AND offerid=:s)");
+    auto prep = db.getPreparedStatement(existsStmt);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(key.offer().offerID));
@@ -419,7 +428,9 @@ void
 OfferFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
 {
     auto timer = db.getDeleteTimer("offer");
-    auto prep = db.getPreparedStatement("DELETE FROM offers WHERE offerid=:s");
+    static StatementID const deleteStmt =
+        Database::registerStatement("DELETE FROM offers WHERE offerid=:s");
+    auto prep = db.getPreparedStatement(deleteStmt);
     auto& st = prep.statement();
     st.exchange(use(key.offer().offerID));
     st.define_and_bind();
@@ -493,26 +504,20 @@ OfferFrame::storeUpdateHelper(LedgerDelta& delta, Database& db, bool insert)
         buying_ind = soci::i_ok;
     }
 
-    string sql;
-
-    if (insert)
-    {
-        sql = "INSERT INTO offers (sellerid,offerid,"
-              "sellingassettype,sellingassetcode,sellingissuer,"
-              "buyingassettype,buyingassetcode,buyingissuer,"
-              "amount,pricen,priced,price,flags,lastmodified) VALUES "
-              "(:sid,:oid,:sat,:sac,:si,:bat,:bac,:bi,:a,:pn,:pd,:p,:f,:l)";
-    }
-    else
-    {
-        sql = "UPDATE offers SET sellingassettype=:sat "
-              ",sellingassetcode=:sac,sellingissuer=:si,"
-              "buyingassettype=:bat,buyingassetcode=:bac,buyingissuer=:bi,"
-              "amount=:a,pricen=:pn,priced=:pd,price=:p,flags=:f,"
-              "lastmodified=:l WHERE offerid=:oid";
-    }
-
-    auto prep = db.getPreparedStatement(sql);
+    static StatementID const insertStmt = Database::registerStatement(
+        "INSERT INTO offers (sellerid,offerid,"
+        "sellingassettype,sellingassetcode,sellingissuer,"
+        "buyingassettype,buyingassetcode,buyingissuer,"
+        "amount,pricen,priced,price,flags,lastmodified) VALUES "
+        "(:sid,:oid,:sat,:sac,:si,:bat,:bac,:bi,:a,:pn,:pd,:p,:f,:l)");
+    static StatementID const updateStmt = Database::registerStatement(
+        "UPDATE offers SET sellingassettype=:sat "
+        ",sellingassetcode=:sac,sellingissuer=:si,"
+        "buyingassettype=:bat,buyingassetcode=:bac,buyingissuer=:bi,"
+        "amount=:a,pricen=:pn,priced=:pd,price=:p,flags=:f,"
+        "lastmodified=:l WHERE offerid=:oid");
+
+    auto prep = db.getPreparedStatement(insert ? insertStmt : updateStmt);
     auto& st = prep.statement();
 
     if (insert)
@@ -87,6 +87,8 @@ class OfferFrame : public EntryFrame
     // database utilities
     static pointer loadOffer(AccountID const& accountID, uint64_t offerID,
                              Database& db);
+    static pointer loadOffer(AccountID const& accountID, uint64_t offerID,
+                             Database& db, soci::session& sess);
 
     static void loadBestOffers(size_t numOffers, size_t offset,
                                Asset const& pays, Asset const& gets,
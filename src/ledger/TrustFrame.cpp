@@ -7,7 +7,10 @@
 #include "crypto/SHA.h"
 #include "database/Database.h"
 #include "LedgerDelta.h"
+#include "ledger/LedgerHashUtils.h"
 #include "util/types.h"
+#include <algorithm>
+#include <unordered_set>
 
 using namespace std;
 using namespace soci;
@@ -180,9 +183,10 @@ TrustFrame::exists(Database& db, LedgerKey const& key)
     getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
     int exists = 0;
     auto timer = db.getSelectTimer("trust-exists");
-    auto prep = db.getPreparedStatement(
+    static StatementID const existsStmt = Database::registerStatement(
         "SELECT EXISTS (SELECT NULL FROM trustlines "
         "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3)");
+    auto prep = db.getPreparedStatement(existsStmt);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(issuerStrKey));
@@ -215,10 +219,19 @@ TrustFrame::storeDelete(LedgerDelta& delta, Database& db, LedgerKey const& key)
     std::string actIDStrKey, issuerStrKey, assetCode;
     getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
 
-    auto timer = db.getDeleteTimer("trust");
-    db.getSession() << "DELETE FROM trustlines "
-                       "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3",
-        use(actIDStrKey), use(issuerStrKey), use(assetCode);
+    static StatementID const deleteStmt = Database::registerStatement(
+        "DELETE FROM trustlines "
+        "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3");
+    auto prep = db.getPreparedStatement(deleteStmt);
+    auto& st = prep.statement();
+    st.exchange(use(actIDStrKey));
+    st.exchange(use(issuerStrKey));
+    st.exchange(use(assetCode));
+    st.define_and_bind();
+    {
+        auto timer = db.getDeleteTimer("trust");
+        st.execute(true);
+    }
 
     delta.deleteEntry(key);
 }
@@ -242,10 +255,11 @@ TrustFrame::storeChange(LedgerDelta& delta, Database& db)
     std::string actIDStrKey, issuerStrKey, assetCode;
     getKeyFields(key, actIDStrKey, issuerStrKey, assetCode);
 
-    auto prep = db.getPreparedStatement(
+    static StatementID const updateStmt = Database::registerStatement(
         "UPDATE trustlines "
         "SET balance=:b, tlimit=:tl, flags=:a, lastmodified=:lm "
         "WHERE accountid=:v1 AND issuer=:v2 AND assetcode=:v3");
+    auto prep = db.getPreparedStatement(updateStmt);
     auto& st = prep.statement();
     st.exchange(use(mTrustLine.balance));
     st.exchange(use(mTrustLine.limit));
@@ -287,11 +301,12 @@ TrustFrame::storeAdd(LedgerDelta& delta, Database& db)
     unsigned int assetType = getKey().trustLine().asset.type();
     getKeyFields(getKey(), actIDStrKey, issuerStrKey, assetCode);
 
-    auto prep = db.getPreparedStatement(
+    static StatementID const insertStmt = Database::registerStatement(
         "INSERT INTO trustlines "
         "(accountid, assettype, issuer, assetcode, balance, tlimit, flags, "
         "lastmodified) "
         "VALUES (:v1, :v2, :v3, :v4, :v5, :v6, :v7, :v8)");
+    auto prep = db.getPreparedStatement(insertStmt);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
     st.exchange(use(assetType));
@@ -339,6 +354,13 @@ TrustFrame::createIssuerFrame(Asset const& issuer)
 TrustFrame::pointer
 TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
                           Database& db)
+{
+    return loadTrustLine(accountID, asset, db, db.getSession());
+}
+
+TrustFrame::pointer
+TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
+                          Database& db, soci::session& sess)
 {
     if (asset.type() == ASSET_TYPE_NATIVE)
     {
@@ -356,7 +378,8 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
     key.type(TRUSTLINE);
     key.trustLine().accountID = accountID;
     key.trustLine().asset = asset;
-    if (cachedEntryExists(key, db))
+    bool useCache = db.isMainSession(sess);
+    if (useCache && cachedEntryExists(key, db))
     {
         auto p = getCachedEntry(key, db);
         return p ? std::make_shared<TrustFrame>(*p) : nullptr;
@@ -376,11 +399,12 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
         issuerStr = PubKeyUtils::toStrKey(asset.alphaNum12().issuer);
     }
 
-    auto query = std::string(trustLineColumnSelector);
-    query += (" WHERE accountid = :id "
-              " AND issuer = :issuer "
-              " AND assetcode = :asset");
-    auto prep = db.getPreparedStatement(query);
+    static StatementID const loadStmt = Database::registerStatement(
+        std::string(trustLineColumnSelector) +
+        " WHERE accountid = :id "
+        " AND issuer = :issuer "
+        " AND assetcode = :asset");
+    auto prep = db.getPreparedStatement(loadStmt, sess);
     auto& st = prep.statement();
     st.exchange(use(accStr));
     st.exchange(use(issuerStr));
@@ -393,6 +417,10 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
                   retLine = make_shared<TrustFrame>(trust);
               });
 
+    if (!useCache)
+    {
+        return retLine;
+    }
     if (retLine)
     {
         retLine->putCachedEntry(db);
@@ -404,6 +432,74 @@ TrustFrame::loadTrustLine(AccountID const& accountID, Asset const& asset,
     return retLine;
 }
 
+size_t
+TrustFrame::prefetch(std::vector<LedgerKey> const& keys, Database& db)
+{
+    std::unordered_set<LedgerKey, LedgerKeyHash, LedgerKeyEqual> todo;
+    for (auto const& k : keys)
+    {
+        auto const& tl = k.trustLine();
+        if (tl.asset.type() != ASSET_TYPE_NATIVE &&
+            !(tl.accountID == getIssuer(tl.asset)))
+        {
+            todo.insert(k);
+        }
+    }
+    std::vector<LedgerKey> sorted(todo.begin(), todo.end());
+    std::sort(sorted.begin(), sorted.end(), LedgerEntryIdCmp());
+
+    // rows are matched back against the keys of the batch, as the query
+    // itself also returns other combinations of the accounts and issuers
+    static StatementID const loadStmt = Database::registerStatement(
+        std::string(trustLineColumnSelector) + " WHERE accountid IN (" +
+        batchPlaceholders("id") + ") AND issuer IN (" +
+        batchPlaceholders("is") + ")");
+
+    size_t found = 0;
+    for (size_t b = 0; b < sorted.size(); b += kPrefetchBatchSize)
+    {
+        std::unordered_set<LedgerKey, LedgerKeyHash, LedgerKeyEqual> wanted(
+            sorted.begin() + b,
+            sorted.begin() + std::min(b + kPrefetchBatchSize, sorted.size()));
+        std::vector<std::string> accounts, issuers;
+        for (auto const& k : wanted)
+        {
+            accounts.emplace_back(
+                PubKeyUtils::toStrKey(k.trustLine().accountID));
+            issuers.emplace_back(
+                PubKeyUtils::toStrKey(getIssuer(k.trustLine().asset)));
+        }
+        accounts.resize(kPrefetchBatchSize, accounts[0]);
+        issuers.resize(kPrefetchBatchSize, issuers[0]);
+
+        auto prep = db.getPreparedStatement(loadStmt);
+        auto& st = prep.statement();
+        for (auto& id : accounts)
+        {
+            st.exchange(use(id));
+        }
+        for (auto& id : issuers)
+        {
+            st.exchange(use(id));
+        }
+        auto timer = db.getSelectTimer("trust");
+        loadLines(prep, [&](LedgerEntry const& trust)
+                  {
+                      auto line = make_shared<TrustFrame>(trust);
+                      if (wanted.erase(line->getKey()) != 0)
+                      {
+                          line->putCachedEntry(db);
+                          ++found;
+                      }
+                  });
+        for (auto const& k : wanted)
+        {
+            putCachedEntry(k, nullptr, db);
+        }
+    }
+    return found;
+}
+
 std::pair<TrustFrame::pointer, AccountFrame::pointer>
 TrustFrame::loadTrustLineIssuer(AccountID const& accountID, Asset const& asset,
                                 Database& db)
@@ -474,9 +570,9 @@ TrustFrame::loadLines(AccountID const& accountID,
     std::string actIDStrKey;
     actIDStrKey = PubKeyUtils::toStrKey(accountID);
 
-    auto query = std::string(trustLineColumnSelector);
-    query += (" WHERE accountid = :id ");
-    auto prep = db.getPreparedStatement(query);
+    static StatementID const loadByAccountStmt = Database::registerStatement(
+        std::string(trustLineColumnSelector) + " WHERE accountid = :id ");
+    auto prep = db.getPreparedStatement(loadByAccountStmt);
     auto& st = prep.statement();
     st.exchange(use(actIDStrKey));
 
@@ -69,6 +69,16 @@ class TrustFrame : public EntryFrame
     // returns the specified trustline or a generated one for issuers
     static pointer loadTrustLine(AccountID const& accountID, Asset const& asset,
                                  Database& db);
+    // as above, through `sess` (the entry cache is used for the main session
+    // only)
+    static pointer loadTrustLine(AccountID const& accountID, Asset const& asset,
+                                 Database& db, soci::session& sess);
+
+    // Loads the trust lines named by `keys` (TRUSTLINE keys) with batched
+    // queries on the main session into the entry cache, recording the ones
+    // that do not exist as such, as loadTrustLine does. Returns the number of
+    // trust lines found.
+    static size_t prefetch(std::vector<LedgerKey> const& keys, Database& db);
 
     // overload that also returns the issuer
     static std::pair<TrustFrame::pointer, AccountFrame::pointer>
@@ -33,6 +33,7 @@ class Database;
 class PersistentState;
 class LoadGenerator;
 class CommandHandler;
+class MetricsFacade;
 
 /*
  * State of a single instance of the stellar-core application.
@@ -167,6 +168,10 @@ class Application
     // reported through the administrative HTTP interface, see CommandHandler.
     virtual medida::MetricsRegistry& getMetrics() = 0;
 
+    // Get the low-overhead front end to the same registry, for metrics that
+    // are marked on hot paths. See MetricsFacade.
+    virtual MetricsFacade& getMetricsFacade() = 0;
+
     // Ensure any App-local metrics that are "current state" gauge-like counters
     // reflect the current reality as best as possible.
     virtual void syncOwnMetrics() = 0;
@@ -216,6 +221,13 @@ class Application
     virtual void generateLoad(uint32_t nAccounts, uint32_t nTxs,
                               uint32_t txRate, bool autoRate) = 0;
 
+    // Run the named load profile (see LoadGenerator::Profile) against the
+    // current application, txRate 0 standing for the profile's own rate.
+    // Throws if there is no such profile or one is already running.
+    virtual void generateLoadProfile(std::string const& profile,
+                                     uint32_t nAccounts, uint32_t nTxs,
+                                     uint32_t txRate, uint32_t seed) = 0;
+
     // Run a consistency check between the database and the bucketlist.
     virtual void checkDB() = 0;
 
@@ -31,6 +31,7 @@
 #include "util/TmpDir.h"
 #include "util/Logging.h"
 #include "util/make_unique.h"
+#include "util/MetricsFacade.h"
 
 #include <set>
 #include <string>
@@ -50,6 +51,7 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
     , mStopping(false)
     , mStoppingTimer(*this)
     , mMetrics(make_unique<medida::MetricsRegistry>())
+    , mMetricsFacade(make_unique<MetricsFacade>(*mMetrics))
     , mAppStateCurrent(mMetrics->NewCounter({"app", "state", "current"}))
     , mAppStateChanges(mMetrics->NewTimer({"app", "state", "changes"}))
     , mLastStateChange(clock.now())
@@ -65,6 +67,10 @@ ApplicationImpl::ApplicationImpl(VirtualClock& clock, Config const& cfg)
 
     mNetworkID = sha256(mConfig.NETWORK_PASSPHRASE);
 
+    PubKeyUtils::setVerifySigCacheSize(mConfig.VERIFY_SIG_CACHE_SIZE);
+    clock.getCrankStats().setStallThreshold(
+        std::chrono::milliseconds(mConfig.CRANK_STALL_THRESHOLD_MS));
+
     unsigned t = std::thread::hardware_concurrency();
     LOG(INFO) << "Application constructing "
               << "(worker threads: " << t << ")";
@@ -138,6 +144,7 @@ ApplicationImpl::reportCfgMetrics()
     {
         return;
     }
+    mMetricsFacade->sync();
 
     std::set<std::string> metricsToReport;
     std::set<std::string> allMetrics;
@@ -370,15 +377,71 @@ ApplicationImpl::generateLoad(uint32_t nAccounts, uint32_t nTxs,
     mLoadGenerator->generateLoad(*this, nAccounts, nTxs, txRate, autoRate);
 }
 
+void
+ApplicationImpl::generateLoadProfile(std::string const& profile,
+                                     uint32_t nAccounts, uint32_t nTxs,
+                                     uint32_t txRate, uint32_t seed)
+{
+    LoadGenerator::Profile p;
+    if (!LoadGenerator::getProfileByName(profile, p))
+    {
+        throw std::runtime_error("unknown load profile: " + profile);
+    }
+    if (!mLoadGenerator)
+    {
+        mLoadGenerator = make_unique<LoadGenerator>(getNetworkID());
+    }
+    mLoadGenerator->startProfile(*this, p, nAccounts, nTxs, txRate, seed);
+    getMetrics().NewMeter({"loadgen", "run", "start"}, "run").Mark();
+}
+
 void
 ApplicationImpl::checkDB()
 {
     getClock().getIOService().post(
         [this]
         {
-            checkDBAgainstBuckets(this->getMetrics(), this->getBucketManager(),
-                                  this->getDatabase(),
-                                  this->getBucketManager().getBucketList());
+            // Buckets are collected here, on the main thread, together with
+            // the ledger they describe; the merge and comparison then run in
+            // a read-only snapshot transaction off the main thread (when the
+            // database has a connection pool), which checkDBAgainstBuckets
+            // skips if a ledger has closed in between.
+            auto ledgerSeq =
+                this->getLedgerManager().getLastClosedLedgerNum();
+            auto buckets = collectBucketsForCheckDB(
+                this->getBucketManager().getBucketList());
+            this->getDatabase().postReadQuery(
+                "checkdb",
+                [this, ledgerSeq, buckets](soci::session& sess)
+                {
+                    checkDBAgainstBuckets(this->getMetrics(),
+                                          this->getBucketManager(),
+                                          this->getDatabase(), sess,
+                                          ledgerSeq, buckets);
+                },
+                [this](std::exception_ptr ep)
+                {
+                    if (!ep)
+                    {
+                        return;
+                    }
+                    this->getMetrics()
+                        .NewMeter({"bucket", "checkdb", "failure"}, "run")
+                        .Mark();
+                    try
+                    {
+                        std::rethrow_exception(ep);
+                    }
+                    catch (std::exception const& e)
+                    {
+                        CLOG(ERROR, "Bucket") << "CheckDB failed: "
+                                              << e.what();
+                    }
+                    catch (...)
+                    {
+                        CLOG(ERROR, "Bucket") << "CheckDB failed";
+                    }
+                });
         });
 }
 
@@ -468,9 +531,17 @@ ApplicationImpl::getMetrics()
     return *mMetrics;
 }
 
+MetricsFacade&
+ApplicationImpl::getMetricsFacade()
+{
+    return *mMetricsFacade;
+}
+
 void
 ApplicationImpl::syncOwnMetrics()
 {
+    mMetricsFacade->sync();
+
     int64_t c = mAppStateCurrent.count();
     int64_t n = static_cast<int64_t>(getState());
     if (c != n)
@@ -46,6 +46,7 @@ class ApplicationImpl : public Application
     virtual bool isStopping() const override;
     virtual VirtualClock& getClock() override;
     virtual medida::MetricsRegistry& getMetrics() override;
+    virtual MetricsFacade& getMetricsFacade() override;
     virtual void syncOwnMetrics() override;
     virtual void syncAllMetrics() override;
     virtual TmpDirManager& getTmpDirManager() override;
@@ -79,6 +80,10 @@ class ApplicationImpl : public Application
     virtual void generateLoad(uint32_t nAccounts, uint32_t nTxs,
                               uint32_t txRate, bool autoRate) override;
 
+    virtual void generateLoadProfile(std::string const& profile,
+                                     uint32_t nAccounts, uint32_t nTxs,
+                                     uint32_t txRate, uint32_t seed) override;
+
     virtual void checkDB() override;
 
     virtual void applyCfgCommands() override;
@@ -128,6 +133,7 @@ class ApplicationImpl : public Application
     VirtualTimer mStoppingTimer;
 
     std::unique_ptr<medida::MetricsRegistry> mMetrics;
+    std::unique_ptr<MetricsFacade> mMetricsFacade;
     medida::Counter& mAppStateCurrent;
     medida::Timer& mAppStateChanges;
     VirtualClock::time_point mLastStateChange;
@@ -4,6 +4,7 @@
 
 #include "crypto/Hex.h"
 #include "herder/Herder.h"
+#include "ledger/LedgerCloseTimeline.h"
 #include "ledger/LedgerManager.h"
 #include "lib/http/server.hpp"
 #include "lib/json/json.h"
@@ -12,12 +13,17 @@
 #include "main/CommandHandler.h"
 #include "main/Config.h"
 #include "overlay/OverlayManager.h"
+#include "util/CrankStats.h"
 #include "util/Logging.h"
+#include "util/Timer.h"
 #include "util/make_unique.h"
 #include "StellarCoreVersion.h"
 
 #include "util/basen.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
 #include "medida/reporting/json_reporter.h"
+#include "medida/timer.h"
 #include "xdrpp/marshal.h"
 #include "xdrpp/printer.h"
 
@@ -32,7 +38,14 @@ using std::placeholders::_2;
 
 namespace stellar
 {
-CommandHandler::CommandHandler(Application& app) : mApp(app)
+std::chrono::milliseconds const CommandHandler::kSnapshotMaxAge(1000);
+size_t const CommandHandler::kMaxSnapshots = 64;
+
+CommandHandler::CommandHandler(Application& app)
+    : mApp(app)
+    , mSnapshotHits(
+          app.getMetrics().NewMeter({"http", "snapshot", "hit"}, "request"))
+    , mAlive(std::make_shared<bool>(true))
 {
     if (mApp.getConfig().HTTP_PORT)
     {
@@ -49,47 +62,148 @@ CommandHandler::CommandHandler(Application& app) : mApp(app)
                   << mApp.getConfig().HTTP_PORT << " for HTTP requests";
 
         mServer = stellar::make_unique<http::server::server>(
-            app.getClock().getIOService(), ipStr, mApp.getConfig().HTTP_PORT);
+            mIOService, ipStr, mApp.getConfig().HTTP_PORT);
     }
     else
     {
-        mServer = stellar::make_unique<http::server::server>(
-            app.getClock().getIOService());
+        mServer = stellar::make_unique<http::server::server>(mIOService);
     }
 
     mServer->add404(std::bind(&CommandHandler::fileNotFound, this, _1, _2));
+    mServer->setDispatcher(std::bind(&CommandHandler::dispatch, this, _1, _2,
+                                     std::placeholders::_3,
+                                     std::placeholders::_4));
+
+    addRoute("catchup", &CommandHandler::catchup);
+    addRoute("checkdb", &CommandHandler::checkdb);
+    addRoute("checkpoint", &CommandHandler::checkpoint);
+    addRoute("connect", &CommandHandler::connect);
+    addRoute("crankstats", &CommandHandler::crankStats);
+    addRoute("dropcursor", &CommandHandler::dropcursor);
+    addRoute("generateload", &CommandHandler::generateLoad);
+    addRoute("info", &CommandHandler::info, ROUTE_SNAPSHOT);
+    addRoute("ledgertimeline", &CommandHandler::ledgerTimeline,
+             ROUTE_SNAPSHOT);
+    addRoute("ll", &CommandHandler::ll);
+    addRoute("logrotate", &CommandHandler::logRotate);
+    addRoute("maintenance", &CommandHandler::maintenance);
+    addRoute("manualclose", &CommandHandler::manualClose);
+    addRoute("metrics", &CommandHandler::metrics, ROUTE_SNAPSHOT);
+    addRoute("peers", &CommandHandler::peers, ROUTE_SNAPSHOT);
+    addRoute("scp", &CommandHandler::scpInfo, ROUTE_SNAPSHOT);
+    addRoute("setcursor", &CommandHandler::setcursor);
+    addRoute("testacc", &CommandHandler::testAcc);
+    addRoute("testtx", &CommandHandler::testTx);
+    addRoute("tx", &CommandHandler::tx);
+    addRoute("txbatch", &CommandHandler::txBatch);
+
+    if (mApp.getConfig().HTTP_PORT)
+    {
+        mWork = make_unique<asio::io_service::work>(mIOService);
+        for (unsigned i = 0; i < mApp.getConfig().HTTP_THREADS; ++i)
+        {
+            mThreads.emplace_back([this]()
+                                  {
+                                      mIOService.run();
+                                  });
+        }
+    }
+}
 
-    mServer->addRoute("catchup",
-                      std::bind(&CommandHandler::catchup, this, _1, _2));
-    mServer->addRoute("checkdb",
-                      std::bind(&CommandHandler::checkdb, this, _1, _2));
-    mServer->addRoute("checkpoint",
-                      std::bind(&CommandHandler::checkpoint, this, _1, _2));
-    mServer->addRoute("connect",
-                      std::bind(&CommandHandler::connect, this, _1, _2));
-    mServer->addRoute("dropcursor",
-                      std::bind(&CommandHandler::dropcursor, this, _1, _2));
-    mServer->addRoute("generateload",
-                      std::bind(&CommandHandler::generateLoad, this, _1, _2));
-    mServer->addRoute("info", std::bind(&CommandHandler::info, this, _1, _2));
-    mServer->addRoute("ll", std::bind(&CommandHandler::ll, this, _1, _2));
-    mServer->addRoute("logrotate",
-                      std::bind(&CommandHandler::logRotate, this, _1, _2));
-    mServer->addRoute("maintenance",
-                      std::bind(&CommandHandler::maintenance, this, _1, _2));
-    mServer->addRoute("manualclose",
-                      std::bind(&CommandHandler::manualClose, this, _1, _2));
-    mServer->addRoute("metrics",
-                      std::bind(&CommandHandler::metrics, this, _1, _2));
-    mServer->addRoute("peers", std::bind(&CommandHandler::peers, this, _1, _2));
-    mServer->addRoute("setcursor",
-                      std::bind(&CommandHandler::setcursor, this, _1, _2));
-    mServer->addRoute("scp", std::bind(&CommandHandler::scpInfo, this, _1, _2));
-    mServer->addRoute("testacc",
-                      std::bind(&CommandHandler::testAcc, this, _1, _2));
-    mServer->addRoute("testtx",
-                      std::bind(&CommandHandler::testTx, this, _1, _2));
-    mServer->addRoute("tx", std::bind(&CommandHandler::tx, this, _1, _2));
+CommandHandler::~CommandHandler()
+{
+    mAlive.reset();
+    mWork.reset();
+    mIOService.stop();
+    for (auto& t : mThreads)
+    {
+        t.join();
+    }
+    // with no thread left to complete its connections
+    mServer.reset();
+}
+
+void
+CommandHandler::addRoute(std::string const& name, HandlerRoute route,
+                         RouteKind kind)
+{
+    mServer->addRoute(
+        name, [this, route](std::string const& params, std::string& retStr)
+        {
+            CrankTag crankTag(mApp.getClock().getCrankStats(),
+                              CrankStats::ORIGIN_HTTP);
+            (this->*route)(params, retStr);
+        });
+    mRouteInfo[name] = RouteInfo{
+        kind, &mApp.getMetrics().NewTimer({"http", "latency", name})};
+}
+
+void
+CommandHandler::dispatch(std::string const& name, std::string const& params,
+                         http::server::server::routeHandler const& handler,
+                         std::function<void(std::string const&)> respond)
+{
+    using std::chrono::steady_clock;
+    auto start = steady_clock::now();
+    medida::Timer* latency = nullptr;
+    bool snapshot = false;
+    auto info = mRouteInfo.find(name);
+    if (info != mRouteInfo.end())
+    {
+        latency = info->second.mLatency;
+        snapshot = info->second.mKind == ROUTE_SNAPSHOT;
+    }
+    auto key = name + params;
+
+    if (snapshot)
+    {
+        std::string content;
+        bool hit = false;
+        {
+            std::lock_guard<std::mutex> lock(mSnapshotsMutex);
+            auto s = mSnapshots.find(key);
+            if (s != mSnapshots.end() &&
+                start - s->second.mTaken < kSnapshotMaxAge)
+            {
+                content = s->second.mContent;
+                hit = true;
+            }
+        }
+        if (hit)
+        {
+            mSnapshotHits.Mark();
+            latency->Update(steady_clock::now() - start);
+            respond(content);
+            return;
+        }
+    }
+
+    std::weak_ptr<bool> alive = mAlive;
+    mApp.getClock().getIOService().post(
+        [this, alive, key, params, &handler, respond, start, latency,
+         snapshot]()
+        {
+            if (!alive.lock())
+            {
+                return;
+            }
+            std::string content;
+            handler(params, content);
+            if (snapshot)
+            {
+                std::lock_guard<std::mutex> lock(mSnapshotsMutex);
+                if (mSnapshots.size() >= kMaxSnapshots)
+                {
+                    mSnapshots.clear();
+                }
+                mSnapshots[key] = Snapshot{content, steady_clock::now()};
+            }
+            if (latency)
+            {
+                latency->Update(steady_clock::now() - start);
+            }
+            respond(content);
+        });
 }
 
 void
@@ -252,15 +366,31 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "triggers the instance to write an immediate history checkpoint."
         "</p><p><h1> /connect?peer=NAME&port=NNN</h1>"
         "triggers the instance to connect to peer NAME at port NNN."
+        "</p><p><h1> /crankstats[?reset=true]</h1>"
+        "returns, in JSON format, how much main thread time each subsystem "
+        "(overlay, herder, ledger, ...) used per event handler and how many "
+        "handlers stalled the main thread; reset clears the statistics "
+        "after reporting them"
         "</p><p><h1> "
-        "/generateload[?accounts=N&txs=M&txrate=(R|auto)]</h1>"
+        "/generateload[?accounts=N&txs=M&txrate=(R|auto)]"
+        "[&profile=P[&seed=S]]</h1>"
         "artificially generate load for testing; must be used with "
-        "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING set to true"
+        "ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING set to true. With a profile "
+        "(payments, hotaccounts, dex, multisig or largetxsets), the load is "
+        "a fixed workload drawn from seed S (default 1), submitted at R tx/s "
+        "(default: the profile's own) whatever the network keeps up with; "
+        "loadgen.tx.latency then times each transaction from submission to "
+        "ledger close"
         "</p><p><h1> /help</h1>"
         "give a list of currently supported commands"
         "</p><p><h1> /info</h1>"
         "returns information about the server in JSON format (sync state, "
         "connected peers, etc)"
+        "</p><p><h1> /ledgertimeline[?limit=N][&format=trace]</h1>"
+        "returns, in JSON format, the duration, SQL statement count and "
+        "bucket bytes written of each phase of the last N (default: all "
+        "kept) ledger closes; format=trace returns them in Chrome's trace "
+        "event format instead"
         "</p><p><h1> /ll?level=L[&partition=P]</h1>"
         "adjust the log level for partition P (or all if no partition is "
         "specified).<br>"
@@ -282,6 +412,13 @@ CommandHandler::fileNotFound(std::string const& params, std::string& retStr)
         "returns a JSON object<br>"
         "wasReceived: boolean, true if transaction was queued properly<br>"
         "result: hex encoded, XDR serialized 'TransactionResult'<br>"
+        "</p><p><h1> /txbatch</h1>"
+        "submit many transactions to the network at once.<br>"
+        "POST their 'TransactionEnvelope's XDR serialized one after the "
+        "other, each preceded by its record mark, as in history files; or "
+        "pass the same base64 encoded as /txbatch?blob=BASE64<br>"
+        "returns a JSON object whose results are what /tx returns for each "
+        "transaction, in order"
         "</p><p><h1> /dropcursor?id=XYZ</h1> deletes the tracking cursor with "
         "identified by `id`. See `setcursor` for more information"
         "</p><p><h1> /setcursor?id=ID&cursor=N</h1> sets or creates a cursor "
@@ -362,6 +499,31 @@ CommandHandler::generateLoad(std::string const& params, std::string& retStr)
         if (!parseOptionalNumParam(map, "txs", nTxs, retStr))
             return;
 
+        auto profile = map.find("profile");
+        if (profile != map.end())
+        {
+            uint32_t seed = 1;
+            txRate = 0;
+            if (!parseOptionalNumParam(map, "txrate", txRate, retStr))
+                return;
+            if (!parseOptionalNumParam(map, "seed", seed, retStr))
+                return;
+            try
+            {
+                mApp.generateLoadProfile(profile->second, nAccounts, nTxs,
+                                         txRate, seed);
+            }
+            catch (std::exception& e)
+            {
+                retStr = e.what();
+                return;
+            }
+            retStr = fmt::format("Generating load profile {}: {:d} accounts, "
+                                 "{:d} txs, seed {:d}",
+                                 profile->second, nAccounts, nTxs, seed);
+            return;
+        }
+
         {
             auto i = map.find("txrate");
             if (i != map.end() && i->second == std::string("auto"))
@@ -440,6 +602,47 @@ CommandHandler::metrics(std::string const& params, std::string& retStr)
     retStr = jr.Report();
 }
 
+void
+CommandHandler::crankStats(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    auto& stats = mApp.getClock().getCrankStats();
+    Json::Value root;
+    stats.report(root);
+    if (retMap["reset"] == "true")
+    {
+        stats.reset();
+    }
+    retStr = root.toStyledString();
+}
+
+void
+CommandHandler::ledgerTimeline(std::string const& params, std::string& retStr)
+{
+    std::map<std::string, std::string> retMap;
+    http::server::server::parseParams(params, retMap);
+
+    size_t limit = 0;
+    if (!parseOptionalNumParam(retMap, "limit", limit, retStr))
+    {
+        return;
+    }
+
+    auto const& timeline = mApp.getLedgerManager().getCloseTimeline();
+    Json::Value root;
+    if (retMap["format"] == "trace")
+    {
+        timeline.reportTrace(root, limit);
+    }
+    else
+    {
+        timeline.report(root, limit);
+    }
+    retStr = root.toStyledString();
+}
+
 void
 CommandHandler::logRotate(std::string const& params, std::string& retStr)
 {
@@ -700,6 +903,100 @@ CommandHandler::tx(std::string const& params, std::string& retStr)
     retStr = output.str();
 }
 
+// Splits `bin` into the XDR objects it holds, each preceded by its 4 byte
+// record mark like in XDR files.
+static std::vector<TransactionEnvelope>
+decodeEnvelopes(std::vector<uint8_t> const& bin)
+{
+    std::vector<TransactionEnvelope> envelopes;
+    size_t pos = 0;
+    while (pos < bin.size())
+    {
+        if (bin.size() - pos < 4)
+        {
+            throw std::runtime_error("truncated record mark");
+        }
+        uint32_t sz = ((bin[pos] & 0x7f) << 24) | (bin[pos + 1] << 16) |
+                      (bin[pos + 2] << 8) | bin[pos + 3];
+        pos += 4;
+        if (bin.size() - pos < sz)
+        {
+            throw std::runtime_error("truncated envelope");
+        }
+        envelopes.emplace_back();
+        xdr::xdr_get g(bin.data() + pos, bin.data() + pos + sz);
+        xdr::xdr_argpack_archive(g, envelopes.back());
+        pos += sz;
+    }
+    return envelopes;
+}
+
+void
+CommandHandler::txBatch(std::string const& params, std::string& retStr)
+{
+    Json::Value root;
+
+    std::vector<uint8_t> binBlob;
+    const std::string prefix("?blob=");
+    if (params.compare(0, prefix.size(), prefix) == 0)
+    {
+        bn::decode_b64(params.substr(prefix.size()), binBlob);
+    }
+    else if (!params.empty() && params[0] != '?')
+    {
+        // the body of the request
+        binBlob.assign(params.begin(), params.end());
+    }
+    else
+    {
+        root["exception"] = "Must POST the transactions or specify a blob: "
+                            "txbatch?blob=<txs in xdr format>";
+        retStr = root.toStyledString();
+        return;
+    }
+
+    std::vector<TransactionEnvelope> envelopes;
+    try
+    {
+        envelopes = decodeEnvelopes(binBlob);
+    }
+    catch (std::exception& e)
+    {
+        root["exception"] = e.what();
+        retStr = root.toStyledString();
+        return;
+    }
+
+    std::vector<TransactionFramePtr> txs;
+    txs.reserve(envelopes.size());
+    for (auto const& envelope : envelopes)
+    {
+        txs.emplace_back(TransactionFrame::makeTransactionFromWire(
+            mApp.getNetworkID(), envelope));
+    }
+    auto statuses = mApp.getHerder().recvTransactions(txs);
+
+    auto& results = root["results"];
+    results = Json::Value(Json::arrayValue);
+    for (size_t i = 0; i < txs.size(); ++i)
+    {
+        Json::Value res;
+        res["status"] = TX_STATUS_STRING[statuses[i]];
+        if (statuses[i] == Herder::TX_STATUS_PENDING)
+        {
+            mApp.getOverlayManager().broadcastMessage(
+                txs[i]->toStellarMessage());
+        }
+        else if (statuses[i] == Herder::TX_STATUS_ERROR)
+        {
+            res["error"] =
+                bn::encode_b64(xdr::xdr_to_opaque(txs[i]->getResult()));
+        }
+        results.append(res);
+    }
+    retStr = root.toStyledString();
+}
+
 void
 CommandHandler::dropcursor(std::string const& params, std::string& retStr)
 {
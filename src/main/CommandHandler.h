@@ -4,13 +4,31 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
-#include <string>
 #include "lib/http/server.hpp"
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 /*
 handler functions for the http commands this server supports
+
+The HTTP port is served by HTTP_THREADS threads of the handler's own, which
+accept connections and parse and answer requests. The handlers themselves
+need the state of the node, so they are queued as jobs on the main thread,
+except for read-only ones answered from a snapshot of their output: see
+dispatch.
 */
 
+namespace medida
+{
+class Meter;
+class Timer;
+}
+
 namespace stellar
 {
 class Application;
@@ -19,10 +37,61 @@ class CommandHandler
 {
 
     Application& mApp;
+    asio::io_service mIOService;
+    std::unique_ptr<asio::io_service::work> mWork;
+    std::vector<std::thread> mThreads;
     std::unique_ptr<http::server::server> mServer;
 
+    enum RouteKind
+    {
+        // changes the state of the node, or needs it to be up to date
+        ROUTE_MAIN_THREAD,
+        // read-only, and fine with an answer up to kSnapshotMaxAge old
+        ROUTE_SNAPSHOT
+    };
+
+    struct RouteInfo
+    {
+        RouteKind mKind;
+        medida::Timer* mLatency;
+    };
+    // filled by the constructor, read-only afterwards
+    std::map<std::string, RouteInfo> mRouteInfo;
+
+    struct Snapshot
+    {
+        std::string mContent;
+        std::chrono::steady_clock::time_point mTaken;
+    };
+    static std::chrono::milliseconds const kSnapshotMaxAge;
+    static size_t const kMaxSnapshots;
+    // by route and parameters
+    std::map<std::string, Snapshot> mSnapshots;
+    std::mutex mSnapshotsMutex;
+    medida::Meter& mSnapshotHits;
+
+    // Jobs queued on the main thread only hold a weak reference to this, so
+    // that those still queued when the handler goes away do nothing.
+    std::shared_ptr<bool> mAlive;
+
+    typedef void (CommandHandler::*HandlerRoute)(std::string const& params,
+                                                 std::string& retStr);
+    // registers `route` so that the time it takes is accounted for as
+    // CrankStats::ORIGIN_HTTP, and the time requests for it take as
+    // http.latency.<name>
+    void addRoute(std::string const& name, HandlerRoute route,
+                  RouteKind kind = ROUTE_MAIN_THREAD);
+
+    // Called on the HTTP threads: answers from the snapshot of a
+    // ROUTE_SNAPSHOT route if it is recent enough, otherwise queues `handler`
+    // on the main thread, and answers from there.
+    void dispatch(std::string const& name, std::string const& params,
+                  http::server::server::routeHandler const& handler,
+                  std::function<void(std::string const&)> respond);
+
   public:
     CommandHandler(Application& app);
+    ~CommandHandler();
 
     void manualCmd(std::string const& cmd);
 
@@ -32,9 +101,11 @@ class CommandHandler
     void checkpoint(std::string const& params, std::string& retStr);
     void checkdb(std::string const& params, std::string& retStr);
     void connect(std::string const& params, std::string& retStr);
+    void crankStats(std::string const& params, std::string& retStr);
     void dropcursor(std::string const& params, std::string& retStr);
     void generateLoad(std::string const& params, std::string& retStr);
     void info(std::string const& params, std::string& retStr);
+    void ledgerTimeline(std::string const& params, std::string& retStr);
     void ll(std::string const& params, std::string& retStr);
     void logRotate(std::string const& params, std::string& retStr);
     void maintenance(std::string const& params, std::string& retStr);
@@ -44,6 +115,7 @@ class CommandHandler
     void setcursor(std::string const& params, std::string& retStr);
     void scpInfo(std::string const& params, std::string& retStr);
     void tx(std::string const& params, std::string& retStr);
+    void txBatch(std::string const& params, std::string& retStr);
     void testAcc(std::string const& params, std::string& retStr);
     void testTx(std::string const& params, std::string& retStr);
 };
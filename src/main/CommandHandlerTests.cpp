@@ -0,0 +1,189 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/asio.h"
+#include "main/Application.h"
+#include "main/Config.h"
+#include "main/test.h"
+#include "lib/catch.hpp"
+#include "lib/http/HttpClient.h"
+#include "lib/json/json.h"
+#include "transactions/TxTests.h"
+#include "util/Timer.h"
+#include "util/basen.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include "xdrpp/marshal.h"
+#include <future>
+
+using namespace stellar;
+using namespace stellar::txtest;
+
+// Runs `request` on another thread, cranking the application's clock
+// until it completes: the requests block until the main thread has run
+// their handler.
+template <typename T>
+static T
+crankUntilDone(VirtualClock& clock, std::function<T()> request)
+{
+    auto f = std::async(std::launch::async, request);
+    while (f.wait_for(std::chrono::milliseconds(0)) !=
+           std::future_status::ready)
+    {
+        clock.crank(false);
+    }
+    return f.get();
+}
+
+TEST_CASE("http commands served off the main thread", "[http]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.HTTP_THREADS = 2;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto get = [&](std::string const& path)
+    {
+        std::string ret;
+        REQUIRE(crankUntilDone<int>(clock, [&]()
+                                    {
+                                        return http_request("127.0.0.1", path,
+                                                            cfg.HTTP_PORT, ret);
+                                    }) == 200);
+        return ret;
+    };
+
+    auto& metrics = app->getMetrics();
+    auto& hits = metrics.NewMeter({"http", "snapshot", "hit"}, "request");
+    auto& infoLatency = metrics.NewTimer({"http", "latency", "info"});
+
+    SECTION("read-only routes are served from snapshots")
+    {
+        auto first = get("/info");
+        REQUIRE(first.find("\"info\"") != std::string::npos);
+        REQUIRE(hits.count() == 0);
+        auto second = get("/info");
+        REQUIRE(second == first);
+        REQUIRE(hits.count() == 1);
+        REQUIRE(infoLatency.count() == 2);
+    }
+
+    SECTION("other routes run on the main thread every time")
+    {
+        auto& llLatency = metrics.NewTimer({"http", "latency", "ll"});
+        get("/ll");
+        get("/ll");
+        REQUIRE(llLatency.count() == 2);
+        REQUIRE(hits.count() == 0);
+    }
+
+    SECTION("unknown routes")
+    {
+        REQUIRE(get("/nosuchcommand").find("supported commands") !=
+                std::string::npos);
+    }
+}
+
+TEST_CASE("txbatch", "[http][herder]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    Hash const& networkID = app->getNetworkID();
+    SecretKey root = getRoot(networkID);
+    SecretKey a1 = getAccount("A");
+    SecretKey b1 = getAccount("B");
+    const int64_t paymentAmount = app->getLedgerManager().getMinBalance(0);
+    SequenceNumber rootSeq = getAccountSeqNum(root, *app) + 1;
+
+    // the envelopes one after the other, each after its record mark
+    std::vector<uint8_t> stream;
+    auto append = [&](TransactionFramePtr tx)
+    {
+        auto bin = xdr::xdr_to_opaque(tx->getEnvelope());
+        uint32_t sz = static_cast<uint32_t>(bin.size());
+        stream.push_back(static_cast<uint8_t>((sz >> 24) | 0x80));
+        stream.push_back(static_cast<uint8_t>(sz >> 16));
+        stream.push_back(static_cast<uint8_t>(sz >> 8));
+        stream.push_back(static_cast<uint8_t>(sz));
+        stream.insert(stream.end(), bin.begin(), bin.end());
+    };
+    append(createCreateAccountTx(networkID, root, a1, rootSeq, paymentAmount));
+    append(createCreateAccountTx(networkID, root, b1, rootSeq + 1,
+                                 paymentAmount));
+    append(createCreateAccountTx(networkID, root, b1, rootSeq + 1,
+                                 paymentAmount));
+    append(createPaymentTx(networkID, a1, root, 1, paymentAmount));
+
+    auto query = [&]()
+    {
+        std::string blob;
+        for (auto c : bn::encode_b64(stream))
+        {
+            blob += c == '+' ? std::string("%2B") : std::string(1, c);
+        }
+        std::string ret;
+        REQUIRE(crankUntilDone<int>(clock, [&]()
+                                    {
+                                        return http_request(
+                                            "127.0.0.1", "/txbatch?blob=" + blob,
+                                            cfg.HTTP_PORT, ret);
+                                    }) == 200);
+        return ret;
+    };
+
+    auto checkResults = [](std::string const& ret)
+    {
+        Json::Value root;
+        REQUIRE(Json::Reader().parse(ret, root));
+        auto const& results = root["results"];
+        REQUIRE(results.size() == 4);
+        REQUIRE(results[0]["status"].asString() == "PENDING");
+        REQUIRE(results[1]["status"].asString() == "PENDING");
+        REQUIRE(results[2]["status"].asString() == "DUPLICATE");
+        REQUIRE(results[3]["status"].asString() == "ERROR");
+        REQUIRE(!results[3]["error"].asString().empty());
+    };
+
+    SECTION("base64 in the query string")
+    {
+        checkResults(query());
+    }
+
+    SECTION("binary in the body")
+    {
+        auto ret = crankUntilDone<std::string>(clock, [&]()
+                                               {
+            asio::io_service io;
+            asio::ip::tcp::socket socket(io);
+            socket.connect(asio::ip::tcp::endpoint(
+                asio::ip::address::from_string("127.0.0.1"), cfg.HTTP_PORT));
+            std::string request = "POST /txbatch HTTP/1.0\r\n"
+                                  "Content-Length: " +
+                                  std::to_string(stream.size()) + "\r\n\r\n";
+            request.append(stream.begin(), stream.end());
+            asio::write(socket, asio::buffer(request));
+            std::string reply;
+            asio::error_code ec;
+            char buf[4096];
+            size_t n;
+            while ((n = socket.read_some(asio::buffer(buf), ec)) > 0)
+            {
+                reply.append(buf, n);
+            }
+            return reply.substr(reply.find("\r\n\r\n") + 4);
+        });
+        checkResults(ret);
+    }
+
+    SECTION("malformed")
+    {
+        stream.pop_back();
+        REQUIRE(query().find("exception") != std::string::npos);
+    }
+}
@@ -36,6 +36,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
     ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING = false;
     ARTIFICIALLY_SET_CLOSE_TIME_FOR_TESTING = 0;
     ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING = false;
+    ARTIFICIALLY_CLUSTER_TX_APPLY_FOR_TESTING = false;
     ALLOW_LOCALHOST_FOR_TESTING = false;
     FAILURE_SAFETY = 1;
     UNSAFE_QUORUM = false;
@@ -49,6 +50,7 @@ Config::Config() : NODE_SEED(SecretKey::random())
 
     HTTP_PORT = DEFAULT_PEER_PORT + 1;
     PUBLIC_HTTP_PORT = false;
+    HTTP_THREADS = 2;
 
     PEER_PORT = DEFAULT_PEER_PORT;
     TARGET_PEER_CONNECTIONS = 20;
@@ -56,8 +58,11 @@ Config::Config() : NODE_SEED(SecretKey::random())
     PREFERRED_PEERS_ONLY = false;
 
     MINIMUM_IDLE_PERCENT = 0;
+    CRANK_STALL_THRESHOLD_MS = 1000;
+    LEDGER_CLOSE_TIMELINE_SIZE = 100;
 
     MAX_CONCURRENT_SUBPROCESSES = 16;
+    VERIFY_SIG_CACHE_SIZE = 0xffff;
     PARANOID_MODE = false;
     NODE_IS_VALIDATOR = false;
 
@@ -201,6 +206,15 @@ Config::load(std::string const& filename)
                 }
                 PUBLIC_HTTP_PORT = item.second->as<bool>()->value();
             }
+            else if (item.first == "HTTP_THREADS")
+            {
+                if (!item.second->as<int64_t>() ||
+                    item.second->as<int64_t>()->value() <= 0)
+                {
+                    throw std::invalid_argument("invalid HTTP_THREADS");
+                }
+                HTTP_THREADS = (unsigned)item.second->as<int64_t>()->value();
+            }
             else if (item.first == "DESIRED_BASE_FEE")
             {
                 if (!item.second->as<int64_t>())
@@ -333,6 +347,16 @@ Config::load(std::string const& filename)
                 }
                 BUCKET_DIR_PATH = item.second->as<std::string>()->value();
             }
+            else if (item.first == "LEDGER_CHANGE_FEED_DIR_PATH")
+            {
+                if (!item.second->as<std::string>())
+                {
+                    throw std::invalid_argument(
+                        "invalid LEDGER_CHANGE_FEED_DIR_PATH");
+                }
+                LEDGER_CHANGE_FEED_DIR_PATH =
+                    item.second->as<std::string>()->value();
+            }
             else if (item.first == "NODE_NAMES")
             {
                 if (!item.second->is_array())
@@ -480,6 +504,17 @@ Config::load(std::string const& filename)
                 MAX_CONCURRENT_SUBPROCESSES =
                     (size_t)item.second->as<int64_t>()->value();
             }
+            else if (item.first == "VERIFY_SIG_CACHE_SIZE")
+            {
+                if (!item.second->as<int64_t>() ||
+                    item.second->as<int64_t>()->value() <= 0)
+                {
+                    throw std::invalid_argument(
+                        "invalid VERIFY_SIG_CACHE_SIZE");
+                }
+                VERIFY_SIG_CACHE_SIZE =
+                    (size_t)item.second->as<int64_t>()->value();
+            }
             else if (item.first == "MINIMUM_IDLE_PERCENT")
             {
                 if (!item.second->as<int64_t>() ||
@@ -491,6 +526,30 @@ Config::load(std::string const& filename)
                 MINIMUM_IDLE_PERCENT =
                     (uint32_t)item.second->as<int64_t>()->value();
             }
+            else if (item.first == "CRANK_STALL_THRESHOLD_MS")
+            {
+                if (!item.second->as<int64_t>() ||
+                    item.second->as<int64_t>()->value() < 0 ||
+                    item.second->as<int64_t>()->value() > UINT32_MAX)
+                {
+                    throw std::invalid_argument(
+                        "invalid CRANK_STALL_THRESHOLD_MS");
+                }
+                CRANK_STALL_THRESHOLD_MS =
+                    (uint32_t)item.second->as<int64_t>()->value();
+            }
+            else if (item.first == "LEDGER_CLOSE_TIMELINE_SIZE")
+            {
+                if (!item.second->as<int64_t>() ||
+                    item.second->as<int64_t>()->value() < 0 ||
+                    item.second->as<int64_t>()->value() > UINT32_MAX)
+                {
+                    throw std::invalid_argument(
+                        "invalid LEDGER_CLOSE_TIMELINE_SIZE");
+                }
+                LEDGER_CLOSE_TIMELINE_SIZE =
+                    (uint32_t)item.second->as<int64_t>()->value();
+            }
             else if (item.first == "HISTORY")
             {
                 auto hist = item.second->as_group();
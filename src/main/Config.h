@@ -87,6 +87,12 @@ class Config : public std::enable_shared_from_this<Config>
     // and should be false in all normal cases.
     bool ARTIFICIALLY_PESSIMIZE_MERGES_FOR_TESTING;
 
+    // A config parameter that applies the transactions of a ledger one
+    // conflict-free cluster at a time (see TxSetFrame::partitionForApply)
+    // instead of in apply order; this option exists only for testing the
+    // conflict analysis, and should be false in all normal cases.
+    bool ARTIFICIALLY_CLUSTER_TX_APPLY_FOR_TESTING;
+
     // A config to allow connections to localhost
     // this should only be enabled when testing as it's a security issue
     bool ALLOW_LOCALHOST_FOR_TESTING;
@@ -113,11 +119,14 @@ class Config : public std::enable_shared_from_this<Config>
     std::string LOG_FILE_PATH;
     std::string TMP_DIR_PATH;
     std::string BUCKET_DIR_PATH;
+    // where the ledger change feed is written, "" to not write it
+    std::string LEDGER_CHANGE_FEED_DIR_PATH;
     uint32_t DESIRED_BASE_FEE;     // in stroops
     uint32_t DESIRED_BASE_RESERVE; // in stroops
     uint32_t DESIRED_MAX_TX_PER_LEDGER;
     unsigned short HTTP_PORT;       // what port to listen for commands
     bool PUBLIC_HTTP_PORT;          // if you accept commands from not localhost
+    unsigned HTTP_THREADS;          // threads serving the HTTP port
     std::string NETWORK_PASSPHRASE; // identifier for the network
 
     // overlay config
@@ -142,9 +151,22 @@ class Config : public std::enable_shared_from_this<Config>
     // totally insensitive to overloading.
     uint32_t MINIMUM_IDLE_PERCENT;
 
+    // A single main-thread event handler running for at least this many
+    // milliseconds is logged as a stall, with the time broken down by
+    // subsystem (see /crankstats). 0 disables stall reporting.
+    uint32_t CRANK_STALL_THRESHOLD_MS;
+
+    // Number of recent ledger closes whose phase-by-phase timings are kept
+    // for /ledgertimeline. 0 disables the timeline.
+    uint32_t LEDGER_CLOSE_TIMELINE_SIZE;
+
     // process-management config
     size_t MAX_CONCURRENT_SUBPROCESSES;
 
+    // Number of signature-verification results kept in the process-wide
+    // verification cache.
+    size_t VERIFY_SIG_CACHE_SIZE;
+
     // Setting this causes all sorts of extra checks to occur
     // the overhead may cause slower systems to not perform as fast
     // as the rest of the network, caution is advised when using this.
@@ -6,6 +6,7 @@
 
 #include "database/Database.h"
 #include "Application.h"
+#include "ledger/LedgerChangeFeed.h"
 #include "ledger/LedgerManager.h"
 #include "util/Logging.h"
 #include <regex>
@@ -138,6 +139,16 @@ ExternalQueue::process()
               << ", qmin=" << qmin << ", lmin=" << lmin << ")";
 
     mApp.getLedgerManager().deleteOldEntries(mApp.getDatabase(), cmin);
+
+    // only subscribers need the change feed: it is not trimmed by what
+    // publication needs, and is kept for the first one until there is any
+    auto& feed = mApp.getLedgerManager().getChangeFeed();
+    if (feed.isEnabled() && rmin != std::numeric_limits<uint32_t>::max())
+    {
+        auto deleted = feed.trim(rmin);
+        LOG(INFO) << "Deleted " << deleted
+                  << " ledger change feed files <= ledger " << rmin;
+    }
 }
 
 void
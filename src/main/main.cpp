@@ -15,12 +15,15 @@
 #include "lib/http/HttpClient.h"
 #include "crypto/Hex.h"
 #include "crypto/SecretKey.h"
+#include "history/ArchiveReplayer.h"
 #include "history/HistoryManager.h"
 #include "main/PersistentState.h"
 #include <sodium.h>
 #include "database/Database.h"
 #include "bucket/Bucket.h"
 #include "util/optional.h"
+#include <fstream>
+#include <sstream>
 
 _INITIALIZE_EASYLOGGINGPP
 
@@ -46,6 +49,9 @@ enum opttag
     OPT_METRIC,
     OPT_NEWDB,
     OPT_NEWHIST,
+    OPT_REPLAYARCHIVE,
+    OPT_REPLAYRANGE,
+    OPT_REPLAYREPORT,
     OPT_TEST,
     OPT_VERSION
 };
@@ -66,6 +72,9 @@ static const struct option stellar_core_options[] = {
     {"metric", required_argument, nullptr, OPT_METRIC},
     {"newdb", no_argument, nullptr, OPT_NEWDB},
     {"newhist", required_argument, nullptr, OPT_NEWHIST},
+    {"replay-archive", required_argument, nullptr, OPT_REPLAYARCHIVE},
+    {"replay-range", required_argument, nullptr, OPT_REPLAYRANGE},
+    {"replay-report", required_argument, nullptr, OPT_REPLAYREPORT},
     {"test", no_argument, nullptr, OPT_TEST},
     {"version", no_argument, nullptr, OPT_VERSION},
     {nullptr, 0, nullptr, 0}};
@@ -98,6 +107,15 @@ usage(int err = 1)
           "      --newdb         Creates or restores the DB to the genesis "
           "ledger\n"
           "      --newhist ARCH  Initialize the named history archive ARCH\n"
+          "      --replay-archive DIR  Benchmark: rebuild the database "
+          "(wiping it) from the local\n"
+          "                      history archive in DIR and replay the "
+          "ledgers of --replay-range\n"
+          "      --replay-range FIRST-LAST  Ledgers to replay and report on\n"
+          "      --replay-report FILE  Write per-ledger replay timings to FILE "
+          "(JSON if it ends\n"
+          "                      in .json, CSV otherwise; default stdout, "
+          "CSV)\n"
           "      --test          To run self-tests\n"
           "      --version       To print version information\n";
     exit(err);
@@ -239,6 +257,66 @@ initializeHistories(Config& cfg, vector<string> newHistories)
     return 0;
 }
 
+int
+replayArchive(Config& cfg, std::string const& archiveDir,
+              std::string const& range, std::string const& reportFile)
+{
+    uint32_t first = 0, last = 0;
+    char dash = 0;
+    std::istringstream rs(range);
+    if (!(rs >> first >> dash >> last) || dash != '-' || first > last)
+    {
+        LOG(FATAL) << "Bad --replay-range '" << range
+                   << "', expected FIRST-LAST";
+        return 1;
+    }
+
+    // Replay into a freshly-initialized database, and never publish.
+    cfg.REBUILD_DB = true;
+    cfg.HISTORY.clear();
+    LOG(WARNING) << "Replay wipes the database " << cfg.DATABASE;
+
+    VirtualClock clock(VirtualClock::REAL_TIME);
+    Application::pointer app = Application::create(clock, cfg);
+
+    ArchiveReplayer replayer(*app, archiveDir);
+    auto stats = replayer.replay(first, last);
+
+    std::ofstream file;
+    if (!reportFile.empty())
+    {
+        file.open(reportFile);
+        if (!file)
+        {
+            LOG(FATAL) << "Could not open report file " << reportFile;
+            return 1;
+        }
+    }
+    std::ostream& out = reportFile.empty() ? std::cout : file;
+    bool json = reportFile.size() > 5 &&
+                reportFile.compare(reportFile.size() - 5, 5, ".json") == 0;
+    if (json)
+    {
+        ArchiveReplayer::writeJSON(stats, out);
+    }
+    else
+    {
+        ArchiveReplayer::writeCSV(stats, out);
+    }
+
+    std::chrono::nanoseconds total(0);
+    size_t txs = 0;
+    for (auto const& s : stats)
+    {
+        total += s.mApplyTime;
+        txs += s.mTxCount;
+    }
+    LOG(INFO) << "Replayed " << stats.size() << " ledgers, " << txs
+              << " transactions in "
+              << std::chrono::duration<double>(total).count() << "s";
+    return 0;
+}
+
 int
 startApp(string cfgFile, Config& cfg)
 {
@@ -305,6 +383,9 @@ main(int argc, char* const* argv)
     std::string loadXdrBucket = "";
     std::vector<std::string> newHistories;
     std::vector<std::string> metrics;
+    std::string replayArchiveDir;
+    std::string replayRange;
+    std::string replayReport;
 
     int opt;
     while ((opt = getopt_long_only(argc, argv, "", stellar_core_options,
@@ -360,6 +441,15 @@ main(int argc, char* const* argv)
         case OPT_NEWHIST:
             newHistories.push_back(std::string(optarg));
             break;
+        case OPT_REPLAYARCHIVE:
+            replayArchiveDir = std::string(optarg);
+            break;
+        case OPT_REPLAYRANGE:
+            replayRange = std::string(optarg);
+            break;
+        case OPT_REPLAYREPORT:
+            replayReport = std::string(optarg);
+            break;
         case OPT_TEST:
         {
             rest.push_back(*argv);
@@ -427,6 +517,12 @@ main(int argc, char* const* argv)
             setNoListen(cfg);
             return initializeHistories(cfg, newHistories);
         }
+        else if (!replayArchiveDir.empty())
+        {
+            setNoListen(cfg);
+            return replayArchive(cfg, replayArchiveDir, replayRange,
+                                 replayReport);
+        }
 
         if (cfg.MANUAL_CLOSE)
         {
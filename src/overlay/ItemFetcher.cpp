@@ -11,7 +11,6 @@
 #include "overlay/StellarXDR.h"
 #include "crypto/Hex.h"
 #include "crypto/SHA.h"
-#include "herder/Herder.h"
 #include "xdrpp/marshal.h"
 
 namespace stellar
@@ -54,8 +53,8 @@ ItemFetcher<TrackerT>::stopFetchingBelow(uint64 slotIndex)
 {
     // only perform this cleanup from the top of the stack as it causes
     // all sorts of evil side effects
-    mApp.getClock().getIOService().post(
-        [this, slotIndex]()
+    mApp.getClock().post(
+        CrankStats::ORIGIN_OVERLAY, [this, slotIndex]()
         {
             stopFetchingBelowInternal(slotIndex);
         });
@@ -96,22 +95,16 @@ ItemFetcher<TrackerT>::recv(uint256 itemID)
 {
     CLOG(TRACE, "Overlay") << "Recv " << hexAbbrev(itemID);
     const auto& iter = mTrackers.find(itemID);
-    using xdr::operator==;
     if (iter != mTrackers.end())
     {
-        // this code can safely be called even if recvSCPEnvelope ends up
-        // calling recv on the same itemID
+        // the envelopes waiting for the item are handed over to SCP by
+        // PendingEnvelopes, which knows which ones it completes
         auto& waiting = iter->second->mWaitingEnvelopes;
 
         CLOG(TRACE, "Overlay") << "Recv " << hexAbbrev(itemID) << " : "
                                << waiting.size();
 
-        while (!waiting.empty())
-        {
-            SCPEnvelope env = waiting.back().second;
-            waiting.pop_back();
-            mApp.getHerder().recvSCPEnvelope(env);
-        }
+        waiting.clear();
         // stop the timer, stop requesting the item as we have it
         iter->second->mTimer.cancel();
     }
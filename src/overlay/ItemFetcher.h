@@ -82,7 +82,7 @@ template <class TrackerT> class ItemFetcher : private NonMovableOrCopyable
 
     void doesntHave(uint256 const& itemID, Peer::pointer peer);
 
-    // recv: notifies all listeners of the arrival of the item
+    // recv: stops fetching the item, which has arrived
     void recv(uint256 itemID);
 
   protected:
@@ -13,6 +13,7 @@
 #include "medida/metrics_registry.h"
 #include "medida/timer.h"
 #include "medida/meter.h"
+#include <algorithm>
 
 namespace stellar
 {
@@ -23,7 +24,8 @@ using namespace std;
 // LoopbackPeer
 ///////////////////////////////////////////////////////////////////////
 
-LoopbackPeer::LoopbackPeer(Application& app, PeerRole role) : Peer(app, role)
+LoopbackPeer::LoopbackPeer(Application& app, PeerRole role)
+    : Peer(app, role), mArrivalTimer(app)
 {
 }
 
@@ -72,16 +74,18 @@ LoopbackPeer::drop()
     }
     mState = CLOSING;
     mIdleTimer.cancel();
+    mArrivalTimer.cancel();
     auto self = shared_from_this();
     getApp().getOverlayManager().dropPeer(self);
 
     auto remote = mRemote.lock();
     if (remote)
     {
-        remote->getApp().getClock().getIOService().post([remote]()
-                                                        {
-                                                            remote->drop();
-                                                        });
+        remote->getApp().getClock().post(CrankStats::ORIGIN_OVERLAY,
+                                         [remote]()
+                                         {
+                                             remote->drop();
+                                         });
     }
 }
 
@@ -129,14 +133,72 @@ LoopbackPeer::processInQueue()
         if (!mInQueue.empty())
         {
             auto self = static_pointer_cast<LoopbackPeer>(shared_from_this());
-            mApp.getClock().getIOService().post([self]()
-                                                {
-                                                    self->processInQueue();
-                                                });
+            mApp.getClock().post(CrankStats::ORIGIN_OVERLAY, [self]()
+                                 {
+                                     self->processInQueue();
+                                 });
         }
     }
 }
 
+void
+LoopbackPeer::scheduleArrival(VirtualClock::time_point when,
+                              xdr::msg_ptr&& msg)
+{
+    // A message never arrives in the past of the receiving clock.
+    when = std::max(when, mApp.getClock().now());
+    auto it = std::upper_bound(mArrivals.begin(), mArrivals.end(), when,
+                               [](VirtualClock::time_point t, Arrival const& a)
+                               {
+                                   return t < a.first;
+                               });
+    bool first = it == mArrivals.begin();
+    mArrivals.emplace(it, when, std::move(msg));
+    if (first)
+    {
+        auto self = static_pointer_cast<LoopbackPeer>(shared_from_this());
+        mArrivalTimer.expires_at(when);
+        mArrivalTimer.async_wait(
+            [self]()
+            {
+                self->processArrivals();
+            },
+            &VirtualTimer::onFailureNoop);
+    }
+}
+
+void
+LoopbackPeer::processArrivals()
+{
+    if (mState == CLOSING)
+    {
+        return;
+    }
+    auto now = mApp.getClock().now();
+    bool wasEmpty = mInQueue.empty();
+    while (!mArrivals.empty() && mArrivals.front().first <= now)
+    {
+        mInQueue.emplace(std::move(mArrivals.front().second));
+        mArrivals.pop_front();
+    }
+    if (!mArrivals.empty())
+    {
+        auto self = static_pointer_cast<LoopbackPeer>(shared_from_this());
+        mArrivalTimer.expires_at(mArrivals.front().first);
+        mArrivalTimer.async_wait(
+            [self]()
+            {
+                self->processArrivals();
+            },
+            &VirtualTimer::onFailureNoop);
+    }
+    // otherwise processInQueue is already scheduled for what is queued
+    if (wasEmpty)
+    {
+        processInQueue();
+    }
+}
+
 void
 LoopbackPeer::deliverOne()
 {
@@ -188,17 +250,42 @@ LoopbackPeer::deliverOne()
 
         size_t nBytes = msg->raw_size();
         mStats.bytesDelivered += nBytes;
+        mStats.messagesDelivered++;
 
         // Pass ownership of a serialized XDR message buffer to a recvMesage
         // callback event against the remote Peer, posted on the remote
         // Peer's io_service.
         auto remote = mRemote.lock();
-        if (remote)
+        if (mLinkModel.mLatency.count() != 0 ||
+            mLinkModel.mBytesPerSecond != 0)
+        {
+            auto now = mApp.getClock().now();
+            auto sent = std::max(now, mLinkBusyUntil);
+            if (mLinkModel.mBytesPerSecond != 0)
+            {
+                sent += std::chrono::duration_cast<VirtualClock::duration>(
+                    std::chrono::nanoseconds(nBytes * 1000000000ULL /
+                                             mLinkModel.mBytesPerSecond));
+            }
+            mLinkBusyUntil = sent;
+            auto arrival =
+                sent + std::chrono::duration_cast<VirtualClock::duration>(
+                           mLinkModel.mLatency);
+            if (mDeferDelivery)
+            {
+                mOutbox.emplace_back(arrival, std::move(msg));
+            }
+            else if (remote)
+            {
+                remote->scheduleArrival(arrival, std::move(msg));
+            }
+        }
+        else if (remote)
         {
             // move msg to remote's in queue
             remote->mInQueue.emplace(std::move(msg));
-            remote->getApp().getClock().getIOService().post(
-                [remote]()
+            remote->getApp().getClock().post(
+                CrankStats::ORIGIN_OVERLAY, [remote]()
                 {
                     remote->processInQueue();
                 });
@@ -212,6 +299,20 @@ LoopbackPeer::deliverOne()
     }
 }
 
+void
+LoopbackPeer::flushOutbox()
+{
+    auto remote = mRemote.lock();
+    if (remote)
+    {
+        for (auto& a : mOutbox)
+        {
+            remote->scheduleArrival(a.first, std::move(a.second));
+        }
+    }
+    mOutbox.clear();
+}
+
 void
 LoopbackPeer::deliverAll()
 {
@@ -359,6 +460,34 @@ LoopbackPeer::setReorderProbability(double d)
     mReorderProb = bernoulli_distribution(d);
 }
 
+LoopbackPeer::LinkModel const&
+LoopbackPeer::getLinkModel() const
+{
+    return mLinkModel;
+}
+
+void
+LoopbackPeer::setLinkModel(LinkModel const& model)
+{
+    if (model.mLatency.count() < 0)
+    {
+        throw std::runtime_error("negative link latency");
+    }
+    mLinkModel = model;
+}
+
+bool
+LoopbackPeer::getDeferDelivery() const
+{
+    return mDeferDelivery;
+}
+
+void
+LoopbackPeer::setDeferDelivery(bool d)
+{
+    mDeferDelivery = d;
+}
+
 LoopbackPeerConnection::LoopbackPeerConnection(Application& initiator,
                                                Application& acceptor)
     : mInitiator(make_shared<LoopbackPeer>(initiator, Peer::WE_CALLED_REMOTE))
@@ -376,8 +505,8 @@ LoopbackPeerConnection::LoopbackPeerConnection(Application& initiator,
     mAcceptor->startIdleTimer();
 
     auto init = mInitiator;
-    mInitiator->getApp().getClock().getIOService().post(
-        [init]()
+    mInitiator->getApp().getClock().post(
+        CrankStats::ORIGIN_OVERLAY, [init]()
         {
             init->connectHandler(asio::error_code());
         });
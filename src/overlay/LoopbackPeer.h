@@ -7,6 +7,7 @@
 #include "overlay/Peer.h"
 #include <deque>
 #include <random>
+#include <vector>
 
 /*
 Another peer out there that we are connected to
@@ -23,6 +24,18 @@ namespace stellar
 
 class LoopbackPeer : public Peer
 {
+  public:
+    // Delay model of the simulated link, applied to every message sent by a
+    // peer: a message is on the wire for its size divided by the bandwidth,
+    // after the messages sent before it, then arrives `mLatency` later. The
+    // default (zero latency, unlimited bandwidth) delivers messages in the
+    // next crank of the remote peer's clock.
+    struct LinkModel
+    {
+        std::chrono::nanoseconds mLatency{0};
+        uint64_t mBytesPerSecond{0}; // 0 for unlimited
+    };
+
   private:
     std::weak_ptr<LoopbackPeer> mRemote;
     std::deque<xdr::msg_ptr> mOutQueue; // sending queue
@@ -39,6 +52,18 @@ class LoopbackPeer : public Peer
     std::bernoulli_distribution mDamageProb{0.0};
     std::bernoulli_distribution mDropProb{0.0};
 
+    typedef std::pair<VirtualClock::time_point, xdr::msg_ptr> Arrival;
+
+    LinkModel mLinkModel;
+    VirtualClock::time_point mLinkBusyUntil;
+    // Messages sent over a delayed link and held back until flushOutbox,
+    // when delivery is deferred.
+    bool mDeferDelivery{false};
+    std::vector<Arrival> mOutbox;
+    // Messages sent by the remote peer over a delayed link, in arrival order.
+    std::deque<Arrival> mArrivals;
+    VirtualTimer mArrivalTimer;
+
     struct Stats
     {
         size_t messagesDuplicated{0};
@@ -56,6 +81,8 @@ class LoopbackPeer : public Peer
     AuthCert getAuthCert();
 
     void processInQueue();
+    void scheduleArrival(VirtualClock::time_point when, xdr::msg_ptr&& msg);
+    void processArrivals();
 
   public:
     virtual ~LoopbackPeer()
@@ -99,6 +126,18 @@ class LoopbackPeer : public Peer
     double getReorderProbability() const;
     void setReorderProbability(double d);
 
+    LinkModel const& getLinkModel() const;
+    void setLinkModel(LinkModel const& model);
+
+    // When set, messages sent over a delayed link wait in this peer's outbox
+    // instead of being handed to the remote peer, which may be running on
+    // another thread; the owner of both moves them across with flushOutbox
+    // once neither peer is running. The link latency must be at least as
+    // long as the time the two clocks can drift apart in the meantime.
+    bool getDeferDelivery() const;
+    void setDeferDelivery(bool d);
+    void flushOutbox();
+
     friend class LoopbackPeerConnection;
 };
 
@@ -46,6 +46,35 @@ TEST_CASE("loopback peer hello", "[overlay]")
     REQUIRE(conn.getAcceptor()->isAuthenticated());
 }
 
+TEST_CASE("loopback peer link latency", "[overlay]")
+{
+    VirtualClock clock;
+    Config const& cfg1 = getTestConfig(0);
+    Config const& cfg2 = getTestConfig(1);
+    auto app1 = Application::create(clock, cfg1);
+    auto app2 = Application::create(clock, cfg2);
+
+    LoopbackPeerConnection conn(*app1, *app2);
+    LoopbackPeer::LinkModel model;
+    model.mLatency = std::chrono::milliseconds(200);
+    conn.getInitiator()->setLinkModel(model);
+    conn.getAcceptor()->setLinkModel(model);
+
+    auto start = clock.now();
+    while (!(conn.getInitiator()->isAuthenticated() &&
+             conn.getAcceptor()->isAuthenticated()) &&
+           clock.now() < start + std::chrono::seconds(5))
+    {
+        clock.crank(false);
+    }
+    REQUIRE(conn.getInitiator()->isAuthenticated());
+    REQUIRE(conn.getAcceptor()->isAuthenticated());
+    // hello and auth, each both ways: four trips over the link
+    REQUIRE(clock.now() - start >= 4 * model.mLatency);
+    REQUIRE(conn.getInitiator()->getStats().messagesDelivered >= 2);
+    REQUIRE(conn.getAcceptor()->getStats().messagesDelivered >= 2);
+}
+
 TEST_CASE("failed auth", "[overlay]")
 {
     VirtualClock clock;
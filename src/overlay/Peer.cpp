@@ -469,6 +469,8 @@ Peer::sendMessage(StellarMessage const& msg)
 void
 Peer::recvMessage(xdr::msg_ptr const& msg)
 {
+    CrankTag crankTag(mApp.getClock().getCrankStats(),
+                      CrankStats::ORIGIN_OVERLAY);
     if (shouldAbort())
     {
         return;
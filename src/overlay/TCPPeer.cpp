@@ -388,8 +388,8 @@ TCPPeer::drop()
 
     // To shutdown, we first queue up our desire to shutdown in the strand,
     // behind any pending read/write calls. We'll let them issue first.
-    getApp().getClock().getIOService().post(
-        [self]()
+    getApp().getClock().post(
+        CrankStats::ORIGIN_OVERLAY, [self]()
         {
             // Gracefully shut down connection: this pushes a FIN packet into
             // TCP which, if we wanted to be really polite about, we would wait
@@ -411,8 +411,8 @@ TCPPeer::drop()
                 CLOG(ERROR, "Overlay")
                     << "TCPPeer::drop shutdown socket failed: " << ec.message();
             }
-            self->getApp().getClock().getIOService().post(
-                [self]()
+            self->getApp().getClock().post(
+                CrankStats::ORIGIN_OVERLAY, [self]()
                 {
                     // Close fd associated with socket. Socket is already
                     // shut down, but depending on platform (and apparently
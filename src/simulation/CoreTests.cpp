@@ -14,6 +14,14 @@
 #include "util/types.h"
 #include "herder/Herder.h"
 #include "transactions/TransactionFrame.h"
+#include "transactions/TxTests.h"
+#include "ledger/AccountFrame.h"
+#include "simulation/LoadGenerator.h"
+#include "lib/json/json.h"
+#include "crypto/SecretKey.h"
+#include "database/Database.h"
+#include "util/basen.h"
+#include "xdrpp/marshal.h"
 
 using namespace stellar;
 
@@ -108,6 +116,10 @@ TEST_CASE("core topology: 4 ledgers at scales 2..4", "[simulation]")
     {
         mode = Simulation::OVER_LOOPBACK;
     }
+    SECTION("Over parallel loopback")
+    {
+        mode = Simulation::OVER_LOOPBACK_PARALLEL;
+    }
     SECTION("Over tcp")
     {
         mode = Simulation::OVER_TCP;
@@ -222,6 +234,83 @@ TEST_CASE("core-nodes with outer nodes", "[simulation]")
     }
 }
 
+TEST_CASE("parallel simulation report", "[simulation]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer sim = Topologies::hierarchicalQuorumSimplified(
+        4, 8, Simulation::OVER_LOOPBACK_PARALLEL, networkID);
+    sim->setThreadCount(4);
+
+    LoopbackPeer::LinkModel model;
+    model.mLatency = std::chrono::milliseconds(0);
+    REQUIRE_THROWS(sim->setLinkModel(model));
+    model.mLatency = std::chrono::milliseconds(50);
+    model.mBytesPerSecond = 10 * 1024 * 1024;
+    sim->setLinkModel(model);
+
+    sim->startAllNodes();
+    int const nLedgers = 3;
+    sim->crankUntil(
+        [&sim, nLedgers]()
+        {
+            return sim->haveAllExternalized(nLedgers + 1, 3);
+        },
+        20 * nLedgers * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+
+    // every node runs on its own clock, in step with the others
+    for (auto const& node : sim->getNodes())
+    {
+        REQUIRE(&node->getClock() != &sim->getClock());
+        auto drift = node->getClock().now() - sim->getClock().now();
+        REQUIRE(drift <= model.mLatency);
+        REQUIRE(-drift <= model.mLatency);
+    }
+
+    Json::Value report;
+    sim->reportConsensus(report);
+    REQUIRE(report["nodes"].size() == 12);
+    for (auto const& node : report["nodes"])
+    {
+        REQUIRE(node["messages_sent"].asUInt64() > 0);
+        REQUIRE(node["messages_received"].asUInt64() > 0);
+    }
+    auto const& latency = report["consensus_latency_ms"];
+    REQUIRE(latency["count"].asUInt64() >= nLedgers);
+    REQUIRE(latency["median"].asDouble() > 0);
+    LOG(INFO) << report.toStyledString();
+
+    sim->stopAllNodes();
+}
+
+TEST_CASE("parallel simulation of 200 nodes", "[simulation][long][hide]")
+{
+    Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
+    Simulation::pointer sim = Topologies::hierarchicalQuorumSimplified(
+        10, 190, Simulation::OVER_LOOPBACK_PARALLEL, networkID);
+    sim->startAllNodes();
+
+    int const nLedgers = 4;
+    auto tBegin = std::chrono::system_clock::now();
+    sim->crankUntil(
+        [&sim, nLedgers]()
+        {
+            return sim->haveAllExternalized(nLedgers + 1, 3);
+        },
+        20 * nLedgers * Herder::EXP_LEDGER_TIMESPAN_SECONDS, false);
+    REQUIRE(sim->haveAllExternalized(nLedgers + 1, 3));
+
+    auto t = std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now() - tBegin);
+    Json::Value report;
+    sim->reportConsensus(report);
+    LOG(INFO) << "Closed " << nLedgers << " ledgers with "
+              << sim->getNodes().size() << " nodes in " << t.count()
+              << " seconds: "
+              << report["consensus_latency_ms"].toStyledString();
+
+    sim->stopAllNodes();
+}
+
 TEST_CASE("cycle4 topology", "[simulation]")
 {
     Hash networkID = sha256(getTestConfig().NETWORK_PASSPHRASE);
@@ -319,3 +408,165 @@ TEST_CASE("Auto-calibrated single node load test", "[autoload][hide]")
         clock.crank();
     }
 }
+
+TEST_CASE("load profiles", "[simulation][loadgen]")
+{
+    VirtualClock clock;
+    Config cfg(getTestConfig());
+    cfg.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = true;
+    Application::pointer app = Application::create(clock, cfg);
+    app->start();
+
+    auto run = [&](std::string const& profile)
+    {
+        app->generateLoadProfile(profile, 20, 50, 0, 7);
+        auto& complete =
+            app->getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::minutes(2);
+        while (complete.count() == 0 &&
+               std::chrono::steady_clock::now() < deadline)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(complete.count() == 1);
+        auto& latency =
+            app->getMetrics().NewTimer({"loadgen", "tx", "latency"});
+        CHECK(latency.count() > 0);
+        CHECK(latency.min() > 0);
+        LOG(INFO) << profile << " latency: mean " << latency.mean()
+                  << "ms, max " << latency.max() << "ms";
+    };
+
+    SECTION("payments")
+    {
+        run("payments");
+    }
+    SECTION("hot accounts")
+    {
+        run("hotaccounts");
+    }
+    SECTION("dex")
+    {
+        run("dex");
+    }
+    SECTION("multisig")
+    {
+        run("multisig");
+        auto& db = app->getDatabase();
+        auto account = AccountFrame::loadAccount(
+            txtest::getAccount("LoadProfile-7-1").getPublicKey(), db);
+        REQUIRE(account);
+        CHECK(account->getAccount().signers.size() ==
+              LoadGenerator::kProfileSigners);
+    }
+    SECTION("large tx sets")
+    {
+        run("largetxsets");
+        // at maxTxSetSize a second, more than the 10 a second of the other
+        // profiles end up in one ledger
+        auto& txSetSize =
+            app->getMetrics().NewHistogram({"loadgen", "txset", "size"});
+        CHECK(txSetSize.max() > 10);
+    }
+    SECTION("unknown profile")
+    {
+        REQUIRE_THROWS(app->generateLoadProfile("nope", 20, 50, 0, 7));
+    }
+}
+
+// The payments made by each of the nAccounts accounts of a profile run with
+// `seed`, in the order they were submitted, as (destination, amount) with
+// accounts numbered as the profile numbers them.
+static std::map<size_t, std::vector<std::pair<size_t, int64_t>>>
+profilePayments(Application& app, uint32_t seed, uint32_t nAccounts)
+{
+    std::map<std::string, size_t> index;
+    for (uint32_t i = 0; i < nAccounts; ++i)
+    {
+        auto name =
+            "LoadProfile-" + std::to_string(seed) + "-" + std::to_string(i);
+        index[PubKeyUtils::toStrKey(
+            txtest::getAccount(name.c_str()).getPublicKey())] = i;
+    }
+
+    std::map<size_t, std::map<SequenceNumber, std::pair<size_t, int64_t>>>
+        bySeq;
+    std::string body64;
+    std::vector<uint8_t> buf;
+    auto& sess = app.getDatabase().getSession();
+    soci::statement st =
+        (sess.prepare << "SELECT txbody FROM txhistory", soci::into(body64));
+    st.execute(true);
+    while (st.got_data())
+    {
+        TransactionEnvelope env;
+        bn::decode_b64(body64, buf);
+        xdr::xdr_from_opaque(buf, env);
+        auto from = index.find(PubKeyUtils::toStrKey(env.tx.sourceAccount));
+        if (from != index.end())
+        {
+            for (auto const& op : env.tx.operations)
+            {
+                REQUIRE(op.body.type() == PAYMENT);
+                auto const& payment = op.body.paymentOp();
+                auto to =
+                    index.find(PubKeyUtils::toStrKey(payment.destination));
+                REQUIRE(to != index.end());
+                bySeq[from->second][env.tx.seqNum] =
+                    std::make_pair(to->second, payment.amount);
+            }
+        }
+        st.fetch();
+    }
+
+    std::map<size_t, std::vector<std::pair<size_t, int64_t>>> payments;
+    for (auto const& account : bySeq)
+    {
+        for (auto const& p : account.second)
+        {
+            payments[account.first].push_back(p.second);
+        }
+    }
+    return payments;
+}
+
+TEST_CASE("load profile seeds", "[simulation][loadgen]")
+{
+    uint32_t const nAccounts = 20;
+    auto run = [&](uint32_t seed)
+    {
+        VirtualClock clock;
+        Config cfg(getTestConfig());
+        cfg.ARTIFICIALLY_GENERATE_LOAD_FOR_TESTING = true;
+        Application::pointer app = Application::create(clock, cfg);
+        app->start();
+
+        app->generateLoadProfile("payments", nAccounts, 50, 0, seed);
+        auto& complete =
+            app->getMetrics().NewMeter({"loadgen", "run", "complete"}, "run");
+        auto deadline =
+            std::chrono::steady_clock::now() + std::chrono::minutes(2);
+        while (complete.count() == 0 &&
+               std::chrono::steady_clock::now() < deadline)
+        {
+            clock.crank(false);
+        }
+        REQUIRE(complete.count() == 1);
+        // a lost transaction would leave a gap in the comparison
+        REQUIRE(app->getMetrics()
+                    .NewMeter({"loadgen", "txn", "lost"}, "txn")
+                    .count() == 0);
+        return profilePayments(*app, seed, nAccounts);
+    };
+
+    auto first = run(7);
+    size_t n = 0;
+    for (auto const& account : first)
+    {
+        n += account.second.size();
+    }
+    REQUIRE(n == 50);
+    CHECK(run(7) == first);
+    CHECK(run(8) != first);
+}
@@ -7,6 +7,7 @@
 #include "transactions/TxTests.h"
 #include "herder/Herder.h"
 #include "ledger/LedgerManager.h"
+#include "ledger/LedgerHeaderFrame.h"
 #include "util/Logging.h"
 #include "util/Math.h"
 #include "util/types.h"
@@ -28,10 +29,14 @@
 
 #include "medida/metrics_registry.h"
 #include "medida/meter.h"
+#include "medida/histogram.h"
+#include "medida/timer.h"
 
 #include <set>
+#include <map>
 #include <iomanip>
 #include <cmath>
+#include <random>
 
 namespace stellar
 {
@@ -50,6 +55,48 @@ static const uint64_t LOADGEN_TRUSTLINE_LIMIT = 1000 * LOADGEN_ACCOUNT_BALANCE;
 // Units of load are is scheduled at 100ms intervals.
 const uint32_t LoadGenerator::STEP_MSECS = 100;
 
+const uint32_t LoadGenerator::kProfileSigners = 10;
+
+// Profile transactions not seen in a ledger this many ledgers after their
+// submission have been dropped by the herder.
+static const uint32_t PROFILE_LOST_AFTER_LEDGERS = 8;
+
+// DEX traders pay the reserve of the offers they leave on the books.
+static const uint64_t PROFILE_TRADER_BALANCE = 1000 * LOADGEN_ACCOUNT_BALANCE;
+
+struct LoadGenerator::ProfileRun
+{
+    Profile mProfile;
+    uint32_t mNAccounts;
+    uint32_t mNTxs;
+    uint32_t mTxRate;
+    uint32_t mSeed;
+    std::mt19937_64 mRng;
+
+    std::vector<AccountInfoPtr> mAccounts;
+    std::vector<AccountInfoPtr> mIssuers;
+    // cumulative distribution of account ranks, for PROFILE_HOT_ACCOUNTS
+    std::vector<double> mZipf;
+
+    // Setup stages of the profile, then its transactions proper, are each
+    // submitted at mTxRate from the start of their phase.
+    size_t mStage{0};
+    std::vector<TxInfo> mSetup;
+    bool mLoading{false};
+    VirtualClock::time_point mPhaseStart;
+    uint32_t mPhaseSubmitted{0};
+
+    struct InFlight
+    {
+        VirtualClock::time_point mSubmitted;
+        uint32_t mLedger;
+        // false for setup transactions, which are not part of the load
+        bool mMeasured;
+    };
+    std::map<Hash, InFlight> mInFlight;
+    uint32_t mLastLedger{0};
+};
+
 LoadGenerator::LoadGenerator(Hash const& networkID)
     : mMinBalance(0), mLastSecond(0)
 {
@@ -67,6 +114,40 @@ LoadGenerator::~LoadGenerator()
     clear();
 }
 
+char const*
+LoadGenerator::getProfileName(Profile profile)
+{
+    switch (profile)
+    {
+    case PROFILE_PAYMENTS:
+        return "payments";
+    case PROFILE_HOT_ACCOUNTS:
+        return "hotaccounts";
+    case PROFILE_DEX:
+        return "dex";
+    case PROFILE_MULTISIG:
+        return "multisig";
+    case PROFILE_LARGE_TXSETS:
+        return "largetxsets";
+    default:
+        return "unknown";
+    }
+}
+
+bool
+LoadGenerator::getProfileByName(std::string const& name, Profile& profile)
+{
+    for (int i = 0; i < PROFILE_COUNT; ++i)
+    {
+        if (name == getProfileName(static_cast<Profile>(i)))
+        {
+            profile = static_cast<Profile>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
 std::string
 LoadGenerator::pickRandomAsset()
 {
@@ -442,6 +523,389 @@ LoadGenerator::generateLoad(Application& app, uint32_t nAccounts, uint32_t nTxs,
     }
 }
 
+void
+LoadGenerator::startProfile(Application& app, Profile profile,
+                            uint32_t nAccounts, uint32_t nTxs,
+                            uint32_t txRate, uint32_t seed)
+{
+    if (mProfileRun)
+    {
+        throw std::runtime_error("a load profile is already running");
+    }
+    if (nAccounts < 2)
+    {
+        throw std::runtime_error("a load profile needs at least 2 accounts");
+    }
+    if (mAccounts.empty())
+    {
+        mAccounts.push_back(make_shared<AccountInfo>(
+            0, txtest::getRoot(app.getNetworkID()),
+            100000000ULL * LOADGEN_ACCOUNT_BALANCE, 0, *this));
+    }
+    loadAccount(app, mAccounts[0]);
+
+    if (txRate == 0)
+    {
+        txRate = 10;
+        if (profile == PROFILE_LARGE_TXSETS)
+        {
+            // as many transactions per ledger as a tx set can hold
+            auto ledgerSecs = Herder::EXP_LEDGER_TIMESPAN_SECONDS.count();
+            if (app.getConfig().ARTIFICIALLY_ACCELERATE_TIME_FOR_TESTING)
+            {
+                ledgerSecs = 1;
+            }
+            txRate = std::max<uint32_t>(
+                1, static_cast<uint32_t>(
+                       app.getLedgerManager().getMaxTxSetSize() / ledgerSecs));
+        }
+    }
+
+    mProfileRun = make_unique<ProfileRun>();
+    auto& run = *mProfileRun;
+    run.mProfile = profile;
+    run.mNAccounts = nAccounts;
+    run.mNTxs = nTxs;
+    run.mTxRate = txRate;
+    run.mSeed = seed;
+    run.mRng.seed(seed);
+    run.mLastLedger = app.getLedgerManager().getLastClosedLedgerNum();
+
+    if (profile == PROFILE_HOT_ACCOUNTS)
+    {
+        // Zipf with exponent 1: rank i is picked with weight 1/(i+1)
+        double total = 0;
+        run.mZipf.reserve(nAccounts);
+        for (uint32_t i = 0; i < nAccounts; ++i)
+        {
+            total += 1.0 / (i + 1);
+            run.mZipf.push_back(total);
+        }
+        for (auto& w : run.mZipf)
+        {
+            w /= total;
+        }
+    }
+
+    CLOG(INFO, "LoadGen") << "Starting load profile "
+                          << getProfileName(profile) << ": " << nAccounts
+                          << " accounts, " << nTxs << " txs, " << txRate
+                          << " tx/s, seed " << seed;
+    run.mSetup = profileSetupStage(app, 0);
+    run.mPhaseStart = app.getClock().now();
+    scheduleProfileLoad(app);
+}
+
+bool
+LoadGenerator::isProfileRunning() const
+{
+    return !!mProfileRun;
+}
+
+void
+LoadGenerator::scheduleProfileLoad(Application& app)
+{
+    if (!mLoadTimer)
+    {
+        mLoadTimer = make_unique<VirtualTimer>(app.getClock());
+    }
+    mLoadTimer->expires_from_now(std::chrono::milliseconds(STEP_MSECS));
+    mLoadTimer->async_wait(
+        [this, &app]()
+        {
+            this->generateProfileLoad(app);
+        },
+        &VirtualTimer::onFailureNoop);
+}
+
+// The transactions of the given setup stage of the running profile, none
+// once its accounts are ready. Each stage only starts once the transactions
+// of the previous one are in a closed ledger, and the accounts reloaded.
+vector<LoadGenerator::TxInfo>
+LoadGenerator::profileSetupStage(Application& app, size_t stage)
+{
+    auto& run = *mProfileRun;
+    vector<TxInfo> txs;
+    uint32_t ledgerNum = app.getLedgerManager().getLedgerNum();
+    auto newAccount = [&](std::string const& suffix)
+    {
+        auto name = "LoadProfile-" + to_string(run.mSeed) + "-" + suffix;
+        auto acc = make_shared<AccountInfo>(
+            mAccounts.size(), txtest::getAccount(name.c_str()), 0,
+            static_cast<SequenceNumber>(ledgerNum) << 32, *this);
+        mAccounts.push_back(acc);
+        return acc;
+    };
+
+    bool dex = run.mProfile == PROFILE_DEX;
+    if (stage == 0 && dex)
+    {
+        for (auto const& asset : {"USD", "EUR"})
+        {
+            auto issuer = newAccount(asset);
+            issuer->mIssuedAsset = asset;
+            run.mIssuers.push_back(issuer);
+            txs.push_back(issuer->creationTransaction());
+        }
+    }
+    else if (stage == (dex ? 1u : 0u))
+    {
+        for (uint32_t i = 0; i < run.mNAccounts; ++i)
+        {
+            auto acc = newAccount(to_string(i));
+            for (auto const& issuer : run.mIssuers)
+            {
+                acc->establishTrust(issuer);
+            }
+            run.mAccounts.push_back(acc);
+            txs.push_back(acc->creationTransaction());
+            if (dex)
+            {
+                txs.back().mAmount = PROFILE_TRADER_BALANCE;
+            }
+        }
+    }
+    else if (stage == 1 && run.mProfile == PROFILE_MULTISIG)
+    {
+        for (auto const& acc : run.mAccounts)
+        {
+            auto name = "LoadProfile-" + to_string(run.mSeed) + "-" +
+                        to_string(acc->mId) + "-signer-";
+            for (uint32_t j = 0; j < kProfileSigners; ++j)
+            {
+                acc->mSigners.push_back(
+                    txtest::getAccount((name + to_string(j)).c_str()));
+            }
+            txs.push_back(TxInfo{acc, nullptr, TxInfo::TX_ADD_SIGNERS, 0});
+        }
+    }
+    return txs;
+}
+
+// The next transaction of the running profile.
+LoadGenerator::TxInfo
+LoadGenerator::profileTransaction()
+{
+    auto& run = *mProfileRun;
+    auto& accounts = run.mAccounts;
+    auto uniform = [&]()
+    {
+        return accounts[std::uniform_int_distribution<size_t>(
+            0, accounts.size() - 1)(run.mRng)];
+    };
+    auto zipf = [&]()
+    {
+        auto u = std::uniform_real_distribution<double>(0.0, 1.0)(run.mRng);
+        auto it = std::lower_bound(run.mZipf.begin(), run.mZipf.end(), u);
+        return accounts[std::min<size_t>(it - run.mZipf.begin(),
+                                         accounts.size() - 1)];
+    };
+    auto pick = [&]()
+    {
+        return run.mProfile == PROFILE_HOT_ACCOUNTS ? zipf() : uniform();
+    };
+
+    auto from = pick();
+    if (run.mProfile == PROFILE_DEX)
+    {
+        // Offers on both sides of the book within 2% of parity: about half
+        // of them cross one already there.
+        bool sellUSD = std::bernoulli_distribution(0.5)(run.mRng);
+        TxInfo tx{from, nullptr, TxInfo::TX_MANAGE_OFFER,
+                  std::uniform_int_distribution<int64_t>(1, 10)(run.mRng) *
+                      TENMILLION / 10};
+        tx.mPath.push_back(run.mIssuers[sellUSD ? 0 : 1]);
+        tx.mPath.push_back(run.mIssuers[sellUSD ? 1 : 0]);
+        tx.mPrice.d = 10000;
+        tx.mPrice.n = 10000 - 200 +
+                      std::uniform_int_distribution<int32_t>(0, 400)(run.mRng);
+        return tx;
+    }
+
+    auto to = pick();
+    for (size_t i = 0; to == from && i < 10; ++i)
+    {
+        to = pick();
+    }
+    if (to == from)
+    {
+        to = accounts[(from->mId - accounts.front()->mId + 1) %
+                      accounts.size()];
+    }
+    auto amount = std::uniform_int_distribution<int64_t>(10, 100)(run.mRng);
+    return createTransferNativeTransaction(from, to, amount);
+}
+
+void
+LoadGenerator::submitProfileTransaction(Application& app, TxInfo& tx)
+{
+    auto& run = *mProfileRun;
+    std::vector<TransactionFramePtr> submitted;
+    bool ok = tx.execute(app, &submitted);
+    ProfileRun::InFlight inFlight{app.getClock().now(),
+                                  app.getLedgerManager().getLedgerNum(),
+                                  run.mLoading};
+    for (auto const& f : submitted)
+    {
+        run.mInFlight[f->getContentsHash()] = inFlight;
+    }
+    if (!ok)
+    {
+        // Most likely a stale sequence number.
+        loadAccount(app, tx.mFrom);
+    }
+}
+
+// Records the latency of the profile transactions that made it into the
+// ledgers closed since the last step.
+void
+LoadGenerator::observeProfileLedgers(Application& app)
+{
+    auto& run = *mProfileRun;
+    auto& m = app.getMetrics();
+    auto& latency = m.NewTimer({"loadgen", "tx", "latency"});
+    auto& txSetSize = m.NewHistogram({"loadgen", "txset", "size"});
+    auto& lost = m.NewMeter({"loadgen", "txn", "lost"}, "txn");
+
+    auto& lm = app.getLedgerManager();
+    auto lcl = lm.getLastClosedLedgerNum();
+    while (run.mLastLedger < lcl)
+    {
+        ++run.mLastLedger;
+        auto results = TransactionFrame::getTransactionHistoryMeta(
+            app.getDatabase(), run.mLastLedger);
+
+        // The LCL closed at a precisely known time; a ledger that closed
+        // before it since the last step only has its header's close time,
+        // to the second.
+        VirtualClock::time_point closed;
+        if (run.mLastLedger == lcl)
+        {
+            closed = lm.getLastClosedLedgerTime();
+        }
+        else
+        {
+            auto header = LedgerHeaderFrame::loadBySequence(
+                run.mLastLedger, app.getDatabase(),
+                app.getDatabase().getSession());
+            if (header)
+            {
+                closed = VirtualClock::from_time_t(
+                    header->mHeader.scpValue.closeTime);
+            }
+            else
+            {
+                closed = lm.getLastClosedLedgerTime();
+            }
+        }
+        if (run.mLoading)
+        {
+            txSetSize.Update(results.results.size());
+        }
+        for (auto const& r : results.results)
+        {
+            auto it = run.mInFlight.find(r.transactionHash);
+            if (it != run.mInFlight.end())
+            {
+                if (it->second.mMeasured)
+                {
+                    latency.Update(
+                        std::max(closed, it->second.mSubmitted) -
+                        it->second.mSubmitted);
+                }
+                run.mInFlight.erase(it);
+            }
+        }
+    }
+
+    for (auto it = run.mInFlight.begin(); it != run.mInFlight.end();)
+    {
+        if (it->second.mLedger + PROFILE_LOST_AFTER_LEDGERS < lcl)
+        {
+            if (it->second.mMeasured)
+            {
+                lost.Mark();
+            }
+            it = run.mInFlight.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void
+LoadGenerator::generateProfileLoad(Application& app)
+{
+    soci::transaction sqltx(app.getDatabase().getSession());
+    app.getDatabase().setCurrentTransactionReadOnly();
+
+    auto& run = *mProfileRun;
+    updateMinBalance(app);
+    observeProfileLedgers(app);
+
+    if (!run.mLoading && run.mPhaseSubmitted == run.mSetup.size())
+    {
+        if (!run.mInFlight.empty())
+        {
+            // wait for the stage to be in a closed ledger
+            scheduleProfileLoad(app);
+            return;
+        }
+        loadAccount(app, mAccounts[0]);
+        loadAccounts(app, run.mIssuers);
+        loadAccounts(app, run.mAccounts);
+        run.mSetup = profileSetupStage(app, ++run.mStage);
+        run.mPhaseStart = app.getClock().now();
+        run.mPhaseSubmitted = 0;
+        if (run.mSetup.empty())
+        {
+            CLOG(INFO, "LoadGen") << "Load profile "
+                                  << getProfileName(run.mProfile)
+                                  << " set up, submitting transactions";
+            run.mLoading = true;
+        }
+    }
+
+    // Open loop: whatever was submitted before, submit what is due at the
+    // profile's rate since the start of the phase.
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       app.getClock().now() - run.mPhaseStart)
+                       .count();
+    uint64_t due = static_cast<uint64_t>(elapsed) * run.mTxRate / 1000 + 1;
+    uint32_t total = run.mLoading ? run.mNTxs
+                                  : static_cast<uint32_t>(run.mSetup.size());
+    while (run.mPhaseSubmitted < std::min<uint64_t>(due, total))
+    {
+        if (run.mLoading)
+        {
+            auto tx = profileTransaction();
+            submitProfileTransaction(app, tx);
+        }
+        else
+        {
+            submitProfileTransaction(app, run.mSetup[run.mPhaseSubmitted]);
+        }
+        ++run.mPhaseSubmitted;
+    }
+
+    if (run.mLoading && run.mPhaseSubmitted == run.mNTxs &&
+        run.mInFlight.empty())
+    {
+        auto const& latency =
+            app.getMetrics().NewTimer({"loadgen", "tx", "latency"});
+        CLOG(INFO, "LoadGen")
+            << "Load profile " << getProfileName(run.mProfile)
+            << " complete, latency: mean " << latency.mean() << "ms, max "
+            << latency.max() << "ms";
+        app.getMetrics().NewMeter({"loadgen", "run", "complete"}, "run").Mark();
+        mProfileRun.reset();
+        return;
+    }
+    scheduleProfileLoad(app);
+}
+
 void
 LoadGenerator::updateMinBalance(Application& app)
 {
@@ -790,7 +1254,8 @@ LoadGenerator::TxMetrics::report()
 }
 
 bool
-LoadGenerator::TxInfo::execute(Application& app)
+LoadGenerator::TxInfo::execute(Application& app,
+                               std::vector<TransactionFramePtr>* submitted)
 {
     std::vector<TransactionFramePtr> txfs;
     TxMetrics txm(app.getMetrics());
@@ -818,6 +1283,10 @@ LoadGenerator::TxInfo::execute(Application& app)
             txm.mTxnRejected.Mark();
             return false;
         }
+        if (submitted)
+        {
+            submitted->push_back(f);
+        }
     }
     recordExecution(app.getConfig().DESIRED_BASE_FEE);
     return true;
@@ -919,8 +1388,54 @@ LoadGenerator::TxInfo::toTransactionFrames(
         txm.mNativePayment.Mark();
         txs.push_back(txtest::createPaymentTx(networkID, mFrom->mKey, mTo->mKey,
                                               mFrom->mSeq + 1, mAmount));
+        for (auto& signer : mFrom->mSigners)
+        {
+            txs.back()->addSignature(signer);
+        }
         break;
 
+    case TxInfo::TX_MANAGE_OFFER:
+    {
+        txm.mOfferCreated.Mark();
+        Asset selling =
+            txtest::makeAsset(mPath[0]->mKey, mPath[0]->mIssuedAsset);
+        Asset buying =
+            txtest::makeAsset(mPath[1]->mKey, mPath[1]->mIssuedAsset);
+        txs.push_back(txtest::manageOfferOp(networkID, 0, mFrom->mKey, selling,
+                                            buying, mPrice, mAmount,
+                                            mFrom->mSeq + 1));
+    }
+    break;
+
+    case TxInfo::TX_ADD_SIGNERS:
+    {
+        TransactionEnvelope e;
+        e.tx.sourceAccount = mFrom->mKey.getPublicKey();
+        e.tx.seqNum = mFrom->mSeq + 1;
+        for (auto const& signer : mFrom->mSigners)
+        {
+            Operation op;
+            op.body.type(SET_OPTIONS);
+            op.body.setOptionsOp().signer.activate() =
+                Signer{signer.getPublicKey(), 1};
+            e.tx.operations.push_back(op);
+        }
+        // Payments need the weight of every signer.
+        Operation thresholdsOp;
+        thresholdsOp.body.type(SET_OPTIONS);
+        thresholdsOp.body.setOptionsOp().masterWeight.activate() = 1;
+        thresholdsOp.body.setOptionsOp().medThreshold.activate() =
+            static_cast<uint32>(mFrom->mSigners.size() + 1);
+        e.tx.operations.push_back(thresholdsOp);
+
+        e.tx.fee = 100 * static_cast<uint32>(e.tx.operations.size());
+        TransactionFramePtr res =
+            TransactionFrame::makeTransactionFromWire(networkID, e);
+        res->addSignature(mFrom->mKey);
+        txs.push_back(res);
+    }
+    break;
+
     case TxInfo::TX_TRANSFER_CREDIT:
     {
         txm.mPayment.Mark();
@@ -976,6 +1491,10 @@ LoadGenerator::TxInfo::recordExecution(int64_t baseFee)
 {
     mFrom->mSeq++;
     mFrom->mBalance -= baseFee;
+    if (mType == TX_MANAGE_OFFER || mType == TX_ADD_SIGNERS)
+    {
+        return;
+    }
     if (mFrom && mTo)
     {
         if (!mPath.empty())
@@ -8,6 +8,8 @@
 #include "crypto/SecretKey.h"
 #include "transactions/TxTests.h"
 #include "xdr/Stellar-types.h"
+#include <memory>
+#include <string>
 #include <vector>
 
 namespace medida
@@ -37,6 +39,45 @@ class LoadGenerator
     static std::string pickRandomAsset();
     static const uint32_t STEP_MSECS;
 
+    // Fixed workloads for throughput benchmarks. Unlike the random mix of
+    // generateLoad, a profile draws all its choices from an engine of its
+    // own, seeded by the caller, so that a run can be replayed exactly, and
+    // submits transactions at a constant rate whatever the network does
+    // with them (open loop).
+    enum Profile
+    {
+        // uniformly random native payments
+        PROFILE_PAYMENTS,
+        // native payments between accounts drawn from a Zipf distribution,
+        // a few hot accounts taking most of them
+        PROFILE_HOT_ACCOUNTS,
+        // offers between two assets, priced to cross each other about half
+        // of the time
+        PROFILE_DEX,
+        // native payments from accounts that need all of their
+        // kProfileSigners signatures
+        PROFILE_MULTISIG,
+        // native payments at a rate filling every tx set up to the ledger's
+        // maxTxSetSize
+        PROFILE_LARGE_TXSETS,
+        PROFILE_COUNT
+    };
+
+    static uint32_t const kProfileSigners;
+
+    static char const* getProfileName(Profile profile);
+    // Returns false if `name` is not the name of a profile.
+    static bool getProfileByName(std::string const& name, Profile& profile);
+
+    // Runs `profile` against `app`: creates nAccounts accounts for it, then
+    // submits nTxs transactions at txRate per second, 0 standing for the
+    // default rate of the profile. The time from the submission of each
+    // transaction to the close of the ledger including it goes to the
+    // loadgen.tx.latency timer.
+    void startProfile(Application& app, Profile profile, uint32_t nAccounts,
+                      uint32_t nTxs, uint32_t txRate, uint32_t seed);
+    bool isProfileRunning() const;
+
     // Primary store of accounts.
     std::vector<AccountInfoPtr> mAccounts;
 
@@ -63,6 +104,10 @@ class LoadGenerator
 
     bool maybeCreateAccount(uint32_t ledgerNum, std::vector<TxInfo>& txs);
 
+    // One step of the running profile; schedules the next one until all of
+    // its transactions are in a closed ledger or lost.
+    void generateProfileLoad(Application& app);
+
     std::vector<TxInfo> accountCreationTransactions(size_t n);
     AccountInfoPtr createAccount(size_t i, uint32_t ledgerNum = 0);
     std::vector<AccountInfoPtr> createAccounts(size_t n);
@@ -121,6 +166,9 @@ class LoadGenerator
         AccountInfoPtr mBuyCredit;
         AccountInfoPtr mSellCredit;
 
+        // Additional signers, all of which sign the account's payments.
+        std::vector<SecretKey> mSigners;
+
         TxInfo creationTransaction();
 
       private:
@@ -157,17 +205,34 @@ class LoadGenerator
         {
             TX_CREATE_ACCOUNT,
             TX_TRANSFER_NATIVE,
-            TX_TRANSFER_CREDIT
+            TX_TRANSFER_CREDIT,
+            // mFrom sells mAmount of mPath[0]'s asset for mPath[1]'s
+            TX_MANAGE_OFFER,
+            // mFrom adds its mSigners and requires all of them
+            TX_ADD_SIGNERS
         } mType;
         int64_t mAmount;
         std::vector<AccountInfoPtr> mPath;
+        Price mPrice;
 
-        bool execute(Application& app);
+        // Also returns the transactions submitted in `submitted`, if set.
+        bool execute(Application& app,
+                     std::vector<TransactionFramePtr>* submitted = nullptr);
 
         void toTransactionFrames(Hash const& networkID,
                                  std::vector<TransactionFramePtr>& txs,
                                  TxMetrics& metrics);
         void recordExecution(int64_t baseFee);
     };
+
+  private:
+    struct ProfileRun;
+    std::unique_ptr<ProfileRun> mProfileRun;
+
+    void scheduleProfileLoad(Application& app);
+    std::vector<TxInfo> profileSetupStage(Application& app, size_t stage);
+    TxInfo profileTransaction();
+    void submitProfileTransaction(Application& app, TxInfo& tx);
+    void observeProfileLedgers(Application& app);
 };
 }
@@ -10,13 +10,20 @@
 #include "main/test.h"
 #include "overlay/OverlayManager.h"
 #include "overlay/PeerRecord.h"
+#include "crypto/SecretKey.h"
+#include "lib/json/json.h"
+#include "util/GlobalChecks.h"
 #include "util/Logging.h"
 #include "util/Math.h"
+#include "util/make_unique.h"
 #include "util/types.h"
 
 #include "medida/medida.h"
 #include "medida/reporting/console_reporter.h"
+#include "medida/stats/snapshot.h"
 
+#include <algorithm>
+#include <exception>
 #include <thread>
 
 namespace stellar
@@ -29,10 +36,16 @@ Simulation::Simulation(Mode mode, Hash const& networkID,
     : LoadGenerator(networkID)
     , mClock(mode == OVER_TCP ? VirtualClock::REAL_TIME
                               : VirtualClock::VIRTUAL_TIME)
+    , mThreadCount(std::max(1u, std::thread::hardware_concurrency()))
     , mMode(mode)
     , mConfigCount(0)
     , mConfigGen(confGen)
 {
+    if (mMode == OVER_LOOPBACK_PARALLEL)
+    {
+        mLinkModel.mLatency = std::chrono::milliseconds(100);
+    }
+    mWindowEnd = mClock.now();
     mIdleApp = Application::create(mClock, newConfig());
 }
 
@@ -44,6 +57,13 @@ Simulation::~Simulation()
     mClock.getIOService().stop();
     while (mClock.cancelAllEvents())
         ;
+    for (auto& clock : mNodeClocks)
+    {
+        clock->getIOService().poll_one();
+        clock->getIOService().stop();
+        while (clock->cancelAllEvents())
+            ;
+    }
 }
 
 VirtualClock&
@@ -52,6 +72,34 @@ Simulation::getClock()
     return mClock;
 }
 
+void
+Simulation::setLinkModel(LoopbackPeer::LinkModel const& model)
+{
+    if (mMode == OVER_LOOPBACK_PARALLEL && model.mLatency.count() <= 0)
+    {
+        throw runtime_error("parallel simulation needs a link latency");
+    }
+    mLinkModel = model;
+}
+
+LoopbackPeer::LinkModel const&
+Simulation::getLinkModel() const
+{
+    return mLinkModel;
+}
+
+void
+Simulation::setThreadCount(size_t n)
+{
+    mThreadCount = std::max<size_t>(1, n);
+}
+
+bool
+Simulation::isLoopback() const
+{
+    return mMode == OVER_LOOPBACK || mMode == OVER_LOOPBACK_PARALLEL;
+}
+
 NodeID
 Simulation::addNode(SecretKey nodeKey, SCPQuorumSet qSet, VirtualClock& clock,
                     Config const* cfg2)
@@ -67,9 +115,17 @@ Simulation::addNode(SecretKey nodeKey, SCPQuorumSet qSet, VirtualClock& clock,
     }
     cfg->NODE_SEED = nodeKey;
     cfg->QUORUM_SET = qSet;
-    cfg->RUN_STANDALONE = (mMode == OVER_LOOPBACK);
+    cfg->RUN_STANDALONE = isLoopback();
 
-    Application::pointer result = Application::create(clock, *cfg);
+    VirtualClock* nodeClock = &clock;
+    if (mMode == OVER_LOOPBACK_PARALLEL)
+    {
+        mNodeClocks.emplace_back(
+            make_unique<VirtualClock>(VirtualClock::VIRTUAL_TIME));
+        nodeClock = mNodeClocks.back().get();
+        nodeClock->setCurrentTime(mWindowEnd);
+    }
+    Application::pointer result = Application::create(*nodeClock, *cfg);
 
     NodeID nodeID = nodeKey.getPublicKey();
     mConfigs[nodeID] = cfg;
@@ -110,7 +166,7 @@ Simulation::addPendingConnection(NodeID const& initiator,
 void
 Simulation::addConnection(NodeID initiator, NodeID acceptor)
 {
-    if (mMode == OVER_LOOPBACK)
+    if (isLoopback())
         addLoopbackConnection(initiator, acceptor);
     else
         addTCPConnection(initiator, acceptor);
@@ -123,6 +179,11 @@ Simulation::addLoopbackConnection(NodeID initiator, NodeID acceptor)
     {
         auto conn = std::make_shared<LoopbackPeerConnection>(
             *getNode(initiator), *getNode(acceptor));
+        for (auto const& peer : {conn->getInitiator(), conn->getAcceptor()})
+        {
+            peer->setLinkModel(mLinkModel);
+            peer->setDeferDelivery(mMode == OVER_LOOPBACK_PARALLEL);
+        }
         mLoopbackConnections.push_back(conn);
     }
 }
@@ -179,8 +240,111 @@ Simulation::crankAllNodes(int nbTicks)
         {
             return 0;
         }
-        count += mClock.crank(false);
+        if (mMode == OVER_LOOPBACK_PARALLEL)
+        {
+            count += crankWindow();
+        }
+        else
+        {
+            count += mClock.crank(false);
+        }
+    }
+    return count;
+}
+
+std::size_t
+Simulation::crankWindow()
+{
+    // Messages sent since the last window, including those caused by
+    // transactions injected from this thread, go to their destination first.
+    for (auto& conn : mLoopbackConnections)
+    {
+        conn->getInitiator()->flushOutbox();
+        conn->getAcceptor()->flushOutbox();
+    }
+
+    std::vector<VirtualClock*> running;
+    for (auto& clock : mNodeClocks)
+    {
+        if (!clock->getIOService().stopped())
+        {
+            running.push_back(clock.get());
+        }
+    }
+    if (running.empty())
+    {
+        return 0;
+    }
+
+    // Skip the time where nothing is scheduled; a node with only IO pending
+    // runs it at the start of the window.
+    auto start = mClock.next();
+    for (auto clock : running)
+    {
+        start = std::min(start, clock->next());
+    }
+    start = std::max(start, mWindowEnd);
+    if (start == VirtualClock::time_point::max())
+    {
+        start = mWindowEnd;
+    }
+    auto end =
+        start +
+        std::chrono::duration_cast<VirtualClock::duration>(mLinkModel.mLatency);
+
+    size_t nThreads = std::min(mThreadCount, running.size());
+    std::vector<size_t> counts(nThreads, 0);
+    std::vector<std::exception_ptr> errors(nThreads);
+    auto crankShare = [&](size_t t)
+    {
+        MainThreadScope scope;
+        try
+        {
+            for (size_t i = t; i < running.size(); i += nThreads)
+            {
+                auto clock = running[i];
+                if (clock->now() < start)
+                {
+                    clock->setCurrentTime(start);
+                }
+                counts[t] += clock->crankUpTo(end);
+            }
+        }
+        catch (...)
+        {
+            errors[t] = std::current_exception();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < nThreads; t++)
+    {
+        threads.emplace_back(crankShare, t);
+    }
+    crankShare(0);
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    for (auto const& e : errors)
+    {
+        if (e)
+        {
+            std::rethrow_exception(e);
+        }
+    }
+
+    size_t count = 0;
+    for (auto c : counts)
+    {
+        count += c;
+    }
+    if (mClock.now() < start)
+    {
+        mClock.setCurrentTime(start);
     }
+    count += mClock.crankUpTo(end);
+    mWindowEnd = end;
     return count;
 }
 
@@ -510,4 +674,47 @@ Simulation::metricsSummary(string domain)
     }
     return out.str();
 }
+
+void
+Simulation::reportConsensus(Json::Value& root)
+{
+    std::vector<double> latencies;
+    auto& nodes = root["nodes"];
+    nodes = Json::Value(Json::arrayValue);
+    for (auto const& kv : mNodes)
+    {
+        auto& metrics = kv.second->getMetrics();
+        auto& externalized =
+            metrics.NewTimer({"scp", "timing", "externalized"});
+        auto values = externalized.GetSnapshot().getValues();
+        latencies.insert(latencies.end(), values.begin(), values.end());
+
+        Json::Value node;
+        node["node"] = PubKeyUtils::toShortString(kv.first);
+        node["externalized"] = static_cast<Json::UInt64>(externalized.count());
+        node["messages_sent"] = static_cast<Json::UInt64>(
+            metrics.NewMeter({"overlay", "message", "write"}, "message")
+                .count());
+        node["messages_received"] = static_cast<Json::UInt64>(
+            metrics.NewMeter({"overlay", "message", "read"}, "message")
+                .count());
+        node["bytes_sent"] = static_cast<Json::UInt64>(
+            metrics.NewMeter({"overlay", "byte", "write"}, "byte").count());
+        node["bytes_received"] = static_cast<Json::UInt64>(
+            metrics.NewMeter({"overlay", "byte", "read"}, "byte").count());
+        nodes.append(node);
+    }
+
+    auto& latency = root["consensus_latency_ms"];
+    latency["count"] = static_cast<Json::UInt64>(latencies.size());
+    if (!latencies.empty())
+    {
+        medida::stats::Snapshot snap(latencies);
+        latency["min"] = *std::min_element(latencies.begin(), latencies.end());
+        latency["median"] = snap.getMedian();
+        latency["p75"] = snap.get75thPercentile();
+        latency["p99"] = snap.get99thPercentile();
+        latency["max"] = *std::max_element(latencies.begin(), latencies.end());
+    }
+}
 }
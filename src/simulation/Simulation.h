@@ -15,6 +15,7 @@
 #include "transactions/TxTests.h"
 #include "xdr/Stellar-types.h"
 #include "simulation/LoadGenerator.h"
+#include "lib/json/json-forwards.h"
 
 #define SIMULATION_CREATE_NODE(N)                                              \
     const Hash v##N##VSeed = sha256("NODE_SEED_" #N);                          \
@@ -32,7 +33,10 @@ class Simulation : public LoadGenerator
     enum Mode
     {
         OVER_TCP,
-        OVER_LOOPBACK
+        OVER_LOOPBACK,
+        // Loopback connections between nodes that each have a virtual clock
+        // of their own, cranked in parallel; see crankAllNodes.
+        OVER_LOOPBACK_PARALLEL
     };
 
     typedef std::shared_ptr<Simulation> pointer;
@@ -43,6 +47,18 @@ class Simulation : public LoadGenerator
 
     VirtualClock& getClock();
 
+    // Delay model of the loopback connections added from now on. In
+    // OVER_LOOPBACK_PARALLEL mode the latency must not be zero: it is the
+    // lookahead of the parallel scheduler.
+    void setLinkModel(LoopbackPeer::LinkModel const& model);
+    LoopbackPeer::LinkModel const& getLinkModel() const;
+
+    // Number of threads cranking nodes in OVER_LOOPBACK_PARALLEL mode,
+    // defaults to the number of cores.
+    void setThreadCount(size_t n);
+
+    // In OVER_LOOPBACK_PARALLEL mode, `clock` is ignored: every node gets a
+    // clock of its own.
     NodeID addNode(SecretKey nodeKey, SCPQuorumSet qSet, VirtualClock& clock,
                    Config const* cfg = nullptr);
     Application::pointer getNode(NodeID nodeID);
@@ -57,6 +73,12 @@ class Simulation : public LoadGenerator
     // triggers and exception if a node externalized higher than num+maxSpread
     bool haveAllExternalized(SequenceNumber num, uint32 maxSpread);
 
+    // In OVER_LOOPBACK_PARALLEL mode a tick is a window of virtual time as
+    // long as the link latency, starting at the earliest pending event of
+    // any clock. No message sent in a window can arrive before its end, so
+    // the nodes are cranked up to it independently, on worker threads;
+    // messages cross over between windows, and the simulation's own clock
+    // (timeouts, predicates) is cranked last.
     size_t crankAllNodes(int nbTicks = 1);
     void crankForAtMost(VirtualClock::duration seconds, bool finalCrank);
     void crankForAtLeast(VirtualClock::duration seconds, bool finalCrank);
@@ -77,13 +99,25 @@ class Simulation : public LoadGenerator
     bool loadAccount(AccountInfo& account);
     std::string metricsSummary(std::string domain = "");
 
+    // Distribution, over all nodes, of the time from triggering a ledger to
+    // externalizing it (in milliseconds), and the messages and bytes each
+    // node sent and received.
+    void reportConsensus(Json::Value& root);
+
     void addConnection(NodeID initiator, NodeID acceptor);
 
   private:
     void addLoopbackConnection(NodeID initiator, NodeID acceptor);
     void addTCPConnection(NodeID initiator, NodeID acception);
+    bool isLoopback() const;
+    size_t crankWindow();
 
     VirtualClock mClock;
+    // node clocks in OVER_LOOPBACK_PARALLEL mode, outliving the nodes
+    std::vector<std::unique_ptr<VirtualClock>> mNodeClocks;
+    VirtualClock::time_point mWindowEnd;
+    size_t mThreadCount;
+    LoopbackPeer::LinkModel mLinkModel;
     Mode mMode;
     int mConfigCount;
     Application::pointer mIdleApp;
@@ -5,6 +5,8 @@
 #include "main/Application.h"
 #include "util/Timer.h"
 #include "main/Config.h"
+#include "database/Database.h"
+#include "ledger/AccountFrame.h"
 #include "ledger/LedgerManager.h"
 #include "ledger/LedgerDelta.h"
 #include "herder/LedgerCloseData.h"
@@ -352,6 +354,9 @@ TEST_CASE("inflation", "[tx][inflation]")
 
                 doInflation(app, nbAccounts, balanceFunc, voteFunc,
                             expectedWinners);
+
+                // payouts kept the vote tally in line with the accounts
+                app.getLedgerManager().checkDbState();
             }
         };
 
@@ -467,3 +472,112 @@ TEST_CASE("inflation", "[tx][inflation]")
         }
     }
 }
+
+TEST_CASE("inflation votes tally", "[tx][inflation]")
+{
+    Config const& cfg = getTestConfig(0);
+    VirtualClock clock;
+    Application::pointer appPtr = Application::create(clock, cfg);
+    Application& app = *appPtr;
+    app.start();
+
+    auto& lm = app.getLedgerManager();
+    auto& db = app.getDatabase();
+    SecretKey root = getRoot(app.getNetworkID());
+    SequenceNumber rootSeq = getAccountSeqNum(root, app) + 1;
+    int64 const minVote = AccountFrame::kMinInflationVoteBalance;
+
+    SecretKey a = getTestAccount(0);
+    SecretKey b = getTestAccount(1);
+    SecretKey voter1 = getTestAccount(2);
+    SecretKey voter2 = getTestAccount(3);
+    for (auto k : {&a, &b, &voter1, &voter2})
+    {
+        applyCreateAccountTx(app, root, *k, rootSeq++, lm.getMinBalance(0));
+    }
+
+    auto votesFor = [&](SecretKey const& k)
+    {
+        auto tally = AccountFrame::loadInflationVotes(db);
+        auto it = tally.find(k.getPublicKey());
+        return it == tally.end() ? 0 : it->second;
+    };
+    auto store = [&](SecretKey const& k, int64 balance, SecretKey const* dest)
+    {
+        LedgerDelta delta(lm.getCurrentLedgerHeader(), db);
+        auto act = loadAccount(k, app);
+        act->getAccount().balance = balance;
+        if (dest)
+        {
+            act->getAccount().inflationDest.activate() = dest->getPublicKey();
+        }
+        else
+        {
+            act->getAccount().inflationDest.reset();
+        }
+        act->storeChange(delta, db);
+        delta.commit();
+        lm.checkDbState();
+    };
+
+    REQUIRE(AccountFrame::loadInflationVotes(db).empty());
+
+    store(voter1, 2 * minVote, &a);
+    store(voter2, 3 * minVote, &a);
+    CHECK(votesFor(a) == 5 * minVote);
+
+    // balance changes
+    store(voter2, 4 * minVote, &a);
+    CHECK(votesFor(a) == 6 * minVote);
+
+    // falling below the minimum balance withdraws the vote
+    store(voter1, minVote - 1, &a);
+    CHECK(votesFor(a) == 4 * minVote);
+    store(voter1, minVote, &a);
+    CHECK(votesFor(a) == 5 * minVote);
+
+    // changing destination moves the votes
+    store(voter1, minVote, &b);
+    CHECK(votesFor(a) == 4 * minVote);
+    CHECK(votesFor(b) == minVote);
+
+    // destinations without voters leave the tally
+    store(voter2, 4 * minVote, nullptr);
+    CHECK(AccountFrame::loadInflationVotes(db).size() == 1);
+
+    // winners come out best first
+    store(voter2, 2 * minVote, &a);
+    std::vector<AccountFrame::InflationVotes> winners;
+    AccountFrame::processForInflation(
+        [&](AccountFrame::InflationVotes const& v)
+        {
+            winners.push_back(v);
+            return true;
+        },
+        10, db);
+    REQUIRE(winners.size() == 2);
+    CHECK(winners[0].mInflationDest == a.getPublicKey());
+    CHECK(winners[0].mVotes == 2 * minVote);
+    CHECK(winners[1].mInflationDest == b.getPublicKey());
+
+    // merged accounts stop voting
+    {
+        LedgerDelta delta(lm.getCurrentLedgerHeader(), db);
+        loadAccount(voter1, app)->storeDelete(delta, db);
+        delta.commit();
+    }
+    CHECK(votesFor(b) == 0);
+    lm.checkDbState();
+
+    // a rolled back change leaves the tally as it was
+    {
+        LedgerDelta delta(lm.getCurrentLedgerHeader(), db);
+        soci::transaction sqlTx(db.getSession());
+        auto act = loadAccount(voter2, app);
+        act->getAccount().balance = 10 * minVote;
+        act->storeChange(delta, db);
+        CHECK(votesFor(a) == 10 * minVote);
+    }
+    CHECK(votesFor(a) == 2 * minVote);
+    lm.checkDbState();
+}
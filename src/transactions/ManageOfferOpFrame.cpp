@@ -283,7 +283,7 @@ ManageOfferOpFrame::doApply(medida::MetricsRegistry& metrics,
             if (wheat.type() == ASSET_TYPE_NATIVE)
             {
                 mSourceAccount->getAccount().balance += wheatReceived;
-                mSourceAccount->storeChange(delta, db);
+                mSourceAccount->storeChange(tempDelta, db);
             }
             else
             {
@@ -293,13 +293,13 @@ ManageOfferOpFrame::doApply(medida::MetricsRegistry& metrics,
                     throw std::runtime_error("offer claimed over limit");
                 }
 
-                mWheatLineA->storeChange(delta, db);
+                mWheatLineA->storeChange(tempDelta, db);
             }
 
             if (sheep.type() == ASSET_TYPE_NATIVE)
             {
                 mSourceAccount->getAccount().balance -= sheepSent;
-                mSourceAccount->storeChange(delta, db);
+                mSourceAccount->storeChange(tempDelta, db);
             }
             else
             {
@@ -308,7 +308,7 @@ ManageOfferOpFrame::doApply(medida::MetricsRegistry& metrics,
                     // this would indicate a bug in OfferExchange
                     throw std::runtime_error("offer sold more than balance");
                 }
-                mSheepLineA->storeChange(delta, db);
+                mSheepLineA->storeChange(tempDelta, db);
             }
         }
 
@@ -21,6 +21,7 @@
 #include "transactions/PaymentOpFrame.h"
 #include "transactions/SetOptionsOpFrame.h"
 #include "database/Database.h"
+#include "util/MetricsFacade.h"
 
 #include "medida/meter.h"
 #include "medida/metrics_registry.h"
@@ -29,6 +30,24 @@ namespace stellar
 {
 
 using namespace std;
+using xdr::operator==;
+
+namespace
+{
+struct OperationMetrics
+{
+    MeterHandle& mNoAccount;
+    MeterHandle& mBadAuth;
+
+    explicit OperationMetrics(MetricsFacade& m)
+        : mNoAccount(
+              m.newMeter({"operation", "invalid", "no-account"}, "operation"))
+        , mBadAuth(
+              m.newMeter({"operation", "invalid", "bad-auth"}, "operation"))
+    {
+    }
+};
+}
 
 shared_ptr<OperationFrame>
 OperationFrame::makeHelper(Operation const& op, OperationResult& res,
@@ -66,6 +85,106 @@ OperationFrame::makeHelper(Operation const& op, OperationResult& res,
     }
 }
 
+void
+LedgerFootprint::addAccount(AccountID const& id, bool write)
+{
+    LedgerKey k;
+    k.type(ACCOUNT);
+    k.account().accountID = id;
+    (write ? mWrites : mReads).push_back(k);
+}
+
+void
+LedgerFootprint::addTrustLine(AccountID const& id, Asset const& asset)
+{
+    if (asset.type() == ASSET_TYPE_NATIVE)
+    {
+        addAccount(id);
+        return;
+    }
+    auto issuer = getIssuer(asset);
+    addAccount(issuer, false);
+    if (!(issuer == id))
+    {
+        LedgerKey k;
+        k.type(TRUSTLINE);
+        k.trustLine().accountID = id;
+        k.trustLine().asset = asset;
+        mWrites.push_back(k);
+    }
+}
+
+void
+OperationFrame::addFootprint(Operation const& op, AccountID const& txSourceID,
+                             LedgerFootprint& fp)
+{
+    AccountID const& source =
+        op.sourceAccount ? *op.sourceAccount : txSourceID;
+    fp.addAccount(source);
+
+    switch (op.body.type())
+    {
+    case CREATE_ACCOUNT:
+        fp.addAccount(op.body.createAccountOp().destination);
+        break;
+    case PAYMENT:
+    {
+        auto const& payment = op.body.paymentOp();
+        fp.addAccount(payment.destination);
+        fp.addTrustLine(source, payment.asset);
+        fp.addTrustLine(payment.destination, payment.asset);
+        break;
+    }
+    case PATH_PAYMENT:
+    {
+        auto const& payment = op.body.pathPaymentOp();
+        fp.addAccount(payment.destination);
+        fp.addTrustLine(source, payment.sendAsset);
+        fp.addTrustLine(payment.destination, payment.destAsset);
+        if (!payment.path.empty() ||
+            !compareAsset(payment.sendAsset, payment.destAsset))
+        {
+            fp.mGlobal = true;
+        }
+        break;
+    }
+    case SET_OPTIONS:
+        if (op.body.setOptionsOp().inflationDest)
+        {
+            fp.addAccount(*op.body.setOptionsOp().inflationDest, false);
+        }
+        break;
+    case CHANGE_TRUST:
+        fp.addTrustLine(source, op.body.changeTrustOp().line);
+        break;
+    case ALLOW_TRUST:
+    {
+        auto const& allow = op.body.allowTrustOp();
+        Asset ci;
+        ci.type(allow.asset.type());
+        if (allow.asset.type() == ASSET_TYPE_CREDIT_ALPHANUM4)
+        {
+            ci.alphaNum4().assetCode = allow.asset.assetCode4();
+            ci.alphaNum4().issuer = source;
+        }
+        else if (allow.asset.type() == ASSET_TYPE_CREDIT_ALPHANUM12)
+        {
+            ci.alphaNum12().assetCode = allow.asset.assetCode12();
+            ci.alphaNum12().issuer = source;
+        }
+        fp.addTrustLine(allow.trustor, ci);
+        break;
+    }
+    case ACCOUNT_MERGE:
+        fp.addAccount(op.body.destination());
+        break;
+    default:
+        // offers, inflation and anything unknown
+        fp.mGlobal = true;
+        break;
+    }
+}
+
 OperationFrame::OperationFrame(Operation const& op, OperationResult& res,
                                TransactionFrame& parentTx)
     : mOperation(op), mParentTx(parentTx), mResult(res)
@@ -128,9 +247,7 @@ OperationFrame::checkValid(Application& app, bool forApply)
     {
         if (forApply || !mOperation.sourceAccount)
         {
-            app.getMetrics()
-                .NewMeter({"operation", "invalid", "no-account"}, "operation")
-                .Mark();
+            app.getMetricsFacade().handles<OperationMetrics>().mNoAccount.mark();
             mResult.code(opNO_ACCOUNT);
             return false;
         }
@@ -143,9 +260,7 @@ OperationFrame::checkValid(Application& app, bool forApply)
 
     if (!checkSignature())
     {
-        app.getMetrics()
-            .NewMeter({"operation", "invalid", "bad-auth"}, "operation")
-            .Mark();
+        app.getMetricsFacade().handles<OperationMetrics>().mBadAuth.mark();
         mResult.code(opBAD_AUTH);
         return false;
     }
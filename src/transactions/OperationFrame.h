@@ -23,6 +23,22 @@ class LedgerDelta;
 
 class TransactionFrame;
 
+// The ledger entries applying some operations may touch, as far as that can
+// be told from the operations themselves. See TxSetFrame::partitionForApply.
+struct LedgerFootprint
+{
+    std::vector<LedgerKey> mReads;
+    std::vector<LedgerKey> mWrites;
+    // set when the entries touched cannot be bounded statically: crossing
+    // offers modifies the accounts and trust lines of whoever placed them,
+    // and inflation pays out to any account
+    bool mGlobal{false};
+
+    void addAccount(AccountID const& id, bool write = true);
+    // the trust line of `id` and, for reading, the account of the issuer
+    void addTrustLine(AccountID const& id, Asset const& asset);
+};
+
 class OperationFrame
 {
   protected:
@@ -43,6 +59,11 @@ class OperationFrame
     makeHelper(Operation const& op, OperationResult& res,
                TransactionFrame& parentTx);
 
+    // adds the entries `op` may touch to `fp`; txSourceID is the source
+    // account of the transaction containing it
+    static void addFootprint(Operation const& op, AccountID const& txSourceID,
+                             LedgerFootprint& fp);
+
     OperationFrame(Operation const& op, OperationResult& res,
                    TransactionFrame& parentTx);
     OperationFrame(OperationFrame const&) = delete;
@@ -7,6 +7,7 @@
 #include "OperationFrame.h"
 #include "main/Application.h"
 #include "xdrpp/marshal.h"
+#include <algorithm>
 #include <string>
 #include "util/Logging.h"
 #include "util/XDRStream.h"
@@ -17,9 +18,7 @@
 #include "herder/TxSetFrame.h"
 #include "crypto/Hex.h"
 #include "util/basen.h"
-
-#include "medida/meter.h"
-#include "medida/metrics_registry.h"
+#include "util/MetricsFacade.h"
 
 namespace stellar
 {
@@ -27,6 +26,48 @@ namespace stellar
 using namespace std;
 using xdr::operator==;
 
+namespace
+{
+// rejections are marked for every invalid transaction flooded to us, and the
+// op timer runs for every operation applied
+struct TransactionMetrics
+{
+    MeterHandle& mMissingOperation;
+    MeterHandle& mTooEarly;
+    MeterHandle& mTooLate;
+    MeterHandle& mInsufficientFee;
+    MeterHandle& mNoAccount;
+    MeterHandle& mBadSeq;
+    MeterHandle& mBadAuth;
+    MeterHandle& mInvalidOp;
+    MeterHandle& mBadAuthExtra;
+    SampledTimer& mOpApply;
+
+    explicit TransactionMetrics(MetricsFacade& m)
+        : mMissingOperation(m.newMeter(
+              {"transaction", "invalid", "missing-operation"}, "transaction"))
+        , mTooEarly(
+              m.newMeter({"transaction", "invalid", "too-early"}, "transaction"))
+        , mTooLate(
+              m.newMeter({"transaction", "invalid", "too-late"}, "transaction"))
+        , mInsufficientFee(m.newMeter(
+              {"transaction", "invalid", "insufficient-fee"}, "transaction"))
+        , mNoAccount(m.newMeter({"transaction", "invalid", "no-account"},
+                                "transaction"))
+        , mBadSeq(
+              m.newMeter({"transaction", "invalid", "bad-seq"}, "transaction"))
+        , mBadAuth(
+              m.newMeter({"transaction", "invalid", "bad-auth"}, "transaction"))
+        , mInvalidOp(m.newMeter({"transaction", "invalid", "invalid-op"},
+                                "transaction"))
+        , mBadAuthExtra(m.newMeter(
+              {"transaction", "invalid", "bad-auth-extra"}, "transaction"))
+        , mOpApply(m.newSampledTimer({"transaction", "op", "apply"}))
+    {
+    }
+};
+}
+
 TransactionFramePtr
 TransactionFrame::makeTransactionFromWire(Hash const& networkID,
                                           TransactionEnvelope const& msg)
@@ -166,6 +207,31 @@ TransactionFrame::checkSignature(AccountFrame& account, int32_t neededWeight)
     return false;
 }
 
+void
+TransactionFrame::collectSignatures(
+    AccountFrame const& account, std::vector<PubKeyUtils::SigVerifyItem>& items)
+{
+    auto const& acc = account.getAccount();
+    Hash const& contentsHash = getContentsHash();
+
+    for (auto const& sig : getEnvelope().signatures)
+    {
+        if (acc.thresholds[0] &&
+            PubKeyUtils::hasHint(account.getID(), sig.hint))
+        {
+            items.emplace_back(account.getID(), sig.signature, contentsHash);
+        }
+        for (auto const& signer : acc.signers)
+        {
+            if (PubKeyUtils::hasHint(signer.pubKey, sig.hint))
+            {
+                items.emplace_back(signer.pubKey, sig.signature,
+                                   contentsHash);
+            }
+        }
+    }
+}
+
 AccountFrame::pointer
 TransactionFrame::loadAccount(Database& db, AccountID const& accountID)
 {
@@ -216,12 +282,10 @@ bool
 TransactionFrame::commonValid(Application& app, bool applying,
                               SequenceNumber current)
 {
+    auto& metrics = app.getMetricsFacade().handles<TransactionMetrics>();
     if (mOperations.size() == 0)
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "missing-operation"},
-                      "transaction")
-            .Mark();
+        metrics.mMissingOperation.mark();
         getResult().result.code(txMISSING_OPERATION);
         return false;
     }
@@ -232,19 +296,14 @@ TransactionFrame::commonValid(Application& app, bool applying,
         uint64 closeTime = lm.getCurrentLedgerHeader().scpValue.closeTime;
         if (mEnvelope.tx.timeBounds->minTime > closeTime)
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "too-early"},
-                          "transaction")
-                .Mark();
+            metrics.mTooEarly.mark();
             getResult().result.code(txTOO_EARLY);
             return false;
         }
         if (mEnvelope.tx.timeBounds->maxTime &&
             (mEnvelope.tx.timeBounds->maxTime < closeTime))
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "too-late"}, "transaction")
-                .Mark();
+            metrics.mTooLate.mark();
             getResult().result.code(txTOO_LATE);
             return false;
         }
@@ -252,19 +311,14 @@ TransactionFrame::commonValid(Application& app, bool applying,
 
     if (mEnvelope.tx.fee < getMinFee(lm))
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "insufficient-fee"},
-                      "transaction")
-            .Mark();
+        metrics.mInsufficientFee.mark();
         getResult().result.code(txINSUFFICIENT_FEE);
         return false;
     }
 
     if (!loadAccount(app.getDatabase()))
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "no-account"}, "transaction")
-            .Mark();
+        metrics.mNoAccount.mark();
         getResult().result.code(txNO_ACCOUNT);
         return false;
     }
@@ -279,9 +333,7 @@ TransactionFrame::commonValid(Application& app, bool applying,
 
         if (current + 1 != mEnvelope.tx.seqNum)
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "bad-seq"}, "transaction")
-                .Mark();
+            metrics.mBadSeq.mark();
             getResult().result.code(txBAD_SEQ);
             return false;
         }
@@ -289,9 +341,7 @@ TransactionFrame::commonValid(Application& app, bool applying,
 
     if (!checkSignature(*mSigningAccount, mSigningAccount->getLowThreshold()))
     {
-        app.getMetrics()
-            .NewMeter({"transaction", "invalid", "bad-auth"}, "transaction")
-            .Mark();
+        metrics.mBadAuth.mark();
         getResult().result.code(txBAD_AUTH);
         return false;
     }
@@ -310,10 +360,7 @@ TransactionFrame::commonValid(Application& app, bool applying,
                 // it's OK to just fast fail here and not try to call
                 // checkValid on all operations as the resulting object
                 // is only used by applications
-                app.getMetrics()
-                    .NewMeter({"transaction", "invalid", "invalid-op"},
-                              "transaction")
-                    .Mark();
+                metrics.mInvalidOp.mark();
                 markResultFailed();
                 return false;
             }
@@ -321,10 +368,7 @@ TransactionFrame::commonValid(Application& app, bool applying,
         auto b = checkAllSignaturesUsed();
         if (!b)
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "bad-auth-extra"},
-                          "transaction")
-                .Mark();
+            metrics.mBadAuthExtra.mark();
         }
         return b;
     }
@@ -400,6 +444,7 @@ TransactionFrame::checkValid(Application& app, SequenceNumber current)
     bool res = commonValid(app, false, current);
     if (res)
     {
+        auto& metrics = app.getMetricsFacade().handles<TransactionMetrics>();
         for (auto& op : mOperations)
         {
             if (!op->checkValid(app))
@@ -407,10 +452,7 @@ TransactionFrame::checkValid(Application& app, SequenceNumber current)
                 // it's OK to just fast fail here and not try to call
                 // checkValid on all operations as the resulting object
                 // is only used by applications
-                app.getMetrics()
-                    .NewMeter({"transaction", "invalid", "invalid-op"},
-                              "transaction")
-                    .Mark();
+                metrics.mInvalidOp.mark();
                 markResultFailed();
                 return false;
             }
@@ -418,15 +460,24 @@ TransactionFrame::checkValid(Application& app, SequenceNumber current)
         res = checkAllSignaturesUsed();
         if (!res)
         {
-            app.getMetrics()
-                .NewMeter({"transaction", "invalid", "bad-auth-extra"},
-                          "transaction")
-                .Mark();
+            metrics.mBadAuthExtra.mark();
         }
     }
     return res;
 }
 
+LedgerFootprint
+TransactionFrame::getFootprint() const
+{
+    LedgerFootprint fp;
+    fp.addAccount(getSourceID());
+    for (auto const& op : mEnvelope.tx.operations)
+    {
+        OperationFrame::addFootprint(op, getSourceID(), fp);
+    }
+    return fp;
+}
+
 void
 TransactionFrame::markResultFailed()
 {
@@ -466,7 +517,7 @@ TransactionFrame::apply(LedgerDelta& delta, TransactionMeta& meta,
         LedgerDelta thisTxDelta(delta);
 
         auto& opTimer =
-            app.getMetrics().NewTimer({"transaction", "op", "apply"});
+            app.getMetricsFacade().handles<TransactionMetrics>().mOpApply;
 
         for (auto& op : mOperations)
         {
@@ -538,10 +589,11 @@ TransactionFrame::storeTransaction(LedgerManager& ledgerManager,
     string txIDString(binToHex(getContentsHash()));
 
     auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
+    static StatementID const insertStmt = Database::registerStatement(
         "INSERT INTO txhistory "
         "( txid, ledgerseq, txindex,  txbody, txresult, txmeta) VALUES "
         "(:id,  :seq,      :txindex, :txb,   :txres,   :meta)");
+    auto prep = db.getPreparedStatement(insertStmt);
 
     auto& st = prep.statement();
     st.exchange(soci::use(txIDString));
@@ -575,10 +627,11 @@ TransactionFrame::storeTransactionFee(LedgerManager& ledgerManager,
     string txIDString(binToHex(getContentsHash()));
 
     auto& db = ledgerManager.getDatabase();
-    auto prep = db.getPreparedStatement(
+    static StatementID const insertFeeStmt = Database::registerStatement(
         "INSERT INTO txfeehistory "
         "( txid, ledgerseq, txindex,  txchanges) VALUES "
         "(:id,  :seq,      :txindex, :txchanges)");
+    auto prep = db.getPreparedStatement(insertFeeStmt);
 
     auto& st = prep.statement();
     st.exchange(soci::use(txIDString));
@@ -597,29 +650,6 @@ TransactionFrame::storeTransactionFee(LedgerManager& ledgerManager,
     }
 }
 
-static void
-saveTransactionHelper(Database& db, soci::session& sess, uint32 ledgerSeq,
-                      TxSetFrame& txSet, TransactionHistoryResultEntry& results,
-                      XDROutputFileStream& txOut,
-                      XDROutputFileStream& txResultOut)
-{
-    // prepare the txset for saving
-    LedgerHeaderFrame::pointer lh =
-        LedgerHeaderFrame::loadBySequence(ledgerSeq, db, sess);
-    if (!lh)
-    {
-        throw std::runtime_error("Could not find ledger");
-    }
-    txSet.previousLedgerHash() = lh->mHeader.previousLedgerHash;
-    txSet.sortForHash();
-    TransactionHistoryEntry hist;
-    hist.ledgerSeq = ledgerSeq;
-    txSet.toXDR(hist.txSet);
-    txOut.writeOne(hist);
-
-    txResultOut.writeOne(results);
-}
-
 TransactionResultSet
 TransactionFrame::getTransactionHistoryMeta(Database& db, uint32 ledgerSeq)
 {
@@ -678,83 +708,149 @@ TransactionFrame::getTransactionFeeMeta(Database& db, uint32 ledgerSeq)
     return res;
 }
 
+namespace
+{
+// Number of ledgers whose transactions copyHistoryToStreams asks for at a
+// time, as some backends hold the whole result of a query in memory.
+uint32_t const kHistoryLedgersPerQuery = 8;
+
+// Decodes `in` into `out`, through `buf`, whose storage is reused from one
+// call to the next.
+template <typename T>
+void
+decodeFromBase64(std::string const& in, std::vector<uint8_t>& buf, T& out)
+{
+    bn::decode_b64(in, buf);
+    xdr::xdr_get g(buf.data(), buf.data() + buf.size());
+    xdr::xdr_argpack_archive(g, out);
+    g.done();
+}
+}
+
 size_t
-TransactionFrame::copyTransactionsToStream(Hash const& networkID, Database& db,
-                                           soci::session& sess,
-                                           uint32_t ledgerSeq,
-                                           uint32_t ledgerCount,
-                                           XDROutputFileStream& txOut,
-                                           XDROutputFileStream& txResultOut)
+TransactionFrame::copyHistoryToStreams(
+    Hash const& networkID, Database& db, soci::session& sess,
+    uint32_t ledgerSeq, uint32_t ledgerCount, XDROutputFileStream& headersOut,
+    XDROutputFileStream& txOut, XDROutputFileStream& txResultOut,
+    size_t& nHeaders)
 {
     auto timer = db.getSelectTimer("txhistory");
-    std::string txBody, txResult, txMeta;
     uint32_t begin = ledgerSeq, end = ledgerSeq + ledgerCount;
-    size_t n = 0;
-
-    TransactionEnvelope tx;
-    uint32_t curLedgerSeq;
-
     assert(begin <= end);
-    soci::statement st =
+
+    uint32_t headerSeq;
+    std::string header64;
+    soci::statement headers =
+        (sess.prepare << "SELECT ledgerseq, data FROM ledgerheaders "
+                         "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
+                         "BY ledgerseq ASC",
+         soci::into(headerSeq), soci::into(header64), soci::use(begin),
+         soci::use(end));
+
+    uint32_t txSeq;
+    std::string body64, result64;
+    uint32_t windowBegin = begin, windowEnd = begin;
+    soci::statement txs =
         (sess.prepare << "SELECT ledgerseq, txbody, txresult FROM txhistory "
                          "WHERE ledgerseq >= :begin AND ledgerseq < :end ORDER "
                          "BY ledgerseq ASC, txindex ASC",
-         soci::into(curLedgerSeq), soci::into(txBody), soci::into(txResult),
-         soci::use(begin), soci::use(end));
+         soci::into(txSeq), soci::into(body64), soci::into(result64),
+         soci::use(windowBegin), soci::use(windowEnd));
 
-    Hash h;
-    TxSetFrame txSet(h); // we're setting the hash later
-    TransactionHistoryResultEntry results;
-
-    st.execute(true);
-
-    uint32_t lastLedgerSeq = curLedgerSeq;
-    results.ledgerSeq = curLedgerSeq;
-
-    while (st.got_data())
+    // moves to the next transaction row, running the query over the next
+    // window of ledgers when the current one is exhausted
+    bool haveTx = false;
+    auto nextTx = [&]()
     {
-        if (curLedgerSeq != lastLedgerSeq)
+        haveTx = haveTx && txs.fetch();
+        while (!haveTx && windowEnd < end)
         {
-            saveTransactionHelper(db, sess, lastLedgerSeq, txSet, results,
-                                  txOut, txResultOut);
-            // reset state
-            txSet.mTransactions.clear();
-            results.ledgerSeq = curLedgerSeq;
-            results.txResultSet.results.clear();
-            lastLedgerSeq = curLedgerSeq;
+            windowBegin = windowEnd;
+            windowEnd = std::min(end, windowBegin + kHistoryLedgersPerQuery);
+            haveTx = txs.execute(true);
         }
+    };
 
-        std::vector<uint8_t> body;
-        bn::decode_b64(txBody, body);
-
-        std::vector<uint8_t> result;
-        bn::decode_b64(txResult, result);
-
-        xdr::xdr_get g1(&body.front(), &body.back() + 1);
-        xdr_argpack_archive(g1, tx);
+    // all reused from one ledger to the next
+    std::vector<uint8_t> buf;
+    LedgerHeaderHistoryEntry lhe;
+    TransactionHistoryEntry hist;
+    TransactionHistoryResultEntry results;
+    auto& envs = hist.txSet.txs;
+    decltype(hist.txSet.txs) sorted;
+    std::vector<std::pair<Hash, size_t>> order;
 
-        TransactionFramePtr txFrame =
-            make_shared<TransactionFrame>(networkID, tx);
-        txSet.add(txFrame);
+    size_t n = 0;
+    nHeaders = 0;
+    nextTx();
+    headers.execute(true);
+    while (headers.got_data())
+    {
+        decodeFromBase64(header64, buf, lhe.header);
+        lhe.hash = sha256(buf);
+        if (lhe.header.ledgerSeq != headerSeq)
+        {
+            throw std::runtime_error(
+                "Wrong sequence number in ledger header database: ledger " +
+                std::to_string(headerSeq) + " contains " +
+                std::to_string(lhe.header.ledgerSeq));
+        }
+        CLOG(DEBUG, "Ledger") << "Streaming ledger-header " << headerSeq;
+        headersOut.writeOne(lhe);
+        ++nHeaders;
 
-        xdr::xdr_get g2(&result.front(), &result.back() + 1);
-        results.txResultSet.results.emplace_back();
+        if (haveTx && txSeq < headerSeq)
+        {
+            throw std::runtime_error("Could not find ledger " +
+                                     std::to_string(txSeq));
+        }
 
-        TransactionResultPair& p = results.txResultSet.results.back();
-        xdr_argpack_archive(g2, p);
+        envs.clear();
+        results.txResultSet.results.clear();
+        order.clear();
+        for (; haveTx && txSeq == headerSeq; nextTx())
+        {
+            envs.emplace_back();
+            decodeFromBase64(body64, buf, envs.back());
+            // the hash of the whole envelope, which orders the set
+            order.emplace_back(sha256(buf), order.size());
+
+            results.txResultSet.results.emplace_back();
+            TransactionResultPair& p = results.txResultSet.results.back();
+            decodeFromBase64(result64, buf, p);
+            if (p.transactionHash !=
+                sha256(xdr::xdr_to_opaque(networkID, ENVELOPE_TYPE_TX,
+                                          envs.back().tx)))
+            {
+                throw std::runtime_error("transaction mismatch");
+            }
+        }
 
-        if (p.transactionHash != txFrame->getContentsHash())
+        if (!envs.empty())
         {
-            throw std::runtime_error("transaction mismatch");
+            // same order as TxSetFrame::sortForHash
+            std::sort(order.begin(), order.end());
+            sorted.clear();
+            for (auto const& o : order)
+            {
+                sorted.emplace_back(std::move(envs[o.second]));
+            }
+            envs.swap(sorted);
+
+            hist.ledgerSeq = headerSeq;
+            hist.txSet.previousLedgerHash = lhe.header.previousLedgerHash;
+            txOut.writeOne(hist);
+            results.ledgerSeq = headerSeq;
+            txResultOut.writeOne(results);
+            n += envs.size();
         }
 
-        ++n;
-        st.fetch();
+        headers.fetch();
     }
-    if (n != 0)
+    if (haveTx)
     {
-        saveTransactionHelper(db, sess, lastLedgerSeq, txSet, results, txOut,
-                              txResultOut);
+        throw std::runtime_error("Could not find ledger " +
+                                 std::to_string(txSeq));
     }
     return n;
 }
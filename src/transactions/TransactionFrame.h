@@ -7,6 +7,8 @@
 #include <memory>
 #include "ledger/LedgerManager.h"
 #include "ledger/AccountFrame.h"
+#include "transactions/OperationFrame.h"
+#include "crypto/SecretKey.h"
 #include "overlay/StellarXDR.h"
 #include "util/types.h"
 
@@ -133,8 +135,17 @@ class TransactionFrame
 
     bool checkSignature(AccountFrame& account, int32_t neededWeight);
 
+    // appends every (signer, signature) pair of `account` that
+    // checkSignature could verify, for use with PubKeyUtils::verifySigBatch
+    void collectSignatures(AccountFrame const& account,
+                           std::vector<PubKeyUtils::SigVerifyItem>& items);
+
     bool checkValid(Application& app, SequenceNumber current);
 
+    // the ledger entries applying this transaction may touch, derived from
+    // the envelope alone
+    LedgerFootprint getFootprint() const;
+
     // collect fee, consume sequence number
     void processFeeSeqNum(LedgerDelta& delta, LedgerManager& ledgerManager);
 
@@ -165,16 +176,19 @@ class TransactionFrame
     static std::vector<LedgerEntryChanges>
     getTransactionFeeMeta(Database& db, uint32 ledgerSeq);
 
-    /*
-    txOut: stream of TransactionHistoryEntry
-    txResultOut: stream of TransactionHistoryResultEntry
-    */
-    static size_t copyTransactionsToStream(Hash const& networkID, Database& db,
-                                           soci::session& sess,
-                                           uint32_t ledgerSeq,
-                                           uint32_t ledgerCount,
-                                           XDROutputFileStream& txOut,
-                                           XDROutputFileStream& txResultOut);
+    // Writes the history of the `ledgerCount` ledgers from `ledgerSeq` in a
+    // single pass over the database, with memory bounded by the size of the
+    // largest ledger:
+    // headersOut: stream of LedgerHeaderHistoryEntry, their number is
+    //   returned in nHeaders
+    // txOut: stream of TransactionHistoryEntry
+    // txResultOut: stream of TransactionHistoryResultEntry
+    // returns the number of transactions written
+    static size_t copyHistoryToStreams(
+        Hash const& networkID, Database& db, soci::session& sess,
+        uint32_t ledgerSeq, uint32_t ledgerCount,
+        XDROutputFileStream& headersOut, XDROutputFileStream& txOut,
+        XDROutputFileStream& txResultOut, size_t& nHeaders);
     static void dropAll(Database& db);
 
     static void deleteOldEntries(Database& db, uint32_t ledgerSeq);
@@ -0,0 +1,246 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/CrankStats.h"
+#include "lib/json/json.h"
+#include "util/Logging.h"
+#include "util/make_unique.h"
+#include "medida/histogram.h"
+#include "medida/stats/snapshot.h"
+#include <algorithm>
+#include <cassert>
+#include <sstream>
+
+namespace stellar
+{
+
+static double
+toMs(std::chrono::nanoseconds d)
+{
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+char const*
+CrankStats::originName(Origin origin)
+{
+    switch (origin)
+    {
+    case ORIGIN_TIMER:
+        return "timer";
+    case ORIGIN_OVERLAY:
+        return "overlay";
+    case ORIGIN_HERDER:
+        return "herder";
+    case ORIGIN_LEDGER:
+        return "ledger";
+    case ORIGIN_HISTORY:
+        return "history";
+    case ORIGIN_DATABASE:
+        return "database";
+    case ORIGIN_HTTP:
+        return "http";
+    default:
+        return "other";
+    }
+}
+
+CrankStats::CrankStats() : mStallThreshold(std::chrono::seconds(1))
+{
+    for (auto& s : mStats)
+    {
+        s.mTimes = make_unique<medida::Histogram>();
+    }
+    clearSlices();
+}
+
+CrankStats::~CrankStats()
+{
+}
+
+void
+CrankStats::setStallThreshold(std::chrono::milliseconds threshold)
+{
+    mStallThreshold = threshold;
+}
+
+void
+CrankStats::clearSlices()
+{
+    for (auto& s : mSlices)
+    {
+        s = std::chrono::nanoseconds(0);
+    }
+}
+
+void
+CrankStats::chargeSlice(clock::time_point now)
+{
+    mSlices[mOrigins.back()] += now - mSliceStart;
+    mSliceStart = now;
+}
+
+void
+CrankStats::beginHandler(Origin origin)
+{
+    if (inHandler())
+    {
+        // a handler that threw out of VirtualClock::crank never ended;
+        // forget about it
+        mOrigins.clear();
+        clearSlices();
+    }
+    mOrigins.push_back(origin);
+    mHandlerStart = mSliceStart = clock::now();
+}
+
+void
+CrankStats::endHandler(bool ran)
+{
+    assert(mOrigins.size() == 1);
+    auto now = clock::now();
+    chargeSlice(now);
+    mOrigins.clear();
+
+    if (!ran)
+    {
+        clearSlices();
+        return;
+    }
+
+    ++mHandlerCount;
+    auto total = now - mHandlerStart;
+    for (size_t i = 0; i < ORIGIN_COUNT; ++i)
+    {
+        auto t = mSlices[i];
+        if (t.count() != 0)
+        {
+            auto& s = mStats[i];
+            s.mTimes->Update(
+                std::chrono::duration_cast<std::chrono::microseconds>(t)
+                    .count());
+            s.mTotal += t;
+            s.mMax = std::max(s.mMax, t);
+        }
+    }
+
+    if (mStallThreshold.count() != 0 && total >= mStallThreshold)
+    {
+        ++mStallCount;
+        std::ostringstream breakdown;
+        std::vector<size_t> order;
+        for (size_t i = 0; i < ORIGIN_COUNT; ++i)
+        {
+            if (mSlices[i].count() != 0)
+            {
+                order.push_back(i);
+            }
+        }
+        std::sort(order.begin(), order.end(), [this](size_t a, size_t b)
+                  {
+                      return mSlices[a] > mSlices[b];
+                  });
+        for (auto i : order)
+        {
+            breakdown << " " << originName(static_cast<Origin>(i)) << "="
+                      << toMs(mSlices[i]) << "ms";
+        }
+        LOG(WARNING) << "Main thread stalled for " << toMs(total)
+                     << "ms in one handler:" << breakdown.str();
+    }
+
+    clearSlices();
+}
+
+void
+CrankStats::pushOrigin(Origin origin)
+{
+    assert(inHandler());
+    chargeSlice(clock::now());
+    mOrigins.push_back(origin);
+}
+
+void
+CrankStats::popOrigin()
+{
+    assert(mOrigins.size() > 1);
+    chargeSlice(clock::now());
+    mOrigins.pop_back();
+}
+
+uint64_t
+CrankStats::getHandlerCount() const
+{
+    return mHandlerCount;
+}
+
+uint64_t
+CrankStats::getStallCount() const
+{
+    return mStallCount;
+}
+
+void
+CrankStats::report(Json::Value& root) const
+{
+    root["handlers"] = static_cast<Json::UInt64>(mHandlerCount);
+    root["stalls"] = static_cast<Json::UInt64>(mStallCount);
+    root["stall_threshold_ms"] = toMs(mStallThreshold);
+    auto& origins = root["origins"];
+    origins = Json::Value(Json::objectValue);
+    for (size_t i = 0; i < ORIGIN_COUNT; ++i)
+    {
+        auto const& s = mStats[i];
+        if (s.mTimes->count() == 0)
+        {
+            continue;
+        }
+        auto snap = s.mTimes->GetSnapshot();
+        auto& o = origins[originName(static_cast<Origin>(i))];
+        o["count"] = static_cast<Json::UInt64>(s.mTimes->count());
+        o["total_ms"] = toMs(s.mTotal);
+        o["max_ms"] = toMs(s.mMax);
+        o["mean_ms"] = s.mTimes->mean() / 1000.0;
+        o["median_ms"] = snap.getMedian() / 1000.0;
+        o["p99_ms"] = snap.get99thPercentile() / 1000.0;
+    }
+}
+
+void
+CrankStats::reset()
+{
+    for (auto& s : mStats)
+    {
+        s.mTimes->Clear();
+        s.mTotal = std::chrono::nanoseconds(0);
+        s.mMax = std::chrono::nanoseconds(0);
+    }
+    mHandlerCount = 0;
+    mStallCount = 0;
+}
+
+CrankTag::CrankTag(CrankStats& stats, CrankStats::Origin origin)
+    : mStats(stats), mOwnsHandler(!stats.inHandler())
+{
+    if (mOwnsHandler)
+    {
+        mStats.beginHandler(origin);
+    }
+    else
+    {
+        mStats.pushOrigin(origin);
+    }
+}
+
+CrankTag::~CrankTag()
+{
+    if (mOwnsHandler)
+    {
+        mStats.endHandler();
+    }
+    else
+    {
+        mStats.popOrigin();
+    }
+}
+}
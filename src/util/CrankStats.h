@@ -0,0 +1,118 @@
+#pragma once
+
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "lib/json/json-forwards.h"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace medida
+{
+class Histogram;
+}
+
+namespace stellar
+{
+
+/**
+ * Accounting of where the main thread spends its time.
+ *
+ * VirtualClock::crank brackets every handler it runs (IO completions,
+ * posted functions, timer callbacks) with beginHandler/endHandler. Code
+ * running inside a handler marks the subsystem it belongs to with a
+ * CrankTag; the handler's run time is split into slices charged to the
+ * innermost tag active at the time, so a ledger close triggered by an SCP
+ * message is charged to "ledger" rather than to "overlay" or "herder".
+ *
+ * Each origin keeps a histogram of the time it took per handler it ran in.
+ * Handlers running longer than the stall threshold are logged together with
+ * the breakdown by origin.
+ */
+class CrankStats : NonMovableOrCopyable
+{
+  public:
+    enum Origin
+    {
+        ORIGIN_OTHER,
+        ORIGIN_TIMER,
+        ORIGIN_OVERLAY,
+        ORIGIN_HERDER,
+        ORIGIN_LEDGER,
+        ORIGIN_HISTORY,
+        ORIGIN_DATABASE,
+        ORIGIN_HTTP,
+        ORIGIN_COUNT
+    };
+
+    static char const* originName(Origin origin);
+
+    CrankStats();
+    ~CrankStats();
+
+    void setStallThreshold(std::chrono::milliseconds threshold);
+
+    bool
+    inHandler() const
+    {
+        return !mOrigins.empty();
+    }
+
+    void beginHandler(Origin origin);
+    // `ran` is false when the handler slot turned out to be empty (an IO
+    // poll that found nothing to do), which is then not recorded.
+    void endHandler(bool ran = true);
+
+    void pushOrigin(Origin origin);
+    void popOrigin();
+
+    uint64_t getHandlerCount() const;
+    uint64_t getStallCount() const;
+
+    // Count and timings (in milliseconds) of every origin that ran since
+    // the last reset.
+    void report(Json::Value& root) const;
+    void reset();
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    struct OriginStats
+    {
+        std::unique_ptr<medida::Histogram> mTimes;
+        std::chrono::nanoseconds mTotal{0};
+        std::chrono::nanoseconds mMax{0};
+    };
+
+    void clearSlices();
+    void chargeSlice(clock::time_point now);
+
+    std::vector<Origin> mOrigins;
+    clock::time_point mHandlerStart;
+    clock::time_point mSliceStart;
+    std::chrono::nanoseconds mSlices[ORIGIN_COUNT];
+
+    OriginStats mStats[ORIGIN_COUNT];
+    uint64_t mHandlerCount{0};
+    uint64_t mStallCount{0};
+    std::chrono::nanoseconds mStallThreshold;
+};
+
+// Charges the main-thread time spent in its scope to `origin`; see
+// CrankStats. Outside of any handler it accounts for the scope as a handler
+// of its own.
+class CrankTag : NonMovableOrCopyable
+{
+  public:
+    CrankTag(CrankStats& stats, CrankStats::Origin origin);
+    ~CrankTag();
+
+  private:
+    CrankStats& mStats;
+    bool mOwnsHandler;
+};
+}
@@ -71,6 +71,62 @@ deltree(std::string const& d)
     }
 }
 
+std::vector<std::string>
+findfiles(std::string const& path,
+          std::function<bool(std::string const& name)> predicate)
+{
+    std::vector<std::string> res;
+    WIN32_FIND_DATA data;
+    HANDLE h = FindFirstFile((path + "\\*").c_str(), &data);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        if (GetLastError() == ERROR_FILE_NOT_FOUND)
+        {
+            return res;
+        }
+        throw std::runtime_error("FindFirstFile failed in findfiles");
+    }
+    do
+    {
+        if (!(data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) &&
+            predicate(data.cFileName))
+        {
+            res.emplace_back(data.cFileName);
+        }
+    } while (FindNextFile(h, &data));
+    FindClose(h);
+    return res;
+}
+
+bool
+fileSize(std::string const& path, uint64_t& size)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(path.c_str(), GetFileExInfoStandard, &data))
+    {
+        return false;
+    }
+    size = (static_cast<uint64_t>(data.nFileSizeHigh) << 32) |
+           data.nFileSizeLow;
+    return true;
+}
+
+bool
+truncate(std::string const& path, uint64_t size)
+{
+    HANDLE h = CreateFile(path.c_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING,
+                          FILE_ATTRIBUTE_NORMAL, NULL);
+    if (h == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER pos;
+    pos.QuadPart = static_cast<LONGLONG>(size);
+    bool ok = SetFilePointerEx(h, pos, NULL, FILE_BEGIN) && SetEndOfFile(h);
+    CloseHandle(h);
+    return ok;
+}
+
 long
 getCurrentPid()
 {
@@ -101,6 +157,7 @@ processExists(long pid)
 }
 
 #else
+#include <dirent.h>
 #include <ftw.h>
 #include <unistd.h>
 #include <sys/stat.h>
@@ -163,6 +220,46 @@ deltree(std::string const& d)
     }
 }
 
+std::vector<std::string>
+findfiles(std::string const& path,
+          std::function<bool(std::string const& name)> predicate)
+{
+    std::vector<std::string> res;
+    DIR* dir = opendir(path.c_str());
+    if (!dir)
+    {
+        throw std::runtime_error("opendir failed in findfiles");
+    }
+    while (dirent* entry = readdir(dir))
+    {
+        std::string name(entry->d_name);
+        if (name != "." && name != ".." && predicate(name))
+        {
+            res.emplace_back(name);
+        }
+    }
+    closedir(dir);
+    return res;
+}
+
+bool
+fileSize(std::string const& path, uint64_t& size)
+{
+    struct stat buf;
+    if (stat(path.c_str(), &buf) == -1)
+    {
+        return false;
+    }
+    size = static_cast<uint64_t>(buf.st_size);
+    return true;
+}
+
+bool
+truncate(std::string const& path, uint64_t size)
+{
+    return ::truncate(path.c_str(), static_cast<off_t>(size)) == 0;
+}
+
 long
 getCurrentPid()
 {
@@ -4,7 +4,9 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <functional>
 #include <string>
+#include <vector>
 
 namespace stellar
 {
@@ -32,6 +34,18 @@ void deltree(std::string const& path);
 // Make a single dir; not mkdir-p, i.e. non-recursive
 bool mkdir(std::string const& path);
 
+// Set `size` to the size in bytes of the file at `path`; false if it cannot
+// be read
+bool fileSize(std::string const& path, uint64_t& size);
+
+// Cut the file at `path` down to its first `size` bytes
+bool truncate(std::string const& path, uint64_t size);
+
+// The names of the files directly in `path` that `predicate` accepts
+std::vector<std::string>
+findfiles(std::string const& path,
+          std::function<bool(std::string const& name)> predicate);
+
 ////
 // Utility functions for constructing path names
 ////
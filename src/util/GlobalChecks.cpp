@@ -13,11 +13,22 @@
 namespace stellar
 {
 static std::thread::id mainThread = std::this_thread::get_id();
+static thread_local bool gStandsInForMain = false;
 
 void
 assertThreadIsMain()
 {
-    dbgAssert(mainThread == std::this_thread::get_id());
+    dbgAssert(gStandsInForMain || mainThread == std::this_thread::get_id());
+}
+
+MainThreadScope::MainThreadScope() : mWasMain(gStandsInForMain)
+{
+    gStandsInForMain = true;
+}
+
+MainThreadScope::~MainThreadScope()
+{
+    gStandsInForMain = mWasMain;
 }
 
 void
@@ -8,6 +8,20 @@ namespace stellar
 {
 void assertThreadIsMain();
 
+// Lets the current thread stand in for the main thread while it is in scope,
+// for simulations that run each node's event loop on a thread of its own.
+class MainThreadScope
+{
+  public:
+    MainThreadScope();
+    ~MainThreadScope();
+    MainThreadScope(MainThreadScope const&) = delete;
+    MainThreadScope& operator=(MainThreadScope const&) = delete;
+
+  private:
+    bool mWasMain;
+};
+
 void dbgAbort();
 
 #ifdef NDEBUG
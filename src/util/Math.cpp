@@ -8,9 +8,10 @@
 namespace stellar
 {
 
-std::default_random_engine gRandomEngine;
-std::uniform_real_distribution<double> uniformFractionDistribution(0.0, 1.0);
-std::bernoulli_distribution bernoulliDistribution{0.5};
+thread_local std::default_random_engine gRandomEngine;
+static thread_local std::uniform_real_distribution<double>
+    uniformFractionDistribution(0.0, 1.0);
+static thread_local std::bernoulli_distribution bernoulliDistribution{0.5};
 
 double
 rand_fraction()
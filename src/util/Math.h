@@ -16,7 +16,9 @@ size_t rand_pareto(float alpha, size_t max);
 
 bool rand_flip();
 
-extern std::default_random_engine gRandomEngine;
+// One engine per thread, so that simulated nodes running on different
+// threads do not race on it.
+extern thread_local std::default_random_engine gRandomEngine;
 
 template <typename T>
 T
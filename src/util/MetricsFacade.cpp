@@ -0,0 +1,132 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MetricsFacade.h"
+#include "util/make_unique.h"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+
+namespace stellar
+{
+
+MeterHandle::MeterHandle(medida::Meter& meter) : mMeter(meter)
+{
+}
+
+size_t
+MeterHandle::threadStripe()
+{
+    static std::atomic<size_t> nextStripe{0};
+    static thread_local size_t const stripe =
+        nextStripe.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return stripe;
+}
+
+uint64_t
+MeterHandle::pending() const
+{
+    uint64_t n = 0;
+    for (auto const& s : mStripes)
+    {
+        n += s.mCount.load(std::memory_order_relaxed);
+    }
+    return n;
+}
+
+void
+MeterHandle::sync()
+{
+    uint64_t n = 0;
+    for (auto& s : mStripes)
+    {
+        n += s.mCount.exchange(0, std::memory_order_relaxed);
+    }
+    if (n != 0)
+    {
+        mMeter.Mark(n);
+    }
+}
+
+SampledTimer::Scope::Scope(medida::Timer* timer) : mTimer(timer)
+{
+    if (mTimer)
+    {
+        mStart = std::chrono::steady_clock::now();
+    }
+}
+
+SampledTimer::Scope::Scope(Scope&& other)
+    : mTimer(other.mTimer), mStart(other.mStart)
+{
+    other.mTimer = nullptr;
+}
+
+SampledTimer::Scope::~Scope()
+{
+    if (mTimer)
+    {
+        mTimer->Update(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - mStart));
+    }
+}
+
+SampledTimer::SampledTimer(medida::Timer& timer) : mTimer(timer)
+{
+}
+
+MetricsFacade::MetricsFacade(medida::MetricsRegistry& registry)
+    : mRegistry(registry)
+{
+}
+
+MetricsFacade::~MetricsFacade()
+{
+}
+
+medida::MetricsRegistry&
+MetricsFacade::getRegistry()
+{
+    return mRegistry;
+}
+
+MeterHandle&
+MetricsFacade::newMeter(medida::MetricName const& name,
+                        std::string const& eventType)
+{
+    auto& h = mMeters[name];
+    if (!h)
+    {
+        h = make_unique<MeterHandle>(mRegistry.NewMeter(name, eventType));
+    }
+    return *h;
+}
+
+SampledTimer&
+MetricsFacade::newSampledTimer(medida::MetricName const& name)
+{
+    auto& h = mTimers[name];
+    if (!h)
+    {
+        h = make_unique<SampledTimer>(mRegistry.NewTimer(name));
+    }
+    return *h;
+}
+
+size_t
+MetricsFacade::nextHandleSetSlot()
+{
+    static std::atomic<size_t> next{0};
+    return next++;
+}
+
+void
+MetricsFacade::sync()
+{
+    for (auto& m : mMeters)
+    {
+        m.second->sync();
+    }
+}
+}
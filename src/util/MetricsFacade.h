@@ -0,0 +1,189 @@
+#pragma once
+
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/NonCopyable.h"
+#include "medida/metric_name.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Timers wrapped in a SampledTimer only time one event out of
+// STELLAR_METRICS_TIMER_SAMPLING. The default of 1 times every event; build
+// with e.g. -DSTELLAR_METRICS_TIMER_SAMPLING=16 when reading the clock on
+// every operation shows up in profiles. Sampled timers then report 1/N of
+// the events, with representative durations.
+#ifndef STELLAR_METRICS_TIMER_SAMPLING
+#define STELLAR_METRICS_TIMER_SAMPLING 1
+#endif
+
+namespace medida
+{
+class Meter;
+class MetricsRegistry;
+class Timer;
+}
+
+namespace stellar
+{
+
+/**
+ * A meter that is cheap to mark from hot paths and from any thread.
+ *
+ * Marks go to one of a few cache-line sized counters picked by the calling
+ * thread, with no lock and no lookup by name; they are folded into the
+ * underlying medida::Meter only when MetricsFacade::sync runs, which happens
+ * whenever /metrics is read. Rates reported by the meter are therefore only
+ * as fresh as the last sync; counts are exact after it.
+ */
+class MeterHandle : NonMovableOrCopyable
+{
+  public:
+    explicit MeterHandle(medida::Meter& meter);
+
+    void
+    mark(uint64_t n = 1)
+    {
+        mStripes[threadStripe()].mCount.fetch_add(n,
+                                                  std::memory_order_relaxed);
+    }
+
+    // Marks accumulated and not yet folded into the meter.
+    uint64_t pending() const;
+
+    void sync();
+
+  private:
+    static size_t const kStripes = 8;
+    struct Stripe
+    {
+        std::atomic<uint64_t> mCount{0};
+        char mPad[64 - sizeof(std::atomic<uint64_t>)];
+    };
+
+    static size_t threadStripe();
+
+    medida::Meter& mMeter;
+    Stripe mStripes[kStripes];
+};
+
+/**
+ * A timer for the hottest paths, see STELLAR_METRICS_TIMER_SAMPLING.
+ */
+class SampledTimer : NonMovableOrCopyable
+{
+  public:
+    class Scope
+    {
+      public:
+        explicit Scope(medida::Timer* timer);
+        Scope(Scope&& other);
+        ~Scope();
+
+      private:
+        medida::Timer* mTimer;
+        std::chrono::steady_clock::time_point mStart;
+    };
+
+    explicit SampledTimer(medida::Timer& timer);
+
+    Scope
+    TimeScope()
+    {
+        if (STELLAR_METRICS_TIMER_SAMPLING == 1 ||
+            mSeen.fetch_add(1, std::memory_order_relaxed) %
+                    STELLAR_METRICS_TIMER_SAMPLING ==
+                0)
+        {
+            return Scope(&mTimer);
+        }
+        return Scope(nullptr);
+    }
+
+  private:
+    medida::Timer& mTimer;
+    std::atomic<uint32_t> mSeen{0};
+};
+
+/**
+ * Per-application front end to the metrics registry for code that marks
+ * metrics often enough for registry lookups to matter.
+ *
+ * Handles are registered once, usually when the owning subsystem is
+ * constructed, and are then used directly. Code without a long-lived object
+ * to hold its handles (transaction frames, deltas) groups them in a struct
+ * constructible from a MetricsFacade and fetches it with `handles<T>()`,
+ * which builds it on first use and is an array access afterwards.
+ *
+ * Registration is main-thread only; marking is safe from any thread.
+ */
+class MetricsFacade : NonMovableOrCopyable
+{
+  public:
+    explicit MetricsFacade(medida::MetricsRegistry& registry);
+    ~MetricsFacade();
+
+    medida::MetricsRegistry& getRegistry();
+
+    MeterHandle& newMeter(medida::MetricName const& name,
+                          std::string const& eventType);
+    SampledTimer& newSampledTimer(medida::MetricName const& name);
+
+    template <typename T>
+    T&
+    handles()
+    {
+        size_t slot = handleSetSlot<T>();
+        if (slot >= mHandleSets.size())
+        {
+            mHandleSets.resize(slot + 1);
+        }
+        auto& set = mHandleSets[slot];
+        if (!set)
+        {
+            set.reset(new HandleSet<T>(*this));
+        }
+        return static_cast<HandleSet<T>&>(*set).mHandles;
+    }
+
+    // Folds everything the meter handles accumulated into the registry.
+    void sync();
+
+  private:
+    struct HandleSetBase
+    {
+        virtual ~HandleSetBase()
+        {
+        }
+    };
+
+    template <typename T> struct HandleSet : HandleSetBase
+    {
+        T mHandles;
+        explicit HandleSet(MetricsFacade& facade) : mHandles(facade)
+        {
+        }
+    };
+
+    static size_t nextHandleSetSlot();
+
+    template <typename T>
+    static size_t
+    handleSetSlot()
+    {
+        static size_t const slot = nextHandleSetSlot();
+        return slot;
+    }
+
+    medida::MetricsRegistry& mRegistry;
+    std::map<medida::MetricName, std::unique_ptr<MeterHandle>> mMeters;
+    std::map<medida::MetricName, std::unique_ptr<SampledTimer>> mTimers;
+    std::vector<std::unique_ptr<HandleSetBase>> mHandleSets;
+};
+}
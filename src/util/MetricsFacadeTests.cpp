@@ -0,0 +1,95 @@
+// Copyright 2016 Stellar Development Foundation and contributors. Licensed
+// under the Apache License, Version 2.0. See the COPYING file at the root
+// of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
+
+#include "util/MetricsFacade.h"
+#include "lib/catch.hpp"
+#include "medida/meter.h"
+#include "medida/metrics_registry.h"
+#include "medida/timer.h"
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace stellar;
+
+namespace
+{
+struct TestHandles
+{
+    MeterHandle& mHits;
+    explicit TestHandles(MetricsFacade& m)
+        : mHits(m.newMeter({"test", "handles", "hits"}, "hit"))
+    {
+    }
+};
+}
+
+TEST_CASE("meter handles aggregate lazily", "[metrics]")
+{
+    medida::MetricsRegistry registry;
+    MetricsFacade facade(registry);
+
+    auto& handle = facade.newMeter({"test", "meter", "marks"}, "mark");
+    auto& meter = registry.NewMeter({"test", "meter", "marks"}, "mark");
+    REQUIRE(&facade.newMeter({"test", "meter", "marks"}, "mark") == &handle);
+
+    size_t const nThreads = 4;
+    size_t const nMarks = 10000;
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < nThreads; i++)
+    {
+        threads.emplace_back([&handle]()
+                             {
+                                 for (size_t j = 0; j < nMarks; j++)
+                                 {
+                                     handle.mark();
+                                 }
+                             });
+    }
+    handle.mark(5);
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    CHECK(meter.count() == 0);
+    CHECK(handle.pending() == nThreads * nMarks + 5);
+    facade.sync();
+    CHECK(meter.count() == nThreads * nMarks + 5);
+    CHECK(handle.pending() == 0);
+    facade.sync();
+    CHECK(meter.count() == nThreads * nMarks + 5);
+}
+
+TEST_CASE("metric handle sets are built once", "[metrics]")
+{
+    medida::MetricsRegistry registry;
+    MetricsFacade facade(registry);
+
+    auto& handles = facade.handles<TestHandles>();
+    REQUIRE(&facade.handles<TestHandles>() == &handles);
+    handles.mHits.mark();
+    facade.sync();
+    CHECK(registry.NewMeter({"test", "handles", "hits"}, "hit").count() == 1);
+
+    // another facade gets its own set
+    medida::MetricsRegistry otherRegistry;
+    MetricsFacade other(otherRegistry);
+    CHECK(&other.handles<TestHandles>() != &handles);
+}
+
+TEST_CASE("sampled timer", "[metrics]")
+{
+    medida::MetricsRegistry registry;
+    MetricsFacade facade(registry);
+
+    auto& timer = facade.newSampledTimer({"test", "timer", "sampled"});
+    size_t const n = 64;
+    for (size_t i = 0; i < n; i++)
+    {
+        auto scope = timer.TimeScope();
+    }
+    CHECK(registry.NewTimer({"test", "timer", "sampled"}).count() ==
+          n / STELLAR_METRICS_TIMER_SAMPLING);
+}
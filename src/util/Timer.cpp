@@ -6,6 +6,7 @@
 #include <chrono>
 #include "main/Application.h"
 #include "util/Logging.h"
+#include <algorithm>
 #include <thread>
 #include "util/GlobalChecks.h"
 
@@ -16,16 +17,60 @@ using namespace std;
 
 static const uint32_t RECENT_CRANK_WINDOW = 1024;
 
+using WheelLink = VirtualClockLink<VirtualClockWheelTag>;
+using TimerLink = VirtualClockLink<VirtualClockTimerTag>;
+
+static VirtualClockEvent*
+eventOf(WheelLink* l)
+{
+    return static_cast<VirtualClockEvent*>(l);
+}
+
+static VirtualClockEvent*
+eventOf(TimerLink* l)
+{
+    return static_cast<VirtualClockEvent*>(l);
+}
+
+static size_t
+lowestBit(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(v));
+#else
+    size_t n = 0;
+    while (!(v & 1))
+    {
+        v >>= 1;
+        ++n;
+    }
+    return n;
+#endif
+}
+
 VirtualClock::VirtualClock(Mode mode)
     : mRealTimer(mIOService)
     , mMode(mode)
     , mRecentCrankCount(RECENT_CRANK_WINDOW >> 1)
     , mRecentIdleCrankCount(RECENT_CRANK_WINDOW >> 1)
+    , mWheelTick(0)
+    , mEventCount(0)
+    , mNextTickValid(false)
+    , mNextTick(0)
 {
     if (mMode == REAL_TIME)
     {
         mNow = std::chrono::system_clock::now();
     }
+    for (size_t level = 0; level < kWheelLevels; ++level)
+    {
+        mWheelLevelCount[level] = 0;
+        for (auto& w : mWheelOccupied[level])
+        {
+            w = 0;
+        }
+    }
+    mWheelTick = toTick(mNow);
 }
 
 VirtualClock::time_point
@@ -62,25 +107,232 @@ VirtualClock::maybeSetRealtimer()
     }
 }
 
-bool VirtualClockEventCompare::operator()(shared_ptr<VirtualClockEvent> a,
-                                          shared_ptr<VirtualClockEvent> b)
+uint64_t
+VirtualClock::toTick(time_point t)
+{
+    auto n = t.time_since_epoch().count();
+    return n < 0 ? 0 : static_cast<uint64_t>(n);
+}
+
+void
+VirtualClock::insert(VirtualClockEvent* ev)
+{
+    // events already due are placed at the wheel time
+    if (ev->mTick < mWheelTick)
+    {
+        ev->mTick = mWheelTick;
+    }
+    uint64_t diff = (ev->mTick ^ mWheelTick) >> kWheelSlotBits;
+    size_t level = 0;
+    while (diff != 0)
+    {
+        diff >>= kWheelSlotBits;
+        ++level;
+    }
+    size_t slot =
+        (ev->mTick >> (level * kWheelSlotBits)) & (kWheelSlots - 1);
+
+    ev->mLevel = static_cast<int8_t>(level);
+    ev->mSlot = static_cast<uint8_t>(slot);
+    mWheel[level][slot].pushBack(ev);
+    mWheelOccupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+    ++mWheelLevelCount[level];
+
+    if (mEventCount++ == 0)
+    {
+        mNextTick = ev->mTick;
+        mNextTickValid = true;
+    }
+    else if (mNextTickValid && ev->mTick < mNextTick)
+    {
+        mNextTick = ev->mTick;
+    }
+}
+
+void
+VirtualClock::removeFromWheel(VirtualClockEvent* ev)
+{
+    static_cast<WheelLink*>(ev)->unlink();
+    if (ev->mLevel == VirtualClockEvent::kNotInWheel)
+    {
+        return;
+    }
+    auto& slot = mWheel[ev->mLevel][ev->mSlot];
+    if (slot.empty())
+    {
+        mWheelOccupied[ev->mLevel][ev->mSlot / 64] &=
+            ~(uint64_t(1) << (ev->mSlot % 64));
+    }
+    --mWheelLevelCount[ev->mLevel];
+    --mEventCount;
+    if (mNextTickValid && ev->mTick == mNextTick)
+    {
+        mNextTickValid = false;
+    }
+    ev->mLevel = VirtualClockEvent::kNotInWheel;
+}
+
+size_t
+VirtualClock::takeSlot(size_t level, size_t slot, EventList& out)
+{
+    auto& list = mWheel[level][slot];
+    size_t n = 0;
+    for (auto l = list.mNext; l != &list; l = l->mNext)
+    {
+        eventOf(l)->mLevel = VirtualClockEvent::kNotInWheel;
+        ++n;
+    }
+    list.spliceInto(out);
+    mWheelOccupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    mWheelLevelCount[level] -= n;
+    mEventCount -= n;
+    return n;
+}
+
+uint64_t
+VirtualClock::nextTick()
 {
-    return *a < *b;
+    if (mEventCount == 0)
+    {
+        return UINT64_MAX;
+    }
+    if (mNextTickValid)
+    {
+        return mNextTick;
+    }
+
+    // The earliest events are in the lowest non-empty level, in its first
+    // occupied slot past the wheel time.
+    size_t level = 0;
+    while (mWheelLevelCount[level] == 0)
+    {
+        ++level;
+    }
+    size_t shift = level * kWheelSlotBits;
+    size_t start = (mWheelTick >> shift) & (kWheelSlots - 1);
+    size_t slot = kWheelSlots;
+    for (size_t w = start / 64; w < kWheelSlots / 64; ++w)
+    {
+        uint64_t bits = mWheelOccupied[level][w];
+        if (w == start / 64)
+        {
+            bits &= ~((uint64_t(1) << (start % 64)) - 1);
+        }
+        if (bits != 0)
+        {
+            slot = w * 64 + lowestBit(bits);
+            break;
+        }
+    }
+    assert(slot < kWheelSlots);
+
+    if (level == 0)
+    {
+        mNextTick = (mWheelTick & ~uint64_t(kWheelSlots - 1)) | slot;
+    }
+    else
+    {
+        auto& list = mWheel[level][slot];
+        mNextTick = UINT64_MAX;
+        for (auto l = list.mNext; l != &list; l = l->mNext)
+        {
+            mNextTick = std::min(mNextTick, eventOf(l)->mTick);
+        }
+    }
+    mNextTickValid = true;
+    return mNextTick;
+}
+
+void
+VirtualClock::advanceWheel(uint64_t tick)
+{
+    // Only ever moves up to the earliest pending event, so the slots entered
+    // at each level hold the only events that now need a lower level.
+    assert(tick >= mWheelTick);
+    uint64_t diff = (tick ^ mWheelTick) >> kWheelSlotBits;
+    size_t top = 0;
+    while (diff != 0)
+    {
+        diff >>= kWheelSlotBits;
+        ++top;
+    }
+    mWheelTick = tick;
+
+    for (size_t level = top; level > 0; --level)
+    {
+        size_t slot =
+            (tick >> (level * kWheelSlotBits)) & (kWheelSlots - 1);
+        EventList cascade;
+        takeSlot(level, slot, cascade);
+        while (!cascade.empty())
+        {
+            auto ev = eventOf(cascade.mNext);
+            static_cast<WheelLink*>(ev)->unlink();
+            insert(ev);
+        }
+    }
+}
+
+void
+VirtualClock::schedule(TimerEventList& timerEvents, time_point when,
+                       std::function<void(asio::error_code)> callback)
+{
+    if (mDestructing)
+    {
+        return;
+    }
+    assertThreadIsMain();
+
+    VirtualClockEvent* ev;
+    if (mFreeEvents.empty())
+    {
+        ev = new VirtualClockEvent();
+    }
+    else
+    {
+        ev = eventOf(mFreeEvents.mNext);
+        static_cast<WheelLink*>(ev)->unlink();
+    }
+    ev->mCallback = std::move(callback);
+    ev->mWhen = when;
+    ev->mTick = toTick(when);
+    insert(ev);
+    timerEvents.pushBack(ev);
+    maybeSetRealtimer();
+}
+
+void
+VirtualClock::fire(VirtualClockEvent* ev, asio::error_code const& ec)
+{
+    removeFromWheel(ev);
+    static_cast<TimerLink*>(ev)->unlink();
+    auto cb = std::move(ev->mCallback);
+    ev->mCallback = nullptr;
+    mFreeEvents.pushBack(ev);
+    cb(ec);
+}
+
+void
+VirtualClock::cancelEvents(TimerEventList& timerEvents)
+{
+    TimerEventList cancelled;
+    timerEvents.spliceInto(cancelled);
+    while (!cancelled.empty())
+    {
+        fire(eventOf(cancelled.mNext), asio::error::operation_aborted);
+    }
 }
 
 VirtualClock::time_point
 VirtualClock::next()
 {
     assertThreadIsMain();
-    VirtualClock::time_point least = time_point::max();
-    if (!mEvents.empty())
+    uint64_t tick = nextTick();
+    if (tick > static_cast<uint64_t>(duration::max().count()))
     {
-        if (mEvents.top()->mWhen < least)
-        {
-            least = mEvents.top()->mWhen;
-        }
+        return time_point::max();
     }
-    return least;
+    return time_point(duration(static_cast<rep>(tick)));
 }
 
 VirtualClock::time_point
@@ -145,69 +397,25 @@ VirtualClock::pointToISOString(time_point point)
     return tmToISOString(pointToTm(point));
 }
 
-void
-VirtualClock::enqueue(shared_ptr<VirtualClockEvent> ve)
-{
-    if (mDestructing)
-    {
-        return;
-    }
-    assertThreadIsMain();
-    // LOG(DEBUG) << "VirtualClock::enqueue";
-    mEvents.emplace(ve);
-    maybeSetRealtimer();
-}
-
-void
-VirtualClock::flushCancelledEvents()
+bool
+VirtualClock::cancelAllEvents()
 {
-    if (mDestructing)
-    {
-        return;
-    }
-    if (mFlushesIgnored <= mEvents.size())
-    {
-        // Flushing all the canceled events immediately can lead to
-        // a O(n^2) loop if many events in the queue are canceled one a time.
-        //
-        // By ignoring O(n) flushes, we batch the iterations together and
-        // restore O(n) performance.
-        mFlushesIgnored++;
-        return;
-    }
     assertThreadIsMain();
-    // LOG(DEBUG) << "VirtualClock::cancelAllEventsFrom";
-
-    auto toKeep = vector<shared_ptr<VirtualClockEvent>>();
-    toKeep.reserve(mEvents.size());
 
-    while (!mEvents.empty())
+    bool wasEmpty = (mEventCount == 0);
+    EventList cancelled;
+    for (size_t level = 0; level < kWheelLevels; ++level)
     {
-        auto const& e = mEvents.top();
-        if (!e->getTriggered())
+        for (size_t slot = 0; mWheelLevelCount[level] != 0; ++slot)
         {
-            toKeep.emplace_back(e);
+            takeSlot(level, slot, cancelled);
         }
-        mEvents.pop();
     }
-    mFlushesIgnored = 0;
-    mEvents = PrQueue(toKeep.begin(), toKeep.end());
-    maybeSetRealtimer();
-}
-
-bool
-VirtualClock::cancelAllEvents()
-{
-    assertThreadIsMain();
-
-    bool wasEmpty = mEvents.empty();
-    while (!mEvents.empty())
+    mNextTickValid = false;
+    while (!cancelled.empty())
     {
-        auto ev = mEvents.top();
-        mEvents.pop();
-        ev->cancel();
+        fire(eventOf(cancelled.mNext), asio::error::operation_aborted);
     }
-    mEvents = PrQueue();
     return !wasEmpty;
 }
 
@@ -253,7 +461,9 @@ VirtualClock::crank(bool block)
     size_t i = 0;
     do
     {
+        mCrankStats.beginHandler(CrankStats::ORIGIN_OTHER);
         lastPoll = mIOService.poll_one();
+        mCrankStats.endHandler(lastPoll != 0);
         nWorkDone += lastPoll;
     } while (lastPoll != 0 && ++i < WORK_BATCH_SIZE);
 
@@ -268,7 +478,10 @@ VirtualClock::crank(bool block)
 
     if (block && nWorkDone == 0)
     {
-        nWorkDone += mIOService.run_one();
+        mCrankStats.beginHandler(CrankStats::ORIGIN_OTHER);
+        auto ran = mIOService.run_one();
+        mCrankStats.endHandler(ran != 0);
+        nWorkDone += ran;
     }
 
     noteCrankOccurred(nWorkDone == 0);
@@ -276,6 +489,40 @@ VirtualClock::crank(bool block)
     return nWorkDone;
 }
 
+size_t
+VirtualClock::crankUpTo(time_point limit)
+{
+    if (mDestructing)
+    {
+        return 0;
+    }
+    assert(mMode == VIRTUAL_TIME);
+    size_t nWorkDone = 0;
+    for (;;)
+    {
+        size_t lastPoll;
+        do
+        {
+            mCrankStats.beginHandler(CrankStats::ORIGIN_OTHER);
+            lastPoll = mIOService.poll_one();
+            mCrankStats.endHandler(lastPoll != 0);
+            nWorkDone += lastPoll;
+        } while (lastPoll != 0);
+
+        if (mEventCount == 0 || next() > limit)
+        {
+            break;
+        }
+        nWorkDone += advanceTo(std::max(next(), mNow));
+    }
+    if (mNow < limit)
+    {
+        mNow = limit;
+    }
+    noteCrankOccurred(nWorkDone == 0);
+    return nWorkDone;
+}
+
 void
 VirtualClock::noteCrankOccurred(bool hadIdle)
 {
@@ -331,10 +578,32 @@ VirtualClock::getIOService()
     return mIOService;
 }
 
+void
+VirtualClock::post(CrankStats::Origin origin, std::function<void()> f)
+{
+    mIOService.post([this, origin, f]()
+                    {
+                        CrankTag tag(mCrankStats, origin);
+                        f();
+                    });
+}
+
+CrankStats&
+VirtualClock::getCrankStats()
+{
+    return mCrankStats;
+}
+
 VirtualClock::~VirtualClock()
 {
     mDestructing = true;
     cancelAllEvents();
+    while (!mFreeEvents.empty())
+    {
+        auto ev = eventOf(mFreeEvents.mNext);
+        static_cast<WheelLink*>(ev)->unlink();
+        delete ev;
+    }
 }
 
 size_t
@@ -349,24 +618,28 @@ VirtualClock::advanceTo(time_point n)
     // LOG(DEBUG) << "VirtualClock::advanceTo("
     //            << n.time_since_epoch().count() << ")";
     mNow = n;
-    vector<shared_ptr<VirtualClockEvent>> toDispatch;
-    while (!mEvents.empty())
+    uint64_t limit = toTick(n);
+    EventList toDispatch;
+    while (nextTick() <= limit)
     {
-        if (mEvents.top()->mWhen > mNow)
-            break;
-        toDispatch.push_back(mEvents.top());
-        mEvents.pop();
+        uint64_t tick = nextTick();
+        advanceWheel(tick);
+        takeSlot(0, tick & (kWheelSlots - 1), toDispatch);
+        mNextTickValid = false;
     }
-    // Keep the dispatch loop separate from the pop()-ing loop
-    // so the triggered events can't mutate the priority queue
-    // from underneat us while we are looping.
-    for (auto ev : toDispatch)
+    // Keep the dispatch loop separate from the collecting loop so that events
+    // scheduled by the callbacks wait for the next advance. Events cancelled
+    // by an earlier callback leave toDispatch as they are cancelled.
+    size_t dispatched = 0;
+    while (!toDispatch.empty())
     {
-        ev->trigger();
+        CrankTag tag(mCrankStats, CrankStats::ORIGIN_TIMER);
+        fire(eventOf(toDispatch.mNext), asio::error_code());
+        ++dispatched;
     }
     // LOG(DEBUG) << "VirtualClock::advanceTo done";
     maybeSetRealtimer();
-    return toDispatch.size();
+    return dispatched;
 }
 
 size_t
@@ -378,55 +651,13 @@ VirtualClock::advanceToNext()
     }
     assert(mMode == VIRTUAL_TIME);
     assertThreadIsMain();
-    if (mEvents.empty())
+    if (mEventCount == 0)
     {
         return 0;
     }
     return advanceTo(next());
 }
 
-VirtualClockEvent::VirtualClockEvent(
-    VirtualClock::time_point when,
-    std::function<void(asio::error_code)> callback)
-    : mCallback(callback), mTriggered(false), mWhen(when)
-{
-}
-
-bool
-VirtualClockEvent::getTriggered()
-{
-    return mTriggered;
-}
-void
-VirtualClockEvent::trigger()
-{
-    if (!mTriggered)
-    {
-        mTriggered = true;
-        mCallback(asio::error_code());
-        mCallback = nullptr;
-    }
-}
-
-void
-VirtualClockEvent::cancel()
-{
-    if (!mTriggered)
-    {
-        mTriggered = true;
-        mCallback(asio::error::operation_aborted);
-        mCallback = nullptr;
-    }
-}
-
-bool VirtualClockEvent::operator<(VirtualClockEvent const& other) const
-{
-    // For purposes of priority queue, a timer is "less than"
-    // another timer if it occurs in the future (has a higher
-    // expiry time). The "greatest" timer is timer 0.
-    return mWhen > other.mWhen;
-}
-
 VirtualTimer::VirtualTimer(Application& app) : VirtualTimer(app.getClock())
 {
 }
@@ -451,12 +682,12 @@ VirtualTimer::cancel()
     if (!mCancelled)
     {
         mCancelled = true;
-        for (auto ev : mEvents)
+        // a timer can outlive its clock, which cancels everything pending
+        // when it is destroyed
+        if (!mEvents.empty())
         {
-            ev->cancel();
+            mClock.cancelEvents(mEvents);
         }
-        mClock.flushCancelledEvents();
-        mEvents.clear();
     }
 }
 
@@ -488,9 +719,7 @@ VirtualTimer::async_wait(function<void(asio::error_code)> const& fn)
     if (!mCancelled)
     {
         assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(mExpiryTime, fn);
-        mClock.enqueue(ve);
-        mEvents.push_back(ve);
+        mClock.schedule(mEvents, mExpiryTime, fn);
     }
 }
 
@@ -501,16 +730,14 @@ VirtualTimer::async_wait(std::function<void()> const& onSuccess,
     if (!mCancelled)
     {
         assert(!mDeleting);
-        auto ve = make_shared<VirtualClockEvent>(
-            mExpiryTime, [onSuccess, onFailure](asio::error_code error)
-            {
-                if (error)
-                    onFailure(error);
-                else
-                    onSuccess();
-            });
-        mClock.enqueue(ve);
-        mEvents.push_back(ve);
+        mClock.schedule(mEvents, mExpiryTime,
+                        [onSuccess, onFailure](asio::error_code error)
+                        {
+                            if (error)
+                                onFailure(error);
+                            else
+                                onSuccess();
+                        });
     }
 }
 }
@@ -8,9 +8,11 @@
 // first to include <windows.h> -- so we try to include it before everything
 // else.
 #include "util/asio.h"
+#include "util/CrankStats.h"
 #include "util/NonCopyable.h"
 
 #include <chrono>
+#include <cstdint>
 #include <queue>
 #include <map>
 #include <memory>
@@ -48,13 +50,65 @@ namespace stellar
 class VirtualTimer;
 class Application;
 class VirtualClockEvent;
-class VirtualClockEventCompare
+
+// A link in one of the intrusive circular lists that VirtualClock keeps
+// events in. A list is a sentinel link; the tag keeps an event's link into a
+// clock wheel slot apart from its link into the timer that scheduled it.
+template <typename Tag> class VirtualClockLink
 {
   public:
-    bool operator()(std::shared_ptr<VirtualClockEvent> a,
-                    std::shared_ptr<VirtualClockEvent> b);
+    VirtualClockLink* mPrev;
+    VirtualClockLink* mNext;
+
+    VirtualClockLink() : mPrev(this), mNext(this)
+    {
+    }
+    VirtualClockLink(VirtualClockLink const&) = delete;
+    VirtualClockLink& operator=(VirtualClockLink const&) = delete;
+
+    bool
+    empty() const
+    {
+        return mNext == this;
+    }
+
+    // Appends `link` to the list this is the sentinel of.
+    void
+    pushBack(VirtualClockLink* link)
+    {
+        link->mPrev = mPrev;
+        link->mNext = this;
+        mPrev->mNext = link;
+        mPrev = link;
+    }
+
+    // Moves all of the list's links to the end of `other`.
+    void
+    spliceInto(VirtualClockLink& other)
+    {
+        if (empty())
+        {
+            return;
+        }
+        mNext->mPrev = other.mPrev;
+        other.mPrev->mNext = mNext;
+        mPrev->mNext = &other;
+        other.mPrev = mPrev;
+        mPrev = mNext = this;
+    }
+
+    void
+    unlink()
+    {
+        mPrev->mNext = mNext;
+        mNext->mPrev = mPrev;
+        mPrev = mNext = this;
+    }
 };
 
+struct VirtualClockWheelTag;
+struct VirtualClockTimerTag;
+
 class VirtualClock
 {
   public:
@@ -112,16 +166,49 @@ class VirtualClock
     size_t nRealTimerCancelEvents;
     time_point mNow;
 
-    using PrQueue =
-        std::priority_queue<std::shared_ptr<VirtualClockEvent>,
-                            std::vector<std::shared_ptr<VirtualClockEvent>>,
-                            VirtualClockEventCompare>;
-    PrQueue mEvents;
-    size_t mFlushesIgnored = 0;
+    // Pending events live in a hierarchical timing wheel over the tick count
+    // of their expiry time (one tick is one clock duration unit). Level L
+    // holds the events whose expiry first differs from the wheel time in
+    // byte L, in the slot given by that byte, so every event of level L
+    // expires before any of level L+1. Scheduling and cancelling are O(1);
+    // moving the wheel time forward cascades the slots it enters one level
+    // down, ending with the due events in a level 0 slot of their own.
+    static size_t const kWheelLevels = 8;
+    static size_t const kWheelSlotBits = 8;
+    static size_t const kWheelSlots = 1 << kWheelSlotBits;
+
+    using EventList = VirtualClockLink<VirtualClockWheelTag>;
+    using TimerEventList = VirtualClockLink<VirtualClockTimerTag>;
+
+    EventList mWheel[kWheelLevels][kWheelSlots];
+    uint64_t mWheelOccupied[kWheelLevels][kWheelSlots / 64];
+    size_t mWheelLevelCount[kWheelLevels];
+    uint64_t mWheelTick;
+    size_t mEventCount;
+    bool mNextTickValid;
+    uint64_t mNextTick;
+    // Released events, reused by the next schedule() calls.
+    EventList mFreeEvents;
 
     bool mDestructing{false};
 
-    time_point next();
+    CrankStats mCrankStats;
+
+    static uint64_t toTick(time_point t);
+    void insert(VirtualClockEvent* ev);
+    void removeFromWheel(VirtualClockEvent* ev);
+    size_t takeSlot(size_t level, size_t slot, EventList& out);
+    uint64_t nextTick();
+    void advanceWheel(uint64_t tick);
+
+    friend class VirtualTimer;
+    void schedule(TimerEventList& timerEvents, time_point when,
+                  std::function<void(asio::error_code)> callback);
+    // Runs the callback of `ev` with `ec`, after returning it to the free
+    // list.
+    void fire(VirtualClockEvent* ev, asio::error_code const& ec);
+    void cancelEvents(TimerEventList& timerEvents);
+
     void maybeSetRealtimer();
     size_t advanceTo(time_point n);
     size_t advanceToNext();
@@ -136,17 +223,31 @@ class VirtualClock
     VirtualClock(Mode mode = VIRTUAL_TIME);
     ~VirtualClock();
     size_t crank(bool block = true);
+    // Only valid with VIRTUAL_TIME: runs IO and the events due up to `limit`,
+    // in time order, until neither is left, and leaves the clock at `limit`.
+    // Never moves time past `limit`, so that a caller driving several clocks
+    // can keep them within a bounded distance of each other.
+    size_t crankUpTo(time_point limit);
+    // Expiry time of the earliest pending event, time_point::max() if none.
+    time_point next();
     void noteCrankOccurred(bool hadIdle);
     uint32_t recentIdleCrankPercent() const;
     asio::io_service& getIOService();
 
+    // Posts `f` to run in a later crank, charged to `origin` in the crank
+    // statistics. Like asio's post, safe to call from any thread.
+    void post(CrankStats::Origin origin, std::function<void()> f);
+
+    // Where the main thread's time went, see CrankStats.
+    CrankStats& getCrankStats();
+
     // Note: this is not a static method, which means that VirtualClock is
     // not an implementation of the C++ `Clock` concept; there is no global
     // virtual time. Each virtual clock has its own time.
     time_point now() noexcept;
 
-    void enqueue(std::shared_ptr<VirtualClockEvent> ve);
-    void flushCancelledEvents();
+    // Cancels every pending event, running its callback with
+    // operation_aborted. Returns whether there were any.
     bool cancelAllEvents();
 
     // only valid with VIRTUAL_TIME: sets the current value
@@ -154,19 +255,23 @@ class VirtualClock
     void setCurrentTime(time_point t);
 };
 
-class VirtualClockEvent : public NonMovableOrCopyable
+// A scheduled callback. Events are owned and recycled by their VirtualClock;
+// they sit in a wheel slot (or a list of due events) and in the list of the
+// VirtualTimer that scheduled them until they fire or are cancelled.
+class VirtualClockEvent : public VirtualClockLink<VirtualClockWheelTag>,
+                          public VirtualClockLink<VirtualClockTimerTag>
 {
+    friend class VirtualClock;
+
+    static int8_t const kNotInWheel = -1;
+
     std::function<void(asio::error_code)> mCallback;
-    bool mTriggered;
+    uint64_t mTick{0};
+    int8_t mLevel{kNotInWheel};
+    uint8_t mSlot{0};
 
   public:
     VirtualClock::time_point mWhen;
-    VirtualClockEvent(VirtualClock::time_point when,
-                      std::function<void(asio::error_code)> callback);
-    bool getTriggered();
-    void trigger();
-    void cancel();
-    bool operator<(VirtualClockEvent const& other) const;
 };
 
 /**
@@ -178,7 +283,7 @@ class VirtualTimer : private NonMovableOrCopyable
 {
     VirtualClock& mClock;
     VirtualClock::time_point mExpiryTime;
-    std::vector<std::shared_ptr<VirtualClockEvent>> mEvents;
+    VirtualClockLink<VirtualClockTimerTag> mEvents;
     bool mCancelled;
     bool mDeleting;
 
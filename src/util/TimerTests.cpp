@@ -8,9 +8,11 @@
 #include "main/Config.h"
 #include "main/test.h"
 #include "lib/catch.hpp"
+#include "lib/json/json.h"
 #include "util/Logging.h"
 #include "util/make_unique.h"
 #include <chrono>
+#include <thread>
 
 using namespace stellar;
 
@@ -242,3 +244,178 @@ TEST_CASE("timer cancels", "[timer]")
     REQUIRE(timerFired == 8);
     REQUIRE(timerCancelled == 2);
 }
+
+TEST_CASE("timers across wheel levels", "[timer]")
+{
+    VirtualClock clock;
+
+    // expiries spread from nanoseconds to years, scheduled out of order and
+    // with a couple of ties
+    std::vector<VirtualClock::duration> delays;
+    for (auto d : {std::chrono::nanoseconds(5), std::chrono::nanoseconds(300),
+                   std::chrono::nanoseconds(70000),
+                   std::chrono::nanoseconds(3000000000LL),
+                   std::chrono::nanoseconds(86400000000000LL),
+                   std::chrono::nanoseconds(40000000000000000LL)})
+    {
+        delays.push_back(
+            std::chrono::duration_cast<VirtualClock::duration>(d));
+    }
+    std::vector<size_t> order{3, 0, 5, 1, 4, 2, 1, 3};
+
+    std::vector<std::unique_ptr<VirtualTimer>> timers;
+    std::vector<std::pair<VirtualClock::time_point, size_t>> fired;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+        timers.push_back(make_unique<VirtualTimer>(clock));
+        timers.back()->expires_from_now(delays[order[i]]);
+        timers.back()->async_wait([&, i](asio::error_code const& ec)
+                                  {
+                                      REQUIRE(!ec);
+                                      fired.emplace_back(clock.now(), i);
+                                  });
+    }
+    timers[2]->cancel();
+
+    while (clock.crank(false) > 0)
+        ;
+    REQUIRE(fired.size() == order.size() - 1);
+    for (size_t i = 1; i < fired.size(); i++)
+    {
+        CHECK(fired[i - 1].first <= fired[i].first);
+        if (fired[i - 1].first == fired[i].first)
+        {
+            // ties fire in the order they were scheduled
+            CHECK(fired[i - 1].second < fired[i].second);
+        }
+    }
+    for (auto const& f : fired)
+    {
+        CHECK(f.first == VirtualClock::time_point() + delays[order[f.second]]);
+    }
+}
+
+TEST_CASE("timer schedule and cancel benchmark", "[timer][bench][hide]")
+{
+    VirtualClock clock;
+    size_t const nTimers = 10000;
+    size_t const nRounds = 100;
+
+    std::vector<std::unique_ptr<VirtualTimer>> timers;
+    for (size_t i = 0; i < nTimers; i++)
+    {
+        timers.push_back(make_unique<VirtualTimer>(clock));
+    }
+
+    // like peer idle timers: rearmed over and over, rarely firing
+    size_t fired = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < nRounds; r++)
+    {
+        for (size_t i = 0; i < nTimers; i++)
+        {
+            timers[i]->expires_from_now(std::chrono::seconds(1 + i % 30));
+            timers[i]->async_wait([&fired](asio::error_code const& ec)
+                                  {
+                                      if (!ec)
+                                      {
+                                          ++fired;
+                                      }
+                                  });
+        }
+    }
+    while (clock.crank(false) > 0)
+        ;
+    auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start);
+
+    CHECK(fired == nTimers);
+    LOG(INFO) << "Scheduled and cancelled " << nTimers * nRounds
+              << " timer events in " << elapsed.count() << "us ("
+              << (elapsed.count() * 1000.0) / (nTimers * nRounds)
+              << "ns each)";
+}
+
+TEST_CASE("crank stats charge time to the innermost origin",
+          "[timer][crankstats]")
+{
+    VirtualClock clock;
+    auto& stats = clock.getCrankStats();
+    stats.setStallThreshold(std::chrono::milliseconds(0));
+
+    auto busy = [](std::chrono::milliseconds ms)
+    {
+        auto end = std::chrono::steady_clock::now() + ms;
+        while (std::chrono::steady_clock::now() < end)
+            ;
+    };
+
+    clock.post(CrankStats::ORIGIN_OVERLAY, [&]()
+               {
+                   busy(std::chrono::milliseconds(2));
+                   CrankTag tag(stats, CrankStats::ORIGIN_LEDGER);
+                   busy(std::chrono::milliseconds(20));
+               });
+    clock.post(CrankStats::ORIGIN_DATABASE, [&]()
+               {
+                   busy(std::chrono::milliseconds(1));
+               });
+    while (clock.crank(false) > 0)
+        ;
+
+    Json::Value root;
+    stats.report(root);
+    CHECK(stats.getHandlerCount() == 2);
+    CHECK(stats.getStallCount() == 0);
+    auto const& origins = root["origins"];
+    REQUIRE(origins.isMember("overlay"));
+    REQUIRE(origins.isMember("ledger"));
+    REQUIRE(origins.isMember("database"));
+    CHECK(!origins.isMember("herder"));
+    CHECK(origins["overlay"]["count"].asUInt64() == 1);
+    CHECK(origins["ledger"]["count"].asUInt64() == 1);
+    CHECK(origins["ledger"]["total_ms"].asDouble() >= 20.0);
+    CHECK(origins["overlay"]["total_ms"].asDouble() >= 2.0);
+    CHECK(origins["overlay"]["total_ms"].asDouble() <
+          origins["ledger"]["total_ms"].asDouble());
+
+    stats.reset();
+    Json::Value empty;
+    stats.report(empty);
+    CHECK(stats.getHandlerCount() == 0);
+    CHECK(empty["origins"].size() == 0);
+}
+
+TEST_CASE("crank stats count stalls", "[timer][crankstats]")
+{
+    VirtualClock clock;
+    auto& stats = clock.getCrankStats();
+    stats.setStallThreshold(std::chrono::milliseconds(5));
+
+    clock.post(CrankStats::ORIGIN_HERDER, []()
+               {
+               });
+    clock.post(CrankStats::ORIGIN_HERDER, []()
+               {
+                   std::this_thread::sleep_for(std::chrono::milliseconds(10));
+               });
+    while (clock.crank(false) > 0)
+        ;
+    CHECK(stats.getHandlerCount() == 2);
+    CHECK(stats.getStallCount() == 1);
+
+    // timer callbacks are handlers of their own
+    VirtualTimer timer(clock);
+    timer.expires_from_now(std::chrono::seconds(1));
+    timer.async_wait([](asio::error_code const& ec)
+                     {
+                         std::this_thread::sleep_for(
+                             std::chrono::milliseconds(10));
+                     });
+    while (clock.crank(false) > 0)
+        ;
+    CHECK(stats.getStallCount() == 2);
+    Json::Value root;
+    stats.report(root);
+    CHECK(root["origins"]["timer"]["count"].asUInt64() == 1);
+}
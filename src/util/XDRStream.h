@@ -4,6 +4,7 @@
 // under the Apache License, Version 2.0. See the COPYING file at the root
 // of this distribution or at http://www.apache.org/licenses/LICENSE-2.0
 
+#include <cstring>
 #include <string>
 #include <fstream>
 #include <vector>
@@ -17,17 +18,56 @@ namespace stellar
 /**
  * Helper for loading a sequence of XDR objects from a file one at a time,
  * rather than all at once.
+ *
+ * The file is read in chunks of kBufferSize bytes and every record is
+ * decoded straight out of the chunk, so reading a record neither touches the
+ * ifstream nor copies its bytes. Decoding into the same object over and over
+ * reuses that object's storage (vectors, strings) where it can; callers that
+ * stream many records should keep one object around rather than declare one
+ * per record.
  */
 class XDRInputFileStream
 {
     std::ifstream mIn;
     std::vector<char> mBuf;
+    size_t mPos{0};
+    size_t mEnd{0};
+
+    // Makes at least `n` unread bytes available at mBuf[mPos], reading more
+    // of the file as needed; false if the file ends first.
+    bool
+    fill(size_t n)
+    {
+        if (mEnd - mPos >= n)
+        {
+            return true;
+        }
+        if (mPos != 0)
+        {
+            std::memmove(mBuf.data(), mBuf.data() + mPos, mEnd - mPos);
+            mEnd -= mPos;
+            mPos = 0;
+        }
+        if (mBuf.size() < n)
+        {
+            mBuf.resize(n);
+        }
+        while (mEnd < n && mIn)
+        {
+            mIn.read(mBuf.data() + mEnd, mBuf.size() - mEnd);
+            mEnd += static_cast<size_t>(mIn.gcount());
+        }
+        return mEnd >= n;
+    }
 
   public:
+    static const size_t kBufferSize = 256 * 1024;
+
     void
     close()
     {
         mIn.close();
+        mPos = mEnd = 0;
     }
 
     void
@@ -39,25 +79,31 @@ class XDRInputFileStream
             std::string msg("failed to open XDR file: ");
             throw std::runtime_error(msg + filename);
         }
+        mPos = mEnd = 0;
+        if (mBuf.size() < kBufferSize)
+        {
+            mBuf.resize(kBufferSize);
+        }
     }
 
     operator bool() const
     {
-        return mIn.good();
+        return mPos != mEnd || mIn.good();
     }
 
     template <typename T>
     bool
     readOne(T& out)
     {
-        char szBuf[4];
-        if (!mIn.read(szBuf, 4))
+        if (!fill(4))
         {
+            mPos = mEnd;
             return false;
         }
 
         // Read 4 bytes of size, big-endian, with XDR 'continuation' bit cleared
         // (high bit of high byte).
+        char const* szBuf = mBuf.data() + mPos;
         uint32_t sz = 0;
         sz |= static_cast<uint8_t>(szBuf[0] & '\x7f');
         sz <<= 8;
@@ -67,41 +113,91 @@ class XDRInputFileStream
         sz <<= 8;
         sz |= static_cast<uint8_t>(szBuf[3]);
 
-        if (sz > mBuf.size())
-        {
-            mBuf.resize(sz);
-        }
-        if (!mIn.read(mBuf.data(), sz))
+        if (!fill(sz + 4))
         {
+            mPos = mEnd;
             throw xdr::xdr_runtime_error("malformed XDR file");
         }
-        xdr::xdr_get g(mBuf.data(), mBuf.data() + sz);
+        char const* data = mBuf.data() + mPos + 4;
+        mPos += sz + 4;
+        xdr::xdr_get g(data, data + sz);
         xdr::xdr_argpack_archive(g, out);
         return true;
     }
 };
 
+/**
+ * Writes a sequence of XDR objects to a file, serializing them into a buffer
+ * of kBufferSize bytes that is written out when full, on flush(), on close()
+ * and on destruction. Only close() reports a failure to write out the tail of
+ * the buffer, so writers must close() a file before relying on its contents.
+ */
 class XDROutputFileStream
 {
+    std::string mFilename;
     std::ofstream mOut;
     std::vector<char> mBuf;
+    size_t mEnd{0};
 
   public:
+    static const size_t kBufferSize = 256 * 1024;
+
+    // Writes out what is buffered.
+    void
+    flush()
+    {
+        if (mEnd != 0)
+        {
+            mOut.write(mBuf.data(), mEnd);
+            mEnd = 0;
+        }
+        mOut.flush();
+    }
+
+    ~XDROutputFileStream()
+    {
+        if (mOut.is_open())
+        {
+            flush();
+        }
+    }
+
+    // Writes out what is buffered and closes the file; throws if any of the
+    // file could not be written.
     void
     close()
     {
+        if (!mOut.is_open())
+        {
+            return;
+        }
+        flush();
+        bool ok = mOut.good();
         mOut.close();
+        if (!ok || !mOut)
+        {
+            throw std::runtime_error("failed to write XDR file: " +
+                                     mFilename);
+        }
     }
 
     void
-    open(std::string const& filename)
+    open(std::string const& filename, bool append = false)
     {
-        mOut.open(filename, std::ofstream::binary | std::ofstream::trunc);
+        mFilename = filename;
+        mOut.open(filename, std::ofstream::binary |
+                                (append ? std::ofstream::app
+                                        : std::ofstream::trunc));
         if (!mOut)
         {
             std::string msg("failed to open XDR file: ");
             throw std::runtime_error(msg + filename);
         }
+        mEnd = 0;
+        if (mBuf.size() < kBufferSize)
+        {
+            mBuf.resize(kBufferSize);
+        }
     }
 
     operator bool() const
@@ -116,28 +212,34 @@ class XDROutputFileStream
         uint32_t sz = (uint32_t)xdr::xdr_size(t);
         assert(sz < 0x80000000);
 
-        if (mBuf.size() < sz + 4)
+        if (mBuf.size() - mEnd < sz + 4)
         {
-            mBuf.resize(sz + 4);
+            flush();
+            if (mBuf.size() < sz + 4)
+            {
+                mBuf.resize(sz + 4);
+            }
         }
+        char* buf = mBuf.data() + mEnd;
 
         // Write 4 bytes of size, big-endian, with XDR 'continuation' bit set on
         // high bit of high byte.
-        mBuf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
-        mBuf[1] = static_cast<char>((sz >> 16) & 0xFF);
-        mBuf[2] = static_cast<char>((sz >> 8) & 0xFF);
-        mBuf[3] = static_cast<char>(sz & 0xFF);
+        buf[0] = static_cast<char>((sz >> 24) & 0xFF) | '\x80';
+        buf[1] = static_cast<char>((sz >> 16) & 0xFF);
+        buf[2] = static_cast<char>((sz >> 8) & 0xFF);
+        buf[3] = static_cast<char>(sz & 0xFF);
 
-        xdr::xdr_put p(mBuf.data() + 4, mBuf.data() + 4 + sz);
+        xdr::xdr_put p(buf + 4, buf + 4 + sz);
         xdr_argpack_archive(p, t);
+        mEnd += sz + 4;
 
-        if (!mOut.write(mBuf.data(), sz + 4))
+        if (!mOut)
         {
             return false;
         }
         if (hasher)
         {
-            hasher->add(ByteSlice(mBuf.data(), sz + 4));
+            hasher->add(ByteSlice(buf, sz + 4));
         }
         if (bytesPut)
         {
@@ -231,4 +231,30 @@ union TransactionMeta switch (int v)
 case 0:
     OperationMeta operations<>;
 };
+
+// Entries below are written by the ledger change feed
+
+struct TransactionResultMeta
+{
+    TransactionResultPair result;
+    LedgerEntryChanges feeProcessing;
+    TransactionMeta txApplyProcessing;
+};
+
+struct LedgerCloseMetaV0
+{
+    LedgerHeaderHistoryEntry ledgerHeader;
+    // the transaction set that was agreed on, sorted by hash
+    TransactionSet txSet;
+
+    // sorted in apply order: the fees of all the transactions are
+    // processed before any of them is applied
+    TransactionResultMeta txProcessing<>;
+};
+
+union LedgerCloseMeta switch (int v)
+{
+case 0:
+    LedgerCloseMetaV0 v0;
+};
 }